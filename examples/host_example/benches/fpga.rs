@@ -0,0 +1,15 @@
+//! Runs the benchmarks through `cargo bench`.
+//!
+//! This needs an FPGA with the example bitfile. Pass `--quick` for a short run.
+
+use host_example::benchmarks::{run_all, BenchmarkConfig};
+
+fn main() {
+    let config = if std::env::args().any(|arg| arg == "--quick") {
+        BenchmarkConfig::quick()
+    } else {
+        BenchmarkConfig::default()
+    };
+    let session = host_example::connect_fpga();
+    run_all(&session, &config, &mut std::io::stdout().lock()).unwrap();
+}
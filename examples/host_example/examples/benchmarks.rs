@@ -0,0 +1,16 @@
+//! Standalone benchmarks of registers, FIFOs and IRQs to run on the target.
+//!
+//! Each result is printed as a line of JSON. Redirect the output to a file to
+//! compare between builds. Pass `--quick` for a short run.
+
+use host_example::benchmarks::{run_all, BenchmarkConfig};
+
+fn main() {
+    let config = if std::env::args().any(|arg| arg == "--quick") {
+        BenchmarkConfig::quick()
+    } else {
+        BenchmarkConfig::default()
+    };
+    let session = host_example::connect_fpga();
+    run_all(&session, &config, &mut std::io::stdout().lock()).unwrap();
+}
@@ -0,0 +1,42 @@
+//! This example demonstrates the background streaming interface to the DMAs.
+//!
+//! A dedicated thread drains the FIFO into a ring buffer so the
+//! application thread can read without calling the driver.
+
+use ni_fpga_interface::streaming::{FifoStream, StreamConfig};
+use std::sync::Arc;
+use std::time::Duration;
+
+mod fpga_defs {
+    include!(concat!(env!("OUT_DIR"), "/NiFpga_Main.rs"));
+}
+
+fn main() {
+    let session = Arc::new(host_example::connect_fpga());
+
+    // The FPGA bit file should take a stream of u32s and return the lower half of each.
+    let inputs = [0x12345678, 0x9ABCDEF0, 0x13579BDF, 0x2468ACE0];
+    let expected_outputs = [0x5678, 0xDEF0, 0x9BDF, 0xACE0];
+
+    let mut to_fpga_fifo = fpga_defs::fifos::NumbersToFPGA;
+    let from_fpga_fifo = fpga_defs::fifos::NumbersFromFPGA;
+
+    let config = StreamConfig {
+        block_size: 4,
+        ..Default::default()
+    };
+    let mut stream = FifoStream::start(session.clone(), from_fpga_fifo, config);
+
+    println!("Writing to FIFO");
+    to_fpga_fifo.write(session.as_ref(), None, &inputs).unwrap();
+
+    std::thread::sleep(Duration::from_millis(100));
+
+    let mut outputs = [0u16; 4];
+    let read = stream.read(&mut outputs);
+    assert_eq!(read, 4);
+    assert_eq!(outputs, expected_outputs);
+
+    println!("Stream statistics: {:?}", stream.statistics());
+    stream.stop().unwrap();
+}
@@ -1,15 +1,13 @@
 //! This is designed to be a reference example for how multithreading should work
 //! in the host API.
 //!
-//! In this case we simply wrap the session in an Arc and pass it to the threads.
+//! In this case we wrap the session in a [`SharedSession`] and pass a clone to each thread.
 //!
-//! We cannot clone the session as it will attempt to drop and close the session for each clone.
-//!
-//! Review: Should we just build this into the session?
+//! We cannot clone the session itself as it will attempt to drop and close the session for each clone.
 
 use ni_fpga_interface::{
     irq::{IrqWaitResult, IRQ0},
-    session::Session,
+    session::SharedSession,
 };
 use std::{
     sync::{
@@ -25,17 +23,12 @@ mod fpga_defs {
 }
 
 /// This thread will use the IRQs and a single register.
-fn irq_thread(session: Arc<Session>, stop: Arc<AtomicBool>) {
+fn irq_thread(session: SharedSession, stop: Arc<AtomicBool>) {
     println!("IRQ thread started");
 
     let mut irq_context = session.create_irq_context().unwrap();
     let irq_count_reg = fpga_defs::registers::IRQs;
 
-    // Here I will grab the session as a reference for use below
-    // to save repeating as ref as the register interface can't
-    // automatically dereference the arc.
-    let session = session.as_ref();
-
     let mut count = 0;
 
     while !stop.load(Ordering::Relaxed) {
@@ -47,7 +40,7 @@ fn irq_thread(session: Arc<Session>, stop: Arc<AtomicBool>) {
             IrqWaitResult::IrqsAsserted(_irqs) => {
                 session.acknowledge_irqs(IRQ0).unwrap();
                 count += 1;
-                let value = irq_count_reg.read(session).unwrap();
+                let value = irq_count_reg.read(&session).unwrap();
                 assert_eq!(value, count);
             }
         }
@@ -58,20 +51,21 @@ fn irq_thread(session: Arc<Session>, stop: Arc<AtomicBool>) {
 }
 
 /// This thread will exercise the registers API.
-fn regs_thread(session: Arc<Session>, stop: Arc<AtomicBool>) {
+fn regs_thread(session: SharedSession, stop: Arc<AtomicBool>) {
     println!("Regs thread started");
 
     let output_reg = fpga_defs::registers::U8Control;
     let input_1_reg = fpga_defs::registers::U8Result;
 
-    let session = session.as_ref();
+    // Pinning avoids touching the shared reference count on each access.
+    let session = session.pin();
 
     let mut count = 0;
 
     while !stop.load(Ordering::Relaxed) {
         count += 1;
-        output_reg.write(session, count).unwrap();
-        let value = input_1_reg.read(session).unwrap();
+        output_reg.write(&session, count).unwrap();
+        let value = input_1_reg.read(&session).unwrap();
         assert!(value == count);
         sleep(Duration::from_millis(100));
     }
@@ -80,7 +74,7 @@ fn regs_thread(session: Arc<Session>, stop: Arc<AtomicBool>) {
 
 fn main() {
     let session = host_example::connect_fpga();
-    let session_shared = Arc::new(session);
+    let session_shared = SharedSession::new(session);
 
     let stop = Arc::new(AtomicBool::new(false));
 
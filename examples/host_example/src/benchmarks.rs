@@ -0,0 +1,502 @@
+//! Benchmarks of the interface against the example `FPGA Main.vi` bitfile.
+//!
+//! These are shared by the `cargo bench` target and the `benchmarks`
+//! example, which is the one to copy to the cRIO.
+//!
+//! Each result is written as a single line of JSON so the output can be
+//! compared between builds to catch regressions in the wrapper.
+
+use crate::fpga_defs;
+use ni_fpga_interface::fifos::Fifo;
+use ni_fpga_interface::fxp::{Fxp, FxpWord};
+use ni_fpga_interface::irq::{IrqWaitResult, IRQ0};
+use ni_fpga_interface::registers::{ArrayRegister, Register};
+use ni_fpga_interface::session::{RegisterInterface, Session};
+use std::fmt::{Display, Write as _};
+use std::io::Write;
+use std::time::{Duration, Instant};
+
+/// Controls how long the benchmarks run for.
+#[derive(Debug, Clone)]
+pub struct BenchmarkConfig {
+    /// The number of timed accesses for each register benchmark (default: 10000).
+    pub register_iterations: usize,
+    /// The block sizes to measure FIFO throughput at (default: 16 to 16384).
+    pub fifo_block_sizes: Vec<usize>,
+    /// The number of blocks transferred at each block size (default: 100).
+    pub fifo_repeats: usize,
+    /// The number of IRQs to measure the wake latency of (default: 1000).
+    pub irq_iterations: usize,
+}
+
+impl Default for BenchmarkConfig {
+    fn default() -> Self {
+        Self {
+            register_iterations: 10_000,
+            fifo_block_sizes: vec![16, 256, 4096, 16_384],
+            fifo_repeats: 100,
+            irq_iterations: 1000,
+        }
+    }
+}
+
+impl BenchmarkConfig {
+    /// A short run for checking the benchmarks work.
+    pub fn quick() -> Self {
+        Self {
+            register_iterations: 100,
+            fifo_block_sizes: vec![16, 1024],
+            fifo_repeats: 10,
+            irq_iterations: 10,
+        }
+    }
+}
+
+/// A single line of JSON output.
+struct Record {
+    json: String,
+}
+
+impl Record {
+    fn new(benchmark: &str) -> Self {
+        Self {
+            json: format!("{{\"benchmark\":\"{benchmark}\""),
+        }
+    }
+
+    fn text(mut self, key: &str, value: &str) -> Self {
+        let _ = write!(self.json, ",\"{key}\":\"{value}\"");
+        self
+    }
+
+    fn number(mut self, key: &str, value: impl Display) -> Self {
+        let _ = write!(self.json, ",\"{key}\":{value}");
+        self
+    }
+
+    /// Adds the summary statistics for a set of latency samples in nanoseconds.
+    fn latency(mut self, samples: &mut [u64]) -> Self {
+        if samples.is_empty() {
+            return self.number("iterations", 0);
+        }
+        samples.sort_unstable();
+        let percentile = |p: usize| samples[(samples.len() - 1) * p / 100];
+        let mean = samples.iter().sum::<u64>() / samples.len() as u64;
+        self = self
+            .number("iterations", samples.len())
+            .number("min_ns", samples[0])
+            .number("mean_ns", mean)
+            .number("p50_ns", percentile(50))
+            .number("p99_ns", percentile(99))
+            .number("max_ns", samples[samples.len() - 1]);
+        self
+    }
+
+    /// Adds a histogram of the samples in power of two nanosecond buckets.
+    ///
+    /// Each entry is `[lower bound, count]`.
+    fn histogram(mut self, samples: &[u64]) -> Self {
+        let mut buckets = [0usize; 64];
+        for sample in samples {
+            buckets[63 - sample.max(&1).leading_zeros() as usize] += 1;
+        }
+        let entries: Vec<String> = buckets
+            .iter()
+            .enumerate()
+            .filter(|(_, count)| **count > 0)
+            .map(|(bucket, count)| format!("[{},{count}]", 1u64 << bucket))
+            .collect();
+        let _ = write!(self.json, ",\"histogram_ns\":[{}]", entries.join(","));
+        self
+    }
+
+    fn emit(mut self, output: &mut impl Write) -> std::io::Result<()> {
+        self.json.push('}');
+        writeln!(output, "{}", self.json)
+    }
+}
+
+fn elapsed_ns(start: Instant) -> u64 {
+    start.elapsed().as_nanos() as u64
+}
+
+/// Runs every benchmark, writing a line of JSON per result.
+pub fn run_all(
+    session: &Session,
+    config: &BenchmarkConfig,
+    output: &mut impl Write,
+) -> std::io::Result<()> {
+    registers(session, config, output)?;
+    fifos(session, config, output)?;
+    irqs(session, config, output)?;
+    fxp_conversion(config, output)?;
+    Ok(())
+}
+
+fn register_read<T>(
+    session: &Session,
+    type_name: &str,
+    register: &Register<T>,
+    iterations: usize,
+    output: &mut impl Write,
+) -> std::io::Result<()>
+where
+    T: Default + Copy,
+    Session: RegisterInterface<T>,
+{
+    let mut samples = Vec::with_capacity(iterations);
+    for _ in 0..iterations {
+        let start = Instant::now();
+        std::hint::black_box(register.read(session).unwrap());
+        samples.push(elapsed_ns(start));
+    }
+    Record::new("register_read")
+        .text("type", type_name)
+        .latency(&mut samples)
+        .emit(output)
+}
+
+fn register_write<T>(
+    session: &Session,
+    type_name: &str,
+    register: &Register<T>,
+    iterations: usize,
+    output: &mut impl Write,
+) -> std::io::Result<()>
+where
+    T: Default + Copy,
+    Session: RegisterInterface<T>,
+{
+    let mut samples = Vec::with_capacity(iterations);
+    for _ in 0..iterations {
+        let start = Instant::now();
+        register.write(session, T::default()).unwrap();
+        samples.push(elapsed_ns(start));
+    }
+    Record::new("register_write")
+        .text("type", type_name)
+        .latency(&mut samples)
+        .emit(output)
+}
+
+fn array_read<T, const N: usize>(
+    session: &Session,
+    type_name: &str,
+    register: &ArrayRegister<T, N>,
+    iterations: usize,
+    output: &mut impl Write,
+) -> std::io::Result<()>
+where
+    T: Default + Copy,
+    Session: RegisterInterface<T>,
+{
+    let mut values = [T::default(); N];
+    let mut samples = Vec::with_capacity(iterations);
+    for _ in 0..iterations {
+        let start = Instant::now();
+        register.read_into(session, &mut values).unwrap();
+        samples.push(elapsed_ns(start));
+    }
+    Record::new("array_read")
+        .text("type", type_name)
+        .number("length", N)
+        .latency(&mut samples)
+        .emit(output)
+}
+
+fn array_write<T, const N: usize>(
+    session: &Session,
+    type_name: &str,
+    register: &ArrayRegister<T, N>,
+    iterations: usize,
+    output: &mut impl Write,
+) -> std::io::Result<()>
+where
+    T: Default + Copy,
+    Session: RegisterInterface<T>,
+{
+    let values = [T::default(); N];
+    let mut samples = Vec::with_capacity(iterations);
+    for _ in 0..iterations {
+        let start = Instant::now();
+        register.write(session, &values).unwrap();
+        samples.push(elapsed_ns(start));
+    }
+    Record::new("array_write")
+        .text("type", type_name)
+        .number("length", N)
+        .latency(&mut samples)
+        .emit(output)
+}
+
+/// Latency of single register accesses for each type in the bitfile.
+fn registers(
+    session: &Session,
+    config: &BenchmarkConfig,
+    output: &mut impl Write,
+) -> std::io::Result<()> {
+    use fpga_defs::registers::*;
+    let iterations = config.register_iterations;
+
+    register_read(session, "u8", &U8Result, iterations, output)?;
+    register_write(session, "u8", &U8Control, iterations, output)?;
+    register_read(session, "u32", &IRQs, iterations, output)?;
+    register_read(session, "f32", &SglResult, iterations, output)?;
+    register_write(session, "f32", &SglControl, iterations, output)?;
+    array_read(session, "u8", &U8ResultArray, iterations, output)?;
+    array_write(session, "u8", &U8ControlArray, iterations, output)?;
+    array_read(session, "f32", &SglResultArray, iterations, output)?;
+    array_write(session, "f32", &SglControlArray, iterations, output)?;
+    Ok(())
+}
+
+/// Emits the throughput of a FIFO benchmark.
+fn throughput(
+    benchmark: &str,
+    block_size: usize,
+    samples: &mut [u64],
+    output: &mut impl Write,
+) -> std::io::Result<()> {
+    let total_ns: u64 = samples.iter().sum();
+    let elements = (block_size * samples.len()) as f64;
+    let elements_per_second = elements / (total_ns.max(1) as f64 / 1e9);
+    Record::new(benchmark)
+        .number("block_size", block_size)
+        .number("elements_per_second", elements_per_second.round())
+        .latency(samples)
+        .emit(output)
+}
+
+/// Throughput through the loopback FIFOs for the copy and zero copy interfaces.
+///
+/// The FPGA returns the lower half of each element written to `NumbersToFPGA`
+/// on `NumbersFromFPGA` so read times include the FPGA processing the block.
+fn fifos(
+    session: &Session,
+    config: &BenchmarkConfig,
+    output: &mut impl Write,
+) -> std::io::Result<()> {
+    let mut to_fpga = fpga_defs::fifos::NumbersToFPGA;
+    let mut from_fpga = fpga_defs::fifos::NumbersFromFPGA;
+    let timeout = Some(Duration::from_secs(5));
+
+    let largest_block = config.fifo_block_sizes.iter().copied().max().unwrap_or(0);
+    // Keep the host buffers large enough that a whole block always fits.
+    to_fpga.configure(session, largest_block * 4).unwrap();
+    from_fpga.configure(session, largest_block * 4).unwrap();
+    to_fpga.start(session).unwrap();
+    from_fpga.start(session).unwrap();
+
+    for &block_size in &config.fifo_block_sizes {
+        let inputs: Vec<u32> = (0..block_size as u32).collect();
+        let mut outputs = vec![0u16; block_size];
+        let repeats = config.fifo_repeats;
+
+        let mut write_samples = Vec::with_capacity(repeats);
+        let mut read_samples = Vec::with_capacity(repeats);
+        for _ in 0..repeats {
+            let start = Instant::now();
+            to_fpga.write(session, timeout, &inputs).unwrap();
+            write_samples.push(elapsed_ns(start));
+
+            let start = Instant::now();
+            from_fpga.read(session, timeout, &mut outputs).unwrap();
+            read_samples.push(elapsed_ns(start));
+        }
+        throughput("fifo_write", block_size, &mut write_samples, output)?;
+        throughput("fifo_read", block_size, &mut read_samples, output)?;
+
+        let mut write_samples = Vec::with_capacity(repeats);
+        let mut region_samples = Vec::with_capacity(repeats);
+        let mut copy_samples = Vec::with_capacity(repeats);
+        for _ in 0..repeats {
+            let start = Instant::now();
+            let (region, _) = to_fpga
+                .get_write_region(session, block_size, timeout)
+                .unwrap();
+            region.elements.copy_from_slice(&inputs);
+            drop(region);
+            write_samples.push(elapsed_ns(start));
+
+            // Time the region with and without copying the data out to see
+            // the cost of the copy against the driver calls.
+            let start = Instant::now();
+            let (region, _) = from_fpga
+                .get_read_region(session, block_size / 2, timeout)
+                .unwrap();
+            std::hint::black_box(region.elements);
+            drop(region);
+            region_samples.push(elapsed_ns(start));
+
+            let start = Instant::now();
+            let (region, _) = from_fpga
+                .get_read_region(session, block_size - block_size / 2, timeout)
+                .unwrap();
+            outputs[..region.elements.len()].copy_from_slice(region.elements);
+            drop(region);
+            copy_samples.push(elapsed_ns(start));
+        }
+        throughput("fifo_write_region", block_size, &mut write_samples, output)?;
+        throughput(
+            "fifo_read_region",
+            block_size / 2,
+            &mut region_samples,
+            output,
+        )?;
+        throughput(
+            "fifo_read_region_copy",
+            block_size - block_size / 2,
+            &mut copy_samples,
+            output,
+        )?;
+    }
+
+    to_fpga.stop(session).unwrap();
+    from_fpga.stop(session).unwrap();
+    Ok(())
+}
+
+/// Time from acknowledging the IRQ to the wait returning on the next one.
+///
+/// The FPGA asserts IRQ0 again as soon as it sees the acknowledgement so this
+/// is dominated by the driver waking the waiting thread.
+fn irqs(
+    session: &Session,
+    config: &BenchmarkConfig,
+    output: &mut impl Write,
+) -> std::io::Result<()> {
+    let mut irq_context = session.create_irq_context().unwrap();
+    let timeout = Duration::from_secs(1);
+
+    // Get in step with the FPGA before timing.
+    if let IrqWaitResult::IrqsAsserted(_) = irq_context.wait_on_irq(IRQ0, timeout).unwrap() {
+        session.acknowledge_irqs(IRQ0).unwrap();
+    }
+
+    let mut samples = Vec::with_capacity(config.irq_iterations);
+    let mut timeouts = 0;
+    for _ in 0..config.irq_iterations {
+        let start = Instant::now();
+        match irq_context.wait_on_irq(IRQ0, timeout).unwrap() {
+            IrqWaitResult::IrqsAsserted(_) => {
+                samples.push(elapsed_ns(start));
+                session.acknowledge_irqs(IRQ0).unwrap();
+            }
+            IrqWaitResult::TimedOut => timeouts += 1,
+        }
+    }
+
+    Record::new("irq_wake")
+        .number("timeouts", timeouts)
+        .histogram(&samples)
+        .latency(&mut samples)
+        .emit(output)
+}
+
+/// The per element conversion as the C API does it, for comparison with the slice conversions.
+fn naive_to_f64(raw: u64, signed: bool, word_length: u32, integer_word_length: i32) -> f64 {
+    let unused_bits = 64 - word_length;
+    let value = if signed {
+        ((raw << unused_bits) as i64 >> unused_bits) as f64
+    } else {
+        raw as f64
+    };
+    value * 2f64.powi(integer_word_length - word_length as i32)
+}
+
+fn naive_from_f64(value: f64, signed: bool, word_length: u32, integer_word_length: i32) -> u64 {
+    let scaled = value / 2f64.powi(integer_word_length - word_length as i32);
+    let mask = u64::MAX >> (64 - word_length);
+    if signed {
+        let limit = 2f64.powi(word_length as i32 - 1);
+        (scaled.clamp(-limit, limit - 1.0) as i64 as u64) & mask
+    } else {
+        scaled.clamp(0.0, mask as f64) as u64
+    }
+}
+
+/// Converts blocks of raw words to doubles and back, with the slice conversions
+/// used by the generated `fxp` module and with a per element loop like the C API.
+///
+/// This doesn't use the FPGA, so it shows the cost of the conversion on its own.
+fn fxp_format<W: FxpWord, const SIGNED: bool, const WL: u8, const IWL: i16>(
+    config: &BenchmarkConfig,
+    output: &mut impl Write,
+) -> std::io::Result<()> {
+    let format = format!("{}{WL}.{IWL}", if SIGNED { "s" } else { "u" });
+    for &block_size in &config.fifo_block_sizes {
+        let raw: Vec<W> = (0..block_size as u64)
+            .map(|i| W::from_word(i.wrapping_mul(0x9E37_79B9_7F4A_7C15)))
+            .collect();
+        let mut values = vec![0f64; block_size];
+        let mut words = vec![W::default(); block_size];
+        let (wl, iwl) = (WL as u32, IWL as i32);
+
+        let mut samples = vec![0u64; config.fifo_repeats];
+        for sample in samples.iter_mut() {
+            let start = Instant::now();
+            for (value, &word) in values.iter_mut().zip(&raw) {
+                *value = naive_to_f64(word.into(), SIGNED, wl, iwl);
+            }
+            *sample = elapsed_ns(start);
+            std::hint::black_box(&mut values);
+        }
+        throughput(
+            &format!("fxp_to_f64_naive_{format}"),
+            block_size,
+            &mut samples,
+            output,
+        )?;
+
+        for sample in samples.iter_mut() {
+            let start = Instant::now();
+            Fxp::<SIGNED, WL, IWL>::to_f64_slice(&raw, &mut values);
+            *sample = elapsed_ns(start);
+            std::hint::black_box(&mut values);
+        }
+        throughput(
+            &format!("fxp_to_f64_slice_{format}"),
+            block_size,
+            &mut samples,
+            output,
+        )?;
+
+        for sample in samples.iter_mut() {
+            let start = Instant::now();
+            for (word, &value) in words.iter_mut().zip(&values) {
+                *word = W::from_word(naive_from_f64(value, SIGNED, wl, iwl));
+            }
+            *sample = elapsed_ns(start);
+            std::hint::black_box(&mut words);
+        }
+        throughput(
+            &format!("fxp_from_f64_naive_{format}"),
+            block_size,
+            &mut samples,
+            output,
+        )?;
+
+        for sample in samples.iter_mut() {
+            let start = Instant::now();
+            Fxp::<SIGNED, WL, IWL>::from_f64_slice(&values, &mut words);
+            *sample = elapsed_ns(start);
+            std::hint::black_box(&mut words);
+        }
+        throughput(
+            &format!("fxp_from_f64_slice_{format}"),
+            block_size,
+            &mut samples,
+            output,
+        )?;
+    }
+    Ok(())
+}
+
+/// FXP conversion throughput for a format on each of the conversion paths.
+fn fxp_conversion(config: &BenchmarkConfig, output: &mut impl Write) -> std::io::Result<()> {
+    fxp_format::<u32, true, 16, 8>(config, output)?;
+    fxp_format::<u32, true, 32, 16>(config, output)?;
+    fxp_format::<u64, true, 33, 17>(config, output)?;
+    fxp_format::<u64, true, 64, 32>(config, output)?;
+    Ok(())
+}
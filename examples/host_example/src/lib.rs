@@ -4,6 +4,8 @@
 use ni_fpga_interface::session::{NiFpgaContext, Session};
 use std::path::Path;
 
+pub mod benchmarks;
+
 mod fpga_defs {
     include!(concat!(env!("OUT_DIR"), "/NiFpga_Main.rs"));
 }
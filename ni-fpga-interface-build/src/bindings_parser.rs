@@ -3,7 +3,11 @@
 //! This is still in rough shape but seems to prove the basic concept.
 
 use super::address_definitions_visitor::AddressDefinitionsVisitor;
-use super::registers_generator::{generate_fifo_module, generate_register_module};
+use super::custom_type_register_visitor::{CustomTypeVisitor, FxpRegister};
+use super::registers_generator::{
+    generate_accessors_module, generate_fifo_module, generate_fxp_module, generate_register_module,
+    generate_snapshot_module,
+};
 use super::{
     address_definitions_visitor::AddressSet, string_constant_visitor::StringConstantVisitor,
 };
@@ -16,6 +20,8 @@ use std::path::{Path, PathBuf};
 pub struct InterfaceDescription {
     pub signature: String,
     pub registers: AddressSet,
+    /// The FXP controls, indicators and FIFOs, which are declared as constants.
+    pub fxp: Vec<FxpRegister>,
 }
 
 impl InterfaceDescription {
@@ -44,14 +50,23 @@ impl InterfaceDescription {
     }
 
     /// Generates a new rust module which contains the interface to the FPGA.
-    pub fn generate_rust_output(&self) -> String {
+    ///
+    /// `typed_accessors` adds the `accessors` module with a method per register.
+    pub fn generate_rust_output(&self, typed_accessors: bool) -> String {
         let metadata = self.generate_metadata_output();
         let registers = generate_register_module(&self.registers);
         let fifos = generate_fifo_module(&self.registers);
+        let snapshot = generate_snapshot_module(&self.registers);
+        let fxp = generate_fxp_module(&self.fxp);
+        let accessors =
+            typed_accessors.then(|| generate_accessors_module(&self.registers, &self.fxp));
         let tokens = quote! {
             #metadata
             #registers
             #fifos
+            #snapshot
+            #fxp
+            #accessors
         };
         println!("{}", tokens);
         let file = syn::parse2(tokens).unwrap();
@@ -71,11 +86,17 @@ impl InterfaceDescription {
 fn read_ast(prefix: &str, file: lang_c::ast::TranslationUnit) -> InterfaceDescription {
     let mut sig_visitor = StringConstantVisitor::new(prefix, "Signature");
     let mut register_visitor = AddressDefinitionsVisitor::new(prefix);
+    let mut custom_type_visitor = CustomTypeVisitor::new(prefix);
     sig_visitor.visit_translation_unit(&file);
     register_visitor.visit_translation_unit(&file);
+    custom_type_visitor.visit_translation_unit(&file);
+    let (fxp, _clusters) = custom_type_visitor
+        .get_registers()
+        .expect("Invalid FXP definitions");
     InterfaceDescription {
         signature: sig_visitor.value.expect("No signature"),
         registers: register_visitor.registers,
+        fxp,
     }
 }
 
@@ -145,4 +166,33 @@ mod tests {
 
         assert_eq!(description.signature, "E3E0C23C5F01C0DBA61D947AB8A8F489");
     }
+
+    #[test]
+    fn test_fxp_generated_from_bindings() {
+        let content = r#"
+        typedef unsigned char uint8_t;
+        typedef short int16_t;
+        typedef unsigned int uint32_t;
+        typedef uint8_t NiFpga_Bool;
+        typedef struct NiFpga_FxpTypeInfo
+        {
+            NiFpga_Bool isSigned;
+            uint8_t wordLength;
+            int16_t integerWordLength;
+        } NiFpga_FxpTypeInfo;
+        const char* NiFpga_Main_Signature = "E3E0C23C5F01C0DBA61D947AB8A8F489";
+        const NiFpga_FxpTypeInfo NiFpga_Main_ControlFxp_Gain_TypeInfo = { 1, 32, 16 };
+        const uint32_t NiFpga_Main_ControlFxp_Gain_Resource = 0x18044;
+        "#;
+
+        let description =
+            InterfaceDescription::parse_preprocessed_bindings("Main", content.to_owned());
+        let output = description.generate_rust_output(true);
+
+        assert_eq!(description.fxp.len(), 1);
+        assert!(output.contains(
+            "pub const Gain: FxpRegister<u32, Fxp<true, 32, 16>> = FxpRegister::new(0x18044);"
+        ));
+        assert!(output.contains("pub fn set_gain(&self, value: f64) -> Result<()>"));
+    }
 }
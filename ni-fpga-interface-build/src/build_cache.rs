@@ -0,0 +1,247 @@
+//! Skips regenerating the interface when none of its inputs have changed.
+//!
+//! Parsing the headers and compiling NiFpga.c is the slow part of the build
+//! script, particularly when cross compiling against a sysroot. The outputs
+//! are keyed on a fingerprint of everything that affects them: the contents
+//! of the C interface files, the sysroot, the compiler settings from the
+//! environment and the version and source of this crate.
+//!
+//! The fingerprint is stored next to the outputs in `OUT_DIR` so a rerun of
+//! the build script with the same inputs reuses them. A shared cache folder
+//! can also be set so clean builds and other workspaces reuse them too.
+
+use std::fs;
+use std::io;
+use std::path::{Path, PathBuf};
+
+/// The file in `OUT_DIR` holding the fingerprint of the outputs beside it.
+const FINGERPRINT_FILE: &str = "ni_fpga_interface.fingerprint";
+
+/// A stable 64 bit FNV-1a hash of the build inputs.
+///
+/// This is used rather than the std hasher since its output may change between
+/// compiler versions and the fingerprint is stored on disk.
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub(crate) struct Fingerprint(u64);
+
+impl Fingerprint {
+    const OFFSET_BASIS: u64 = 0xcbf2_9ce4_8422_2325;
+    const PRIME: u64 = 0x0100_0000_01b3;
+
+    pub fn new() -> Self {
+        Fingerprint(Self::OFFSET_BASIS)
+    }
+
+    pub fn add_bytes(&mut self, bytes: &[u8]) -> &mut Self {
+        // Include the length so adjacent inputs can't run together.
+        for byte in (bytes.len() as u64).to_le_bytes().iter().chain(bytes) {
+            self.0 ^= *byte as u64;
+            self.0 = self.0.wrapping_mul(Self::PRIME);
+        }
+        self
+    }
+
+    pub fn add_str(&mut self, text: &str) -> &mut Self {
+        self.add_bytes(text.as_bytes())
+    }
+
+    pub fn add_option(&mut self, text: Option<&str>) -> &mut Self {
+        match text {
+            Some(text) => self.add_str("some").add_str(text),
+            None => self.add_str("none"),
+        }
+    }
+
+    /// Adds the contents of the file, or a marker if it can't be read so the build reports the error.
+    pub fn add_file(&mut self, path: &Path) -> &mut Self {
+        match fs::read(path) {
+            Ok(contents) => self.add_str("file").add_bytes(&contents),
+            Err(_) => self.add_str("missing"),
+        }
+    }
+
+    pub fn to_hex(self) -> String {
+        format!("{:016x}", self.0)
+    }
+}
+
+/// The outputs of the build in `OUT_DIR` and optionally a shared cache folder.
+pub(crate) struct BuildCache {
+    out_dir: PathBuf,
+    shared_dir: Option<PathBuf>,
+    outputs: Vec<String>,
+    fingerprint: Fingerprint,
+}
+
+impl BuildCache {
+    /// `outputs` are the names of the files the build writes to `out_dir`.
+    pub fn new(
+        out_dir: PathBuf,
+        shared_dir: Option<PathBuf>,
+        outputs: Vec<String>,
+        fingerprint: Fingerprint,
+    ) -> Self {
+        Self {
+            out_dir,
+            shared_dir,
+            outputs,
+            fingerprint,
+        }
+    }
+
+    /// Returns true if the outputs in `OUT_DIR` match the fingerprint,
+    /// copying them from the shared cache first if they are there.
+    pub fn restore(&self) -> bool {
+        if self.out_dir_is_current() {
+            return true;
+        }
+        let Some(entry) = self.shared_entry() else {
+            return false;
+        };
+        if !self
+            .outputs
+            .iter()
+            .all(|output| entry.join(output).is_file())
+        {
+            return false;
+        }
+        let restored = self
+            .outputs
+            .iter()
+            .try_for_each(|output| {
+                fs::copy(entry.join(output), self.out_dir.join(output)).map(|_| ())
+            })
+            .and_then(|_| self.write_fingerprint());
+        restored.is_ok()
+    }
+
+    /// Records the fingerprint of freshly built outputs and copies them to the shared cache.
+    ///
+    /// A failure here only costs a rebuild next time so it is reported as a warning.
+    pub fn store(&self) {
+        if let Err(error) = self.write_fingerprint().and_then(|_| self.store_shared()) {
+            println!("cargo:warning=Failed to cache the FPGA interface: {error}");
+        }
+    }
+
+    fn out_dir_is_current(&self) -> bool {
+        let stored = fs::read_to_string(self.out_dir.join(FINGERPRINT_FILE));
+        matches!(stored, Ok(stored) if stored.trim() == self.fingerprint.to_hex())
+            && self
+                .outputs
+                .iter()
+                .all(|output| self.out_dir.join(output).is_file())
+    }
+
+    fn write_fingerprint(&self) -> io::Result<()> {
+        fs::write(
+            self.out_dir.join(FINGERPRINT_FILE),
+            self.fingerprint.to_hex(),
+        )
+    }
+
+    fn shared_entry(&self) -> Option<PathBuf> {
+        self.shared_dir
+            .as_ref()
+            .map(|dir| dir.join(self.fingerprint.to_hex()))
+    }
+
+    fn store_shared(&self) -> io::Result<()> {
+        let Some(entry) = self.shared_entry() else {
+            return Ok(());
+        };
+        fs::create_dir_all(&entry)?;
+        for output in &self.outputs {
+            // Copy then rename so a concurrent build never restores a partial file.
+            let partial = entry.join(format!("{output}.{}.partial", std::process::id()));
+            fs::copy(self.out_dir.join(output), &partial)?;
+            fs::rename(&partial, entry.join(output))?;
+        }
+        Ok(())
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    fn temp_dir(name: &str) -> PathBuf {
+        let dir =
+            std::env::temp_dir().join(format!("ni-fpga-build-cache-{name}-{}", std::process::id()));
+        let _ = fs::remove_dir_all(&dir);
+        fs::create_dir_all(&dir).unwrap();
+        dir
+    }
+
+    fn fingerprint(text: &str) -> Fingerprint {
+        *Fingerprint::new().add_str(text)
+    }
+
+    #[test]
+    fn test_fingerprint_is_stable() {
+        // Stored on disk so it must not change between builds of this crate.
+        assert_eq!(Fingerprint::new().to_hex(), "cbf29ce484222325");
+        assert_eq!(fingerprint("a"), fingerprint("a"));
+        assert_ne!(fingerprint("a"), fingerprint("b"));
+    }
+
+    #[test]
+    fn test_fingerprint_separates_inputs() {
+        let joined = *Fingerprint::new().add_str("ab").add_str("c");
+        let split = *Fingerprint::new().add_str("a").add_str("bc");
+        assert_ne!(joined, split);
+        let none = *Fingerprint::new().add_option(None);
+        let empty = *Fingerprint::new().add_option(Some(""));
+        assert_ne!(none, empty);
+    }
+
+    #[test]
+    fn test_restores_from_out_dir() {
+        let out_dir = temp_dir("out");
+        let outputs = vec!["module.rs".to_string()];
+        let cache = BuildCache::new(out_dir.clone(), None, outputs.clone(), fingerprint("1"));
+        assert!(!cache.restore());
+
+        fs::write(out_dir.join("module.rs"), "generated").unwrap();
+        cache.store();
+        assert!(cache.restore());
+
+        let changed = BuildCache::new(out_dir.clone(), None, outputs, fingerprint("2"));
+        assert!(!changed.restore());
+        fs::remove_dir_all(out_dir).unwrap();
+    }
+
+    #[test]
+    fn test_restores_from_shared_dir() {
+        let first_out = temp_dir("first");
+        let second_out = temp_dir("second");
+        let shared = temp_dir("shared");
+        let outputs = vec!["module.rs".to_string(), "libni_fpga.a".to_string()];
+
+        for output in &outputs {
+            fs::write(first_out.join(output), output).unwrap();
+        }
+        BuildCache::new(
+            first_out.clone(),
+            Some(shared.clone()),
+            outputs.clone(),
+            fingerprint("1"),
+        )
+        .store();
+
+        let cache = BuildCache::new(
+            second_out.clone(),
+            Some(shared.clone()),
+            outputs,
+            fingerprint("1"),
+        );
+        assert!(cache.restore());
+        assert_eq!(
+            fs::read_to_string(second_out.join("libni_fpga.a")).unwrap(),
+            "libni_fpga.a"
+        );
+        for dir in [first_out, second_out, shared] {
+            fs::remove_dir_all(dir).unwrap();
+        }
+    }
+}
@@ -17,19 +17,21 @@
 //!
 //! Similar clusters will have their own types.
 //!
-//!
+//! Only the FXP controls, indicators and FIFOs are returned so far.
+//! FXP arrays are bit packed so need an unpacking step which isn't supported yet.
 
-use std::{collections::HashMap, hash::Hash};
+use std::{collections::BTreeMap, hash::Hash};
 use thiserror::Error;
 
 use lang_c::{
     ast::{
         Declaration, DeclarationSpecifier, DeclaratorKind, Expression, Initializer, TypeQualifier,
+        UnaryOperator,
     },
     visit::Visit,
 };
 
-use crate::address_definitions::value_from_discriminant;
+use crate::address_definitions::{value_from_discriminant, AddressKind};
 
 #[derive(Debug, Error)]
 pub enum CustomTypeVisitorError {
@@ -49,18 +51,21 @@ pub enum CustomTypeVisitorError {
     UnknownTypeField(String),
 }
 
+/// The format from a `NiFpga_FxpTypeInfo` constant.
 #[derive(Debug, PartialEq, Eq, Hash, Clone)]
-struct FxpTypeInfo {
-    signed: bool,
-    word_length: u32,
-    integer_word_length: u32,
+pub struct FxpTypeInfo {
+    pub signed: bool,
+    pub word_length: u32,
+    pub integer_word_length: i32,
 }
 
+/// An FXP control, indicator or FIFO.
 #[derive(Debug, PartialEq, Eq, Hash, Clone)]
 pub struct FxpRegister {
-    name: String,
-    fxp_type_info: FxpTypeInfo,
-    address: u32,
+    pub name: String,
+    pub kind: AddressKind,
+    pub fxp_type_info: FxpTypeInfo,
+    pub address: u32,
 }
 
 #[derive(Debug, PartialEq, Eq, Hash, Clone)]
@@ -72,6 +77,7 @@ pub struct ClusterRegister {
 
 #[derive(Debug, PartialEq, Eq, Hash, Clone, Default)]
 struct CustomTypeData {
+    control_type: String,
     address: Option<u32>,
     fxp_type_info: Option<FxpTypeInfo>,
     cluster_type: Option<String>,
@@ -81,7 +87,8 @@ struct CustomTypeData {
 
 pub struct CustomTypeVisitor {
     prefix: String,
-    types: HashMap<String, CustomTypeData>,
+    /// Keyed by name then control type so the output is in a stable order.
+    types: BTreeMap<(String, String), CustomTypeData>,
 }
 
 impl CustomTypeVisitor {
@@ -96,18 +103,19 @@ impl CustomTypeVisitor {
         &self,
     ) -> Result<(Vec<FxpRegister>, Vec<ClusterRegister>), CustomTypeVisitorError> {
         let mut fxp_regs = Vec::new();
-        for value in &self.types {
+        for ((name, _), value) in &self.types {
+            let (Some(fxp_type_info), Some(kind)) =
+                (&value.fxp_type_info, fxp_kind(&value.control_type))
+            else {
+                continue;
+            };
             fxp_regs.push(FxpRegister {
-                name: value.0.clone(),
-                fxp_type_info: value
-                    .1
-                    .fxp_type_info
-                    .clone()
-                    .expect("Should have FXP type info"),
+                name: name.clone(),
+                kind,
+                fxp_type_info: fxp_type_info.clone(),
                 address: value
-                    .1
                     .address
-                    .ok_or(CustomTypeVisitorError::MissingAddress(value.0.clone()))?,
+                    .ok_or(CustomTypeVisitorError::MissingAddress(name.clone()))?,
             });
         }
 
@@ -130,15 +138,16 @@ impl<'ast> Visit<'ast> for CustomTypeVisitor {
 
         if let Some(reg_details) = get_constant_type_from_name(&self.prefix, name) {
             println!("Found {:?}", reg_details);
-            if !self.types.contains_key(reg_details.control_name) {
-                self.types
-                    .insert(reg_details.control_name.to_owned(), Default::default());
-            }
-
             let control_definition = self
                 .types
-                .get_mut(reg_details.control_name)
-                .expect("Last step should have created this");
+                .entry((
+                    reg_details.control_name.to_owned(),
+                    reg_details.control_type.to_owned(),
+                ))
+                .or_insert_with(|| CustomTypeData {
+                    control_type: reg_details.control_type.to_owned(),
+                    ..Default::default()
+                });
 
             match reg_details.suffix {
                 "Resource" => {
@@ -156,6 +165,17 @@ impl<'ast> Visit<'ast> for CustomTypeVisitor {
     }
 }
 
+/// The kind of a scalar FXP item from the type in its constant names, such as `ControlFxp`.
+fn fxp_kind(control_type: &str) -> Option<AddressKind> {
+    match control_type {
+        "ControlFxp" => Some(AddressKind::Control),
+        "IndicatorFxp" => Some(AddressKind::Indicator),
+        "TargetToHostFifoFxp" => Some(AddressKind::TargetToHostFifo),
+        "HostToTargetFifoFxp" => Some(AddressKind::HostToTargetFifo),
+        _ => None,
+    }
+}
+
 fn is_constant_definition(declaration: &lang_c::ast::Declaration) -> bool {
     for specifier in declaration.specifiers.iter() {
         match &specifier.node {
@@ -249,18 +269,26 @@ fn read_init_value_number(
     Ok(value_from_discriminant(expression))
 }
 
+/// Reads a number which may be negated, as the integer word length can be.
+fn signed_value(expression: &Expression) -> i64 {
+    match expression {
+        Expression::UnaryOperator(unary) if unary.node.operator.node == UnaryOperator::Minus => {
+            -signed_value(&unary.node.operand.node)
+        }
+        _ => value_from_discriminant(expression) as i64,
+    }
+}
+
 fn read_init_fixed_type(declaration: &Declaration) -> Result<FxpTypeInfo, CustomTypeVisitorError> {
     let initializer = get_initializer(declaration)?;
     match initializer {
         Initializer::List(items) => {
-            let values: Result<Vec<u32>, CustomTypeVisitorError> = items
+            let values: Result<Vec<i64>, CustomTypeVisitorError> = items
                 .iter()
                 .map(|item| {
                     let item_initializer = &item.node.initializer.as_ref().node;
                     match item_initializer {
-                        Initializer::Expression(expression) => {
-                            Ok(value_from_discriminant(&expression.node))
-                        }
+                        Initializer::Expression(expression) => Ok(signed_value(&expression.node)),
                         _ => Err(CustomTypeVisitorError::UnexpectedNestingInFxpItem),
                     }
                 })
@@ -274,8 +302,8 @@ fn read_init_fixed_type(declaration: &Declaration) -> Result<FxpTypeInfo, Custom
 
             Ok(FxpTypeInfo {
                 signed: values[0] != 0,
-                word_length: values[1],
-                integer_word_length: values[2],
+                word_length: values[1] as u32,
+                integer_word_length: values[2] as i32,
             })
         }
         _ => Err(CustomTypeVisitorError::FxpInitializerNotList),
@@ -323,7 +351,6 @@ mod tests {
         assert!(constant_types.is_none());
     }
 
-    #[ignore = "still brittle and unfinished"]
     #[test]
     fn test_fxp_control_and_indicator() {
         let content = r#"
@@ -354,6 +381,16 @@ const NiFpga_FxpTypeInfo NiFpga_Main_ControlFxp_FxpSum_TypeInfo =
         16};
 
 const uint32_t NiFpga_Main_ControlFxp_FxpSum_Resource = 0x18040;
+
+const NiFpga_FxpTypeInfo NiFpga_Main_TargetToHostFifoFxp_Samples_TypeInfo = {0,16,-4};
+
+const uint32_t NiFpga_Main_TargetToHostFifoFxp_Samples_Resource = 2;
+
+const NiFpga_FxpTypeInfo NiFpga_Main_ControlFxpArray_FxpSumArray_TypeInfo = {1,32,16};
+
+const uint32_t NiFpga_Main_ControlFxpArray_FxpSumArray_Resource = 0x18034;
+
+const uint32_t NiFpga_Main_ControlCluster_ClusterSum_Resource = 0x18050;
         "#;
 
         let mut visitor = CustomTypeVisitor::new("Main");
@@ -361,9 +398,11 @@ const uint32_t NiFpga_Main_ControlFxp_FxpSum_Resource = 0x18040;
 
         let (fxp_regs, _) = visitor.get_registers().unwrap();
 
+        // The array and cluster are left out.
         let expected = vec![
             FxpRegister {
                 name: "FxpResult".to_owned(),
+                kind: AddressKind::Indicator,
                 fxp_type_info: FxpTypeInfo {
                     signed: true,
                     word_length: 33,
@@ -373,6 +412,7 @@ const uint32_t NiFpga_Main_ControlFxp_FxpSum_Resource = 0x18040;
             },
             FxpRegister {
                 name: "FxpSum".to_owned(),
+                kind: AddressKind::Control,
                 fxp_type_info: FxpTypeInfo {
                     signed: true,
                     word_length: 32,
@@ -380,6 +420,16 @@ const uint32_t NiFpga_Main_ControlFxp_FxpSum_Resource = 0x18040;
                 },
                 address: 0x18040,
             },
+            FxpRegister {
+                name: "Samples".to_owned(),
+                kind: AddressKind::TargetToHostFifo,
+                fxp_type_info: FxpTypeInfo {
+                    signed: false,
+                    word_length: 16,
+                    integer_word_length: -4,
+                },
+                address: 2,
+            },
         ];
         assert_eq!(fxp_regs, expected);
     }
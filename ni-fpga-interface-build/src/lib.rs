@@ -43,8 +43,75 @@
 //!     pub const NumbersFromFPGA: ReadFifo<u16> = ReadFifo::new(0x1);
 //!     pub const NumbersToFPGA: WriteFifo<u32> = WriteFifo::new(0x0);
 //! }
+//!
+//! pub mod snapshot {
+//!     use ni_fpga_interface::error::FPGAError;
+//!     use ni_fpga_interface::session::Session;
+//!
+//!     /// The value of every indicator on the FPGA.
+//!     #[repr(C)]
+//!     #[derive(Debug, Clone, Copy, PartialEq)]
+//!     pub struct IndicatorSnapshot {
+//!         pub U8Result: u8,
+//!         pub U8ResultArray: [u8; 4],
+//!         pub SglResultArray: [f32; 4],
+//!         pub SglResult: f32,
+//!         // ...
+//!     }
+//!
+//!     /// Reads every indicator into the snapshot in address order.
+//!     pub fn refresh(session: &Session, snapshot: &mut IndicatorSnapshot) -> Result<(), FPGAError> {
+//!         // ...
+//!     }
+//! }
+//!
+//! pub mod fxp {
+//!     use ni_fpga_interface::fxp::{Fxp, FxpReadFifo, FxpRegister};
+//!     pub const FxpResult: FxpRegister<u64, Fxp<true, 33, 17>> = FxpRegister::new(0x1803C);
+//!     pub const FxpSum: FxpRegister<u32, Fxp<true, 32, 16>> = FxpRegister::new(0x18040);
+//!     pub const Samples: FxpReadFifo<u32, Fxp<false, 16, { -4 }>> = FxpReadFifo::new(0x2);
+//! }
+//! ```
+//!
+//! With [`FpgaCInterface::typed_accessors`] there is also a struct with a method per register.
+//!
+//! ```rust,ignore
+//! pub mod accessors {
+//!     use ni_fpga_interface::error::Result;
+//!     use ni_fpga_interface::session::{RegisterInterface, Session};
+//!
+//!     /// Typed access to every register of the FPGA through a session.
+//!     #[derive(Clone, Copy)]
+//!     pub struct Fpga<'s> {
+//!         session: &'s Session,
+//!     }
+//!
+//!     impl<'s> Fpga<'s> {
+//!         pub fn new(session: &'s Session) -> Self {
+//!             Self { session }
+//!         }
+//!
+//!         #[inline]
+//!         pub fn u8_control(&self) -> Result<u8> {
+//!             RegisterInterface::<u8>::read(self.session, 0x18002)
+//!         }
+//!         #[inline]
+//!         pub fn set_u8_control(&self, value: u8) -> Result<()> {
+//!             RegisterInterface::<u8>::write(self.session, 0x18002, value)
+//!         }
+//!         #[inline]
+//!         pub fn fxp_sum(&self) -> Result<f64> {
+//!             super::fxp::FxpSum.read(self.session)
+//!         }
+//!         // ...
+//!     }
+//! }
 //! ```
 //!
+//! The outputs are cached against a fingerprint of the C interface files and
+//! build settings so unchanged interfaces aren't parsed or compiled again.
+//! See [`FpgaCInterface::cache_dir`] to share the cache between builds.
+//!
 //! To then use this in your system you can import it into a module.
 //!
 //! ```rust,ignore
@@ -56,15 +123,39 @@
 mod address_definitions;
 mod address_definitions_visitor;
 mod bindings_parser;
+mod build_cache;
 mod custom_type_register_visitor;
 mod registers_generator;
 mod string_constant_visitor;
 
+use build_cache::{BuildCache, Fingerprint};
 use std::{
     env,
     path::{Path, PathBuf},
 };
 
+/// The name of the static library NiFpga.c is compiled into.
+const LIBRARY_NAME: &str = "ni_fpga";
+
+/// The version of the cached outputs. Bump this when they change in a way the
+/// generator sources below don't capture.
+const CACHE_FORMAT: &str = "1";
+
+/// The source of the generator, so editing it invalidates cached outputs even
+/// when the crate version is unchanged, such as when used as a path dependency.
+const GENERATOR_SOURCES: &[&str] = &[
+    include_str!("lib.rs"),
+    include_str!("address_definitions.rs"),
+    include_str!("address_definitions_visitor.rs"),
+    include_str!("bindings_parser.rs"),
+    include_str!("custom_type_register_visitor.rs"),
+    include_str!("registers_generator.rs"),
+    include_str!("string_constant_visitor.rs"),
+];
+
+/// Environment variables read by the `cc` crate which change the compiled library.
+const COMPILER_VARIABLES: [&str; 5] = ["CC", "CFLAGS", "AR", "ARFLAGS", "CRATE_CC_NO_DEFAULTS"];
+
 /// Defines the generated C interface for the FPGA project.
 pub struct FpgaCInterface {
     common_c: PathBuf,
@@ -72,6 +163,10 @@ pub struct FpgaCInterface {
     custom_c: Option<PathBuf>,
     interface_name: String,
     sysroot: Option<String>,
+    direct_link: bool,
+    nifpga_library_dir: Option<PathBuf>,
+    cache_dir: Option<PathBuf>,
+    typed_accessors: bool,
 }
 
 impl FpgaCInterface {
@@ -109,6 +204,10 @@ impl FpgaCInterface {
             custom_c,
             interface_name,
             sysroot: None,
+            direct_link: false,
+            nifpga_library_dir: None,
+            cache_dir: None,
+            typed_accessors: false,
         }
     }
 
@@ -125,10 +224,157 @@ impl FpgaCInterface {
         self
     }
 
+    /// Links the register and FIFO calls directly against the NI FPGA driver library.
+    ///
+    /// Normally every call goes through a wrapper in NiFpga.c which checks a function
+    /// pointer loaded when the library is opened and calls through it. Linking directly
+    /// removes that indirection and branch from every access.
+    ///
+    /// This must be used with the `direct-link` feature of `ni-fpga-interface`.
+    /// Session management still goes through NiFpga.c.
+    ///
+    /// ```no_run
+    /// use ni_fpga_interface_build::FpgaCInterface;
+    /// FpgaCInterface::from_custom_header("NiFpga_prefix.h")
+    ///    .link_nifpga_directly()
+    ///    .build();
+    /// ```
+    pub fn link_nifpga_directly(&mut self) -> &mut Self {
+        self.direct_link = true;
+        self
+    }
+
+    /// Sets the folder to find the NI FPGA driver library in when linking directly.
+    ///
+    /// When cross compiling this will normally be a folder in the sysroot.
+    pub fn nifpga_library_dir(&mut self, dir: impl Into<PathBuf>) -> &mut Self {
+        self.nifpga_library_dir = Some(dir.into());
+        self
+    }
+
+    /// Shares the generated module and compiled library through a folder outside `OUT_DIR`.
+    ///
+    /// Outputs are always reused within `OUT_DIR` while the inputs are unchanged.
+    /// With a cache folder a clean build or another workspace building the same
+    /// interface for the same target and profile reuses them as well.
+    ///
+    /// ```no_run
+    /// use ni_fpga_interface_build::FpgaCInterface;
+    /// FpgaCInterface::from_custom_header("NiFpga_prefix.h")
+    ///    .cache_dir("../target/fpga-interface-cache")
+    ///    .build();
+    /// ```
+    pub fn cache_dir(&mut self, dir: impl Into<PathBuf>) -> &mut Self {
+        self.cache_dir = Some(dir.into());
+        self
+    }
+
+    /// Also generates the `accessors` module with a method per register.
+    ///
+    /// `Fpga::new(&session)` wraps a session and has a method to read each
+    /// register, named in snake case, so `U8Control` is read with `u8_control()`.
+    /// Controls also have a `set_` method and arrays an `_into` method to read
+    /// into existing storage.
+    ///
+    /// Each method passes a constant address to the register implementation
+    /// for its exact type so it inlines to a single driver call.
+    ///
+    /// ```no_run
+    /// use ni_fpga_interface_build::FpgaCInterface;
+    /// FpgaCInterface::from_custom_header("NiFpga_prefix.h")
+    ///    .typed_accessors()
+    ///    .build();
+    /// ```
+    pub fn typed_accessors(&mut self) -> &mut Self {
+        self.typed_accessors = true;
+        self
+    }
+
     /// Build the C interface and generate rust bindings for it.
+    ///
+    /// If the inputs are unchanged since the outputs were last built they are reused.
     pub fn build(&self) {
-        self.build_lib();
-        self.build_rust_interface();
+        self.emit_rerun_directives();
+
+        let out_dir = PathBuf::from(env::var("OUT_DIR").unwrap());
+        let cache = BuildCache::new(
+            out_dir.clone(),
+            self.cache_dir.clone(),
+            vec![self.module_file_name(), library_file_name()],
+            self.fingerprint(),
+        );
+
+        if cache.restore() {
+            // These are normally printed by cc when it compiles the library.
+            println!("cargo:rustc-link-search=native={}", out_dir.display());
+            println!("cargo:rustc-link-lib=static={LIBRARY_NAME}");
+        } else {
+            self.build_lib();
+            self.build_rust_interface();
+            cache.store();
+        }
+        self.emit_direct_link();
+    }
+
+    /// The C files the outputs are built from. NiFpga.h is included by the others.
+    fn input_files(&self) -> Vec<PathBuf> {
+        let mut files = vec![
+            self.custom_h.clone(),
+            self.common_c.with_file_name("NiFpga.h"),
+            self.common_c.clone(),
+        ];
+        files.extend(self.custom_c.clone());
+        files
+    }
+
+    /// Tells cargo exactly what the outputs depend on so the build script
+    /// doesn't rerun for unrelated changes.
+    fn emit_rerun_directives(&self) {
+        for file in self.input_files() {
+            println!("cargo:rerun-if-changed={}", file.display());
+        }
+        // The cc crate prints these itself but not when the cached library is used.
+        for variable in compiler_variables() {
+            println!("cargo:rerun-if-env-changed={variable}");
+        }
+    }
+
+    fn fingerprint(&self) -> Fingerprint {
+        self.fingerprint_for_generator(CACHE_FORMAT, GENERATOR_SOURCES)
+    }
+
+    fn fingerprint_for_generator(&self, cache_format: &str, sources: &[&str]) -> Fingerprint {
+        let mut fingerprint = Fingerprint::new();
+        fingerprint
+            .add_str(env!("CARGO_PKG_VERSION"))
+            .add_str(cache_format);
+        for source in sources {
+            fingerprint.add_str(source);
+        }
+        fingerprint
+            .add_str(&self.interface_name)
+            .add_str(if self.typed_accessors {
+                "accessors"
+            } else {
+                ""
+            })
+            .add_option(self.sysroot.as_deref());
+        for file in self.input_files() {
+            fingerprint.add_file(&file);
+        }
+        // Set by cargo and used by cc to pick the compiler and flags.
+        for variable in ["TARGET", "HOST", "OPT_LEVEL", "DEBUG"]
+            .into_iter()
+            .map(String::from)
+            .chain(compiler_variables())
+        {
+            fingerprint.add_option(env::var(variable).ok().as_deref());
+        }
+        fingerprint
+    }
+
+    fn module_file_name(&self) -> String {
+        format!("NiFpga_{}.rs", self.interface_name)
     }
 
     fn build_lib(&self) {
@@ -144,21 +390,60 @@ impl FpgaCInterface {
             build.file(custom_c);
         }
 
-        build.compile("ni_fpga");
+        build.compile(LIBRARY_NAME);
+    }
+
+    fn emit_direct_link(&self) {
+        if self.direct_link {
+            if let Some(dir) = &self.nifpga_library_dir {
+                println!("cargo:rustc-link-search=native={}", dir.display());
+            }
+            println!("cargo:rustc-link-lib=dylib=NiFpga");
+        }
     }
 
     fn build_rust_interface(&self) {
         // Write the bindings to the $OUT_DIR/bindings.rs file.
         let out_path = PathBuf::from(env::var("OUT_DIR").unwrap());
-        let mod_path = out_path.join(format!("NiFpga_{}.rs", self.interface_name));
-        println!("cargo:rerun-if-changed={}", self.custom_h.display());
+        let mod_path = out_path.join(self.module_file_name());
 
         let interface_description = bindings_parser::InterfaceDescription::parse_bindings(
             &self.interface_name,
             &PathBuf::from(&self.custom_h),
         );
 
-        std::fs::write(mod_path, interface_description.generate_rust_output()).unwrap();
+        std::fs::write(
+            mod_path,
+            interface_description.generate_rust_output(self.typed_accessors),
+        )
+        .unwrap();
+    }
+}
+
+/// The compiler variables with the target specific forms cc also checks.
+fn compiler_variables() -> Vec<String> {
+    let target = env::var("TARGET").unwrap_or_default();
+    COMPILER_VARIABLES
+        .iter()
+        .flat_map(|variable| {
+            [
+                variable.to_string(),
+                format!("{variable}_{target}"),
+                format!("{variable}_{}", target.replace('-', "_")),
+                format!("TARGET_{variable}"),
+                format!("HOST_{variable}"),
+            ]
+        })
+        .collect()
+}
+
+/// The file name cc gives the static library.
+fn library_file_name() -> String {
+    let target = env::var("TARGET").unwrap_or_default();
+    if target.contains("msvc") {
+        format!("{LIBRARY_NAME}.lib")
+    } else {
+        format!("lib{LIBRARY_NAME}.a")
     }
 }
 
@@ -166,7 +451,8 @@ impl FpgaCInterface {
 mod test {
     use std::path::PathBuf;
 
-    use crate::FpgaCInterface;
+    use crate::build_cache::BuildCache;
+    use crate::{FpgaCInterface, CACHE_FORMAT, GENERATOR_SOURCES};
 
     #[test]
     fn test_constructs_from_custom_header_relative_path() {
@@ -192,4 +478,81 @@ mod test {
         );
         assert_eq!(fpga_interface.interface_name, "fpga");
     }
+
+    #[test]
+    fn test_direct_link_options() {
+        let mut fpga_interface = FpgaCInterface::from_custom_header("./NiFpga_fpga.h");
+        assert!(!fpga_interface.direct_link);
+        fpga_interface
+            .link_nifpga_directly()
+            .nifpga_library_dir("/usr/lib");
+        assert!(fpga_interface.direct_link);
+        assert_eq!(
+            fpga_interface.nifpga_library_dir,
+            Some(PathBuf::from("/usr/lib"))
+        );
+    }
+
+    #[test]
+    fn test_input_files() {
+        let fpga_interface = FpgaCInterface::from_custom_header("./NiFpga_fpga.h");
+        assert_eq!(
+            fpga_interface.input_files(),
+            vec![
+                PathBuf::from("./NiFpga_fpga.h"),
+                PathBuf::from("./NiFpga.h"),
+                PathBuf::from("./NiFpga.c"),
+            ]
+        );
+    }
+
+    #[test]
+    fn test_fingerprint_includes_sysroot() {
+        let mut fpga_interface = FpgaCInterface::from_custom_header("./NiFpga_fpga.h");
+        let without = fpga_interface.fingerprint();
+        fpga_interface.sysroot("/sysroots/arm");
+        assert_ne!(fpga_interface.fingerprint(), without);
+    }
+
+    #[test]
+    fn test_fingerprint_includes_typed_accessors() {
+        let mut fpga_interface = FpgaCInterface::from_custom_header("./NiFpga_fpga.h");
+        let without = fpga_interface.fingerprint();
+        fpga_interface.typed_accessors();
+        assert!(fpga_interface.typed_accessors);
+        assert_ne!(fpga_interface.fingerprint(), without);
+    }
+
+    #[test]
+    fn test_generator_changes_invalidate_cache() {
+        let fpga_interface = FpgaCInterface::from_custom_header("./NiFpga_fpga.h");
+        let current = fpga_interface.fingerprint();
+        assert_eq!(
+            fpga_interface.fingerprint_for_generator(CACHE_FORMAT, GENERATOR_SOURCES),
+            current
+        );
+
+        let mut edited: Vec<&str> = GENERATOR_SOURCES.to_vec();
+        let edited_source = format!("{}\n// edited", edited[0]);
+        edited[0] = &edited_source;
+        let new_format = fpga_interface.fingerprint_for_generator("2", GENERATOR_SOURCES);
+        let new_source = fpga_interface.fingerprint_for_generator(CACHE_FORMAT, &edited);
+        assert_ne!(new_format, current);
+        assert_ne!(new_source, current);
+
+        let out_dir = std::env::temp_dir().join(format!(
+            "ni-fpga-generator-fingerprint-{}",
+            std::process::id()
+        ));
+        std::fs::create_dir_all(&out_dir).unwrap();
+        let outputs = vec![fpga_interface.module_file_name()];
+        std::fs::write(out_dir.join(&outputs[0]), "generated").unwrap();
+        BuildCache::new(out_dir.clone(), None, outputs.clone(), current).store();
+        for fingerprint in [new_format, new_source] {
+            let cache = BuildCache::new(out_dir.clone(), None, outputs.clone(), fingerprint);
+            assert!(!cache.restore());
+        }
+        assert!(BuildCache::new(out_dir.clone(), None, outputs, current).restore());
+        std::fs::remove_dir_all(out_dir).unwrap();
+    }
 }
@@ -1,7 +1,9 @@
 use super::address_definitions::AddressKind;
 use super::address_definitions_visitor::{AddressSet, LocationDefinition};
-use proc_macro2::TokenStream;
+use super::custom_type_register_visitor::FxpRegister;
+use proc_macro2::{Ident, Span, TokenStream};
 use quote::{format_ident, quote, ToTokens, TokenStreamExt};
+use std::collections::BTreeMap;
 use std::str::FromStr;
 
 /// Generates a rust module containing the register definitions.
@@ -78,6 +80,357 @@ pub fn generate_fifo_module(addresses: &AddressSet) -> impl ToTokens {
     }
 }
 
+/// Generates a separate module with the FXP registers and FIFOs, which read and write doubles.
+pub fn generate_fxp_module(fxp_registers: &[FxpRegister]) -> impl ToTokens {
+    let mut tokens = quote! {};
+    let mut imports = std::collections::BTreeSet::new();
+    for register in fxp_registers {
+        let name = format_ident!("{}", register.name);
+        let ty = generate_fxp_type(register);
+        let address = TokenStream::from_str(&format!("0x{:X}", register.address)).unwrap();
+        let wrapper = match register.kind {
+            AddressKind::Control | AddressKind::Indicator => "FxpRegister",
+            AddressKind::TargetToHostFifo => "FxpReadFifo",
+            AddressKind::HostToTargetFifo => "FxpWriteFifo",
+            _ => panic!("FXP {} isn't a scalar register or FIFO.", register.name),
+        };
+        imports.insert(wrapper);
+        let wrapper = format_ident!("{}", wrapper);
+        tokens.append_all(quote! {
+            pub const #name: #wrapper<#ty> = #wrapper::new(#address);
+        });
+    }
+    let imports = if imports.is_empty() {
+        quote! {}
+    } else {
+        let imports = imports
+            .into_iter()
+            .map(|import| format_ident!("{}", import));
+        quote! {
+            use ni_fpga_interface::fxp::{ Fxp, #(#imports),* };
+        }
+    };
+
+    quote! {
+        #[allow(non_upper_case_globals)]
+        #[allow(dead_code)]
+        pub mod fxp {
+            #imports
+            #tokens
+        }
+    }
+}
+
+/// The word type and format parameters for an FXP item, such as `u64, Fxp<true, 33, 17>`.
+///
+/// Words of up to 32 bits are held in a `u32` as in the C API.
+fn generate_fxp_type(register: &FxpRegister) -> TokenStream {
+    let info = &register.fxp_type_info;
+    let word = if info.word_length <= 32 {
+        quote! {u32}
+    } else {
+        quote! {u64}
+    };
+    let signed = info.signed;
+    let word_length = TokenStream::from_str(&info.word_length.to_string()).unwrap();
+    // Negative const arguments have to be in a block.
+    let integer_word_length = if info.integer_word_length < 0 {
+        TokenStream::from_str(&format!("{{ {} }}", info.integer_word_length)).unwrap()
+    } else {
+        TokenStream::from_str(&info.integer_word_length.to_string()).unwrap()
+    };
+    quote! { #word, Fxp<#signed, #word_length, #integer_word_length> }
+}
+
+/// Records the accessor names for a register, panicking if another register already has one.
+fn claim_accessor_names<'a>(
+    method_names: &mut BTreeMap<String, &'a str>,
+    register: &'a str,
+    names: &[String],
+) {
+    for method in names {
+        if let Some(other) = method_names.insert(method.clone(), register) {
+            panic!(
+                "Registers {} and {} both generate the accessor {method}.",
+                other, register
+            );
+        }
+    }
+}
+
+/// Generates a module with a flat struct holding every indicator and a function to refresh it.
+///
+/// The fields are laid out in address order and refreshed in that order.
+pub fn generate_snapshot_module(registers: &AddressSet) -> impl ToTokens {
+    let mut indicators: Vec<(&LocationDefinition, u32, Option<u32>)> = registers
+        .iter()
+        .filter_map(|(def, address)| match def.kind {
+            AddressKind::Indicator => Some((def, *address, None)),
+            AddressKind::IndicatorArray => {
+                let mut size_def = def.clone();
+                size_def.kind = def.kind.with_size();
+                let array_size = registers.get(&size_def).expect("Array size not found.");
+                Some((def, *address, Some(*array_size)))
+            }
+            _ => None,
+        })
+        .collect();
+    indicators.sort_by_key(|(_, address, _)| *address);
+
+    let mut fields = quote! {};
+    let mut defaults = quote! {};
+    let mut reads = quote! {};
+    for (def, _, array_size) in indicators {
+        let name = format_ident!("{}", def.name);
+        let ty = type_string_to_type(&def.datatype);
+        match array_size {
+            None => {
+                fields.append_all(quote! { pub #name: #ty, });
+                defaults.append_all(quote! { #name: Default::default(), });
+                reads.append_all(quote! {
+                    snapshot.#name = super::registers::#name.read(session)?;
+                });
+            }
+            Some(array_size) => {
+                let array_size = TokenStream::from_str(&format!("{array_size}")).unwrap();
+                fields.append_all(quote! { pub #name: [#ty; #array_size], });
+                defaults.append_all(quote! { #name: [Default::default(); #array_size], });
+                reads.append_all(quote! {
+                    super::registers::#name.read_into(session, &mut snapshot.#name)?;
+                });
+            }
+        }
+    }
+
+    quote! {
+        #[allow(non_snake_case)]
+        #[allow(unused_variables)]
+        #[allow(dead_code)]
+        pub mod snapshot {
+            use ni_fpga_interface::error::FPGAError;
+            use ni_fpga_interface::session::Session;
+
+            /// The value of every indicator on the FPGA.
+            #[repr(C)]
+            #[derive(Debug, Clone, Copy, PartialEq)]
+            pub struct IndicatorSnapshot {
+                #fields
+            }
+
+            impl Default for IndicatorSnapshot {
+                fn default() -> Self {
+                    Self {
+                        #defaults
+                    }
+                }
+            }
+
+            /// Reads every indicator into the snapshot in address order.
+            pub fn refresh(session: &Session, snapshot: &mut IndicatorSnapshot) -> Result<(), FPGAError> {
+                #reads
+                Ok(())
+            }
+        }
+    }
+}
+
+/// Generates a module with a struct that has a method per register on a concrete `Session`.
+///
+/// Each method passes its address as a constant to the register implementation for the
+/// exact type, so it inlines to the single driver call with no generic dispatch at the call site.
+/// Controls also get a `set_` method and arrays a `_into` method reading into existing storage.
+/// FXP registers are read and written as doubles through the `fxp` module.
+pub fn generate_accessors_module(
+    registers: &AddressSet,
+    fxp_registers: &[FxpRegister],
+) -> impl ToTokens {
+    let mut accessors: Vec<(&LocationDefinition, u32, Option<u32>)> = registers
+        .iter()
+        .filter_map(|(def, address)| match def.kind {
+            AddressKind::Control | AddressKind::Indicator => Some((def, *address, None)),
+            AddressKind::ControlArray | AddressKind::IndicatorArray => {
+                let mut size_def = def.clone();
+                size_def.kind = def.kind.with_size();
+                let array_size = registers.get(&size_def).expect("Array size not found.");
+                Some((def, *address, Some(*array_size)))
+            }
+            _ => None,
+        })
+        .collect();
+    accessors.sort_by_key(|(_, address, _)| *address);
+
+    let mut method_names: BTreeMap<String, &str> = BTreeMap::new();
+    let mut methods = quote! {};
+    for (def, address, array_size) in accessors {
+        let name = to_snake_case(&def.name);
+        let is_control = matches!(def.kind, AddressKind::Control | AddressKind::ControlArray);
+        let mut names = vec![name.clone()];
+        if array_size.is_some() {
+            names.push(format!("{name}_into"));
+        }
+        if is_control {
+            names.push(format!("set_{name}"));
+        }
+        claim_accessor_names(&mut method_names, &def.name, &names);
+
+        let getter = method_ident(&names[0]);
+        let ty = type_string_to_type(&def.datatype);
+        let address = TokenStream::from_str(&format!("0x{:X}", address)).unwrap();
+        match array_size {
+            None => {
+                methods.append_all(quote! {
+                    #[inline]
+                    pub fn #getter(&self) -> Result<#ty> {
+                        RegisterInterface::<#ty>::read(self.session, #address)
+                    }
+                });
+            }
+            Some(array_size) => {
+                let array_size = TokenStream::from_str(&format!("{array_size}")).unwrap();
+                let into = method_ident(&names[1]);
+                methods.append_all(quote! {
+                    #[inline]
+                    pub fn #getter(&self) -> Result<[#ty; #array_size]> {
+                        RegisterInterface::<#ty>::read_array::<#array_size>(self.session, #address)
+                    }
+                    #[inline]
+                    pub fn #into(&self, value: &mut [#ty; #array_size]) -> Result<()> {
+                        RegisterInterface::<#ty>::read_array_mut::<#array_size>(self.session, #address, value)
+                    }
+                });
+            }
+        }
+        if is_control {
+            let setter = method_ident(names.last().unwrap());
+            match array_size {
+                None => methods.append_all(quote! {
+                    #[inline]
+                    pub fn #setter(&self, value: #ty) -> Result<()> {
+                        RegisterInterface::<#ty>::write(self.session, #address, value)
+                    }
+                }),
+                Some(array_size) => {
+                    let array_size = TokenStream::from_str(&format!("{array_size}")).unwrap();
+                    methods.append_all(quote! {
+                        #[inline]
+                        pub fn #setter(&self, value: &[#ty; #array_size]) -> Result<()> {
+                            RegisterInterface::<#ty>::write_array::<#array_size>(self.session, #address, value)
+                        }
+                    });
+                }
+            }
+        }
+    }
+
+    let mut fxp_accessors: Vec<&FxpRegister> = fxp_registers
+        .iter()
+        .filter(|register| matches!(register.kind, AddressKind::Control | AddressKind::Indicator))
+        .collect();
+    fxp_accessors.sort_by_key(|register| register.address);
+    for register in fxp_accessors {
+        let name = to_snake_case(&register.name);
+        let is_control = register.kind == AddressKind::Control;
+        let mut names = vec![name.clone()];
+        if is_control {
+            names.push(format!("set_{name}"));
+        }
+        claim_accessor_names(&mut method_names, &register.name, &names);
+
+        let getter = method_ident(&names[0]);
+        let constant = format_ident!("{}", register.name);
+        methods.append_all(quote! {
+            #[inline]
+            pub fn #getter(&self) -> Result<f64> {
+                super::fxp::#constant.read(self.session)
+            }
+        });
+        if is_control {
+            let setter = method_ident(&names[1]);
+            methods.append_all(quote! {
+                #[inline]
+                pub fn #setter(&self, value: f64) -> Result<()> {
+                    super::fxp::#constant.write(self.session, value)
+                }
+            });
+        }
+    }
+
+    quote! {
+        #[allow(dead_code)]
+        pub mod accessors {
+            use ni_fpga_interface::error::Result;
+            use ni_fpga_interface::session::{RegisterInterface, Session};
+
+            /// Typed access to every register of the FPGA through a session.
+            #[derive(Clone, Copy)]
+            pub struct Fpga<'s> {
+                session: &'s Session,
+            }
+
+            impl<'s> Fpga<'s> {
+                pub fn new(session: &'s Session) -> Self {
+                    Self { session }
+                }
+
+                #methods
+            }
+        }
+    }
+}
+
+/// Converts a register name such as `U8ControlArray` to `u8_control_array`.
+///
+/// An acronym stays together unless it runs into a word, so `ADCValue` becomes `adc_value`
+/// but a trailing plural like `IRQs` becomes `irqs`.
+fn to_snake_case(name: &str) -> String {
+    let characters: Vec<char> = name.chars().collect();
+    let mut snake = String::with_capacity(name.len() + 4);
+    for (index, character) in characters.iter().enumerate() {
+        if !character.is_ascii_alphanumeric() {
+            if !snake.is_empty() && !snake.ends_with('_') {
+                snake.push('_');
+            }
+            continue;
+        }
+        if character.is_ascii_uppercase() && index > 0 {
+            let previous = characters[index - 1];
+            let next = characters.get(index + 1);
+            let after_next = characters.get(index + 2);
+            let starts_word = previous.is_ascii_lowercase()
+                || previous.is_ascii_digit()
+                || (previous.is_ascii_uppercase()
+                    && matches!(next, Some(next) if next.is_ascii_lowercase())
+                    && matches!(after_next, Some(after) if after.is_ascii_lowercase()));
+            if starts_word && !snake.is_empty() && !snake.ends_with('_') {
+                snake.push('_');
+            }
+        }
+        snake.push(character.to_ascii_lowercase());
+    }
+    let snake = snake.trim_end_matches('_');
+    if snake.starts_with(|character: char| character.is_ascii_digit()) {
+        format!("_{snake}")
+    } else {
+        snake.to_string()
+    }
+}
+
+/// Makes an identifier for the method, escaping any that are keywords.
+fn method_ident(name: &str) -> Ident {
+    const KEYWORDS: [&str; 38] = [
+        "as", "async", "await", "break", "const", "continue", "dyn", "else", "enum", "extern",
+        "false", "fn", "for", "if", "impl", "in", "let", "loop", "match", "mod", "move", "mut",
+        "pub", "ref", "return", "static", "struct", "trait", "true", "type", "unsafe", "use",
+        "where", "while", "abstract", "become", "do", "try",
+    ];
+    match name {
+        // These can't be raw identifiers or would clash with the constructor.
+        "self" | "super" | "crate" | "new" => format_ident!("{}_", name),
+        _ if KEYWORDS.contains(&name) => Ident::new_raw(name, Span::call_site()),
+        _ => format_ident!("{}", name),
+    }
+}
+
 fn type_string_to_type(type_string: &str) -> impl ToTokens {
     match type_string {
         "U8" => quote! {u8},
@@ -143,6 +496,7 @@ fn generate_address_definition(
 #[cfg(test)]
 mod tests {
     use super::*;
+    use crate::custom_type_register_visitor::FxpTypeInfo;
 
     #[test]
     fn test_generate_control_register() {
@@ -386,6 +740,108 @@ mod tests {
         assert_eq!(tokens.to_token_stream().to_string(), expected.to_string());
     }
 
+    #[test]
+    fn test_should_generate_snapshot_in_address_order() {
+        let mut registers = AddressSet::new();
+        registers.insert(
+            LocationDefinition {
+                name: "b_indicator".to_string(),
+                datatype: "U8".to_string(),
+                kind: AddressKind::Indicator,
+            },
+            0x18002,
+        );
+        registers.insert(
+            LocationDefinition {
+                name: "a_indicator".to_string(),
+                datatype: "Dbl".to_string(),
+                kind: AddressKind::Indicator,
+            },
+            0x18010,
+        );
+        registers.insert(
+            LocationDefinition {
+                name: "control".to_string(),
+                datatype: "U8".to_string(),
+                kind: AddressKind::Control,
+            },
+            0x18000,
+        );
+
+        let tokens = generate_snapshot_module(&registers);
+
+        let expected = quote! {
+            #[allow(non_snake_case)]
+            #[allow(unused_variables)]
+            #[allow(dead_code)]
+            pub mod snapshot {
+                use ni_fpga_interface::error::FPGAError;
+                use ni_fpga_interface::session::Session;
+
+                /// The value of every indicator on the FPGA.
+                #[repr(C)]
+                #[derive(Debug, Clone, Copy, PartialEq)]
+                pub struct IndicatorSnapshot {
+                    pub b_indicator: u8,
+                    pub a_indicator: f64,
+                }
+
+                impl Default for IndicatorSnapshot {
+                    fn default() -> Self {
+                        Self {
+                            b_indicator: Default::default(),
+                            a_indicator: Default::default(),
+                        }
+                    }
+                }
+
+                /// Reads every indicator into the snapshot in address order.
+                pub fn refresh(session: &Session, snapshot: &mut IndicatorSnapshot) -> Result<(), FPGAError> {
+                    snapshot.b_indicator = super::registers::b_indicator.read(session)?;
+                    snapshot.a_indicator = super::registers::a_indicator.read(session)?;
+                    Ok(())
+                }
+            }
+        };
+
+        assert_eq!(tokens.to_token_stream().to_string(), expected.to_string());
+    }
+
+    #[test]
+    fn test_should_generate_array_fields_in_snapshot() {
+        let mut registers = AddressSet::new();
+        registers.insert(
+            LocationDefinition {
+                name: "indicator".to_string(),
+                datatype: "I16".to_string(),
+                kind: AddressKind::IndicatorArray,
+            },
+            0x18004,
+        );
+        registers.insert(
+            LocationDefinition {
+                name: "indicator".to_string(),
+                datatype: "I16".to_string(),
+                kind: AddressKind::IndicatorArraySize,
+            },
+            3,
+        );
+
+        let tokens = generate_snapshot_module(&registers)
+            .to_token_stream()
+            .to_string();
+
+        let field = quote! { pub indicator: [i16; 3], }.to_string();
+        let default = quote! { indicator: [Default::default(); 3], }.to_string();
+        let read = quote! {
+            super::registers::indicator.read_into(session, &mut snapshot.indicator)?;
+        }
+        .to_string();
+        assert!(tokens.contains(&field));
+        assert!(tokens.contains(&default));
+        assert!(tokens.contains(&read));
+    }
+
     #[test]
     fn test_should_generate_a_public_module_with_fifos() {
         let mut registers = AddressSet::new();
@@ -429,4 +885,240 @@ mod tests {
 
         assert_eq!(tokens.to_token_stream().to_string(), expected.to_string());
     }
+
+    fn fxp_register(
+        name: &str,
+        kind: AddressKind,
+        format: (bool, u32, i32),
+        address: u32,
+    ) -> FxpRegister {
+        FxpRegister {
+            name: name.to_string(),
+            kind,
+            fxp_type_info: FxpTypeInfo {
+                signed: format.0,
+                word_length: format.1,
+                integer_word_length: format.2,
+            },
+            address,
+        }
+    }
+
+    #[test]
+    fn test_should_generate_a_public_module_with_fxp() {
+        let fxp = [
+            fxp_register("FxpResult", AddressKind::Indicator, (true, 33, 17), 0x1803C),
+            fxp_register("FxpSum", AddressKind::Control, (true, 32, 16), 0x18040),
+            fxp_register("Samples", AddressKind::TargetToHostFifo, (false, 16, -4), 2),
+            fxp_register("Setpoints", AddressKind::HostToTargetFifo, (true, 40, 8), 3),
+        ];
+
+        let tokens = generate_fxp_module(&fxp);
+
+        let expected = quote! {
+            #[allow(non_upper_case_globals)]
+            #[allow(dead_code)]
+            pub mod fxp {
+                use ni_fpga_interface::fxp::{ Fxp, FxpReadFifo, FxpRegister, FxpWriteFifo };
+
+                pub const FxpResult: FxpRegister<u64, Fxp<true, 33, 17> > = FxpRegister::new(0x1803C);
+                pub const FxpSum: FxpRegister<u32, Fxp<true, 32, 16> > = FxpRegister::new(0x18040);
+                pub const Samples: FxpReadFifo<u32, Fxp<false, 16, { -4 }> > = FxpReadFifo::new(0x2);
+                pub const Setpoints: FxpWriteFifo<u64, Fxp<true, 40, 8> > = FxpWriteFifo::new(0x3);
+            }
+        };
+
+        assert_eq!(tokens.to_token_stream().to_string(), expected.to_string());
+    }
+
+    #[test]
+    fn test_should_generate_fxp_accessors() {
+        let fxp = [
+            fxp_register("FxpResult", AddressKind::Indicator, (true, 33, 17), 0x1803C),
+            fxp_register("FxpSum", AddressKind::Control, (true, 32, 16), 0x18040),
+            fxp_register("Samples", AddressKind::TargetToHostFifo, (false, 16, -4), 2),
+        ];
+
+        let tokens = generate_accessors_module(&AddressSet::new(), &fxp)
+            .to_token_stream()
+            .to_string();
+
+        let read = quote! {
+            pub fn fxp_result(&self) -> Result<f64> {
+                super::fxp::FxpResult.read(self.session)
+            }
+        }
+        .to_string();
+        let write = quote! {
+            pub fn set_fxp_sum(&self, value: f64) -> Result<()> {
+                super::fxp::FxpSum.write(self.session, value)
+            }
+        }
+        .to_string();
+        assert!(tokens.contains(&read));
+        assert!(tokens.contains(&write));
+        assert!(!tokens.contains("set_fxp_result"));
+        assert!(!tokens.contains("samples"));
+    }
+
+    #[test]
+    #[should_panic(expected = "both generate the accessor fxp_sum")]
+    fn test_fxp_accessor_name_clash_panics() {
+        let mut registers = AddressSet::new();
+        registers.insert(
+            LocationDefinition {
+                name: "fxp_sum".to_string(),
+                datatype: "Sgl".to_string(),
+                kind: AddressKind::Indicator,
+            },
+            0x18000,
+        );
+        let fxp = [fxp_register(
+            "FxpSum",
+            AddressKind::Control,
+            (true, 32, 16),
+            0x18040,
+        )];
+        generate_accessors_module(&registers, &fxp);
+    }
+
+    #[test]
+    fn test_should_generate_typed_accessors() {
+        let mut registers = AddressSet::new();
+        registers.insert(
+            LocationDefinition {
+                name: "U8Result".to_string(),
+                datatype: "U8".to_string(),
+                kind: AddressKind::Indicator,
+            },
+            0x1800A,
+        );
+        registers.insert(
+            LocationDefinition {
+                name: "SglControl".to_string(),
+                datatype: "Sgl".to_string(),
+                kind: AddressKind::Control,
+            },
+            0x18002,
+        );
+
+        let tokens = generate_accessors_module(&registers, &[]);
+
+        let expected = quote! {
+            #[allow(dead_code)]
+            pub mod accessors {
+                use ni_fpga_interface::error::Result;
+                use ni_fpga_interface::session::{RegisterInterface, Session};
+
+                /// Typed access to every register of the FPGA through a session.
+                #[derive(Clone, Copy)]
+                pub struct Fpga<'s> {
+                    session: &'s Session,
+                }
+
+                impl<'s> Fpga<'s> {
+                    pub fn new(session: &'s Session) -> Self {
+                        Self { session }
+                    }
+
+                    #[inline]
+                    pub fn sgl_control(&self) -> Result<f32> {
+                        RegisterInterface::<f32>::read(self.session, 0x18002)
+                    }
+                    #[inline]
+                    pub fn set_sgl_control(&self, value: f32) -> Result<()> {
+                        RegisterInterface::<f32>::write(self.session, 0x18002, value)
+                    }
+                    #[inline]
+                    pub fn u8_result(&self) -> Result<u8> {
+                        RegisterInterface::<u8>::read(self.session, 0x1800A)
+                    }
+                }
+            }
+        };
+
+        assert_eq!(tokens.to_token_stream().to_string(), expected.to_string());
+    }
+
+    #[test]
+    fn test_should_generate_array_accessors_with_const_size() {
+        let mut registers = AddressSet::new();
+        registers.insert(
+            LocationDefinition {
+                name: "U8ControlArray".to_string(),
+                datatype: "U8".to_string(),
+                kind: AddressKind::ControlArray,
+            },
+            0x18014,
+        );
+        registers.insert(
+            LocationDefinition {
+                name: "U8ControlArray".to_string(),
+                datatype: "U8".to_string(),
+                kind: AddressKind::ControlArraySize,
+            },
+            4,
+        );
+
+        let tokens = generate_accessors_module(&registers, &[])
+            .to_token_stream()
+            .to_string();
+
+        let read = quote! {
+            pub fn u8_control_array(&self) -> Result<[u8; 4]> {
+                RegisterInterface::<u8>::read_array::<4>(self.session, 0x18014)
+            }
+        }
+        .to_string();
+        let into = quote! {
+            pub fn u8_control_array_into(&self, value: &mut [u8; 4]) -> Result<()> {
+                RegisterInterface::<u8>::read_array_mut::<4>(self.session, 0x18014, value)
+            }
+        }
+        .to_string();
+        let write = quote! {
+            pub fn set_u8_control_array(&self, value: &[u8; 4]) -> Result<()> {
+                RegisterInterface::<u8>::write_array::<4>(self.session, 0x18014, value)
+            }
+        }
+        .to_string();
+        assert!(tokens.contains(&read));
+        assert!(tokens.contains(&into));
+        assert!(tokens.contains(&write));
+    }
+
+    #[test]
+    #[should_panic(expected = "both generate the accessor sgl_sum")]
+    fn test_accessor_name_clash_panics() {
+        let mut registers = AddressSet::new();
+        for name in ["SglSum", "sgl_sum"] {
+            registers.insert(
+                LocationDefinition {
+                    name: name.to_string(),
+                    datatype: "Sgl".to_string(),
+                    kind: AddressKind::Indicator,
+                },
+                0x18000,
+            );
+        }
+        generate_accessors_module(&registers, &[]);
+    }
+
+    #[test]
+    fn test_to_snake_case() {
+        assert_eq!(to_snake_case("U8Control"), "u8_control");
+        assert_eq!(to_snake_case("SglResultArray"), "sgl_result_array");
+        assert_eq!(to_snake_case("IRQs"), "irqs");
+        assert_eq!(to_snake_case("ADCValue"), "adc_value");
+        assert_eq!(to_snake_case("already_snake"), "already_snake");
+        assert_eq!(to_snake_case("Motor Speed (rpm)"), "motor_speed_rpm");
+    }
+
+    #[test]
+    fn test_method_ident_escapes_keywords() {
+        assert_eq!(method_ident("type").to_string(), "r#type");
+        assert_eq!(method_ident("self").to_string(), "self_");
+        assert_eq!(method_ident("new").to_string(), "new_");
+        assert_eq!(method_ident("speed").to_string(), "speed");
+    }
 }
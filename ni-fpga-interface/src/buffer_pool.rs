@@ -0,0 +1,581 @@
+//! A pool of reusable blocks for handing FIFO data between threads.
+//!
+//! Reading into a fresh buffer for each block and sending it to another
+//! thread allocates and frees memory at the data rate. A [`BufferPool`]
+//! allocates every block up front in one aligned slab, which can be locked
+//! into RAM, and hands them out as [`PooledBuffer`]s. A buffer can be moved
+//! to another thread, or converted to a cloneable [`SharedBuffer`] for
+//! several readers, and its block returns to the pool when the last handle
+//! is dropped. Once the pool is created nothing allocates.
+//!
+//! [`ReadFifo::read_pooled`](crate::fifos::ReadFifo::read_pooled) reads a FIFO
+//! straight into a block from the pool.
+//!
+//! # Example
+//!
+//! ```rust
+//! # use ni_fpga_interface::fifos::ReadFifo;
+//! # use ni_fpga_interface::session::{NiFpgaContext, Session};
+//! use ni_fpga_interface::buffer_pool::{BufferPool, PoolConfig};
+//! use std::sync::mpsc::channel;
+//! use std::time::Duration;
+//!
+//! # let context = NiFpgaContext::new().unwrap();
+//! # let session = Session::new(&context, "main.lvbitx", "sig", "RIO0", &Default::default()).unwrap();
+//! let pool = BufferPool::<u64>::new(PoolConfig {
+//!     blocks: 8,
+//!     block_len: 4096,
+//!     lock_pages: true,
+//!     ..Default::default()
+//! })
+//! .unwrap();
+//! let (sender, receiver) = channel();
+//! let consumer = std::thread::spawn(move || {
+//!     for block in receiver {
+//!         println!("Sum {}", block.iter().sum::<u64>());
+//!         // The block returns to the pool here.
+//!     }
+//! });
+//!
+//! let mut fifo = ReadFifo::<u64>::new(1);
+//! for _ in 0..100 {
+//!     let (block, _remaining) = fifo
+//!         .read_pooled(&session, &pool, 4096, Some(Duration::from_millis(100)))
+//!         .unwrap();
+//!     sender.send(block).unwrap();
+//! }
+//! drop(sender);
+//! consumer.join().unwrap();
+//! ```
+
+use crate::error::{FPGAError, NiFpgaStatus};
+use std::alloc::Layout;
+use std::fmt;
+use std::mem::ManuallyDrop;
+use std::ops::{Deref, DerefMut};
+use std::ptr::NonNull;
+use std::sync::atomic::{AtomicU64, AtomicUsize, Ordering};
+use std::sync::{Arc, Condvar, Mutex};
+use std::time::{Duration, Instant};
+
+/// Configuration for the blocks of a pool.
+#[derive(Debug, Clone)]
+pub struct PoolConfig {
+    /// The number of blocks in the pool (default: 16).
+    pub blocks: usize,
+    /// The number of elements in each block (default: 16384).
+    pub block_len: usize,
+    /// The alignment in bytes of the start of each block. Must be a power of two (default: 4096).
+    pub alignment: usize,
+    /// Lock the blocks into RAM so they are never paged out (default: false).
+    ///
+    /// This is limited by `RLIMIT_MEMLOCK` for processes without `CAP_IPC_LOCK`.
+    /// Only supported on Unix.
+    pub lock_pages: bool,
+}
+
+impl Default for PoolConfig {
+    fn default() -> Self {
+        Self {
+            blocks: 16,
+            block_len: 16_384,
+            alignment: 4096,
+            lock_pages: false,
+        }
+    }
+}
+
+/// The counters of a pool.
+#[derive(Debug, Default, Clone, Copy, PartialEq, Eq)]
+pub struct PoolStatistics {
+    /// Blocks handed out by the pool.
+    pub acquired: u64,
+    /// Acquires which found every block in use, whether or not one was freed in time.
+    pub exhausted: u64,
+}
+
+/// One allocation holding every block, each starting on the alignment.
+struct Slab<T> {
+    ptr: NonNull<T>,
+    layout: Layout,
+    /// Elements from the start of one block to the next.
+    stride: usize,
+    locked: bool,
+}
+
+impl<T: Copy + Default> Slab<T> {
+    fn new(config: &PoolConfig) -> Result<Self, FPGAError> {
+        assert!(
+            config.blocks > 0 && config.block_len > 0,
+            "A pool needs at least one block of at least one element"
+        );
+        assert!(
+            std::mem::size_of::<T>() > 0,
+            "Zero sized types can't be pooled"
+        );
+        let alignment = config.alignment.max(std::mem::align_of::<T>());
+        let block_bytes = (config.block_len * std::mem::size_of::<T>()).next_multiple_of(alignment);
+        let layout = Layout::from_size_align(block_bytes * config.blocks, alignment)
+            .expect("The alignment must be a power of two and the pool must fit in memory");
+
+        let ptr = unsafe { std::alloc::alloc(layout) } as *mut T;
+        let Some(ptr) = NonNull::new(ptr) else {
+            std::alloc::handle_alloc_error(layout);
+        };
+        let mut slab = Self {
+            ptr,
+            layout,
+            stride: block_bytes / std::mem::size_of::<T>(),
+            locked: false,
+        };
+        let elements = layout.size() / std::mem::size_of::<T>();
+        for element in 0..elements {
+            // Safety: the element is inside the allocation and the alignment is at least that of T.
+            unsafe { slab.ptr.as_ptr().add(element).write(T::default()) };
+        }
+        if config.lock_pages {
+            lock_memory(slab.ptr.as_ptr() as *const u8, layout.size())?;
+            slab.locked = true;
+        }
+        Ok(slab)
+    }
+}
+
+impl<T> Slab<T> {
+    fn block_ptr(&self, index: usize) -> *mut T {
+        // Safety: callers only pass indexes of blocks in the slab.
+        unsafe { self.ptr.as_ptr().add(index * self.stride) }
+    }
+}
+
+impl<T> Drop for Slab<T> {
+    fn drop(&mut self) {
+        if self.locked {
+            // Cant do anything useful if this fails so ignore it.
+            let _ = unlock_memory(self.ptr.as_ptr() as *const u8, self.layout.size());
+        }
+        // The elements are Copy so there is nothing to drop.
+        unsafe { std::alloc::dealloc(self.ptr.as_ptr() as *mut u8, self.layout) };
+    }
+}
+
+#[cfg(unix)]
+fn lock_memory(ptr: *const u8, bytes: usize) -> std::io::Result<()> {
+    if unsafe { libc::mlock(ptr as *const libc::c_void, bytes) } != 0 {
+        return Err(std::io::Error::last_os_error());
+    }
+    Ok(())
+}
+
+#[cfg(unix)]
+fn unlock_memory(ptr: *const u8, bytes: usize) -> std::io::Result<()> {
+    if unsafe { libc::munlock(ptr as *const libc::c_void, bytes) } != 0 {
+        return Err(std::io::Error::last_os_error());
+    }
+    Ok(())
+}
+
+#[cfg(not(unix))]
+fn lock_memory(_ptr: *const u8, _bytes: usize) -> std::io::Result<()> {
+    Err(std::io::Error::new(
+        std::io::ErrorKind::Unsupported,
+        "Locking pool memory is only supported on Unix",
+    ))
+}
+
+#[cfg(not(unix))]
+fn unlock_memory(_ptr: *const u8, _bytes: usize) -> std::io::Result<()> {
+    Ok(())
+}
+
+struct PoolShared<T> {
+    slab: Slab<T>,
+    block_len: usize,
+    /// The indexes of the free blocks. Never grows past the block count so never reallocates.
+    free: Mutex<Vec<usize>>,
+    released: Condvar,
+    /// The number of [`SharedBuffer`] handles to each block.
+    shares: Box<[AtomicUsize]>,
+    acquired: AtomicU64,
+    exhausted: AtomicU64,
+}
+
+// Safety: each block is only accessed through the handles to it, which
+// enforce unique access for writes, and the free list is behind a lock.
+unsafe impl<T: Send> Send for PoolShared<T> {}
+unsafe impl<T: Send + Sync> Sync for PoolShared<T> {}
+
+impl<T> PoolShared<T> {
+    fn release(&self, index: usize) {
+        self.free.lock().unwrap().push(index);
+        self.released.notify_one();
+    }
+}
+
+/// A fixed set of preallocated blocks which are recycled as their buffers are dropped.
+///
+/// Clones share the same blocks. See the [module documentation](self) for an example.
+pub struct BufferPool<T> {
+    shared: Arc<PoolShared<T>>,
+}
+
+impl<T> Clone for BufferPool<T> {
+    fn clone(&self) -> Self {
+        Self {
+            shared: self.shared.clone(),
+        }
+    }
+}
+
+impl<T: Copy + Default> BufferPool<T> {
+    /// Allocates every block, initialised to the default value, and locks them if configured.
+    ///
+    /// # Panics
+    ///
+    /// If there are no blocks, the blocks are empty or the alignment isn't a power of two.
+    pub fn new(config: PoolConfig) -> Result<Self, FPGAError> {
+        let slab = Slab::new(&config)?;
+        // Popped from the end so the blocks are first used in order.
+        let free = (0..config.blocks).rev().collect();
+        Ok(Self {
+            shared: Arc::new(PoolShared {
+                slab,
+                block_len: config.block_len,
+                free: Mutex::new(free),
+                released: Condvar::new(),
+                shares: (0..config.blocks).map(|_| AtomicUsize::new(0)).collect(),
+                acquired: AtomicU64::new(0),
+                exhausted: AtomicU64::new(0),
+            }),
+        })
+    }
+}
+
+impl<T> BufferPool<T> {
+    /// The number of elements in each block.
+    pub fn block_len(&self) -> usize {
+        self.shared.block_len
+    }
+
+    /// The number of blocks in the pool.
+    pub fn blocks(&self) -> usize {
+        self.shared.shares.len()
+    }
+
+    /// The number of blocks not currently in use.
+    pub fn available(&self) -> usize {
+        self.shared.free.lock().unwrap().len()
+    }
+
+    /// A snapshot of the pool counters.
+    pub fn statistics(&self) -> PoolStatistics {
+        PoolStatistics {
+            acquired: self.shared.acquired.load(Ordering::Relaxed),
+            exhausted: self.shared.exhausted.load(Ordering::Relaxed),
+        }
+    }
+
+    /// Takes a free block without waiting, returning [`None`] if every block is in use.
+    pub fn try_acquire(&self) -> Option<PooledBuffer<T>> {
+        self.acquire(Some(Duration::ZERO))
+    }
+
+    /// Takes a free block, waiting for one to be released if every block is in use.
+    ///
+    /// The timeout can be [`None`] to wait forever. Returns [`None`] on timeout.
+    /// The buffer starts with the full block length and the block contents from its previous use.
+    pub fn acquire(&self, timeout: Option<Duration>) -> Option<PooledBuffer<T>> {
+        let mut free = self.shared.free.lock().unwrap();
+        if free.is_empty() {
+            self.shared.exhausted.fetch_add(1, Ordering::Relaxed);
+            let deadline = timeout.map(|timeout| Instant::now() + timeout);
+            while free.is_empty() {
+                free = match deadline {
+                    None => self.shared.released.wait(free).unwrap(),
+                    Some(deadline) => {
+                        let now = Instant::now();
+                        if now >= deadline {
+                            return None;
+                        }
+                        self.shared
+                            .released
+                            .wait_timeout(free, deadline - now)
+                            .unwrap()
+                            .0
+                    }
+                };
+            }
+        }
+        let index = free.pop().expect("Waited for a free block");
+        drop(free);
+
+        self.shared.acquired.fetch_add(1, Ordering::Relaxed);
+        Some(PooledBuffer {
+            shared: self.shared.clone(),
+            index,
+            len: self.shared.block_len,
+        })
+    }
+
+    /// Takes a free block like [`BufferPool::acquire`] but fails with the FIFO timeout status.
+    ///
+    /// This lets polling loops handle a full pool like a FIFO read which timed out.
+    pub(crate) fn acquire_or_timeout(
+        &self,
+        timeout: Option<Duration>,
+    ) -> Result<PooledBuffer<T>, FPGAError> {
+        self.acquire(timeout)
+            .ok_or(FPGAError::InternalError(NiFpgaStatus::FIFO_TIMEOUT))
+    }
+}
+
+/// A block from a [`BufferPool`] with unique access to its contents.
+///
+/// This dereferences to the first [`PooledBuffer::len`] elements of the block.
+/// The block returns to the pool when this is dropped.
+pub struct PooledBuffer<T> {
+    shared: Arc<PoolShared<T>>,
+    index: usize,
+    len: usize,
+}
+
+impl<T> PooledBuffer<T> {
+    /// The number of elements the block can hold.
+    pub fn capacity(&self) -> usize {
+        self.shared.block_len
+    }
+
+    /// Sets the number of elements in use, keeping the block contents.
+    ///
+    /// # Panics
+    ///
+    /// If the length is more than the capacity.
+    pub fn set_len(&mut self, len: usize) {
+        assert!(
+            len <= self.capacity(),
+            "Length {len} is more than the block capacity {}",
+            self.capacity()
+        );
+        self.len = len;
+    }
+
+    /// Converts to a read only buffer which can be cloned to share the block between threads.
+    ///
+    /// The block returns to the pool when every clone is dropped.
+    pub fn share(self) -> SharedBuffer<T> {
+        let buffer = ManuallyDrop::new(self);
+        buffer.shared.shares[buffer.index].store(1, Ordering::Relaxed);
+        SharedBuffer {
+            // Safety: the buffer is never used or dropped again so the Arc is moved, not duplicated.
+            shared: unsafe { std::ptr::read(&buffer.shared) },
+            index: buffer.index,
+            len: buffer.len,
+        }
+    }
+}
+
+impl<T> Deref for PooledBuffer<T> {
+    type Target = [T];
+
+    fn deref(&self) -> &[T] {
+        // Safety: this handle has unique access to the block, which holds at least len elements.
+        unsafe { std::slice::from_raw_parts(self.shared.slab.block_ptr(self.index), self.len) }
+    }
+}
+
+impl<T> DerefMut for PooledBuffer<T> {
+    fn deref_mut(&mut self) -> &mut [T] {
+        // Safety: as for deref, and the handle is borrowed mutably.
+        unsafe { std::slice::from_raw_parts_mut(self.shared.slab.block_ptr(self.index), self.len) }
+    }
+}
+
+impl<T> fmt::Debug for PooledBuffer<T> {
+    fn fmt(&self, f: &mut fmt::Formatter<'_>) -> fmt::Result {
+        f.debug_struct("PooledBuffer")
+            .field("block", &self.index)
+            .field("len", &self.len)
+            .finish()
+    }
+}
+
+impl<T> Drop for PooledBuffer<T> {
+    fn drop(&mut self) {
+        self.shared.release(self.index);
+    }
+}
+
+/// A read only block from a [`BufferPool`] which can be cloned cheaply.
+///
+/// Created by [`PooledBuffer::share`]. Cloning counts the handles rather than
+/// copying or allocating. The block returns to the pool when the last clone is dropped.
+pub struct SharedBuffer<T> {
+    shared: Arc<PoolShared<T>>,
+    index: usize,
+    len: usize,
+}
+
+impl<T> Clone for SharedBuffer<T> {
+    fn clone(&self) -> Self {
+        self.shared.shares[self.index].fetch_add(1, Ordering::Relaxed);
+        Self {
+            shared: self.shared.clone(),
+            index: self.index,
+            len: self.len,
+        }
+    }
+}
+
+impl<T> Deref for SharedBuffer<T> {
+    type Target = [T];
+
+    fn deref(&self) -> &[T] {
+        // Safety: no handle to the block can write to it while shared handles exist.
+        unsafe { std::slice::from_raw_parts(self.shared.slab.block_ptr(self.index), self.len) }
+    }
+}
+
+impl<T> fmt::Debug for SharedBuffer<T> {
+    fn fmt(&self, f: &mut fmt::Formatter<'_>) -> fmt::Result {
+        f.debug_struct("SharedBuffer")
+            .field("block", &self.index)
+            .field("len", &self.len)
+            .finish()
+    }
+}
+
+impl<T> Drop for SharedBuffer<T> {
+    fn drop(&mut self) {
+        // Release ordering publishes our reads before the block can be reused, as in Arc.
+        if self.shared.shares[self.index].fetch_sub(1, Ordering::AcqRel) == 1 {
+            self.shared.release(self.index);
+        }
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    fn pool(blocks: usize, block_len: usize) -> BufferPool<u32> {
+        BufferPool::new(PoolConfig {
+            blocks,
+            block_len,
+            ..Default::default()
+        })
+        .unwrap()
+    }
+
+    #[test]
+    fn test_blocks_are_aligned_and_separate() {
+        let pool = pool(3, 10);
+        let mut buffers: Vec<_> = (0..3).map(|_| pool.try_acquire().unwrap()).collect();
+        for (value, buffer) in buffers.iter_mut().enumerate() {
+            assert_eq!(buffer.as_ptr() as usize % 4096, 0);
+            assert_eq!(buffer.len(), 10);
+            buffer.fill(value as u32);
+        }
+        for (value, buffer) in buffers.iter().enumerate() {
+            assert!(buffer.iter().all(|&element| element == value as u32));
+        }
+    }
+
+    #[test]
+    fn test_dropped_buffers_are_reused() {
+        let pool = pool(2, 4);
+        let first = pool.try_acquire().unwrap();
+        let first_ptr = first.as_ptr();
+        let _second = pool.try_acquire().unwrap();
+        assert!(pool.try_acquire().is_none());
+        assert_eq!(pool.available(), 0);
+
+        drop(first);
+        assert_eq!(pool.try_acquire().unwrap().as_ptr(), first_ptr);
+        assert_eq!(
+            pool.statistics(),
+            PoolStatistics {
+                acquired: 3,
+                exhausted: 1
+            }
+        );
+    }
+
+    #[test]
+    fn test_acquire_waits_for_release_from_another_thread() {
+        let pool = pool(1, 4);
+        let buffer = pool.try_acquire().unwrap();
+        let releaser = std::thread::spawn(move || {
+            std::thread::sleep(Duration::from_millis(20));
+            drop(buffer);
+        });
+        assert!(pool.acquire(Some(Duration::from_secs(5))).is_some());
+        releaser.join().unwrap();
+
+        let _held = pool.try_acquire().unwrap();
+        assert!(pool.acquire(Some(Duration::from_millis(10))).is_none());
+        assert!(pool
+            .acquire_or_timeout(Some(Duration::ZERO))
+            .unwrap_err()
+            .is_fifo_timeout());
+    }
+
+    #[test]
+    fn test_shared_buffer_returns_after_last_clone() {
+        let pool = pool(1, 4);
+        let mut buffer = pool.try_acquire().unwrap();
+        buffer.copy_from_slice(&[1, 2, 3, 4]);
+        buffer.set_len(2);
+
+        let shared = buffer.share();
+        let clone = shared.clone();
+        let reader = std::thread::spawn(move || clone.iter().sum::<u32>());
+        assert_eq!(reader.join().unwrap(), 3);
+        assert_eq!(pool.available(), 0);
+
+        drop(shared);
+        assert_eq!(pool.available(), 1);
+    }
+
+    #[test]
+    fn test_read_pooled_fills_block_and_times_out_when_exhausted() {
+        use crate::fifos::ReadFifo;
+        use crate::sim::{SimFifoConfig, SimSession};
+
+        let mut fifo = ReadFifo::<u32>::new(1);
+        let session =
+            SimSession::new().with_read_fifo(&fifo, (0..100).collect(), SimFifoConfig::default());
+        let pool = pool(1, 64);
+
+        let (block, remaining) = fifo.read_pooled(&session, &pool, 10, None).unwrap();
+        assert_eq!(*block, (0..10).collect::<Vec<_>>());
+        assert_eq!(remaining, 90);
+
+        let error = fifo
+            .read_pooled(&session, &pool, 10, Some(Duration::ZERO))
+            .unwrap_err();
+        assert!(error.is_fifo_timeout());
+        drop(block);
+        let (block, _) = fifo.read_pooled(&session, &pool, 10, None).unwrap();
+        assert_eq!(block[0], 10);
+    }
+
+    #[test]
+    #[should_panic(expected = "more than the block capacity")]
+    fn test_set_len_past_capacity_panics() {
+        pool(1, 4).try_acquire().unwrap().set_len(5);
+    }
+
+    #[cfg(unix)]
+    #[test]
+    fn test_locked_pool() {
+        // Small enough for the default memlock limit.
+        let pool = BufferPool::<u8>::new(PoolConfig {
+            blocks: 2,
+            block_len: 4096,
+            lock_pages: true,
+            ..Default::default()
+        })
+        .unwrap();
+        assert_eq!(pool.try_acquire().unwrap().len(), 4096);
+    }
+}
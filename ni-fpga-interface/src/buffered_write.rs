@@ -0,0 +1,302 @@
+//! Coalesces small writes to a host to target FIFO into larger transfers.
+//!
+//! Every [`WriteFifo::write`] is a driver call. When data is produced a few
+//! elements at a time the call overhead dominates. A [`BufferedWriteFifo`]
+//! stages the elements and writes them in one call once enough have built up,
+//! the oldest has waited long enough, or [`BufferedWriteFifo::flush`] is called.
+//!
+//! There is no background thread so the deadline is checked on each write.
+//! Call [`BufferedWriteFifo::flush_if_due`] from idle loops to make sure data
+//! doesn't wait longer than the deadline when nothing else is written.
+//!
+//! # Example
+//!
+//! ```rust
+//! # use ni_fpga_interface::fifos::WriteFifo;
+//! # use ni_fpga_interface::session::{NiFpgaContext, Session};
+//! use ni_fpga_interface::buffered_write::{BufferedWriteFifo, WriteBatchConfig};
+//!
+//! # let context = NiFpgaContext::new().unwrap();
+//! # let session = Session::new(&context, "main.lvbitx", "sig", "RIO0", &Default::default()).unwrap();
+//! let mut commands = BufferedWriteFifo::new(WriteFifo::<u32>::new(2), WriteBatchConfig::default());
+//! for command in 0..10_000 {
+//!     commands.write(&session, &[command, 0]).unwrap();
+//! }
+//! commands.flush(&session).unwrap();
+//! println!("Mean batch: {}", commands.statistics().mean_batch_size());
+//! ```
+
+use crate::error::FPGAError;
+use crate::fifos::WriteFifo;
+use crate::session::{FifoInterface, NativeFpgaType};
+use std::time::{Duration, Instant};
+
+/// Controls when a [`BufferedWriteFifo`] writes to the driver.
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub struct WriteBatchConfig {
+    /// Writes once this many elements are staged (default: 4096).
+    pub watermark: usize,
+    /// Writes once the oldest staged element has waited this long (default: 1ms).
+    pub max_delay: Duration,
+    /// The timeout for each driver write (default: 100ms).
+    pub timeout: Option<Duration>,
+}
+
+impl Default for WriteBatchConfig {
+    fn default() -> Self {
+        Self {
+            watermark: 4096,
+            max_delay: Duration::from_millis(1),
+            timeout: Some(Duration::from_millis(100)),
+        }
+    }
+}
+
+/// The sizes of the batches written so far.
+#[derive(Debug, Clone, Copy, Default, PartialEq, Eq)]
+pub struct BatchStatistics {
+    /// The number of driver writes.
+    pub batches: u64,
+    /// The total elements written.
+    pub elements: u64,
+    /// The largest single write.
+    pub largest_batch: usize,
+    /// Writes caused by reaching the watermark, including writes larger than it.
+    pub watermark_flushes: u64,
+    /// Writes caused by the deadline.
+    pub deadline_flushes: u64,
+    /// Writes caused by calling [`BufferedWriteFifo::flush`].
+    pub explicit_flushes: u64,
+}
+
+impl BatchStatistics {
+    /// The mean number of elements per driver write.
+    pub fn mean_batch_size(&self) -> f64 {
+        if self.batches == 0 {
+            0.0
+        } else {
+            self.elements as f64 / self.batches as f64
+        }
+    }
+}
+
+#[derive(Clone, Copy)]
+enum FlushReason {
+    Watermark,
+    Deadline,
+    Explicit,
+}
+
+/// A [`WriteFifo`] which batches small writes.
+///
+/// Staged data is discarded if this is dropped so call [`BufferedWriteFifo::flush`] first.
+///
+/// See the [module documentation](self) for an example.
+pub struct BufferedWriteFifo<T: NativeFpgaType> {
+    fifo: WriteFifo<T>,
+    config: WriteBatchConfig,
+    staged: Vec<T>,
+    /// When the first element currently staged was written.
+    oldest: Option<Instant>,
+    statistics: BatchStatistics,
+}
+
+impl<T: NativeFpgaType + 'static> BufferedWriteFifo<T> {
+    pub fn new(fifo: WriteFifo<T>, config: WriteBatchConfig) -> Self {
+        Self {
+            fifo,
+            config,
+            staged: Vec::with_capacity(config.watermark),
+            oldest: None,
+            statistics: BatchStatistics::default(),
+        }
+    }
+
+    /// Stages the data, writing to the FIFO if the watermark or deadline is reached.
+    ///
+    /// If a write fails the data stays staged so it can be retried with a flush.
+    pub fn write(&mut self, session: &impl FifoInterface<T>, data: &[T]) -> Result<(), FPGAError> {
+        // Large writes skip the staging copy if there is nothing to go ahead of them.
+        if self.staged.is_empty() && data.len() >= self.config.watermark {
+            let result = self.write_batch(session, data, FlushReason::Watermark);
+            if result.is_err() {
+                self.oldest = Some(Instant::now());
+                self.staged.extend_from_slice(data);
+            }
+            return result;
+        }
+
+        if self.staged.is_empty() {
+            self.oldest = Some(Instant::now());
+        }
+        self.staged.extend_from_slice(data);
+
+        if self.staged.len() >= self.config.watermark {
+            self.flush_staged(session, FlushReason::Watermark)
+        } else if self.is_due() {
+            self.flush_staged(session, FlushReason::Deadline)
+        } else {
+            Ok(())
+        }
+    }
+
+    /// Writes any staged data now.
+    pub fn flush(&mut self, session: &impl FifoInterface<T>) -> Result<(), FPGAError> {
+        self.flush_staged(session, FlushReason::Explicit)
+    }
+
+    /// Writes the staged data if the oldest element has reached the deadline.
+    ///
+    /// Returns true if data was written.
+    pub fn flush_if_due(&mut self, session: &impl FifoInterface<T>) -> Result<bool, FPGAError> {
+        if !self.is_due() {
+            return Ok(false);
+        }
+        self.flush_staged(session, FlushReason::Deadline)?;
+        Ok(true)
+    }
+
+    /// The number of elements waiting to be written.
+    pub fn staged_len(&self) -> usize {
+        self.staged.len()
+    }
+
+    /// The batch sizes written so far.
+    pub fn statistics(&self) -> &BatchStatistics {
+        &self.statistics
+    }
+
+    /// The underlying FIFO, for example to check [`WriteFifo::last_level`] with the session.
+    pub fn fifo(&self) -> &WriteFifo<T> {
+        &self.fifo
+    }
+
+    fn is_due(&self) -> bool {
+        self.oldest
+            .map(|oldest| oldest.elapsed() >= self.config.max_delay)
+            .unwrap_or(false)
+    }
+
+    fn flush_staged(
+        &mut self,
+        session: &impl FifoInterface<T>,
+        reason: FlushReason,
+    ) -> Result<(), FPGAError> {
+        if self.staged.is_empty() {
+            return Ok(());
+        }
+        let staged = std::mem::take(&mut self.staged);
+        let result = self.write_batch(session, &staged, reason);
+        self.staged = staged;
+        if result.is_ok() {
+            self.staged.clear();
+            self.oldest = None;
+        }
+        result
+    }
+
+    fn write_batch(
+        &mut self,
+        session: &impl FifoInterface<T>,
+        data: &[T],
+        reason: FlushReason,
+    ) -> Result<(), FPGAError> {
+        self.fifo.write(session, self.config.timeout, data)?;
+
+        let statistics = &mut self.statistics;
+        statistics.batches += 1;
+        statistics.elements += data.len() as u64;
+        statistics.largest_batch = statistics.largest_batch.max(data.len());
+        match reason {
+            FlushReason::Watermark => statistics.watermark_flushes += 1,
+            FlushReason::Deadline => statistics.deadline_flushes += 1,
+            FlushReason::Explicit => statistics.explicit_flushes += 1,
+        }
+        Ok(())
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use crate::sim::{SimFifoConfig, SimSession};
+
+    const FIFO: WriteFifo<u32> = WriteFifo::new(4);
+
+    fn session() -> SimSession {
+        SimSession::new().with_write_fifo(&FIFO, SimFifoConfig::default())
+    }
+
+    fn config(watermark: usize, max_delay: Duration) -> WriteBatchConfig {
+        WriteBatchConfig {
+            watermark,
+            max_delay,
+            ..Default::default()
+        }
+    }
+
+    #[test]
+    fn test_small_writes_coalesce_at_watermark() {
+        let session = session();
+        let mut fifo = BufferedWriteFifo::new(FIFO, config(8, Duration::MAX));
+        for value in 0..20 {
+            fifo.write(&session, &[value]).unwrap();
+        }
+        assert_eq!(fifo.staged_len(), 4);
+        fifo.flush(&session).unwrap();
+
+        let statistics = fifo.statistics();
+        assert_eq!(statistics.batches, 3);
+        assert_eq!(statistics.watermark_flushes, 2);
+        assert_eq!(statistics.explicit_flushes, 1);
+        assert_eq!(statistics.elements, 20);
+        assert_eq!(statistics.largest_batch, 8);
+        assert_eq!(session.fifo_statistics(&FIFO).unwrap().transferred, 20);
+    }
+
+    #[test]
+    fn test_large_write_goes_straight_through() {
+        let session = session();
+        let mut fifo = BufferedWriteFifo::new(FIFO, config(8, Duration::MAX));
+        fifo.write(&session, &[0; 100]).unwrap();
+        assert_eq!(fifo.staged_len(), 0);
+        assert_eq!(fifo.statistics().largest_batch, 100);
+    }
+
+    #[test]
+    fn test_deadline_flush() {
+        let session = session();
+        let mut fifo = BufferedWriteFifo::new(FIFO, config(1000, Duration::ZERO));
+        assert!(!fifo.flush_if_due(&session).unwrap());
+        fifo.write(&session, &[1, 2]).unwrap();
+        assert_eq!(fifo.staged_len(), 0);
+        assert_eq!(fifo.statistics().deadline_flushes, 1);
+    }
+
+    #[test]
+    fn test_failed_write_keeps_data_staged() {
+        // Nothing drains this FIFO so it fills up.
+        let session = SimSession::new().with_write_fifo(
+            &FIFO,
+            SimFifoConfig {
+                depth: 4,
+                elements_per_second: 0.0,
+                ..Default::default()
+            },
+        );
+        let mut fifo = BufferedWriteFifo::new(
+            FIFO,
+            WriteBatchConfig {
+                watermark: 3,
+                max_delay: Duration::MAX,
+                timeout: Some(Duration::ZERO),
+            },
+        );
+        fifo.write(&session, &[1, 2, 3]).unwrap();
+        assert!(fifo.write(&session, &[4, 5, 6]).is_err());
+        assert_eq!(fifo.staged_len(), 3);
+        assert!(fifo.flush(&session).is_err());
+        assert_eq!(fifo.staged_len(), 3);
+        assert_eq!(fifo.statistics().batches, 1);
+    }
+}
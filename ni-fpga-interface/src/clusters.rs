@@ -0,0 +1,458 @@
+//! Support for DMA FIFOs of clusters.
+//!
+//! The FPGA transfers clusters as a packed, big endian bit stream
+//! where each element of the cluster takes only the bits it needs.
+//! For example a boolean takes a single bit.
+//!
+//! Use [`packed_cluster!`](crate::packed_cluster) to declare a rust struct
+//! matching the cluster and generate the pack and unpack code for it.
+//! [`ClusterReadFifo`] and [`ClusterWriteFifo`] then transfer slices of
+//! that struct, decoding a whole read in a single pass over the data
+//! written by the driver without any intermediate buffers.
+//!
+//! # Example
+//!
+//! ```rust
+//! use ni_fpga_interface::clusters::{ClusterReadFifo, FpgaBool};
+//! use ni_fpga_interface::packed_cluster;
+//! # use ni_fpga_interface::session::{NiFpgaContext, Session};
+//!
+//! packed_cluster! {
+//!     /// Matches the cluster used by the FPGA FIFO.
+//!     #[derive(Debug, Default)]
+//!     pub struct Sample {
+//!         pub timestamp: u64,
+//!         pub value: i32,
+//!         pub valid: FpgaBool,
+//!     }
+//! }
+//!
+//! # let context = NiFpgaContext::new().unwrap();
+//! # let session = Session::new(&context, "main.lvbitx", "sig", "RIO0", &Default::default()).unwrap();
+//! let mut fifo = ClusterReadFifo::<Sample>::new(1);
+//! let mut samples = [Sample::default(); 1000];
+//! let remaining = fifo.read(&session, None, &mut samples).unwrap();
+//! ```
+
+use crate::error::FPGAError;
+use crate::fifos::Fifo;
+use crate::nifpga_sys::FifoAddress;
+use crate::session::Session;
+use libc::c_void;
+use std::marker::PhantomData;
+use std::time::Duration;
+
+// Re-export the bool type from here for use in cluster definitions.
+pub use crate::types::FpgaBool;
+
+/// Reads values from a packed big endian bit stream.
+pub struct BitReader<'a> {
+    data: &'a [u8],
+    position: usize,
+}
+
+impl<'a> BitReader<'a> {
+    pub fn new(data: &'a [u8]) -> Self {
+        Self { data, position: 0 }
+    }
+
+    /// Reads the next `bits` bits (up to 64) as an unsigned value.
+    pub fn read_bits(&mut self, bits: u32) -> u64 {
+        debug_assert!(bits <= 64);
+        let mut value = 0u64;
+        let mut remaining = bits;
+        while remaining > 0 {
+            let byte = self.data[self.position / 8];
+            let available = 8 - (self.position % 8) as u32;
+            let take = available.min(remaining);
+            let chunk = (byte >> (available - take)) as u64 & low_mask(take);
+            value = (value << take) | chunk;
+            remaining -= take;
+            self.position += take as usize;
+        }
+        value
+    }
+}
+
+/// Writes values to a packed big endian bit stream.
+pub struct BitWriter<'a> {
+    data: &'a mut [u8],
+    position: usize,
+}
+
+impl<'a> BitWriter<'a> {
+    pub fn new(data: &'a mut [u8]) -> Self {
+        Self { data, position: 0 }
+    }
+
+    /// Writes the low `bits` bits (up to 64) of the value.
+    pub fn write_bits(&mut self, value: u64, bits: u32) {
+        debug_assert!(bits <= 64);
+        let mut remaining = bits;
+        while remaining > 0 {
+            let index = self.position / 8;
+            let available = 8 - (self.position % 8) as u32;
+            let take = available.min(remaining);
+            let chunk = (value >> (remaining - take)) & low_mask(take);
+            let shift = available - take;
+            let mask = (low_mask(take) << shift) as u8;
+            self.data[index] = (self.data[index] & !mask) | ((chunk << shift) as u8);
+            remaining -= take;
+            self.position += take as usize;
+        }
+    }
+}
+
+const fn low_mask(bits: u32) -> u64 {
+    if bits >= 64 {
+        u64::MAX
+    } else {
+        (1u64 << bits) - 1
+    }
+}
+
+/// A type that can be transferred as part of a packed cluster.
+///
+/// Normally implemented with [`packed_cluster!`](crate::packed_cluster).
+///
+/// # Safety
+///
+/// FIFO reads are decoded in place so the implementer must guarantee:
+///
+/// * `size_of::<Self>()` is at least [`PackedCluster::PACKED_SIZE`].
+/// * Any bit pattern is a valid value of the type.
+pub unsafe trait PackedCluster: Copy {
+    /// The number of bits this takes in the packed stream.
+    const PACKED_BITS: usize;
+    /// The number of bytes for a FIFO element of this type.
+    const PACKED_SIZE: usize = (Self::PACKED_BITS + 7) / 8;
+
+    fn unpack(reader: &mut BitReader) -> Self;
+    fn pack(&self, writer: &mut BitWriter);
+}
+
+/// First entry is the rust type, second is the unsigned type of the same width.
+macro_rules! impl_packed_integer {
+    ($rust_type:ty, $unsigned:ty) => {
+        unsafe impl PackedCluster for $rust_type {
+            const PACKED_BITS: usize = <$rust_type>::BITS as usize;
+
+            fn unpack(reader: &mut BitReader) -> Self {
+                reader.read_bits(Self::PACKED_BITS as u32) as $unsigned as $rust_type
+            }
+
+            fn pack(&self, writer: &mut BitWriter) {
+                writer.write_bits(*self as $unsigned as u64, Self::PACKED_BITS as u32);
+            }
+        }
+    };
+}
+
+impl_packed_integer!(u8, u8);
+impl_packed_integer!(u16, u16);
+impl_packed_integer!(u32, u32);
+impl_packed_integer!(u64, u64);
+impl_packed_integer!(i8, u8);
+impl_packed_integer!(i16, u16);
+impl_packed_integer!(i32, u32);
+impl_packed_integer!(i64, u64);
+
+unsafe impl PackedCluster for f32 {
+    const PACKED_BITS: usize = 32;
+
+    fn unpack(reader: &mut BitReader) -> Self {
+        f32::from_bits(reader.read_bits(32) as u32)
+    }
+
+    fn pack(&self, writer: &mut BitWriter) {
+        writer.write_bits(self.to_bits() as u64, 32);
+    }
+}
+
+unsafe impl PackedCluster for f64 {
+    const PACKED_BITS: usize = 64;
+
+    fn unpack(reader: &mut BitReader) -> Self {
+        f64::from_bits(reader.read_bits(64))
+    }
+
+    fn pack(&self, writer: &mut BitWriter) {
+        writer.write_bits(self.to_bits(), 64);
+    }
+}
+
+unsafe impl PackedCluster for FpgaBool {
+    const PACKED_BITS: usize = 1;
+
+    fn unpack(reader: &mut BitReader) -> Self {
+        (reader.read_bits(1) != 0).into()
+    }
+
+    fn pack(&self, writer: &mut BitWriter) {
+        writer.write_bits(bool::from(*self) as u64, 1);
+    }
+}
+
+/// Declares a struct matching an FPGA cluster and implements [`PackedCluster`] for it.
+///
+/// Fields must be listed in the cluster order and be types that implement
+/// [`PackedCluster`], including other clusters.
+///
+/// Clone and Copy are always derived, other attributes are passed through.
+#[macro_export]
+macro_rules! packed_cluster {
+    (
+        $(#[$meta:meta])*
+        $vis:vis struct $name:ident {
+            $($field_vis:vis $field:ident : $field_type:ty),* $(,)?
+        }
+    ) => {
+        $(#[$meta])*
+        #[derive(Clone, Copy)]
+        #[repr(C)]
+        $vis struct $name {
+            $($field_vis $field: $field_type),*
+        }
+
+        // Safety: the struct is at least as large as its fields and every field
+        // accepts any bit pattern so the struct does too.
+        unsafe impl $crate::clusters::PackedCluster for $name {
+            const PACKED_BITS: usize =
+                0 $(+ <$field_type as $crate::clusters::PackedCluster>::PACKED_BITS)*;
+
+            fn unpack(reader: &mut $crate::clusters::BitReader) -> Self {
+                Self {
+                    $($field: <$field_type as $crate::clusters::PackedCluster>::unpack(reader)),*
+                }
+            }
+
+            fn pack(&self, writer: &mut $crate::clusters::BitWriter) {
+                $(<$field_type as $crate::clusters::PackedCluster>::pack(&self.$field, writer);)*
+            }
+        }
+    };
+}
+
+/// Decodes packed elements into the output slice.
+///
+/// The packed data must hold at least `output.len()` elements.
+pub fn unpack_slice<T: PackedCluster>(packed: &[u8], output: &mut [T]) {
+    for (element, bytes) in output.iter_mut().zip(packed.chunks_exact(T::PACKED_SIZE)) {
+        *element = T::unpack(&mut BitReader::new(bytes));
+    }
+}
+
+/// Encodes the elements into the packed buffer.
+///
+/// The packed buffer must hold at least `data.len()` elements.
+pub fn pack_slice<T: PackedCluster>(data: &[T], packed: &mut [u8]) {
+    for (element, bytes) in data.iter().zip(packed.chunks_exact_mut(T::PACKED_SIZE)) {
+        element.pack(&mut BitWriter::new(bytes));
+    }
+}
+
+/// Decodes packed elements held at the start of the element memory.
+///
+/// Working from the last element backwards, each packed element is
+/// read before its slot is written and the slot never reaches the packed
+/// data of an earlier element as the packed size is no larger than the type.
+///
+/// # Safety
+///
+/// `elements` must point to `count` elements whose memory begins with `count` packed elements.
+unsafe fn unpack_in_place<T: PackedCluster>(elements: *mut T, count: usize) {
+    let bytes = elements as *const u8;
+    for index in (0..count).rev() {
+        let packed = std::slice::from_raw_parts(bytes.add(index * T::PACKED_SIZE), T::PACKED_SIZE);
+        let value = T::unpack(&mut BitReader::new(packed));
+        std::ptr::write(elements.add(index), value);
+    }
+}
+
+/// A FIFO of clusters that can be read from.
+pub struct ClusterReadFifo<T: PackedCluster> {
+    address: FifoAddress,
+    phantom: PhantomData<T>,
+}
+
+impl<T: PackedCluster> ClusterReadFifo<T> {
+    pub const fn new(address: FifoAddress) -> Self {
+        Self {
+            address,
+            phantom: PhantomData,
+        }
+    }
+
+    /// Read from the FIFO into the provided buffer.
+    /// The size of the read is determined by the size of the data slice.
+    ///
+    /// The packed data is read directly into the buffer and then decoded in place.
+    ///
+    /// Returns the number of elements still to be read.
+    pub fn read(
+        &mut self,
+        session: &Session,
+        timeout: Option<Duration>,
+        data: &mut [T],
+    ) -> Result<usize, FPGAError> {
+        // Safety: the trait guarantees the packed elements fit within the buffer
+        // and that the buffer stays valid whatever the driver writes into it.
+        unsafe {
+            let remaining = session.read_fifo_composite(
+                self.address,
+                data.as_mut_ptr() as *mut c_void,
+                T::PACKED_SIZE as u32,
+                data.len(),
+                timeout,
+            )?;
+            unpack_in_place(data.as_mut_ptr(), data.len());
+            Ok(remaining)
+        }
+    }
+}
+
+impl<T: PackedCluster> Fifo for ClusterReadFifo<T> {
+    fn address(&self) -> FifoAddress {
+        self.address
+    }
+}
+
+/// A FIFO of clusters that can be written to.
+pub struct ClusterWriteFifo<T: PackedCluster> {
+    address: FifoAddress,
+    phantom: PhantomData<T>,
+}
+
+impl<T: PackedCluster> ClusterWriteFifo<T> {
+    pub const fn new(address: FifoAddress) -> Self {
+        Self {
+            address,
+            phantom: PhantomData,
+        }
+    }
+
+    /// Write the data to the FIFO.
+    ///
+    /// The data is packed into `buffer` first. Reuse the same buffer between
+    /// calls to avoid allocating.
+    ///
+    /// Returns the number of elements free in the FIFO.
+    pub fn write(
+        &mut self,
+        session: &Session,
+        timeout: Option<Duration>,
+        data: &[T],
+        buffer: &mut Vec<u8>,
+    ) -> Result<usize, FPGAError> {
+        buffer.resize(data.len() * T::PACKED_SIZE, 0);
+        pack_slice(data, buffer);
+        session.write_fifo_composite(self.address, buffer, T::PACKED_SIZE as u32, timeout)
+    }
+}
+
+impl<T: PackedCluster> Fifo for ClusterWriteFifo<T> {
+    fn address(&self) -> FifoAddress {
+        self.address
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    crate::packed_cluster! {
+        #[derive(Debug, Default, PartialEq)]
+        struct Point {
+            x: i16,
+            y: i16,
+        }
+    }
+
+    crate::packed_cluster! {
+        #[derive(Debug, Default, PartialEq)]
+        struct Flagged {
+            enabled: FpgaBool,
+            fault: FpgaBool,
+            point: Point,
+            time: u64,
+        }
+    }
+
+    #[test]
+    fn test_packs_like_the_c_api() {
+        let point = Point { x: 0x1234, y: -2 };
+        let mut packed = [0u8; 4];
+        point.pack(&mut BitWriter::new(&mut packed));
+        assert_eq!(packed, [0x12, 0x34, 0xFF, 0xFE]);
+        assert_eq!(Point::unpack(&mut BitReader::new(&packed)), point);
+    }
+
+    #[test]
+    fn test_booleans_take_a_single_bit() {
+        assert_eq!(Flagged::PACKED_BITS, 2 + 32 + 64);
+        assert_eq!(Flagged::PACKED_SIZE, 13);
+
+        let value = Flagged {
+            enabled: FpgaBool::TRUE,
+            fault: FpgaBool::FALSE,
+            point: Point { x: -1, y: 7 },
+            time: 0x0123_4567_89AB_CDEF,
+        };
+        let mut packed = [0u8; 13];
+        value.pack(&mut BitWriter::new(&mut packed));
+        assert_eq!(packed[0] >> 6, 0b10);
+        assert_eq!(Flagged::unpack(&mut BitReader::new(&packed)), value);
+    }
+
+    #[test]
+    fn test_unaligned_reads_and_writes() {
+        let mut packed = [0u8; 3];
+        let mut writer = BitWriter::new(&mut packed);
+        writer.write_bits(0b101, 3);
+        writer.write_bits(0x1FFF, 13);
+        writer.write_bits(0x5A, 8);
+        assert_eq!(packed, [0b1011_1111, 0xFF, 0x5A]);
+
+        let mut reader = BitReader::new(&packed);
+        assert_eq!(reader.read_bits(3), 0b101);
+        assert_eq!(reader.read_bits(13), 0x1FFF);
+        assert_eq!(reader.read_bits(8), 0x5A);
+    }
+
+    #[test]
+    fn test_slices_round_trip() {
+        let data: Vec<Point> = (0..10).map(|i| Point { x: i, y: -i }).collect();
+        let mut packed = vec![0u8; data.len() * Point::PACKED_SIZE];
+        pack_slice(&data, &mut packed);
+
+        let mut output = vec![Point::default(); data.len()];
+        unpack_slice(&packed, &mut output);
+        assert_eq!(output, data);
+    }
+
+    #[test]
+    fn test_unpack_in_place() {
+        let data: Vec<Flagged> = (0..50)
+            .map(|i| Flagged {
+                enabled: (i % 2 == 0).into(),
+                fault: (i % 3 == 0).into(),
+                point: Point { x: i, y: i * 2 },
+                time: i as u64 * 1000,
+            })
+            .collect();
+        let mut packed = vec![0u8; data.len() * Flagged::PACKED_SIZE];
+        pack_slice(&data, &mut packed);
+
+        // Simulate the driver writing the packed data into the output buffer.
+        let mut output = vec![Flagged::default(); data.len()];
+        unsafe {
+            std::ptr::copy_nonoverlapping(
+                packed.as_ptr(),
+                output.as_mut_ptr() as *mut u8,
+                packed.len(),
+            );
+            unpack_in_place(output.as_mut_ptr(), output.len());
+        }
+        assert_eq!(output, data);
+    }
+}
@@ -0,0 +1,468 @@
+//! Runs a control loop on a dedicated thread woken by the FPGA.
+//!
+//! Each cycle of a [`ControlLoop`] waits for the FPGA, reads the indicators of
+//! a [`RegisterBatch`] into your state, calls your step function, writes the
+//! controls back and acknowledges the IRQ. The thread can be pinned to a core
+//! and given a `SCHED_FIFO` priority before the loop starts.
+//!
+//! Every cycle is timed. The cycle time is the time between wakes and the
+//! wake latency is how much later than [`ControlLoopConfig::period`] after the
+//! previous wake the loop woke. A cycle overruns when the time from waking to
+//! acknowledging is longer than [`ControlLoopConfig::deadline`]. The counts are
+//! available while running from [`ControlLoop::statistics`] and the histograms
+//! are returned by [`ControlLoop::stop`].
+//!
+//! For loops faster than the IRQ latency allows, roughly under 10 µs,
+//! [`WakeSource::Poll`] busy-polls a register the FPGA changes every cycle
+//! instead. This keeps the core fully busy.
+//!
+//! # Example
+//!
+//! ```rust
+//! # mod fpga_defs { pub mod registers {
+//! #     use ni_fpga_interface::registers::Register;
+//! #     pub const Temperature: Register<f32> = Register::new(0x18000);
+//! #     pub const Heater: Register<f32> = Register::new(0x18004);
+//! # } }
+//! # use ni_fpga_interface::session::{NiFpgaContext, Session};
+//! use ni_fpga_interface::control_loop::{ControlLoop, ControlLoopConfig};
+//! use ni_fpga_interface::registers::RegisterBatch;
+//! use std::ops::ControlFlow;
+//! use std::sync::Arc;
+//! use std::time::Duration;
+//!
+//! #[derive(Default)]
+//! struct Io {
+//!     temperature: f32,
+//!     heater: f32,
+//! }
+//!
+//! # let context = NiFpgaContext::new().unwrap();
+//! let session = Arc::new(
+//!     Session::new(&context, "main.lvbitx", "sig", "RIO0", &Default::default()).unwrap(),
+//! );
+//! let batch = RegisterBatch::<Io>::new()
+//!     .read(&fpga_defs::registers::Temperature, |io| &mut io.temperature)
+//!     .write(&fpga_defs::registers::Heater, |io| io.heater);
+//! let config = ControlLoopConfig {
+//!     period: Duration::from_micros(100),
+//!     deadline: Duration::from_micros(50),
+//!     core: Some(1),
+//!     priority: Some(80),
+//!     ..Default::default()
+//! };
+//!
+//! let control = ControlLoop::start(session, batch, Io::default(), config, |io, _cycle| {
+//!     io.heater = (50.0 - io.temperature) * 0.1;
+//!     ControlFlow::Continue(())
+//! });
+//!
+//! println!("{:?}", control.statistics());
+//! let timings = control.stop().unwrap();
+//! println!("p99 cycle time {:?}", timings.cycle_time.percentile(0.99));
+//! ```
+
+use crate::error::FPGAError;
+use crate::instrumentation::LatencyHistogram;
+use crate::irq::{IrqSelection, IrqWaitResult, IRQ0};
+use crate::realtime::{pin_current_thread, set_fifo_priority};
+use crate::registers::RegisterBatch;
+use crate::session::{RegisterAddress, RegisterInterface, Session};
+use std::ops::ControlFlow;
+use std::sync::atomic::{AtomicBool, AtomicU64, Ordering};
+use std::sync::Arc;
+use std::thread::JoinHandle;
+use std::time::{Duration, Instant};
+
+/// What starts each cycle of the loop.
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub enum WakeSource {
+    /// Wait on the IRQs and acknowledge the asserted ones once the controls are written.
+    Irq(IrqSelection),
+    /// Spin reading the U32 register until it changes, such as a counter the FPGA increments every cycle.
+    ///
+    /// Nothing is acknowledged in this mode.
+    Poll(RegisterAddress),
+}
+
+/// Configuration for the control loop thread.
+#[derive(Debug, Clone, Copy)]
+pub struct ControlLoopConfig {
+    /// What starts each cycle (default: [`WakeSource::Irq`] on IRQ 0).
+    pub wake: WakeSource,
+    /// The expected time between wakes, used for the wake latency (default: 1ms).
+    pub period: Duration,
+    /// The longest a cycle can take from waking to acknowledging before it counts as an overrun (default: 1ms).
+    pub deadline: Duration,
+    /// How long to wait for a wake before counting a timeout and checking for stop (default: 100ms).
+    pub timeout: Duration,
+    /// The core to pin the thread to (default: not pinned).
+    pub core: Option<usize>,
+    /// The `SCHED_FIFO` priority for the thread, from 1 to 99 (default: normal scheduling).
+    pub priority: Option<i32>,
+}
+
+impl Default for ControlLoopConfig {
+    fn default() -> Self {
+        Self {
+            wake: WakeSource::Irq(IRQ0),
+            period: Duration::from_millis(1),
+            deadline: Duration::from_millis(1),
+            timeout: Duration::from_millis(100),
+            core: None,
+            priority: None,
+        }
+    }
+}
+
+/// The cycle being run, passed to the step function.
+#[derive(Debug, Clone, Copy)]
+pub struct Cycle {
+    /// Counts up from zero for each cycle run.
+    pub index: u64,
+    /// When the loop woke for this cycle.
+    pub woke: Instant,
+    /// The time since the previous wake. [`None`] for the first cycle and after a timeout.
+    pub interval: Option<Duration>,
+}
+
+/// The counts reported while the loop runs.
+#[derive(Debug, Default, Clone, Copy, PartialEq, Eq)]
+pub struct ControlLoopStatistics {
+    /// Cycles run.
+    pub cycles: u64,
+    /// Cycles which took longer than the deadline.
+    pub overruns: u64,
+    /// Waits which timed out without a wake.
+    pub timeouts: u64,
+}
+
+/// The timing of every cycle, returned when the loop stops.
+#[derive(Debug, Clone, Default)]
+pub struct ControlLoopTimings {
+    pub statistics: ControlLoopStatistics,
+    /// The time between consecutive wakes.
+    pub cycle_time: LatencyHistogram,
+    /// How much later than one period after the previous wake each wake was.
+    pub wake_latency: LatencyHistogram,
+    /// The time from waking to acknowledging, which is checked against the deadline.
+    pub work_time: LatencyHistogram,
+}
+
+#[derive(Default)]
+struct LoopCounters {
+    cycles: AtomicU64,
+    overruns: AtomicU64,
+    timeouts: AtomicU64,
+}
+
+impl LoopCounters {
+    fn snapshot(&self) -> ControlLoopStatistics {
+        ControlLoopStatistics {
+            cycles: self.cycles.load(Ordering::Relaxed),
+            overruns: self.overruns.load(Ordering::Relaxed),
+            timeouts: self.timeouts.load(Ordering::Relaxed),
+        }
+    }
+}
+
+/// Times the cycles of the loop. Kept apart from the driver calls so it can be tested.
+struct CycleTimer {
+    period: Duration,
+    deadline: Duration,
+    last_wake: Option<Instant>,
+    timings: ControlLoopTimings,
+}
+
+impl CycleTimer {
+    fn new(config: &ControlLoopConfig) -> Self {
+        Self {
+            period: config.period,
+            deadline: config.deadline,
+            last_wake: None,
+            timings: ControlLoopTimings::default(),
+        }
+    }
+
+    fn woke(&mut self, now: Instant) -> Cycle {
+        let interval = self
+            .last_wake
+            .map(|last| now.saturating_duration_since(last));
+        if let Some(interval) = interval {
+            self.timings.cycle_time.record(interval);
+            self.timings
+                .wake_latency
+                .record(interval.saturating_sub(self.period));
+        }
+        self.last_wake = Some(now);
+        Cycle {
+            index: self.timings.statistics.cycles,
+            woke: now,
+            interval,
+        }
+    }
+
+    /// Records the end of the cycle, returning true if it overran.
+    fn finished(&mut self, cycle: &Cycle, now: Instant) -> bool {
+        let work = now.saturating_duration_since(cycle.woke);
+        self.timings.work_time.record(work);
+        self.timings.statistics.cycles += 1;
+        let overrun = work > self.deadline;
+        if overrun {
+            self.timings.statistics.overruns += 1;
+        }
+        overrun
+    }
+
+    /// The next interval would include the missed wakes so it isn't recorded.
+    fn timed_out(&mut self) {
+        self.last_wake = None;
+        self.timings.statistics.timeouts += 1;
+    }
+}
+
+/// A control loop running on its own thread.
+///
+/// The thread is stopped when this is dropped or [`ControlLoop::stop`] is called.
+/// See the [module documentation](self) for an example.
+pub struct ControlLoop {
+    counters: Arc<LoopCounters>,
+    stop: Arc<AtomicBool>,
+    thread: Option<JoinHandle<Result<ControlLoopTimings, FPGAError>>>,
+}
+
+impl ControlLoop {
+    /// Starts the loop thread, which runs until stopped or `step` returns [`ControlFlow::Break`].
+    ///
+    /// The batch reads into the state before each step and writes from it after.
+    /// Errors setting up the thread or from the driver stop the loop and are returned by [`ControlLoop::stop`].
+    pub fn start<S, F>(
+        session: Arc<Session>,
+        batch: RegisterBatch<S>,
+        state: S,
+        config: ControlLoopConfig,
+        step: F,
+    ) -> Self
+    where
+        S: Send + 'static,
+        F: FnMut(&mut S, &Cycle) -> ControlFlow<()> + Send + 'static,
+    {
+        let counters = Arc::new(LoopCounters::default());
+        let stop = Arc::new(AtomicBool::new(false));
+
+        let thread_counters = counters.clone();
+        let thread_stop = stop.clone();
+        let thread = std::thread::Builder::new()
+            .name("control-loop".to_string())
+            .spawn(move || {
+                if let Some(core) = config.core {
+                    pin_current_thread(core)?;
+                }
+                if let Some(priority) = config.priority {
+                    set_fifo_priority(priority)?;
+                }
+                run_loop(
+                    &session,
+                    &batch,
+                    state,
+                    &config,
+                    step,
+                    &thread_counters,
+                    &thread_stop,
+                )
+            })
+            .expect("Failed to spawn control loop thread");
+
+        Self {
+            counters,
+            stop,
+            thread: Some(thread),
+        }
+    }
+
+    /// A snapshot of the loop counters.
+    pub fn statistics(&self) -> ControlLoopStatistics {
+        self.counters.snapshot()
+    }
+
+    /// Returns false if the loop thread has exited, because the step finished the loop or an error.
+    ///
+    /// Call [`ControlLoop::stop`] to retrieve the result.
+    pub fn is_running(&self) -> bool {
+        self.thread
+            .as_ref()
+            .map(|thread| !thread.is_finished())
+            .unwrap_or(false)
+    }
+
+    /// Stops the loop after the current cycle and returns its timings or the error which stopped it.
+    pub fn stop(mut self) -> Result<ControlLoopTimings, FPGAError> {
+        self.stop_thread()
+    }
+
+    fn stop_thread(&mut self) -> Result<ControlLoopTimings, FPGAError> {
+        self.stop.store(true, Ordering::Relaxed);
+        match self.thread.take() {
+            Some(thread) => thread.join().expect("Control loop thread panicked"),
+            None => Ok(ControlLoopTimings::default()),
+        }
+    }
+}
+
+impl Drop for ControlLoop {
+    fn drop(&mut self) {
+        // Cant return result from drop so ignore it.
+        let _ = self.stop_thread();
+    }
+}
+
+#[derive(PartialEq)]
+enum Wake {
+    Irqs(IrqSelection),
+    Changed,
+    TimedOut,
+}
+
+fn run_loop<S: 'static>(
+    session: &Session,
+    batch: &RegisterBatch<S>,
+    mut state: S,
+    config: &ControlLoopConfig,
+    mut step: impl FnMut(&mut S, &Cycle) -> ControlFlow<()>,
+    counters: &LoopCounters,
+    stop: &AtomicBool,
+) -> Result<ControlLoopTimings, FPGAError> {
+    let mut timer = CycleTimer::new(config);
+    // Reserved before the loop so the first wait doesn't pay for it.
+    let mut irq_context = match config.wake {
+        WakeSource::Irq(_) => Some(session.create_irq_context()?),
+        WakeSource::Poll(_) => None,
+    };
+    let mut last_count = match config.wake {
+        WakeSource::Poll(address) => RegisterInterface::<u32>::read(session, address)?,
+        WakeSource::Irq(_) => 0,
+    };
+
+    while !stop.load(Ordering::Relaxed) {
+        let wake = match (config.wake, irq_context.as_mut()) {
+            (WakeSource::Irq(irq), Some(context)) => {
+                match context.wait_on_irq(irq, config.timeout)? {
+                    IrqWaitResult::IrqsAsserted(asserted) => Wake::Irqs(asserted),
+                    IrqWaitResult::TimedOut => Wake::TimedOut,
+                }
+            }
+            (WakeSource::Poll(address), _) => {
+                match poll_for_change(session, address, last_count, config.timeout, stop)? {
+                    Some(count) => {
+                        last_count = count;
+                        Wake::Changed
+                    }
+                    None => Wake::TimedOut,
+                }
+            }
+            (WakeSource::Irq(_), None) => unreachable!("The IRQ context is reserved for IRQ wakes"),
+        };
+        if wake == Wake::TimedOut {
+            timer.timed_out();
+            counters.timeouts.fetch_add(1, Ordering::Relaxed);
+            continue;
+        }
+
+        let cycle = timer.woke(Instant::now());
+        batch.read_into(session, &mut state)?;
+        let flow = step(&mut state, &cycle);
+        batch.write_from(session, &state)?;
+        if let Wake::Irqs(asserted) = wake {
+            session.acknowledge_irqs(asserted)?;
+        }
+        if timer.finished(&cycle, Instant::now()) {
+            counters.overruns.fetch_add(1, Ordering::Relaxed);
+        }
+        counters.cycles.fetch_add(1, Ordering::Relaxed);
+
+        if flow.is_break() {
+            break;
+        }
+    }
+
+    Ok(timer.timings)
+}
+
+/// Spins until the register differs from `last`, returning the new value or [`None`] on timeout or stop.
+fn poll_for_change(
+    session: &Session,
+    address: RegisterAddress,
+    last: u32,
+    timeout: Duration,
+    stop: &AtomicBool,
+) -> Result<Option<u32>, FPGAError> {
+    let start = Instant::now();
+    loop {
+        let count = RegisterInterface::<u32>::read(session, address)?;
+        if count != last {
+            return Ok(Some(count));
+        }
+        if stop.load(Ordering::Relaxed) || start.elapsed() > timeout {
+            return Ok(None);
+        }
+        std::hint::spin_loop();
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    fn config(period_micros: u64, deadline_micros: u64) -> ControlLoopConfig {
+        ControlLoopConfig {
+            period: Duration::from_micros(period_micros),
+            deadline: Duration::from_micros(deadline_micros),
+            ..Default::default()
+        }
+    }
+
+    #[test]
+    fn test_cycle_timing() {
+        let mut timer = CycleTimer::new(&config(100, 40));
+        let start = Instant::now();
+
+        let first = timer.woke(start);
+        assert_eq!(first.index, 0);
+        assert_eq!(first.interval, None);
+        assert!(!timer.finished(&first, start + Duration::from_micros(30)));
+
+        // Five microseconds late and too slow.
+        let second = timer.woke(start + Duration::from_micros(105));
+        assert_eq!(second.index, 1);
+        assert_eq!(second.interval, Some(Duration::from_micros(105)));
+        assert!(timer.finished(&second, start + Duration::from_micros(155)));
+
+        let timings = &timer.timings;
+        assert_eq!(timings.statistics.cycles, 2);
+        assert_eq!(timings.statistics.overruns, 1);
+        assert_eq!(timings.cycle_time.count(), 1);
+        assert_eq!(timings.wake_latency.max(), Duration::from_micros(5));
+        assert_eq!(timings.work_time.max(), Duration::from_micros(50));
+    }
+
+    #[test]
+    fn test_early_wake_has_no_latency() {
+        let mut timer = CycleTimer::new(&config(100, 100));
+        let start = Instant::now();
+        timer.woke(start);
+        timer.woke(start + Duration::from_micros(90));
+        assert_eq!(timer.timings.wake_latency.max(), Duration::ZERO);
+    }
+
+    #[test]
+    fn test_timeout_skips_the_interval() {
+        let mut timer = CycleTimer::new(&config(100, 100));
+        let start = Instant::now();
+        timer.woke(start);
+        timer.timed_out();
+        let cycle = timer.woke(start + Duration::from_millis(200));
+        assert_eq!(cycle.interval, None);
+        assert_eq!(timer.timings.cycle_time.count(), 0);
+        assert_eq!(timer.timings.statistics.timeouts, 1);
+    }
+}
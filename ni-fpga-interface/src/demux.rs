@@ -0,0 +1,244 @@
+//! Splitting interleaved multi-channel DMA data into a buffer per channel.
+//!
+//! To save DMA channels the FPGA often interleaves several channels into one
+//! FIFO as frames of one element per channel. [`Demux`] takes the frames from
+//! a read or a zero copy region and scatters them into contiguous per-channel
+//! buffers, optionally converting each value in the same pass.
+//!
+//! The channel count and frame stride are const generics so the loops are
+//! compiled for the exact layout. The data is processed in blocks small
+//! enough to stay in the L1 cache, one channel at a time, so each output is
+//! written sequentially. [`deinterleave`] picks the compiled version for
+//! common channel counts when the count is only known at runtime.
+//!
+//! # Example
+//!
+//! ```rust
+//! # use ni_fpga_interface::fifos::ReadFifo;
+//! # use ni_fpga_interface::session::{NiFpgaContext, Session};
+//! use ni_fpga_interface::demux::Demux;
+//!
+//! # let context = NiFpgaContext::new().unwrap();
+//! # let session = Session::new(&context, "main.lvbitx", "sig", "RIO0", &Default::default()).unwrap();
+//! const FRAMES: usize = 4096;
+//! let gains = [0.001f32, 0.001, 0.002, 0.01];
+//! let mut channels = [[0f32; FRAMES]; 4];
+//! let [a, b, c, d] = &mut channels;
+//!
+//! let mut fifo = ReadFifo::<i16>::new(1);
+//! let (region, _remaining) = fifo.get_read_region(&session, FRAMES * 4, None).unwrap();
+//! // Widen and scale to volts while splitting.
+//! Demux::<4>::split_with(region.elements, &mut [a, b, c, d], |channel, raw| {
+//!     raw as f32 * gains[channel]
+//! });
+//! ```
+
+/// The layout of interleaved frames.
+///
+/// * `CHANNELS` - The number of channels taken from each frame, from its start.
+/// * `STRIDE` - The number of elements in each frame. This defaults to the channel count
+///   and is larger when the frame holds other elements which are skipped.
+pub struct Demux<const CHANNELS: usize, const STRIDE: usize = CHANNELS>;
+
+impl<const CHANNELS: usize, const STRIDE: usize> Demux<CHANNELS, STRIDE> {
+    /// Referenced by each split so an invalid layout fails to compile.
+    const VALID: () = assert!(
+        CHANNELS >= 1 && CHANNELS <= STRIDE,
+        "A frame must hold at least one channel and no more than its stride"
+    );
+
+    /// The number of complete frames in the interleaved data.
+    pub const fn frames(interleaved_len: usize) -> usize {
+        interleaved_len / STRIDE
+    }
+
+    /// Copies each channel of the frames into its output.
+    ///
+    /// Splits as many complete frames as fit in the shortest output and returns
+    /// the number of frames split. Elements of an incomplete frame at the end are ignored.
+    pub fn split<T: Copy>(interleaved: &[T], outputs: &mut [&mut [T]; CHANNELS]) -> usize {
+        Self::split_with(interleaved, outputs, |_, value| value)
+    }
+
+    /// Converts each value with `convert`, which is given the channel index, as it is split.
+    ///
+    /// Use this to widen or scale the data without a second pass. Otherwise as [`Demux::split`].
+    #[inline]
+    pub fn split_with<T: Copy, U>(
+        interleaved: &[T],
+        outputs: &mut [&mut [U]; CHANNELS],
+        convert: impl Fn(usize, T) -> U,
+    ) -> usize {
+        let () = Self::VALID;
+        split_blocked(interleaved, STRIDE, outputs, convert)
+    }
+}
+
+/// Frames per block. At four 32 bit channels a block of input is 4 KiB.
+const BLOCK_FRAMES: usize = 256;
+
+/// The shared implementation. Inlined so the stride is a constant when called from [`Demux`].
+#[inline(always)]
+fn split_blocked<T: Copy, U>(
+    interleaved: &[T],
+    stride: usize,
+    outputs: &mut [&mut [U]],
+    convert: impl Fn(usize, T) -> U,
+) -> usize {
+    let frames = outputs
+        .iter()
+        .fold(interleaved.len() / stride, |frames, output| {
+            frames.min(output.len())
+        });
+    let input = &interleaved[..frames * stride];
+
+    for (block_index, block) in input.chunks(BLOCK_FRAMES * stride).enumerate() {
+        let start = block_index * BLOCK_FRAMES;
+        let block_frames = block.len() / stride;
+        for (channel, output) in outputs.iter_mut().enumerate() {
+            let output = &mut output[start..start + block_frames];
+            for (value, frame) in output.iter_mut().zip(block.chunks_exact(stride)) {
+                *value = convert(channel, frame[channel]);
+            }
+        }
+    }
+    frames
+}
+
+/// Copies each channel of the frames into its output, with a frame stride known only at runtime.
+///
+/// The channel count is the number of outputs. Common layouts where the stride
+/// matches the channel count use the compiled [`Demux`] for that count.
+///
+/// # Panics
+///
+/// If there are no outputs or more outputs than the stride.
+pub fn deinterleave<T: Copy>(interleaved: &[T], stride: usize, outputs: &mut [&mut [T]]) -> usize {
+    deinterleave_with(interleaved, stride, outputs, |_, value| value)
+}
+
+/// Converts each value with `convert`, which is given the channel index, as it is split.
+///
+/// Otherwise as [`deinterleave`].
+pub fn deinterleave_with<T: Copy, U>(
+    interleaved: &[T],
+    stride: usize,
+    outputs: &mut [&mut [U]],
+    convert: impl Fn(usize, T) -> U,
+) -> usize {
+    assert!(
+        !outputs.is_empty() && outputs.len() <= stride,
+        "A frame must hold at least one channel and no more than its stride"
+    );
+
+    macro_rules! compiled {
+        ($($channels:literal),*) => {
+            match (outputs.len(), stride) {
+                $(
+                    ($channels, $channels) => {
+                        let outputs: &mut [&mut [U]; $channels] = outputs.try_into().unwrap();
+                        Demux::<$channels>::split_with(interleaved, outputs, convert)
+                    }
+                )*
+                _ => split_blocked(interleaved, stride, outputs, convert),
+            }
+        };
+    }
+    compiled!(1, 2, 3, 4, 6, 8, 16)
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    /// Element by element to check against.
+    fn reference(interleaved: &[i32], stride: usize, channels: usize) -> Vec<Vec<i32>> {
+        (0..channels)
+            .map(|channel| {
+                interleaved
+                    .chunks_exact(stride)
+                    .map(|frame| frame[channel])
+                    .collect()
+            })
+            .collect()
+    }
+
+    fn run_deinterleave(interleaved: &[i32], stride: usize, channels: usize) -> Vec<Vec<i32>> {
+        let frames = interleaved.len() / stride;
+        let mut outputs = vec![vec![0; frames]; channels];
+        let mut slices: Vec<&mut [i32]> = outputs.iter_mut().map(Vec::as_mut_slice).collect();
+        assert_eq!(deinterleave(interleaved, stride, &mut slices), frames);
+        outputs
+    }
+
+    #[test]
+    fn test_split_channels() {
+        let interleaved = [1, 10, 100, 2, 20, 200, 3, 30, 300];
+        let (mut a, mut b, mut c) = ([0; 3], [0; 3], [0; 3]);
+        let frames = Demux::<3>::split(&interleaved, &mut [&mut a, &mut b, &mut c]);
+        assert_eq!(frames, 3);
+        assert_eq!(a, [1, 2, 3]);
+        assert_eq!(b, [10, 20, 30]);
+        assert_eq!(c, [100, 200, 300]);
+    }
+
+    #[test]
+    fn test_split_skips_stride_padding() {
+        let interleaved = [1, 10, -1, -1, 2, 20, -1, -1];
+        let (mut a, mut b) = ([0; 2], [0; 2]);
+        assert_eq!(Demux::<2, 4>::split(&interleaved, &mut [&mut a, &mut b]), 2);
+        assert_eq!(a, [1, 2]);
+        assert_eq!(b, [10, 20]);
+        assert_eq!(Demux::<2, 4>::frames(interleaved.len()), 2);
+    }
+
+    #[test]
+    fn test_split_limited_by_shortest_output_and_whole_frames() {
+        // Two and a half frames.
+        let interleaved = [1, 10, 2, 20, 3];
+        let (mut a, mut b) = ([0; 4], [0; 4]);
+        assert_eq!(Demux::<2>::split(&interleaved, &mut [&mut a, &mut b]), 2);
+        assert_eq!(a, [1, 2, 0, 0]);
+
+        let (mut short, mut long) = ([0; 1], [0; 4]);
+        assert_eq!(
+            Demux::<2>::split(&interleaved, &mut [&mut short, &mut long]),
+            1
+        );
+        assert_eq!(long, [10, 0, 0, 0]);
+    }
+
+    #[test]
+    fn test_split_with_widens_and_scales() {
+        let interleaved: [i16; 4] = [100, -200, 300, -400];
+        let gains = [0.5f32, 0.25];
+        let (mut a, mut b) = ([0f32; 2], [0f32; 2]);
+        Demux::<2>::split_with(&interleaved, &mut [&mut a, &mut b], |channel, raw| {
+            raw as f32 * gains[channel]
+        });
+        assert_eq!(a, [50.0, 150.0]);
+        assert_eq!(b, [-50.0, -100.0]);
+    }
+
+    #[test]
+    fn test_deinterleave_matches_reference_across_blocks() {
+        // Enough frames for several blocks plus a partial one.
+        let interleaved: Vec<i32> = (0..(BLOCK_FRAMES as i32 * 3 + 7) * 16).collect();
+        for (channels, stride) in [(1, 1), (2, 2), (4, 4), (5, 5), (8, 8), (16, 16), (3, 5)] {
+            let length = interleaved.len() / stride * stride;
+            let interleaved = &interleaved[..length];
+            assert_eq!(
+                run_deinterleave(interleaved, stride, channels),
+                reference(interleaved, stride, channels),
+                "{channels} channels with stride {stride}"
+            );
+        }
+    }
+
+    #[test]
+    #[should_panic(expected = "no more than its stride")]
+    fn test_deinterleave_more_channels_than_stride_panics() {
+        let (mut a, mut b) = ([0; 1], [0; 1]);
+        deinterleave(&[1, 2], 1, &mut [&mut a, &mut b]);
+    }
+}
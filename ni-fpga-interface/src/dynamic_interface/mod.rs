@@ -0,0 +1,551 @@
+//! Register and FIFO definitions loaded from a bitfile at runtime.
+//!
+//! The build crate generates constants for one bitfile at compile time. When an
+//! application has to work with several bitfile variants a
+//! [`BitfileInterface`] reads the same information from the `.lvbitx` file
+//! instead, so one binary can drive all of them.
+//!
+//! The names are resolved to the same [`Register`], [`ArrayRegister`],
+//! [`ReadFifo`] and [`WriteFifo`] types the generated code uses, checking the
+//! type and direction against the bitfile. Resolve them once after loading and
+//! the accesses are then exactly as fast as with generated constants.
+//!
+//! The file is read directly with [`BitfileInterface::load`], since the
+//! signature is needed before a session can be opened. Once a session is open
+//! [`BitfileInterface::from_session`] reads the same contents from the driver.
+//!
+//! # Example
+//!
+//! ```rust
+//! use ni_fpga_interface::dynamic_interface::BitfileInterface;
+//! use ni_fpga_interface::session::{NiFpgaContext, Session};
+//!
+//! let interface = BitfileInterface::load("main.lvbitx").unwrap();
+//! let context = NiFpgaContext::new().unwrap();
+//! let session = Session::new(
+//!     &context,
+//!     "main.lvbitx",
+//!     interface.signature(),
+//!     "RIO0",
+//!     &Default::default(),
+//! )
+//! .unwrap();
+//!
+//! let result = interface.register::<u8>("U8Result").unwrap();
+//! let mut samples = interface.read_fifo::<u32>("NumbersFromFPGA").unwrap();
+//!
+//! println!("{}", result.read(&session).unwrap());
+//! let mut buffer = [0u32; 16];
+//! samples.read(&session, None, &mut buffer).unwrap();
+//! ```
+
+mod xml;
+
+use crate::error::{FPGAError, Result};
+use crate::fifos::{ReadFifo, WriteFifo};
+use crate::nifpga_sys::FifoAddress;
+use crate::registers::{ArrayRegister, Register};
+use crate::session::{NativeFpgaType, RegisterAddress, Session};
+use std::collections::HashMap;
+use std::path::Path;
+use xml::Element;
+
+/// A front panel control or indicator described by the bitfile.
+#[derive(Debug, Clone, PartialEq, Eq)]
+pub struct RegisterInfo {
+    pub name: String,
+    pub address: RegisterAddress,
+    /// The element type as named by [`NativeFpgaType::FPGA_TYPE`] for native types,
+    /// otherwise the name used in the bitfile such as `FXP` or `Cluster`.
+    pub data_type: String,
+    /// True if the data type is a [`NativeFpgaType`].
+    pub native: bool,
+    pub indicator: bool,
+    /// The number of elements for array registers.
+    pub array_size: Option<usize>,
+}
+
+/// The direction of a DMA FIFO.
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub enum FifoDirection {
+    TargetToHost,
+    HostToTarget,
+}
+
+/// A DMA FIFO described by the bitfile.
+#[derive(Debug, Clone, PartialEq, Eq)]
+pub struct FifoInfo {
+    pub name: String,
+    pub address: FifoAddress,
+    /// The element type, named as for [`RegisterInfo::data_type`].
+    pub data_type: String,
+    /// True if the data type is a [`NativeFpgaType`].
+    pub native: bool,
+    pub direction: FifoDirection,
+}
+
+/// The registers and FIFOs of a bitfile, indexed by name.
+///
+/// See the [module documentation](self) for an example.
+#[derive(Debug, Clone)]
+pub struct BitfileInterface {
+    signature: String,
+    registers: Vec<RegisterInfo>,
+    fifos: Vec<FifoInfo>,
+    register_index: HashMap<String, usize>,
+    fifo_index: HashMap<String, usize>,
+}
+
+impl BitfileInterface {
+    /// Reads the interface from a `.lvbitx` file.
+    pub fn load(path: impl AsRef<Path>) -> Result<Self> {
+        Self::parse(&std::fs::read_to_string(path)?)
+    }
+
+    /// Reads the interface of the bitfile an open session was created from.
+    ///
+    /// Use [`BitfileInterface::load`] when the signature is needed to open the session.
+    pub fn from_session(session: &Session) -> Result<Self> {
+        Self::parse(&session.bitfile_contents()?)
+    }
+
+    /// Reads the interface from the XML contents of a bitfile.
+    pub fn parse(xml: &str) -> Result<Self> {
+        let root = xml::parse(xml).map_err(FPGAError::InvalidBitfile)?;
+        let signature = root
+            .child_text("SignatureRegister")
+            .ok_or_else(|| invalid("missing SignatureRegister"))?
+            .to_ascii_uppercase();
+        let nifpga = root
+            .path(&[
+                "Project",
+                "CompilationResultsTree",
+                "CompilationResults",
+                "NiFpga",
+            ])
+            .ok_or_else(|| invalid("missing the NiFpga compilation results"))?;
+        let base_address: RegisterAddress = parse_number(
+            nifpga
+                .child_text("BaseAddressOnDevice")
+                .ok_or_else(|| invalid("missing BaseAddressOnDevice"))?,
+        )?;
+
+        let mut registers = Vec::new();
+        if let Some(list) = root.path(&["VI", "RegisterList"]) {
+            for register in list
+                .children
+                .iter()
+                .filter(|child| child.name == "Register")
+            {
+                if let Some(info) = parse_register(register, base_address)? {
+                    registers.push(info);
+                }
+            }
+        }
+
+        let mut fifos = Vec::new();
+        if let Some(list) = nifpga.child("DmaChannelAllocationList") {
+            for channel in list.children.iter().filter(|child| child.name == "Channel") {
+                if let Some(info) = parse_fifo(channel)? {
+                    fifos.push(info);
+                }
+            }
+        }
+
+        Ok(Self::new(signature, registers, fifos))
+    }
+
+    fn new(signature: String, registers: Vec<RegisterInfo>, fifos: Vec<FifoInfo>) -> Self {
+        let register_index = registers
+            .iter()
+            .enumerate()
+            .map(|(index, register)| (register.name.clone(), index))
+            .collect();
+        let fifo_index = fifos
+            .iter()
+            .enumerate()
+            .map(|(index, fifo)| (fifo.name.clone(), index))
+            .collect();
+        Self {
+            signature,
+            registers,
+            fifos,
+            register_index,
+            fifo_index,
+        }
+    }
+
+    /// The signature to pass to [`crate::session::Session::new`] with this bitfile.
+    pub fn signature(&self) -> &str {
+        &self.signature
+    }
+
+    pub fn registers(&self) -> &[RegisterInfo] {
+        &self.registers
+    }
+
+    pub fn fifos(&self) -> &[FifoInfo] {
+        &self.fifos
+    }
+
+    pub fn register_info(&self, name: &str) -> Option<&RegisterInfo> {
+        self.register_index
+            .get(name)
+            .map(|index| &self.registers[*index])
+    }
+
+    pub fn fifo_info(&self, name: &str) -> Option<&FifoInfo> {
+        self.fifo_index.get(name).map(|index| &self.fifos[*index])
+    }
+
+    /// Resolves a scalar register, checking it holds a `T`.
+    pub fn register<T: NativeFpgaType + Default>(&self, name: &str) -> Result<Register<T>> {
+        let info = self.find_register::<T>(name)?;
+        if let Some(size) = info.array_size {
+            return Err(mismatch(format!(
+                "register {name} is an array of {size} elements"
+            )));
+        }
+        Ok(Register::new(info.address))
+    }
+
+    /// Resolves an array register, checking it holds `N` of `T`.
+    pub fn array_register<T: NativeFpgaType + Default, const N: usize>(
+        &self,
+        name: &str,
+    ) -> Result<ArrayRegister<T, N>> {
+        let info = self.find_register::<T>(name)?;
+        if info.array_size != Some(N) {
+            return Err(mismatch(format!(
+                "register {name} has {:?} elements, not {N}",
+                info.array_size
+            )));
+        }
+        Ok(ArrayRegister::new(info.address))
+    }
+
+    /// Resolves a target to host FIFO, checking it carries `T`.
+    pub fn read_fifo<T: NativeFpgaType + 'static>(&self, name: &str) -> Result<ReadFifo<T>> {
+        let info = self.find_fifo::<T>(name, FifoDirection::TargetToHost)?;
+        Ok(ReadFifo::new(info.address))
+    }
+
+    /// Resolves a host to target FIFO, checking it carries `T`.
+    pub fn write_fifo<T: NativeFpgaType + 'static>(&self, name: &str) -> Result<WriteFifo<T>> {
+        let info = self.find_fifo::<T>(name, FifoDirection::HostToTarget)?;
+        Ok(WriteFifo::new(info.address))
+    }
+
+    fn find_register<T: NativeFpgaType>(&self, name: &str) -> Result<&RegisterInfo> {
+        let info = self
+            .register_info(name)
+            .ok_or_else(|| mismatch(format!("no register named {name}")))?;
+        if info.data_type != T::FPGA_TYPE {
+            return Err(mismatch(format!(
+                "register {name} is {} not {}",
+                info.data_type,
+                T::FPGA_TYPE
+            )));
+        }
+        Ok(info)
+    }
+
+    fn find_fifo<T: NativeFpgaType>(
+        &self,
+        name: &str,
+        direction: FifoDirection,
+    ) -> Result<&FifoInfo> {
+        let info = self
+            .fifo_info(name)
+            .ok_or_else(|| mismatch(format!("no FIFO named {name}")))?;
+        if info.direction != direction {
+            return Err(mismatch(format!(
+                "FIFO {name} is {:?} not {direction:?}",
+                info.direction
+            )));
+        }
+        if info.data_type != T::FPGA_TYPE {
+            return Err(mismatch(format!(
+                "FIFO {name} is {} not {}",
+                info.data_type,
+                T::FPGA_TYPE
+            )));
+        }
+        Ok(info)
+    }
+}
+
+fn invalid(message: &str) -> FPGAError {
+    FPGAError::InvalidBitfile(message.to_string())
+}
+
+fn mismatch(message: String) -> FPGAError {
+    FPGAError::InterfaceMismatch(message)
+}
+
+/// Parses a decimal or `0x` prefixed hex number.
+fn parse_number<N: TryFrom<u64>>(text: &str) -> Result<N> {
+    let value = match text.strip_prefix("0x").or_else(|| text.strip_prefix("0X")) {
+        Some(hex) => u64::from_str_radix(hex, 16),
+        None => text.parse(),
+    };
+    value
+        .ok()
+        .and_then(|value| N::try_from(value).ok())
+        .ok_or_else(|| FPGAError::InvalidBitfile(format!("{text} is not a valid number")))
+}
+
+/// Maps a type name from the bitfile to [`NativeFpgaType::FPGA_TYPE`].
+fn native_type(name: &str) -> Option<&'static str> {
+    let native = match name.to_ascii_uppercase().as_str() {
+        "U8" => "U8",
+        "U16" => "U16",
+        "U32" => "U32",
+        "U64" => "U64",
+        "I8" => "I8",
+        "I16" => "I16",
+        "I32" => "I32",
+        "I64" => "I64",
+        "SGL" => "Sgl",
+        "DBL" => "Dbl",
+        "BOOL" | "BOOLEAN" => "Bool",
+        _ => return None,
+    };
+    Some(native)
+}
+
+/// The type name and whether it is native.
+fn data_type(name: &str) -> (String, bool) {
+    match native_type(name) {
+        Some(native) => (native.to_string(), true),
+        None => (name.to_string(), false),
+    }
+}
+
+/// The type of a register is the single child element of its `Datatype`.
+fn parse_register(
+    register: &Element,
+    base_address: RegisterAddress,
+) -> Result<Option<RegisterInfo>> {
+    // Internal registers are used by the driver itself, such as the VI control register.
+    if register.child_text("Internal") == Some("true") {
+        return Ok(None);
+    }
+    let name = register
+        .child_text("Name")
+        .ok_or_else(|| invalid("register without a name"))?;
+    let Some(type_element) = register
+        .child("Datatype")
+        .and_then(|datatype| datatype.children.first())
+    else {
+        return Ok(None);
+    };
+    let offset: RegisterAddress = parse_number(
+        register
+            .child_text("Offset")
+            .ok_or_else(|| invalid("register without an offset"))?,
+    )?;
+
+    let (element_type, array_size) = if type_element.name == "Array" {
+        let size = parse_number(
+            type_element
+                .child_text("Size")
+                .ok_or_else(|| invalid("array register without a size"))?,
+        )?;
+        let element = type_element
+            .child("Type")
+            .and_then(|element| element.children.first())
+            .ok_or_else(|| invalid("array register without an element type"))?;
+        (element.name.as_str(), Some(size))
+    } else {
+        (type_element.name.as_str(), None)
+    };
+    let (data_type, native) = data_type(element_type);
+
+    Ok(Some(RegisterInfo {
+        name: name.to_string(),
+        address: base_address + offset,
+        data_type,
+        native,
+        indicator: register.child_text("Indicator") == Some("true"),
+        array_size,
+    }))
+}
+
+/// DMA channels also include peer to peer streams, which are skipped.
+fn parse_fifo(channel: &Element) -> Result<Option<FifoInfo>> {
+    let name = channel
+        .attribute("name")
+        .ok_or_else(|| invalid("DMA channel without a name"))?;
+    let kind = channel
+        .child_text("Direction")
+        .or_else(|| channel.child_text("Implementation"))
+        .unwrap_or_default();
+    let direction = if kind.contains("TargetToHost") {
+        FifoDirection::TargetToHost
+    } else if kind.contains("HostToTarget") {
+        FifoDirection::HostToTarget
+    } else {
+        return Ok(None);
+    };
+    let address = parse_number(
+        channel
+            .child_text("Number")
+            .ok_or_else(|| invalid("DMA channel without a number"))?,
+    )?;
+    let type_name = channel
+        .child("DataType")
+        .and_then(|data_type| {
+            data_type
+                .child_text("SubType")
+                .or_else(|| data_type.children.first().map(|child| child.name.as_str()))
+        })
+        .ok_or_else(|| invalid("DMA channel without a data type"))?;
+    let (data_type, native) = data_type(type_name);
+
+    Ok(Some(FifoInfo {
+        name: name.to_string(),
+        address,
+        data_type,
+        native,
+        direction,
+    }))
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    const BITFILE: &str = r#"<?xml version="1.0" encoding="UTF-8"?>
+<Bitfile>
+  <BitfileVersion>4.0</BitfileVersion>
+  <SignatureRegister>a0613989b20f45fc6e79eb71383493e8</SignatureRegister>
+  <VI>
+    <Name>Main.vi</Name>
+    <RegisterList>
+      <Register>
+        <Name>U8Control</Name>
+        <Indicator>false</Indicator>
+        <Datatype><U8><Name>U8Control</Name></U8></Datatype>
+        <Offset>2</Offset>
+        <Internal>false</Internal>
+      </Register>
+      <Register>
+        <Name>SglResultArray</Name>
+        <Indicator>true</Indicator>
+        <Datatype>
+          <Array><Name>SglResultArray</Name><Size>3</Size><Type><SGL><Name/></SGL></Type></Array>
+        </Datatype>
+        <Offset>24</Offset>
+        <Internal>false</Internal>
+      </Register>
+      <Register>
+        <Name>FxpResult</Name>
+        <Indicator>true</Indicator>
+        <Datatype><FXP><Name>FxpResult</Name></FXP></Datatype>
+        <Offset>60</Offset>
+      </Register>
+      <Register>
+        <Name>ViControl</Name>
+        <Datatype><U32/></Datatype>
+        <Offset>0</Offset>
+        <Internal>true</Internal>
+      </Register>
+    </RegisterList>
+  </VI>
+  <Project>
+    <CompilationResultsTree>
+      <CompilationResults>
+        <NiFpga>
+          <BaseAddressOnDevice>98304</BaseAddressOnDevice>
+          <DmaChannelAllocationList>
+            <Channel name="NumbersFromFPGA">
+              <DataType><SubType>U32</SubType></DataType>
+              <Direction>TargetToHost</Direction>
+              <Number>0</Number>
+            </Channel>
+            <Channel name="NumbersToFPGA">
+              <DataType><SubType>Boolean</SubType></DataType>
+              <Direction>HostToTarget</Direction>
+              <Number>1</Number>
+            </Channel>
+            <Channel name="PeerStream">
+              <DataType><SubType>U32</SubType></DataType>
+              <Implementation>niFpgaPeerToPeerWriter</Implementation>
+              <Number>2</Number>
+            </Channel>
+          </DmaChannelAllocationList>
+        </NiFpga>
+      </CompilationResults>
+    </CompilationResultsTree>
+  </Project>
+  <Bitstream>YmFzZTY0</Bitstream>
+</Bitfile>
+"#;
+
+    #[test]
+    fn test_parse_bitfile() {
+        let interface = BitfileInterface::parse(BITFILE).unwrap();
+        assert_eq!(interface.signature(), "A0613989B20F45FC6E79EB71383493E8");
+        assert_eq!(interface.registers().len(), 3);
+        assert!(interface.register_info("ViControl").is_none());
+
+        let array = interface.register_info("SglResultArray").unwrap();
+        assert_eq!(array.address, 0x18018);
+        assert_eq!(array.data_type, "Sgl");
+        assert_eq!(array.array_size, Some(3));
+        assert!(array.indicator);
+        assert!(!interface.register_info("FxpResult").unwrap().native);
+
+        assert_eq!(interface.fifos().len(), 2);
+        let fifo = interface.fifo_info("NumbersToFPGA").unwrap();
+        assert_eq!(fifo.direction, FifoDirection::HostToTarget);
+        assert_eq!(fifo.data_type, "Bool");
+    }
+
+    #[test]
+    fn test_resolves_matching_types() {
+        let interface = BitfileInterface::parse(BITFILE).unwrap();
+        assert_eq!(
+            interface.register::<u8>("U8Control").unwrap().address(),
+            0x18002
+        );
+        assert_eq!(
+            interface
+                .array_register::<f32, 3>("SglResultArray")
+                .unwrap()
+                .address(),
+            0x18018
+        );
+        let fifo = interface.read_fifo::<u32>("NumbersFromFPGA").unwrap();
+        assert_eq!(crate::fifos::Fifo::address(&fifo), 0);
+    }
+
+    #[test]
+    fn test_rejects_mismatches() {
+        let interface = BitfileInterface::parse(BITFILE).unwrap();
+        for result in [
+            interface.register::<u16>("U8Control").map(|_| ()),
+            interface.register::<f32>("SglResultArray").map(|_| ()),
+            interface
+                .array_register::<f32, 4>("SglResultArray")
+                .map(|_| ()),
+            interface.register::<u8>("Missing").map(|_| ()),
+            interface.write_fifo::<u32>("NumbersFromFPGA").map(|_| ()),
+        ] {
+            assert!(matches!(result, Err(FPGAError::InterfaceMismatch(_))));
+        }
+    }
+
+    #[test]
+    fn test_invalid_bitfile() {
+        assert!(matches!(
+            BitfileInterface::parse("<Bitfile></Bitfile>"),
+            Err(FPGAError::InvalidBitfile(_))
+        ));
+        assert!(matches!(
+            BitfileInterface::parse("<Bitfile>"),
+            Err(FPGAError::InvalidBitfile(_))
+        ));
+    }
+}
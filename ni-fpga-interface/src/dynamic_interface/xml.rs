@@ -0,0 +1,249 @@
+//! A minimal XML reader for bitfiles.
+//!
+//! This covers what bitfiles use: elements, attributes, text, comments,
+//! processing instructions and CDATA. Document type declarations are skipped
+//! rather than interpreted.
+
+use std::borrow::Cow;
+
+#[derive(Debug, Default, PartialEq, Eq)]
+pub(crate) struct Element {
+    pub name: String,
+    pub attributes: Vec<(String, String)>,
+    pub children: Vec<Element>,
+    pub text: String,
+}
+
+impl Element {
+    /// The first child with the name.
+    pub fn child(&self, name: &str) -> Option<&Element> {
+        self.children.iter().find(|child| child.name == name)
+    }
+
+    /// Follows the names down through the first matching child at each level.
+    pub fn path(&self, names: &[&str]) -> Option<&Element> {
+        names
+            .iter()
+            .try_fold(self, |element, name| element.child(name))
+    }
+
+    /// The trimmed text of the first child with the name.
+    pub fn child_text(&self, name: &str) -> Option<&str> {
+        self.child(name).map(|child| child.text.trim())
+    }
+
+    pub fn attribute(&self, name: &str) -> Option<&str> {
+        self.attributes
+            .iter()
+            .find(|(key, _)| key == name)
+            .map(|(_, value)| value.as_str())
+    }
+}
+
+/// Parses the document and returns the root element.
+pub(crate) fn parse(xml: &str) -> Result<Element, String> {
+    let mut stack: Vec<Element> = Vec::new();
+    let mut root = None;
+    let mut rest = xml;
+
+    while !rest.is_empty() {
+        let start = rest.find('<').unwrap_or(rest.len());
+        if let Some(current) = stack.last_mut() {
+            current.text.push_str(&unescape(&rest[..start]));
+        }
+        rest = &rest[start..];
+        if rest.is_empty() {
+            break;
+        }
+
+        if let Some(after) = rest.strip_prefix("<?") {
+            rest = skip_past(after, "?>")?;
+        } else if let Some(after) = rest.strip_prefix("<!--") {
+            rest = skip_past(after, "-->")?;
+        } else if let Some(after) = rest.strip_prefix("<![CDATA[") {
+            let end = after.find("]]>").ok_or("Unterminated CDATA")?;
+            if let Some(current) = stack.last_mut() {
+                current.text.push_str(&after[..end]);
+            }
+            rest = &after[end + 3..];
+        } else if let Some(after) = rest.strip_prefix("<!") {
+            rest = skip_past(after, ">")?;
+        } else if let Some(after) = rest.strip_prefix("</") {
+            let end = after.find('>').ok_or("Unterminated closing tag")?;
+            let name = after[..end].trim();
+            let element = stack
+                .pop()
+                .ok_or_else(|| format!("Unexpected closing tag {name}"))?;
+            if element.name != name {
+                return Err(format!("Closing tag {name} doesn't match {}", element.name));
+            }
+            close(&mut stack, &mut root, element)?;
+            rest = &after[end + 1..];
+        } else {
+            let end = tag_end(&rest[1..]).ok_or("Unterminated tag")? + 1;
+            let mut content = &rest[1..end];
+            let self_closing = content.ends_with('/');
+            if self_closing {
+                content = &content[..content.len() - 1];
+            }
+            let element = open_tag(content)?;
+            if self_closing {
+                close(&mut stack, &mut root, element)?;
+            } else {
+                stack.push(element);
+            }
+            rest = &rest[end + 1..];
+        }
+    }
+
+    if let Some(unclosed) = stack.last() {
+        return Err(format!("Element {} isn't closed", unclosed.name));
+    }
+    root.ok_or_else(|| "No root element".to_string())
+}
+
+fn close(
+    stack: &mut [Element],
+    root: &mut Option<Element>,
+    element: Element,
+) -> Result<(), String> {
+    match stack.last_mut() {
+        Some(parent) => parent.children.push(element),
+        None if root.is_none() => *root = Some(element),
+        None => return Err(format!("Second root element {}", element.name)),
+    }
+    Ok(())
+}
+
+fn skip_past<'a>(text: &'a str, terminator: &str) -> Result<&'a str, String> {
+    text.find(terminator)
+        .map(|end| &text[end + terminator.len()..])
+        .ok_or_else(|| format!("Missing {terminator}"))
+}
+
+/// Finds the closing `>` of a tag, ignoring any inside quoted attribute values.
+fn tag_end(text: &str) -> Option<usize> {
+    let mut quote = None;
+    for (index, character) in text.char_indices() {
+        match (quote, character) {
+            (None, '>') => return Some(index),
+            (None, '"' | '\'') => quote = Some(character),
+            (Some(open), _) if open == character => quote = None,
+            _ => {}
+        }
+    }
+    None
+}
+
+/// Parses the name and attributes between the angle brackets of an opening tag.
+fn open_tag(content: &str) -> Result<Element, String> {
+    let content = content.trim();
+    let name_end = content
+        .find(|character: char| character.is_whitespace())
+        .unwrap_or(content.len());
+    let mut element = Element {
+        name: content[..name_end].to_string(),
+        ..Default::default()
+    };
+    if element.name.is_empty() {
+        return Err("Empty tag name".to_string());
+    }
+
+    let mut rest = content[name_end..].trim_start();
+    while !rest.is_empty() {
+        let equals = rest
+            .find('=')
+            .ok_or_else(|| format!("Attribute without value in {}", element.name))?;
+        let key = rest[..equals].trim().to_string();
+        let value = rest[equals + 1..].trim_start();
+        let quote = value
+            .chars()
+            .next()
+            .filter(|quote| *quote == '"' || *quote == '\'')
+            .ok_or_else(|| format!("Unquoted attribute {key}"))?;
+        let value_end = value[1..]
+            .find(quote)
+            .ok_or_else(|| format!("Unterminated attribute {key}"))?
+            + 1;
+        element
+            .attributes
+            .push((key, unescape(&value[1..value_end]).into_owned()));
+        rest = value[value_end + 1..].trim_start();
+    }
+    Ok(element)
+}
+
+/// Replaces the predefined and numeric character references.
+fn unescape(text: &str) -> Cow<'_, str> {
+    if !text.contains('&') {
+        return Cow::Borrowed(text);
+    }
+    let mut output = String::with_capacity(text.len());
+    let mut rest = text;
+    while let Some(start) = rest.find('&') {
+        output.push_str(&rest[..start]);
+        rest = &rest[start..];
+        let replacement = rest.find(';').and_then(|end| {
+            let character = match &rest[1..end] {
+                "lt" => Some('<'),
+                "gt" => Some('>'),
+                "amp" => Some('&'),
+                "quot" => Some('"'),
+                "apos" => Some('\''),
+                reference => reference
+                    .strip_prefix("#x")
+                    .map(|hex| u32::from_str_radix(hex, 16))
+                    .or_else(|| reference.strip_prefix('#').map(str::parse))
+                    .and_then(|code| code.ok())
+                    .and_then(char::from_u32),
+            };
+            character.map(|character| (character, end))
+        });
+        match replacement {
+            Some((character, end)) => {
+                output.push(character);
+                rest = &rest[end + 1..];
+            }
+            // Leave anything unrecognised as it was.
+            None => {
+                output.push('&');
+                rest = &rest[1..];
+            }
+        }
+    }
+    output.push_str(rest);
+    Cow::Owned(output)
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn test_parse_nested_elements() {
+        let root = parse(
+            "<?xml version=\"1.0\"?>\n<!-- note -->\n<A><B x=\"1\" y='a>b'>text &amp; &#65;</B><C/></A>",
+        )
+        .unwrap();
+        assert_eq!(root.name, "A");
+        let b = root.child("B").unwrap();
+        assert_eq!(b.attribute("x"), Some("1"));
+        assert_eq!(b.attribute("y"), Some("a>b"));
+        assert_eq!(b.text, "text & A");
+        assert!(root.child("C").unwrap().children.is_empty());
+    }
+
+    #[test]
+    fn test_path_and_cdata() {
+        let root = parse("<A><B><C><![CDATA[<raw>]]></C></B></A>").unwrap();
+        assert_eq!(root.path(&["B", "C"]).unwrap().text, "<raw>");
+        assert!(root.path(&["B", "D"]).is_none());
+    }
+
+    #[test]
+    fn test_mismatched_tags_fail() {
+        assert!(parse("<A><B></A></B>").is_err());
+        assert!(parse("<A>").is_err());
+        assert!(parse("<A/><B/>").is_err());
+    }
+}
@@ -4,11 +4,32 @@
 pub enum FPGAError {
     InternalError(NiFpgaStatus),
     ContextAlreadyActive,
+    /// The driver returned a property value we don't recognise.
+    UnexpectedPropertyValue(i32),
+    /// The operation was abandoned before it completed, for example because the reactor shut down.
+    Cancelled,
+    /// A file operation failed, for example while recording a FIFO.
+    Io(std::io::Error),
+    /// A bitfile couldn't be read as a bitfile interface.
+    InvalidBitfile(String),
+    /// A register or FIFO requested from a bitfile interface is missing or has a different type.
+    InterfaceMismatch(String),
+    /// A peer-to-peer stream couldn't be controlled or isn't linked.
+    PeerToPeer(String),
+    /// A FIFO configuration can't be committed, for example because it doesn't fit the host buffer allocation.
+    InvalidFifoConfig(String),
 }
 
 pub type Result<T> = core::result::Result<T, FPGAError>;
 
-impl FPGAError {}
+impl FPGAError {
+    /// Returns true if the error is the FIFO timeout status.
+    ///
+    /// When polling a FIFO this is normally expected rather than a failure.
+    pub fn is_fifo_timeout(&self) -> bool {
+        matches!(self, FPGAError::InternalError(status) if *status == NiFpgaStatus::FIFO_TIMEOUT)
+    }
+}
 
 impl From<NiFpgaStatus> for FPGAError {
     fn from(status: NiFpgaStatus) -> Self {
@@ -16,6 +37,12 @@ impl From<NiFpgaStatus> for FPGAError {
     }
 }
 
+impl From<std::io::Error> for FPGAError {
+    fn from(error: std::io::Error) -> Self {
+        FPGAError::Io(error)
+    }
+}
+
 pub fn to_fpga_result<T>(value: T, status: NiFpgaStatus) -> Result<T> {
     if !status.is_error() {
         Ok(value)
@@ -28,12 +55,36 @@ pub fn to_fpga_result<T>(value: T, status: NiFpgaStatus) -> Result<T> {
 /// where the value represents the errors.
 #[repr(transparent)]
 #[derive(Clone, Copy, PartialEq, Eq)]
-pub struct NiFpgaStatus(i32);
+pub struct NiFpgaStatus(pub(crate) i32);
 
 impl NiFpgaStatus {
+    /// No errors or warnings.
+    pub const SUCCESS: NiFpgaStatus = NiFpgaStatus(0);
+    /// The timeout expired before the FIFO operation could complete.
+    pub const FIFO_TIMEOUT: NiFpgaStatus = NiFpgaStatus(-50400);
+    /// A parameter to a function was not valid.
+    pub const INVALID_PARAMETER: NiFpgaStatus = NiFpgaStatus(-52005);
+    /// A required resource was not found.
+    pub const RESOURCE_NOT_FOUND: NiFpgaStatus = NiFpgaStatus(-52006);
+    /// The timeout expired before any of the IRQs were asserted.
+    pub const IRQ_TIMEOUT: NiFpgaStatus = NiFpgaStatus(-61060);
+    /// The number of FIFO elements is greater than the host buffer or more were released than acquired.
+    pub const INVALID_FIFO_ELEMENTS: NiFpgaStatus = NiFpgaStatus(-61073);
+
     pub fn is_error(&self) -> bool {
         self.0 < 0
     }
+
+    /// Returns true for a positive status, where the call completed but the driver has a warning.
+    pub fn is_warning(&self) -> bool {
+        self.0 > 0
+    }
+
+    /// The raw status code returned by the driver.
+    pub fn code(&self) -> i32 {
+        self.0
+    }
+
     fn get_error_description(&self) -> &'static str {
         match self.0 {
         0 => "No errors or warnings.",
@@ -0,0 +1,264 @@
+//! Services several target to host DMA FIFOs from a single thread.
+//!
+//! A thread per FIFO blocked in [`ReadFifo::read`] works but each thread
+//! competes for the CPU with the rest of the system, which hurts on
+//! embedded targets with few cores.
+//!
+//! A [`FifoGroup`] instead polls the fill level of every FIFO in one loop.
+//! Once a FIFO reaches its watermark the available data is acquired as a
+//! zero copy region and handed to the callback for that channel.
+//!
+//! # Example
+//!
+//! ```rust
+//! # use ni_fpga_interface::fifos::ReadFifo;
+//! # use ni_fpga_interface::session::{NiFpgaContext, Session};
+//! use ni_fpga_interface::fifo_group::{ChannelConfig, FifoGroup};
+//! use std::sync::Arc;
+//! use std::time::Duration;
+//!
+//! # let context = NiFpgaContext::new().unwrap();
+//! let session = Arc::new(
+//!     Session::new(&context, "main.lvbitx", "sig", "RIO0", &Default::default()).unwrap(),
+//! );
+//! let group = FifoGroup::new()
+//!     .add(ReadFifo::<u64>::new(1), ChannelConfig::watermark(4096), |data| {
+//!         println!("Channel 1: {} elements", data.len());
+//!     })
+//!     .add(ReadFifo::<i16>::new(2), ChannelConfig::watermark(512), |data| {
+//!         println!("Channel 2: {} elements", data.len());
+//!     });
+//!
+//! let running = group.start(session, Duration::from_micros(500));
+//! // ...
+//! running.stop().unwrap();
+//! ```
+
+use crate::error::FPGAError;
+use crate::fifos::ReadFifo;
+use crate::session::{FifoInterface, NativeFpgaType, Session};
+use std::sync::atomic::{AtomicBool, Ordering};
+use std::sync::Arc;
+use std::thread::JoinHandle;
+use std::time::Duration;
+
+/// Controls when a channel in the group is serviced.
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub struct ChannelConfig {
+    /// The number of elements which must be available before the data is acquired (default: 1).
+    pub watermark: usize,
+    /// The most elements passed to the callback in a single call (default: unlimited).
+    pub max_block: usize,
+}
+
+impl Default for ChannelConfig {
+    fn default() -> Self {
+        Self {
+            watermark: 1,
+            max_block: usize::MAX,
+        }
+    }
+}
+
+impl ChannelConfig {
+    /// Acquires data once the given number of elements are available.
+    pub fn watermark(watermark: usize) -> Self {
+        Self {
+            watermark,
+            ..Default::default()
+        }
+    }
+
+    /// Limits the number of elements in a single callback.
+    pub fn max_block(mut self, max_block: usize) -> Self {
+        self.max_block = max_block;
+        self
+    }
+}
+
+/// Type erased access to a channel so FIFOs of different types can share the group.
+trait GroupChannel: Send {
+    /// Checks the fill level and calls the callback if the watermark is reached.
+    ///
+    /// Returns the number of elements passed to the callback.
+    fn service(&mut self, session: &Session) -> Result<usize, FPGAError>;
+}
+
+struct Channel<T: NativeFpgaType, F> {
+    fifo: ReadFifo<T>,
+    config: ChannelConfig,
+    callback: F,
+}
+
+impl<T, F> GroupChannel for Channel<T, F>
+where
+    T: NativeFpgaType + Send + 'static,
+    F: FnMut(&[T]) + Send,
+    Session: FifoInterface<T>,
+{
+    fn service(&mut self, session: &Session) -> Result<usize, FPGAError> {
+        let available = self.fifo.elements_available(session)?;
+        if available == 0 || available < self.config.watermark {
+            return Ok(0);
+        }
+
+        let elements = available.min(self.config.max_block);
+        // The elements are already in the host buffer so this doesn't wait.
+        let (region, _remaining) =
+            self.fifo
+                .get_read_region(session, elements, Some(Duration::ZERO))?;
+        (self.callback)(region.elements);
+        Ok(region.elements.len())
+    }
+}
+
+/// A set of target to host FIFOs serviced together.
+///
+/// See the [module documentation](self) for an example.
+#[derive(Default)]
+pub struct FifoGroup {
+    channels: Vec<Box<dyn GroupChannel>>,
+}
+
+impl FifoGroup {
+    /// Creates an empty group.
+    pub fn new() -> Self {
+        Self::default()
+    }
+
+    /// Adds a FIFO to the group.
+    ///
+    /// The callback receives the data directly from the DMA host buffer.
+    /// The elements are released back to the driver when it returns.
+    pub fn add<T, F>(mut self, fifo: ReadFifo<T>, config: ChannelConfig, callback: F) -> Self
+    where
+        T: NativeFpgaType + Send + 'static,
+        F: FnMut(&[T]) + Send + 'static,
+        Session: FifoInterface<T>,
+    {
+        self.channels.push(Box::new(Channel {
+            fifo,
+            config,
+            callback,
+        }));
+        self
+    }
+
+    /// The number of FIFOs in the group.
+    pub fn len(&self) -> usize {
+        self.channels.len()
+    }
+
+    /// Returns true if no FIFOs have been added.
+    pub fn is_empty(&self) -> bool {
+        self.channels.is_empty()
+    }
+
+    /// Checks every FIFO once without waiting.
+    ///
+    /// Returns the total number of elements passed to callbacks.
+    pub fn poll(&mut self, session: &Session) -> Result<usize, FPGAError> {
+        let mut serviced = 0;
+        for channel in &mut self.channels {
+            serviced += channel.service(session)?;
+        }
+        Ok(serviced)
+    }
+
+    /// Polls the FIFOs until stop is set.
+    ///
+    /// When a pass finds no FIFO at its watermark the thread sleeps for `idle_sleep`
+    /// to give the core back to the rest of the system.
+    pub fn run(
+        &mut self,
+        session: &Session,
+        stop: &AtomicBool,
+        idle_sleep: Duration,
+    ) -> Result<(), FPGAError> {
+        while !stop.load(Ordering::Relaxed) {
+            if self.poll(session)? == 0 {
+                std::thread::sleep(idle_sleep);
+            }
+        }
+        Ok(())
+    }
+
+    /// Moves the group to a new thread which runs it until stopped.
+    pub fn start(mut self, session: Arc<Session>, idle_sleep: Duration) -> RunningFifoGroup {
+        let stop = Arc::new(AtomicBool::new(false));
+        let thread_stop = stop.clone();
+        let thread = std::thread::Builder::new()
+            .name("fifo-group".to_string())
+            .spawn(move || self.run(session.as_ref(), &thread_stop, idle_sleep))
+            .expect("Failed to spawn FIFO group thread");
+
+        RunningFifoGroup {
+            stop,
+            thread: Some(thread),
+        }
+    }
+}
+
+/// A [`FifoGroup`] running on its own thread.
+///
+/// The thread is stopped when this is dropped or [`RunningFifoGroup::stop`] is called.
+pub struct RunningFifoGroup {
+    stop: Arc<AtomicBool>,
+    thread: Option<JoinHandle<Result<(), FPGAError>>>,
+}
+
+impl RunningFifoGroup {
+    /// Returns false if the thread has exited, for example due to an error.
+    ///
+    /// Call [`RunningFifoGroup::stop`] to retrieve the error.
+    pub fn is_running(&self) -> bool {
+        self.thread
+            .as_ref()
+            .map(|thread| !thread.is_finished())
+            .unwrap_or(false)
+    }
+
+    /// Stops the thread and returns any error it encountered.
+    pub fn stop(mut self) -> Result<(), FPGAError> {
+        self.stop_thread()
+    }
+
+    fn stop_thread(&mut self) -> Result<(), FPGAError> {
+        self.stop.store(true, Ordering::Relaxed);
+        match self.thread.take() {
+            Some(thread) => thread.join().expect("FIFO group thread panicked"),
+            None => Ok(()),
+        }
+    }
+}
+
+impl Drop for RunningFifoGroup {
+    fn drop(&mut self) {
+        // Cant return result from drop so ignore it.
+        let _ = self.stop_thread();
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn test_channel_config() {
+        let config = ChannelConfig::watermark(100).max_block(50);
+        assert_eq!(config.watermark, 100);
+        assert_eq!(config.max_block, 50);
+        assert_eq!(ChannelConfig::default().watermark, 1);
+    }
+
+    #[test]
+    fn test_mixed_types_in_group() {
+        let group = FifoGroup::new()
+            .add(ReadFifo::<u64>::new(1), ChannelConfig::default(), |_| {})
+            .add(ReadFifo::<i16>::new(2), ChannelConfig::default(), |_| {})
+            .add(ReadFifo::<f32>::new(3), ChannelConfig::default(), |_| {});
+        assert_eq!(group.len(), 3);
+        assert!(!group.is_empty());
+        assert!(FifoGroup::new().is_empty());
+    }
+}
@@ -1,10 +1,23 @@
 //! Provides the high level interface for DMA FIFOs.
 
+use crate::buffer_pool::{BufferPool, PooledBuffer};
 use crate::error::FPGAError;
+use crate::host_buffer::HostBufferAllocation;
 use crate::nifpga_sys::*;
-use crate::session::{FifoInterface, FifoReadRegion, FifoWriteRegion, NativeFpgaType, Session};
+use crate::region_queue::ReadRegionQueue;
+use crate::session::{
+    FifoAcquire, FifoInterface, FifoReadRegion, FifoTransfer, FifoWriteRegion, NativeFpgaType,
+    Session,
+};
+use libc::c_void;
+use std::collections::HashMap;
 use std::marker::PhantomData;
-use std::time::Duration;
+use std::sync::atomic::{AtomicU64, AtomicUsize, Ordering};
+use std::sync::{Arc, Mutex, OnceLock};
+use std::time::{Duration, Instant};
+
+// Re-export the FIFO property types from here for a better dev experience.
+pub use crate::types::{FifoFlowControl, FifoProperty, HostBufferType};
 
 /// The elements that are common between read and write FIFOs.
 pub trait Fifo {
@@ -82,9 +95,479 @@ pub trait Fifo {
     ) -> Result<PeerToPeerEndpoint, FPGAError> {
         session.get_peer_to_peer_fifo_endpoint(self.address())
     }
+
+    /// Starts a configuration of the host buffer properties for this FIFO.
+    ///
+    /// The settings are collected in the returned [`FifoConfig`] and applied together with [`FifoConfig::commit`].
+    ///
+    /// ```rust
+    /// # use ni_fpga_interface::fifos::{ ReadFifo, Fifo, FifoFlowControl};
+    /// # use ni_fpga_interface::session::Session;
+    ///
+    ///
+    /// let session = Session::new("main.lvbitx", "sig", "RIO0").unwrap();
+    /// let mut fifo = ReadFifo::<u64>::new(1);
+    /// fifo.stop(&session).unwrap();
+    /// fifo.config()
+    ///     .host_buffer_size(1 << 20)
+    ///     .flow_control(FifoFlowControl::Disabled)
+    ///     .commit(&session)
+    ///     .unwrap();
+    /// ```
+    fn config(&self) -> FifoConfig {
+        FifoConfig::new(self.address())
+    }
+
+    /// The number of bytes in a single element of the FIFO.
+    fn bytes_per_element(&self, session: &Session) -> Result<u32, FPGAError> {
+        session.get_fifo_property_u32(self.address(), FifoProperty::BytesPerElement)
+    }
+
+    /// The number of elements in the host memory part of the FIFO.
+    fn host_buffer_size(&self, session: &Session) -> Result<u64, FPGAError> {
+        session.get_fifo_property_u64(self.address(), FifoProperty::HostBufferSize)
+    }
+
+    /// The allocation unit, in elements, the host buffer size is coerced to.
+    fn host_buffer_allocation_granularity(&self, session: &Session) -> Result<u32, FPGAError> {
+        session.get_fifo_property_u32(
+            self.address(),
+            FifoProperty::HostBufferAllocationGranularity,
+        )
+    }
+
+    /// The number of elements mirrored at the end of the host buffer.
+    fn host_buffer_mirror_size(&self, session: &Session) -> Result<u64, FPGAError> {
+        session.get_fifo_property_u64(self.address(), FifoProperty::HostBufferMirrorSize)
+    }
+
+    /// Who allocated the host memory part of the FIFO.
+    fn host_buffer_type(&self, session: &Session) -> Result<HostBufferType, FPGAError> {
+        let value = session.get_fifo_property_i32(self.address(), FifoProperty::HostBufferType)?;
+        HostBufferType::try_from(value).map_err(FPGAError::UnexpectedPropertyValue)
+    }
+
+    /// The current flow control behaviour of the FIFO.
+    fn flow_control(&self, session: &Session) -> Result<FifoFlowControl, FPGAError> {
+        let value = session.get_fifo_property_i32(self.address(), FifoProperty::FlowControl)?;
+        FifoFlowControl::try_from(value).map_err(FPGAError::UnexpectedPropertyValue)
+    }
+
+    /// The number of elements acquired through the zero copy interface and not yet released.
+    fn elements_currently_acquired(&self, session: &Session) -> Result<u64, FPGAError> {
+        session.get_fifo_property_u64(self.address(), FifoProperty::ElementsCurrentlyAcquired)
+    }
+}
+
+/// Where the host memory part of the FIFO comes from.
+#[derive(Debug, Clone)]
+enum HostBuffer {
+    AllocatedByRio,
+    AllocatedByUser(*mut c_void),
+    /// Allocated by the user through this crate and held by the session once committed.
+    Allocation(Arc<HostBufferAllocation>),
+}
+
+/// The sizing properties a commit sets, where [`None`] leaves the property unchanged.
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+struct HostBufferSizes {
+    granularity: Option<u32>,
+    size: Option<u64>,
+    mirror_size: Option<u64>,
+}
+
+/// A set of FIFO host buffer properties to apply in a single commit.
+///
+/// This is created by [`Fifo::config`]. Only the properties you set are changed.
+///
+/// The FIFO must be stopped before committing. Committing empties any data from the host memory and FPGA parts of the FIFO.
+#[derive(Debug, Clone)]
+pub struct FifoConfig {
+    address: FifoAddress,
+    host_buffer_size: Option<u64>,
+    allocation_granularity: Option<u32>,
+    mirror_size: Option<u64>,
+    flow_control: Option<FifoFlowControl>,
+    host_buffer: Option<HostBuffer>,
+}
+
+impl FifoConfig {
+    /// Create an empty configuration for the FIFO address.
+    pub const fn new(address: FifoAddress) -> Self {
+        Self {
+            address,
+            host_buffer_size: None,
+            allocation_granularity: None,
+            mirror_size: None,
+            flow_control: None,
+            host_buffer: None,
+        }
+    }
+
+    /// The number of elements in the host memory part of the FIFO.
+    /// This will be coerced to a multiple of the allocation granularity.
+    pub fn host_buffer_size(mut self, elements: u64) -> Self {
+        self.host_buffer_size = Some(elements);
+        self
+    }
+
+    /// The allocation unit, in elements, the host buffer size is coerced to. Must be a power of 2.
+    pub fn host_buffer_allocation_granularity(mut self, elements: u32) -> Self {
+        self.allocation_granularity = Some(elements);
+        self
+    }
+
+    /// The number of elements mirrored at the end of the host buffer.
+    ///
+    /// This allows the zero copy interface to return a full region
+    /// when it would otherwise wrap around the end of the buffer.
+    pub fn host_buffer_mirror_size(mut self, elements: u64) -> Self {
+        self.mirror_size = Some(elements);
+        self
+    }
+
+    /// Sets the flow control behaviour.
+    ///
+    /// Disabling flow control lets the FPGA overwrite data the host hasn't read,
+    /// which suits streams where only the latest data matters.
+    pub fn flow_control(mut self, flow_control: FifoFlowControl) -> Self {
+        self.flow_control = Some(flow_control);
+        self
+    }
+
+    /// Use a host buffer allocated by the caller, for example hugepage backed or locked memory.
+    ///
+    /// The buffer must be sized for the host buffer size in elements of the FIFO
+    /// and the driver will page lock it.
+    ///
+    /// # Safety
+    ///
+    /// The driver will DMA into this memory. It must remain valid until the session is closed
+    /// or the FIFO is reconfigured with a different buffer.
+    pub unsafe fn user_host_buffer(mut self, buffer: *mut c_void) -> Self {
+        self.host_buffer = Some(HostBuffer::AllocatedByUser(buffer));
+        self
+    }
+
+    /// Use a host buffer from [`HostBufferAllocation`], for example hugepage backed memory on a chosen NUMA node.
+    ///
+    /// Committing sets the host buffer size and allocation granularity to those of
+    /// the allocation and the mirror size to zero, since the allocation has no room
+    /// for mirrored elements. The commit fails with [`FPGAError::InvalidFifoConfig`]
+    /// if the configuration sets any of these to something else, or if the elements
+    /// of the FIFO are too large for the allocation to hold them all.
+    ///
+    /// Committing hands the allocation to the session, which keeps it until the
+    /// FIFO is committed with another buffer or the session is closed.
+    /// See [`crate::host_buffer`] for an example.
+    pub fn allocated_host_buffer(mut self, buffer: Arc<HostBufferAllocation>) -> Self {
+        self.host_buffer = Some(HostBuffer::Allocation(buffer));
+        self
+    }
+
+    /// Return to a host buffer allocated by the driver.
+    pub fn driver_host_buffer(mut self) -> Self {
+        self.host_buffer = Some(HostBuffer::AllocatedByRio);
+        self
+    }
+
+    /// The granularity, size and mirror size to commit.
+    ///
+    /// With an allocation these are forced to fit it and `bytes_per_element` is called
+    /// for the element size of the FIFO, which must fit the mapping too.
+    fn host_buffer_sizes(
+        &self,
+        bytes_per_element: impl FnOnce() -> Result<u32, FPGAError>,
+    ) -> Result<HostBufferSizes, FPGAError> {
+        let Some(HostBuffer::Allocation(allocation)) = &self.host_buffer else {
+            return Ok(HostBufferSizes {
+                granularity: self.allocation_granularity,
+                size: self.host_buffer_size,
+                mirror_size: self.mirror_size,
+            });
+        };
+        let invalid = |message: String| Err(FPGAError::InvalidFifoConfig(message));
+        if let Some(size) = self
+            .host_buffer_size
+            .filter(|&size| size != allocation.elements())
+        {
+            return invalid(format!(
+                "A host buffer size of {size} elements doesn't match the allocation of {} elements",
+                allocation.elements()
+            ));
+        }
+        if let Some(granularity) = self
+            .allocation_granularity
+            .filter(|&granularity| granularity != allocation.granularity())
+        {
+            return invalid(format!(
+                "An allocation granularity of {granularity} elements doesn't match the allocation, which was sized for {}",
+                allocation.granularity()
+            ));
+        }
+        if let Some(mirror_size) = self.mirror_size.filter(|&mirror_size| mirror_size != 0) {
+            return invalid(format!(
+                "The allocation has no room for {mirror_size} mirrored elements"
+            ));
+        }
+        let bytes_per_element = bytes_per_element()?;
+        let fits = (bytes_per_element as u64)
+            .checked_mul(allocation.elements())
+            .is_some_and(|bytes| bytes <= allocation.len_bytes() as u64);
+        if !fits {
+            return invalid(format!(
+                "The allocation of {} bytes can't hold {} elements of {bytes_per_element} bytes",
+                allocation.len_bytes(),
+                allocation.elements()
+            ));
+        }
+        Ok(HostBufferSizes {
+            granularity: Some(allocation.granularity()),
+            size: Some(allocation.elements()),
+            mirror_size: Some(0),
+        })
+    }
+
+    /// Apply the properties to the FIFO and commit them to the driver.
+    ///
+    /// The FIFO must be stopped.
+    pub fn commit(&self, session: &Session) -> Result<(), FPGAError> {
+        let HostBufferSizes {
+            granularity,
+            size,
+            mirror_size,
+        } = self.host_buffer_sizes(|| {
+            session.get_fifo_property_u32(self.address, FifoProperty::BytesPerElement)
+        })?;
+        // Granularity first since the size is coerced to it.
+        if let Some(granularity) = granularity {
+            session.set_fifo_property_u32(
+                self.address,
+                FifoProperty::HostBufferAllocationGranularity,
+                granularity,
+            )?;
+        }
+        if let Some(size) = size {
+            session.set_fifo_property_u64(self.address, FifoProperty::HostBufferSize, size)?;
+        }
+        if let Some(mirror_size) = mirror_size {
+            session.set_fifo_property_u64(
+                self.address,
+                FifoProperty::HostBufferMirrorSize,
+                mirror_size,
+            )?;
+        }
+        match &self.host_buffer {
+            Some(HostBuffer::AllocatedByUser(buffer)) => {
+                session.set_fifo_property_i32(
+                    self.address,
+                    FifoProperty::HostBufferType,
+                    HostBufferType::AllocatedByUser as i32,
+                )?;
+                // Safety: the caller guaranteed the buffer lifetime when calling user_host_buffer.
+                unsafe {
+                    session.set_fifo_property_ptr(
+                        self.address,
+                        FifoProperty::HostBuffer,
+                        *buffer,
+                    )?;
+                }
+            }
+            Some(HostBuffer::Allocation(allocation)) => {
+                // Held before the driver is given it so it can't be unmapped while in use.
+                session.retain_host_buffer(self.address, allocation)?;
+                session.set_fifo_property_i32(
+                    self.address,
+                    FifoProperty::HostBufferType,
+                    HostBufferType::AllocatedByUser as i32,
+                )?;
+                // Safety: the session now holds the allocation for as long as the driver can use it.
+                unsafe {
+                    session.set_fifo_property_ptr(
+                        self.address,
+                        FifoProperty::HostBuffer,
+                        allocation.as_ptr(),
+                    )?;
+                }
+            }
+            Some(HostBuffer::AllocatedByRio) => {
+                session.set_fifo_property_i32(
+                    self.address,
+                    FifoProperty::HostBufferType,
+                    HostBufferType::AllocatedByRio as i32,
+                )?;
+            }
+            None => {}
+        }
+        if let Some(flow_control) = self.flow_control {
+            session.set_fifo_property_i32(
+                self.address,
+                FifoProperty::FlowControl,
+                flow_control as i32,
+            )?;
+        }
+        session.commit_fifo_configuration(self.address)?;
+        // The driver has moved to the new buffer so earlier allocations for the FIFO can go.
+        if let Some(host_buffer) = &self.host_buffer {
+            let keep = match host_buffer {
+                HostBuffer::Allocation(allocation) => Some(allocation),
+                _ => None,
+            };
+            session.release_host_buffers(self.address, keep);
+        }
+        Ok(())
+    }
+}
+
+/// A fill level of a FIFO reported by the driver.
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub struct FifoLevel {
+    /// For a read FIFO the elements available to read. For a write FIFO the space available to write.
+    pub elements: usize,
+    /// When the driver call which reported the level returned.
+    pub observed_at: Instant,
+}
+
+impl FifoLevel {
+    /// How long ago the level was observed.
+    pub fn age(&self) -> Duration {
+        self.observed_at.elapsed()
+    }
+}
+
+/// The reference point for the timestamps in [`FifoLevels`] so they fit in an atomic.
+fn level_epoch() -> Instant {
+    static EPOCH: OnceLock<Instant> = OnceLock::new();
+    *EPOCH.get_or_init(Instant::now)
+}
+
+/// The last level reported by the driver for one FIFO.
+struct LevelCache {
+    elements: AtomicUsize,
+    /// Nanoseconds since the epoch plus one so zero means nothing has been observed.
+    observed: AtomicU64,
+}
+
+impl LevelCache {
+    fn new() -> Self {
+        Self {
+            elements: AtomicUsize::new(0),
+            observed: AtomicU64::new(0),
+        }
+    }
+
+    fn record(&self, elements: usize) {
+        let nanos = level_epoch().elapsed().as_nanos() as u64;
+        self.elements.store(elements, Ordering::Relaxed);
+        self.observed.store(nanos + 1, Ordering::Relaxed);
+    }
+
+    fn last(&self) -> Option<FifoLevel> {
+        let observed = self.observed.load(Ordering::Relaxed);
+        if observed == 0 {
+            return None;
+        }
+        Some(FifoLevel {
+            elements: self.elements.load(Ordering::Relaxed),
+            observed_at: level_epoch() + Duration::from_nanos(observed - 1),
+        })
+    }
+}
+
+/// FIFO addresses below this are cached without a lock.
+const DIRECT_LEVELS: usize = 32;
+
+/// The levels last reported by the driver for the FIFOs of a session, keyed by FIFO address.
+///
+/// These are kept by the session rather than the FIFO definitions so every copy of a
+/// definition, such as each use of a generated constant, sees the same level.
+/// FIFO addresses are allocated from zero so most are held in atomics, with a
+/// locked map for any others.
+pub struct FifoLevels {
+    direct: [LevelCache; DIRECT_LEVELS],
+    others: Mutex<HashMap<FifoAddress, FifoLevel>>,
+}
+
+impl Default for FifoLevels {
+    fn default() -> Self {
+        Self {
+            direct: std::array::from_fn(|_| LevelCache::new()),
+            others: Mutex::new(HashMap::new()),
+        }
+    }
+}
+
+impl FifoLevels {
+    pub fn new() -> Self {
+        Self::default()
+    }
+
+    /// Stores the level the driver just reported for the FIFO.
+    pub fn record(&self, fifo: FifoAddress, elements: usize) {
+        match self.direct.get(fifo as usize) {
+            Some(cache) => cache.record(elements),
+            None => {
+                let level = FifoLevel {
+                    elements,
+                    observed_at: Instant::now(),
+                };
+                self.others
+                    .lock()
+                    .expect("FIFO levels poisoned")
+                    .insert(fifo, level);
+            }
+        }
+    }
+
+    /// The last level stored for the FIFO or [`None`] if there isn't one.
+    pub fn last(&self, fifo: FifoAddress) -> Option<FifoLevel> {
+        match self.direct.get(fifo as usize) {
+            Some(cache) => cache.last(),
+            None => self
+                .others
+                .lock()
+                .expect("FIFO levels poisoned")
+                .get(&fifo)
+                .copied(),
+        }
+    }
+}
+
+/// Stores the level in the session, if it keeps them.
+fn record_level<T: NativeFpgaType>(
+    session: &impl FifoInterface<T>,
+    fifo: FifoAddress,
+    elements: usize,
+) {
+    if let Some(levels) = session.fifo_levels() {
+        levels.record(fifo, elements);
+    }
+}
+
+/// Returns the level stored in the session if it is newer than max_age, otherwise calls query and stores the result.
+fn level_or_query<T: NativeFpgaType>(
+    session: &impl FifoInterface<T>,
+    fifo: FifoAddress,
+    max_age: Duration,
+    query: impl FnOnce() -> Result<usize, FPGAError>,
+) -> Result<usize, FPGAError> {
+    let levels = session.fifo_levels();
+    match levels.and_then(|levels| levels.last(fifo)) {
+        Some(level) if level.age() <= max_age => Ok(level.elements),
+        _ => {
+            let elements = query()?;
+            if let Some(levels) = levels {
+                levels.record(fifo, elements);
+            }
+            Ok(elements)
+        }
+    }
 }
 
 /// A FIFO that can be read from.
+///
+/// Every read records the elements remaining in the FIFO with the session so the last
+/// fill level is available from [`ReadFifo::last_level`] without a driver call.
 pub struct ReadFifo<T: NativeFpgaType> {
     address: FifoAddress,
     phantom: PhantomData<T>,
@@ -124,7 +607,70 @@ impl<T: NativeFpgaType + 'static> ReadFifo<T> {
         timeout: Option<Duration>,
         data: &mut [T],
     ) -> Result<usize, FPGAError> {
-        session.read_fifo(self.address, data, timeout)
+        let remaining = session.read_fifo(self.address, data, timeout)?;
+        record_level(session, self.address, remaining);
+        Ok(remaining)
+    }
+
+    /// Reads like [`ReadFifo::read`] but returns [`FifoTransfer::TimedOut`] instead of an error
+    /// if the data doesn't arrive in time.
+    ///
+    /// This suits polling loops where the timeout is the common case.
+    /// Any warning returned by the driver is kept in the result.
+    ///
+    /// # Example
+    ///
+    /// ```rust
+    /// # use ni_fpga_interface::fifos::ReadFifo;
+    /// # use ni_fpga_interface::session::{FifoTransfer, NiFpgaContext, Session};
+    /// use std::time::Duration;
+    ///
+    /// # let context = NiFpgaContext::new().unwrap();
+    /// # let session = Session::new(&context, "main.lvbitx", "sig", "RIO0", &Default::default()).unwrap();
+    /// let mut fifo = ReadFifo::<u64>::new(1);
+    /// let mut buffer = [0u64; 1000];
+    /// match fifo.try_read(&session, Some(Duration::from_millis(10)), &mut buffer).unwrap() {
+    ///     FifoTransfer::Complete { .. } => println!("{:?}", buffer),
+    ///     // Take whatever has arrived instead.
+    ///     FifoTransfer::TimedOut { remaining } => {
+    ///         fifo.read(&session, None, &mut buffer[..remaining]).unwrap();
+    ///     }
+    /// }
+    /// ```
+    pub fn try_read(
+        &mut self,
+        session: &impl FifoInterface<T>,
+        timeout: Option<Duration>,
+        data: &mut [T],
+    ) -> Result<FifoTransfer, FPGAError> {
+        let transfer = session.try_read_fifo(self.address, data, timeout)?;
+        record_level(session, self.address, transfer.remaining());
+        Ok(transfer)
+    }
+
+    /// Reads `elements` into a block taken from the pool so it can be handed to another thread without copying.
+    ///
+    /// The timeout applies to waiting for a free block and then to the read.
+    /// If every block is still in use at the timeout this fails with the FIFO timeout,
+    /// as though the read had timed out, so [`FPGAError::is_fifo_timeout`] covers both.
+    ///
+    /// Returns the buffer, holding `elements` elements, and the number of elements still to be read.
+    /// See [`crate::buffer_pool`] for an example.
+    ///
+    /// # Panics
+    ///
+    /// If `elements` is more than the pool block length.
+    pub fn read_pooled(
+        &mut self,
+        session: &impl FifoInterface<T>,
+        pool: &BufferPool<T>,
+        elements: usize,
+        timeout: Option<Duration>,
+    ) -> Result<(PooledBuffer<T>, usize), FPGAError> {
+        let mut buffer = pool.acquire_or_timeout(timeout)?;
+        buffer.set_len(elements);
+        let remaining = self.read(session, timeout, &mut buffer)?;
+        Ok((buffer, remaining))
     }
 
     /// Provides a mechanism to read from the FIFO without copying the data.
@@ -155,7 +701,36 @@ impl<T: NativeFpgaType + 'static> ReadFifo<T> {
         elements: usize,
         timeout: Option<Duration>,
     ) -> Result<(FifoReadRegion<'s, 'd, T>, usize), FPGAError> {
-        session.zero_copy_read(self.address, elements, timeout)
+        let (region, remaining) = session.zero_copy_read(self.address, elements, timeout)?;
+        record_level(session, self.address, remaining);
+        Ok((region, remaining))
+    }
+
+    /// Acquires like [`ReadFifo::get_read_region`] but returns [`FifoAcquire::TimedOut`] instead of
+    /// an error if the elements don't arrive in time. Nothing is acquired in that case.
+    pub fn try_get_read_region<'d, 's: 'd>(
+        &'d mut self,
+        session: &'s impl FifoInterface<T>,
+        elements: usize,
+        timeout: Option<Duration>,
+    ) -> Result<FifoAcquire<FifoReadRegion<'s, 'd, T>>, FPGAError> {
+        let acquire = session.try_zero_copy_read(self.address, elements, timeout)?;
+        record_level(session, self.address, acquire.remaining());
+        Ok(acquire)
+    }
+
+    /// Creates a queue to hold several read regions from this FIFO at once.
+    ///
+    /// See [`crate::region_queue`] for how this pipelines acquisition and processing.
+    pub fn region_queue<'s, 'f>(&'f mut self, session: &'s Session) -> ReadRegionQueue<'s, 'f, T>
+    where
+        Session: FifoInterface<T>,
+    {
+        ReadRegionQueue::new(session, self)
+    }
+
+    pub(crate) fn record_level(&self, session: &impl FifoInterface<T>, elements: usize) {
+        record_level(session, self.address, elements);
     }
 
     /// Returns the number of elements available to read.
@@ -163,7 +738,51 @@ impl<T: NativeFpgaType + 'static> ReadFifo<T> {
     /// Warning: This achieves this by reading zero elements from the FIFO so it will start the FIFO if stopped.
     pub fn elements_available(&self, session: &impl FifoInterface<T>) -> Result<usize, FPGAError> {
         let mut empty_buffer: [T; 0] = [];
-        session.read_fifo(self.address, &mut empty_buffer, None)
+        let available = session.read_fifo(self.address, &mut empty_buffer, None)?;
+        record_level(session, self.address, available);
+        Ok(available)
+    }
+
+    /// Returns the elements available to read from the last driver call on this FIFO
+    /// or [`None`] if there hasn't been one or the session doesn't keep levels.
+    ///
+    /// This doesn't call the driver so is suitable for deciding batch sizes in a tight loop.
+    /// Data may have arrived since it was observed so treat it as a lower bound.
+    pub fn last_level(&self, session: &impl FifoInterface<T>) -> Option<FifoLevel> {
+        session.fifo_levels()?.last(self.address)
+    }
+
+    /// Returns the elements available to read, only calling the driver if the
+    /// last observed level is older than `max_age`.
+    ///
+    /// # Example
+    /// ```rust
+    /// # use ni_fpga_interface::fifos::ReadFifo;
+    /// # use ni_fpga_interface::session::{NiFpgaContext, Session};
+    /// use std::time::Duration;
+    ///
+    /// # let context = NiFpgaContext::new().unwrap();
+    /// # let session = Session::new(&context, "main.lvbitx", "sig", "RIO0", &Default::default()).unwrap();
+    /// let mut fifo = ReadFifo::<u64>::new(1);
+    /// let mut buffer = vec![0u64; 4096];
+    /// loop {
+    ///     let available = fifo
+    ///         .elements_available_within(&session, Duration::from_millis(1))
+    ///         .unwrap();
+    ///     let batch = available.clamp(1, buffer.len());
+    ///     fifo.read(&session, None, &mut buffer[..batch]).unwrap();
+    /// #   break;
+    /// }
+    /// ```
+    pub fn elements_available_within(
+        &self,
+        session: &impl FifoInterface<T>,
+        max_age: Duration,
+    ) -> Result<usize, FPGAError> {
+        level_or_query(session, self.address, max_age, || {
+            let mut empty_buffer: [T; 0] = [];
+            session.read_fifo(self.address, &mut empty_buffer, None)
+        })
     }
 }
 
@@ -174,6 +793,9 @@ impl<T: NativeFpgaType> Fifo for ReadFifo<T> {
 }
 
 /// A FIFO that can be written to.
+///
+/// Every write records the space remaining in the FIFO with the session so the last
+/// fill level is available from [`WriteFifo::last_level`] without a driver call.
 pub struct WriteFifo<T: NativeFpgaType> {
     address: FifoAddress,
     phantom: PhantomData<T>,
@@ -212,7 +834,24 @@ impl<T: NativeFpgaType + 'static> WriteFifo<T> {
         timeout: Option<Duration>,
         data: &[T],
     ) -> Result<usize, FPGAError> {
-        session.write_fifo(self.address, data, timeout)
+        let remaining = session.write_fifo(self.address, data, timeout)?;
+        record_level(session, self.address, remaining);
+        Ok(remaining)
+    }
+
+    /// Writes like [`WriteFifo::write`] but returns [`FifoTransfer::TimedOut`] instead of an error
+    /// if there isn't space in time. Nothing is written in that case.
+    ///
+    /// Any warning returned by the driver is kept in the result.
+    pub fn try_write(
+        &mut self,
+        session: &impl FifoInterface<T>,
+        timeout: Option<Duration>,
+        data: &[T],
+    ) -> Result<FifoTransfer, FPGAError> {
+        let transfer = session.try_write_fifo(self.address, data, timeout)?;
+        record_level(session, self.address, transfer.remaining());
+        Ok(transfer)
     }
 
     /// Provides a way to get a reference to the write region of the FIFO.
@@ -245,14 +884,53 @@ impl<T: NativeFpgaType + 'static> WriteFifo<T> {
         elements: usize,
         timeout: Option<Duration>,
     ) -> Result<(FifoWriteRegion<'s, 'd, T>, usize), FPGAError> {
-        session.zero_copy_write(self.address, elements, timeout)
+        let (region, remaining) = session.zero_copy_write(self.address, elements, timeout)?;
+        record_level(session, self.address, remaining);
+        Ok((region, remaining))
+    }
+
+    /// Acquires like [`WriteFifo::get_write_region`] but returns [`FifoAcquire::TimedOut`] instead of
+    /// an error if there isn't space in time. Nothing is acquired in that case.
+    pub fn try_get_write_region<'d, 's: 'd>(
+        &'d mut self,
+        session: &'s impl FifoInterface<T>,
+        elements: usize,
+        timeout: Option<Duration>,
+    ) -> Result<FifoAcquire<FifoWriteRegion<'s, 'd, T>>, FPGAError> {
+        let acquire = session.try_zero_copy_write(self.address, elements, timeout)?;
+        record_level(session, self.address, acquire.remaining());
+        Ok(acquire)
     }
 
     /// Returns the number of elements free to write.
     /// Warning: This achieves this by writing zero elements to the FIFO so it will start the FIFO if stopped.
     pub fn space_available(&self, session: &impl FifoInterface<T>) -> Result<usize, FPGAError> {
         let empty_buffer: [T; 0] = [];
-        session.write_fifo(self.address, &empty_buffer, None)
+        let available = session.write_fifo(self.address, &empty_buffer, None)?;
+        record_level(session, self.address, available);
+        Ok(available)
+    }
+
+    /// Returns the space available to write from the last driver call on this FIFO
+    /// or [`None`] if there hasn't been one or the session doesn't keep levels.
+    ///
+    /// This doesn't call the driver so is suitable for deciding batch sizes in a tight loop.
+    /// The FPGA may have consumed data since it was observed so treat it as a lower bound.
+    pub fn last_level(&self, session: &impl FifoInterface<T>) -> Option<FifoLevel> {
+        session.fifo_levels()?.last(self.address)
+    }
+
+    /// Returns the space available to write, only calling the driver if the
+    /// last observed level is older than `max_age`.
+    pub fn space_available_within(
+        &self,
+        session: &impl FifoInterface<T>,
+        max_age: Duration,
+    ) -> Result<usize, FPGAError> {
+        level_or_query(session, self.address, max_age, || {
+            let empty_buffer: [T; 0] = [];
+            session.write_fifo(self.address, &empty_buffer, None)
+        })
     }
 }
 
@@ -261,3 +939,195 @@ impl<T: NativeFpgaType> Fifo for WriteFifo<T> {
         self.address
     }
 }
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    use crate::sim::{SimFifoConfig, SimSession};
+
+    /// Declared as the generator emits them.
+    mod fpga_defs {
+        #[allow(non_upper_case_globals)]
+        pub mod fifos {
+            use crate::fifos::{ReadFifo, WriteFifo};
+
+            pub const Samples: ReadFifo<u32> = ReadFifo::new(1);
+            pub const Commands: WriteFifo<u16> = WriteFifo::new(40);
+        }
+    }
+
+    fn sim_session() -> SimSession {
+        SimSession::new()
+            .with_read_fifo(
+                &fpga_defs::fifos::Samples,
+                (0..100).collect(),
+                SimFifoConfig::default(),
+            )
+            .with_write_fifo(
+                &fpga_defs::fifos::Commands,
+                SimFifoConfig {
+                    depth: 64,
+                    ..Default::default()
+                },
+            )
+    }
+
+    #[test]
+    fn test_level_cache_starts_empty() {
+        let session = sim_session();
+        assert_eq!(fpga_defs::fifos::Samples.last_level(&session), None);
+        assert_eq!(FifoLevels::new().last(1), None);
+        assert_eq!(FifoLevels::new().last(1000), None);
+    }
+
+    #[test]
+    fn test_level_cache_records_level() {
+        let levels = FifoLevels::new();
+        let before = Instant::now();
+        // Both a lock free and a locked address.
+        for fifo in [3, 1000] {
+            levels.record(fifo, 42);
+            let level = levels.last(fifo).unwrap();
+            assert_eq!(level.elements, 42);
+            assert!(level.observed_at >= before - Duration::from_millis(1));
+            assert!(level.observed_at <= Instant::now());
+        }
+        assert_eq!(levels.last(4), None);
+    }
+
+    #[test]
+    fn test_level_cache_queries_when_stale() {
+        let session = sim_session();
+        let query = |elements| move || Ok(elements);
+        let level =
+            |max_age, elements| level_or_query::<u32>(&session, 1, max_age, query(elements));
+        assert_eq!(level(Duration::MAX, 10).unwrap(), 10);
+        // Fresh enough so the cached value is used.
+        assert_eq!(level(Duration::MAX, 20).unwrap(), 10);
+        // Too old so the query runs again.
+        assert_eq!(level(Duration::ZERO, 30).unwrap(), 30);
+        let levels = FifoInterface::<u32>::fifo_levels(&session).unwrap();
+        assert_eq!(levels.last(1).unwrap().elements, 30);
+    }
+
+    #[test]
+    fn test_generated_constant_keeps_level() {
+        let session = sim_session();
+        // Taken from the constant as in the examples, so later uses are separate copies.
+        let mut samples = fpga_defs::fifos::Samples;
+        let mut buffer = [0u32; 40];
+        samples
+            .read(&session, Some(Duration::ZERO), &mut buffer)
+            .unwrap();
+        let level = fpga_defs::fifos::Samples.last_level(&session).unwrap();
+        assert_eq!(level.elements, 60);
+        let available = fpga_defs::fifos::Samples
+            .elements_available_within(&session, Duration::MAX)
+            .unwrap();
+        assert_eq!(available, 60);
+
+        let mut commands = fpga_defs::fifos::Commands;
+        let space = commands
+            .write(&session, Some(Duration::ZERO), &[1, 2, 3, 4])
+            .unwrap();
+        let level = fpga_defs::fifos::Commands.last_level(&session).unwrap();
+        assert_eq!(level.elements, space);
+    }
+
+    #[cfg(target_os = "linux")]
+    fn allocation() -> Arc<HostBufferAllocation> {
+        use crate::host_buffer::{HostBufferOptions, PageSize};
+        let options = HostBufferOptions {
+            page_size: PageSize::Standard,
+            lock_pages: false,
+            ..Default::default()
+        };
+        Arc::new(HostBufferAllocation::new(1000, 8, 64, &options).unwrap())
+    }
+
+    #[cfg(target_os = "linux")]
+    #[test]
+    fn test_allocation_sets_sizes_to_fit() {
+        let allocation = allocation();
+        let config = FifoConfig::new(1).allocated_host_buffer(allocation.clone());
+        assert_eq!(
+            config.host_buffer_sizes(|| Ok(8)).unwrap(),
+            HostBufferSizes {
+                granularity: Some(64),
+                size: Some(1024),
+                mirror_size: Some(0),
+            }
+        );
+        // Matching values and a zero mirror are allowed in any order.
+        let config = FifoConfig::new(1)
+            .allocated_host_buffer(allocation)
+            .host_buffer_size(1024)
+            .host_buffer_allocation_granularity(64)
+            .host_buffer_mirror_size(0);
+        assert_eq!(
+            config.host_buffer_sizes(|| Ok(8)).unwrap(),
+            HostBufferSizes {
+                granularity: Some(64),
+                size: Some(1024),
+                mirror_size: Some(0),
+            }
+        );
+    }
+
+    #[cfg(target_os = "linux")]
+    #[test]
+    fn test_commit_rejects_sizes_past_allocation() {
+        let allocation = allocation();
+        let base = FifoConfig::new(1).allocated_host_buffer(allocation);
+        for config in [
+            base.clone().host_buffer_size(1025),
+            base.clone().host_buffer_size(512),
+            base.clone().host_buffer_allocation_granularity(4096),
+            base.clone().host_buffer_mirror_size(16),
+        ] {
+            // Fails before any driver call so this needs no session.
+            assert!(matches!(
+                config.host_buffer_sizes(|| Ok(8)),
+                Err(FPGAError::InvalidFifoConfig(_))
+            ));
+        }
+    }
+
+    #[cfg(target_os = "linux")]
+    #[test]
+    fn test_commit_rejects_elements_larger_than_allocation() {
+        use crate::host_buffer::{HostBufferOptions, PageSize};
+        let options = HostBufferOptions {
+            page_size: PageSize::Standard,
+            lock_pages: false,
+            ..Default::default()
+        };
+        // 1024 elements of 4 bytes fill exactly one page.
+        let allocation = Arc::new(HostBufferAllocation::new(1024, 4, 1, &options).unwrap());
+        assert_eq!(allocation.bytes_per_element(), 4);
+        let config = FifoConfig::new(1).allocated_host_buffer(allocation);
+        assert!(matches!(
+            config.host_buffer_sizes(|| Ok(8)),
+            Err(FPGAError::InvalidFifoConfig(_))
+        ));
+        // Smaller elements still fit.
+        assert!(config.host_buffer_sizes(|| Ok(4)).is_ok());
+        assert!(config.host_buffer_sizes(|| Ok(2)).is_ok());
+    }
+
+    #[test]
+    fn test_sizes_without_allocation_are_passed_through() {
+        let config = FifoConfig::new(1)
+            .host_buffer_size(100)
+            .host_buffer_mirror_size(10);
+        assert_eq!(
+            config.host_buffer_sizes(|| Ok(8)).unwrap(),
+            HostBufferSizes {
+                granularity: None,
+                size: Some(100),
+                mirror_size: Some(10),
+            }
+        );
+    }
+}
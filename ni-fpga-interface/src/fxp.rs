@@ -0,0 +1,719 @@
+//! Conversion of fixed point (FXP) data to and from floating point.
+//!
+//! The FPGA transfers FXP values as the raw integer word, normally in a
+//! U32 or U64 register or FIFO. [`Fxp`] describes the format as const
+//! generics so each conversion is compiled for the exact word length,
+//! integer word length and signedness.
+//!
+//! The conversions avoid the 64 bit integer to float instructions, which have no
+//! packed form before AVX-512 and are a library call on 32 bit ARM:
+//!
+//! * Signed words of up to 32 bits, or unsigned words of up to 31 bits, use
+//!   32 bit integer conversions in both directions.
+//! * Larger words of up to 52 bits convert to floats by placing the word in the
+//!   significand of a double, so only integer logic and a float subtraction are used.
+//!
+//! Other words use the 64 bit conversions. None of these paths branch, so the
+//! bulk conversions compile to packed instructions on SSE2 and AVX2. On 32 bit ARM
+//! the VFP has no packed doubles, but the 32 bit and significand paths still avoid the
+//! library call. The `fxp_conversion` benchmark in the host example compares them
+//! with converting one element at a time like the C API.
+//!
+//! The generated `fxp` module has an [`FxpRegister`], [`FxpReadFifo`] or
+//! [`FxpWriteFifo`] for each FXP item, with the format from its
+//! `NiFpga_FxpTypeInfo`, which read and write doubles through these conversions.
+//!
+//! The conversions match `NiFpga_ConvertFromFxpToDouble` and
+//! `NiFpga_ConvertFromDoubleToFxp` from the C API: values are truncated
+//! towards zero and saturate at the limits of the format.
+//!
+//! # Example
+//!
+//! ```rust
+//! # use ni_fpga_interface::fifos::ReadFifo;
+//! # use ni_fpga_interface::session::{NiFpgaContext, Session};
+//! use ni_fpga_interface::fxp::Fxp;
+//!
+//! /// Signed, 33 bit word with 17 integer bits.
+//! type Measurement = Fxp<true, 33, 17>;
+//!
+//! # let context = NiFpgaContext::new().unwrap();
+//! # let session = Session::new(&context, "main.lvbitx", "sig", "RIO0", &Default::default()).unwrap();
+//! let mut fifo = ReadFifo::<u64>::new(1);
+//! let mut values = vec![0f64; 4096];
+//! let (region, _remaining) = fifo.get_read_region(&session, values.len(), None).unwrap();
+//! Measurement::to_f64_slice(region.elements, &mut values);
+//! ```
+
+use crate::error::FPGAError;
+use crate::fifos::{ReadFifo, WriteFifo};
+use crate::nifpga_sys::FifoAddress;
+use crate::registers::Register;
+use crate::session::{FifoInterface, NativeFpgaType, RegisterAddress, RegisterInterface};
+use std::marker::PhantomData;
+use std::time::Duration;
+
+/// The bits of 2^52 as a double. Or-ing a smaller integer in gives 2^52 plus that integer exactly.
+const TWO_POW_52_BITS: u64 = 0x4330_0000_0000_0000;
+
+/// The bits of 2^23 as a float, for the same conversion in single precision.
+const TWO_POW_23_BITS: u32 = 0x4B00_0000;
+
+/// Computes 2^exponent, saturating the same way as `NiFpga_CalculateFxpDeltaDouble`.
+const fn pow2(exponent: i32) -> f64 {
+    if exponent < -1074 {
+        0.0
+    } else if exponent < -1022 {
+        // Subnormal so the value lives in the significand.
+        f64::from_bits(1u64 << (exponent + 1074))
+    } else if exponent > 1023 {
+        f64::MAX
+    } else {
+        f64::from_bits(((exponent + 1023) as u64) << 52)
+    }
+}
+
+/// A fixed point format.
+///
+/// * `SIGNED` - If the word is two's complement.
+/// * `WORD_LENGTH` - Total bits in the word, 1 to 64.
+/// * `INTEGER_WORD_LENGTH` - Bits before the binary point. This can be negative or larger than the word length.
+///
+/// These match the `NiFpga_FxpTypeInfo` values in the generated header.
+pub struct Fxp<const SIGNED: bool, const WORD_LENGTH: u8, const INTEGER_WORD_LENGTH: i16>;
+
+impl<const SIGNED: bool, const WORD_LENGTH: u8, const INTEGER_WORD_LENGTH: i16>
+    Fxp<SIGNED, WORD_LENGTH, INTEGER_WORD_LENGTH>
+{
+    /// Referenced by each conversion so an invalid word length fails to compile.
+    const VALID: () = assert!(
+        WORD_LENGTH >= 1 && WORD_LENGTH <= 64,
+        "FXP word length must be between 1 and 64 bits"
+    );
+
+    /// The value of the least significant bit.
+    pub const DELTA: f64 = pow2(INTEGER_WORD_LENGTH as i32 - WORD_LENGTH as i32);
+
+    /// Bits to discard above the word when sign extending.
+    const SHIFT: u32 = 64 - WORD_LENGTH as u32;
+
+    const MASK: u64 = u64::MAX >> Self::SHIFT;
+
+    /// [`Self::SHIFT`] for words which fit in 32 bits.
+    const SHIFT_32: u32 = Self::SHIFT.saturating_sub(32);
+
+    /// The top bit of the word. Flipping it offsets a signed word so its range starts at zero.
+    const SIGN_BIT: u64 = 1 << (WORD_LENGTH as u32 - 1);
+
+    /// 2^52 plus the offset added to the word when it is placed in a double.
+    const DOUBLE_OFFSET: f64 = pow2(52) + if SIGNED { Self::SIGN_BIT as f64 } else { 0.0 };
+
+    /// 2^23 plus the offset added to the word when it is placed in a float.
+    const FLOAT_OFFSET: f32 = pow2(23) as f32 + if SIGNED { Self::SIGN_BIT as f32 } else { 0.0 };
+
+    /// The reciprocal of [`Self::DELTA`]. Multiplying by this is exact when both are in range.
+    const SCALE: f64 = pow2(WORD_LENGTH as i32 - INTEGER_WORD_LENGTH as i32);
+
+    const SCALE_IS_EXACT: bool = (INTEGER_WORD_LENGTH as i32 - WORD_LENGTH as i32).abs() <= 1022;
+
+    /// If every value is a normal float, so converting in single precision is exact.
+    const FLOAT_IS_EXACT: bool = WORD_LENGTH <= 23
+        && Self::DELTA >= f32::MIN_POSITIVE as f64
+        && pow2(INTEGER_WORD_LENGTH as i32) <= f32::MAX as f64;
+
+    /// If every saturated value fits in an `i32`.
+    const FITS_I32: bool = if SIGNED {
+        WORD_LENGTH <= 32
+    } else {
+        WORD_LENGTH <= 31
+    };
+
+    /// The smallest raw value as a float.
+    const MIN_RAW: f64 = if SIGNED {
+        -pow2(WORD_LENGTH as i32 - 1)
+    } else {
+        0.0
+    };
+
+    /// The largest raw value as a float.
+    const MAX_RAW: f64 = if SIGNED {
+        pow2(WORD_LENGTH as i32 - 1) - 1.0
+    } else {
+        pow2(WORD_LENGTH as i32) - 1.0
+    };
+
+    /// Converts a raw FXP word to a double.
+    ///
+    /// Bits above the word length are ignored.
+    #[inline(always)]
+    pub fn to_f64(raw: u64) -> f64 {
+        let () = Self::VALID;
+        if Self::FITS_I32 {
+            let word = (raw as u32) << Self::SHIFT_32;
+            let value = if SIGNED {
+                (word as i32) >> Self::SHIFT_32
+            } else {
+                (word >> Self::SHIFT_32) as i32
+            };
+            value as f64 * Self::DELTA
+        } else if WORD_LENGTH <= 52 {
+            let word = raw & Self::MASK;
+            let offset_word = if SIGNED { word ^ Self::SIGN_BIT } else { word };
+            (f64::from_bits(offset_word | TWO_POW_52_BITS) - Self::DOUBLE_OFFSET) * Self::DELTA
+        } else if SIGNED {
+            (((raw << Self::SHIFT) as i64) >> Self::SHIFT) as f64 * Self::DELTA
+        } else {
+            (raw & Self::MASK) as f64 * Self::DELTA
+        }
+    }
+
+    /// Converts a raw FXP word to a float.
+    ///
+    /// Words larger than 23 bits convert through a double so may round
+    /// differently to the C API.
+    #[inline(always)]
+    pub fn to_f32(raw: u64) -> f32 {
+        if Self::FLOAT_IS_EXACT {
+            let word = raw as u32 & Self::MASK as u32;
+            let offset_word = if SIGNED {
+                word ^ Self::SIGN_BIT as u32
+            } else {
+                word
+            };
+            (f32::from_bits(offset_word | TWO_POW_23_BITS) - Self::FLOAT_OFFSET)
+                * Self::DELTA as f32
+        } else {
+            Self::to_f64(raw) as f32
+        }
+    }
+
+    /// Converts a double to a raw FXP word, truncating towards zero
+    /// and saturating to the range of the format.
+    #[inline(always)]
+    pub fn from_f64(value: f64) -> u64 {
+        let () = Self::VALID;
+        // The delta is a power of two so dividing is exact.
+        let scaled = if Self::SCALE_IS_EXACT {
+            value * Self::SCALE
+        } else {
+            value / Self::DELTA
+        };
+        let scaled = scaled.clamp(Self::MIN_RAW, Self::MAX_RAW);
+        if Self::FITS_I32 {
+            // NaN converts to zero, as with the saturating cast.
+            let scaled = if scaled.is_nan() { 0.0 } else { scaled };
+            // Safety: the value is a number within the range of the format, which fits in an i32.
+            let truncated: i32 = unsafe { scaled.to_int_unchecked() };
+            (truncated as i64 as u64) & Self::MASK
+        } else if SIGNED {
+            (scaled as i64 as u64) & Self::MASK
+        } else {
+            scaled as u64
+        }
+    }
+
+    /// Converts raw FXP words to doubles.
+    ///
+    /// The raw data can be the `u32` or `u64` elements from a FIFO or array register.
+    /// Converts up to the length of the shorter slice.
+    pub fn to_f64_slice<R: Copy + Into<u64>>(raw: &[R], output: &mut [f64]) {
+        for (output, raw) in output.iter_mut().zip(raw) {
+            *output = Self::to_f64((*raw).into());
+        }
+    }
+
+    /// Converts raw FXP words to floats.
+    ///
+    /// Converts up to the length of the shorter slice.
+    pub fn to_f32_slice<R: Copy + Into<u64>>(raw: &[R], output: &mut [f32]) {
+        for (output, raw) in output.iter_mut().zip(raw) {
+            *output = Self::to_f32((*raw).into());
+        }
+    }
+
+    /// Converts doubles to raw FXP words.
+    ///
+    /// The output can be `u32` or `u64` words to write to a FIFO or array register.
+    /// Converts up to the length of the shorter slice.
+    pub fn from_f64_slice<W: FxpWord>(values: &[f64], output: &mut [W]) {
+        for (output, value) in output.iter_mut().zip(values) {
+            *output = W::from_word(Self::from_f64(*value));
+        }
+    }
+
+    /// Converts doubles to raw FXP words for formats which fit in 32 bits.
+    ///
+    /// Converts up to the length of the shorter slice.
+    pub fn from_f64_slice_u32(values: &[f64], output: &mut [u32]) {
+        for (output, value) in output.iter_mut().zip(values) {
+            *output = Self::from_f64(*value) as u32;
+        }
+    }
+}
+
+/// The `u32` or `u64` register or FIFO element holding an FXP word.
+pub trait FxpWord: NativeFpgaType + Default + Into<u64> + 'static {
+    /// Takes the word from the low bits.
+    fn from_word(word: u64) -> Self;
+}
+
+impl FxpWord for u32 {
+    fn from_word(word: u64) -> Self {
+        word as u32
+    }
+}
+
+impl FxpWord for u64 {
+    fn from_word(word: u64) -> Self {
+        word
+    }
+}
+
+/// A fixed point format which registers and FIFOs can be generic over.
+///
+/// This is implemented by [`Fxp`] and forwards to its conversions.
+pub trait FxpFormat {
+    fn to_f64(raw: u64) -> f64;
+    fn from_f64(value: f64) -> u64;
+    fn to_f64_slice<R: Copy + Into<u64>>(raw: &[R], output: &mut [f64]);
+    fn from_f64_slice<W: FxpWord>(values: &[f64], output: &mut [W]);
+}
+
+impl<const SIGNED: bool, const WORD_LENGTH: u8, const INTEGER_WORD_LENGTH: i16> FxpFormat
+    for Fxp<SIGNED, WORD_LENGTH, INTEGER_WORD_LENGTH>
+{
+    #[inline(always)]
+    fn to_f64(raw: u64) -> f64 {
+        Self::to_f64(raw)
+    }
+
+    #[inline(always)]
+    fn from_f64(value: f64) -> u64 {
+        Self::from_f64(value)
+    }
+
+    fn to_f64_slice<R: Copy + Into<u64>>(raw: &[R], output: &mut [f64]) {
+        Self::to_f64_slice(raw, output)
+    }
+
+    fn from_f64_slice<W: FxpWord>(values: &[f64], output: &mut [W]) {
+        Self::from_f64_slice(values, output)
+    }
+}
+
+/// A control or indicator holding an FXP value, read and written as a double.
+///
+/// The word is held in a `u32` register for formats of up to 32 bits and a `u64` otherwise.
+///
+/// ```rust
+/// # use ni_fpga_interface::session::{NiFpgaContext, Session};
+/// use ni_fpga_interface::fxp::{Fxp, FxpRegister};
+///
+/// // As generated in the fxp module.
+/// const FxpResult: FxpRegister<u64, Fxp<true, 33, 17>> = FxpRegister::new(0x1803C);
+///
+/// # let context = NiFpgaContext::new().unwrap();
+/// # let session = Session::new(&context, "main.lvbitx", "sig", "RIO0", &Default::default()).unwrap();
+/// let value: f64 = FxpResult.read(&session).unwrap();
+/// ```
+pub struct FxpRegister<W, F> {
+    register: Register<W>,
+    format: PhantomData<F>,
+}
+
+impl<W: FxpWord, F: FxpFormat> FxpRegister<W, F> {
+    pub const fn new(address: RegisterAddress) -> Self {
+        Self {
+            register: Register::new(address),
+            format: PhantomData,
+        }
+    }
+
+    /// The address of the register on the FPGA.
+    pub const fn address(&self) -> RegisterAddress {
+        self.register.address()
+    }
+
+    /// The register holding the raw word.
+    pub fn raw(&self) -> &Register<W> {
+        &self.register
+    }
+
+    pub fn read(&self, session: &impl RegisterInterface<W>) -> Result<f64, FPGAError> {
+        Ok(F::to_f64(self.register.read(session)?.into()))
+    }
+
+    /// Writes the value, truncated towards zero and saturated to the format.
+    pub fn write(&self, session: &impl RegisterInterface<W>, value: f64) -> Result<(), FPGAError> {
+        self.register
+            .write(session, W::from_word(F::from_f64(value)))
+    }
+}
+
+/// A target to host FIFO of FXP values which are converted straight out of the DMA buffer.
+pub struct FxpReadFifo<W: FxpWord, F> {
+    fifo: ReadFifo<W>,
+    format: PhantomData<F>,
+}
+
+impl<W: FxpWord, F: FxpFormat> FxpReadFifo<W, F> {
+    pub const fn new(address: FifoAddress) -> Self {
+        Self {
+            fifo: ReadFifo::new(address),
+            format: PhantomData,
+        }
+    }
+
+    /// The FIFO of raw words, for example to configure it or read without converting.
+    pub fn raw(&mut self) -> &mut ReadFifo<W> {
+        &mut self.fifo
+    }
+
+    /// Fills `values` from the FIFO without copying the raw words out first.
+    ///
+    /// Where the host buffer wraps this takes more than one read region, each with the timeout.
+    /// If a later region times out the elements converted so far are still consumed.
+    ///
+    /// Returns the number of elements still to be read.
+    pub fn read(
+        &mut self,
+        session: &impl FifoInterface<W>,
+        timeout: Option<Duration>,
+        values: &mut [f64],
+    ) -> Result<usize, FPGAError> {
+        let mut converted = 0;
+        let mut remaining = 0;
+        while converted < values.len() {
+            let (region, left) =
+                self.fifo
+                    .get_read_region(session, values.len() - converted, timeout)?;
+            F::to_f64_slice(region.elements, &mut values[converted..]);
+            converted += region.elements.len();
+            remaining = left;
+        }
+        Ok(remaining)
+    }
+}
+
+/// A host to target FIFO of FXP values which are converted straight into the DMA buffer.
+pub struct FxpWriteFifo<W: FxpWord, F> {
+    fifo: WriteFifo<W>,
+    format: PhantomData<F>,
+}
+
+impl<W: FxpWord, F: FxpFormat> FxpWriteFifo<W, F> {
+    pub const fn new(address: FifoAddress) -> Self {
+        Self {
+            fifo: WriteFifo::new(address),
+            format: PhantomData,
+        }
+    }
+
+    /// The FIFO of raw words, for example to configure it or write without converting.
+    pub fn raw(&mut self) -> &mut WriteFifo<W> {
+        &mut self.fifo
+    }
+
+    /// Writes `values` to the FIFO, truncated towards zero and saturated to the format.
+    ///
+    /// Where the host buffer wraps this takes more than one write region, each with the timeout.
+    /// If a later region times out the elements converted so far are still written.
+    ///
+    /// Returns the space left in the FIFO.
+    pub fn write(
+        &mut self,
+        session: &impl FifoInterface<W>,
+        timeout: Option<Duration>,
+        values: &[f64],
+    ) -> Result<usize, FPGAError> {
+        let mut converted = 0;
+        let mut remaining = 0;
+        while converted < values.len() {
+            let (region, left) =
+                self.fifo
+                    .get_write_region(session, values.len() - converted, timeout)?;
+            F::from_f64_slice(&values[converted..], region.elements);
+            converted += region.elements.len();
+            remaining = left;
+        }
+        Ok(remaining)
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use crate::sim::{SimFifoConfig, SimSession};
+
+    /// Direct port of NiFpga_Private_FxpToFloatingPoint to check against.
+    fn reference_to_f64(
+        signed: bool,
+        word_length: u32,
+        integer_word_length: i32,
+        data: u64,
+    ) -> f64 {
+        let delta = 2f64.powi(integer_word_length - word_length as i32);
+        let word_length_mask = if word_length == 64 {
+            u64::MAX
+        } else {
+            (1u64 << word_length) - 1
+        };
+        let data = data & word_length_mask;
+        if signed && data & (1u64 << (word_length - 1)) != 0 {
+            let signed_data = (data ^ word_length_mask) as i64;
+            // Widened as the C code overflows for the most negative 64 bit word.
+            return delta * -(signed_data as i128 + 1) as f64;
+        }
+        delta * data as f64
+    }
+
+    /// The saturating conversion through an `i64` to check the faster paths against.
+    fn reference_from_f64(
+        signed: bool,
+        word_length: u32,
+        integer_word_length: i32,
+        value: f64,
+    ) -> u64 {
+        let delta = 2f64.powi(integer_word_length - word_length as i32);
+        let (min, max) = if signed {
+            (
+                -2f64.powi(word_length as i32 - 1),
+                2f64.powi(word_length as i32 - 1) - 1.0,
+            )
+        } else {
+            (0.0, 2f64.powi(word_length as i32) - 1.0)
+        };
+        let mask = u64::MAX >> (64 - word_length);
+        let scaled = (value / delta).clamp(min, max);
+        if signed {
+            (scaled as i64 as u64) & mask
+        } else {
+            scaled as u64
+        }
+    }
+
+    /// Checks every conversion path against the references for a format.
+    macro_rules! check_format {
+        ($signed:literal, $word_length:literal, $integer_word_length:literal) => {{
+            type Format = Fxp<$signed, $word_length, $integer_word_length>;
+            let (signed, word_length, integer_word_length) =
+                ($signed, $word_length, $integer_word_length);
+            let top = 1u64 << ($word_length - 1);
+            let raws = [
+                0,
+                1,
+                2,
+                top - 1,
+                top,
+                top + 1,
+                top | 1,
+                u64::MAX,
+                0x5555_5555_5555_5555,
+                0x9E37_79B9_7F4A_7C15,
+            ];
+            for raw in raws {
+                let expected = reference_to_f64(signed, word_length, integer_word_length, raw);
+                assert_eq!(
+                    Format::to_f64(raw).to_bits(),
+                    expected.to_bits(),
+                    "{raw:#x} in {}",
+                    stringify!($signed, $word_length, $integer_word_length)
+                );
+                assert_eq!(
+                    Format::to_f32(raw).to_bits(),
+                    (expected as f32).to_bits(),
+                    "{raw:#x} in {}",
+                    stringify!($signed, $word_length, $integer_word_length)
+                );
+            }
+            let delta = Format::DELTA;
+            let values = [
+                0.0,
+                -0.0,
+                0.4 * delta,
+                -0.4 * delta,
+                delta,
+                -delta,
+                1.5 * delta,
+                -1.5 * delta,
+                1.0,
+                -1.0,
+                1e300,
+                -1e300,
+                f64::INFINITY,
+                f64::NEG_INFINITY,
+                f64::NAN,
+                f64::MIN_POSITIVE,
+            ];
+            for value in values {
+                let expected = reference_from_f64(signed, word_length, integer_word_length, value);
+                assert_eq!(
+                    Format::from_f64(value),
+                    expected,
+                    "{value} in {}",
+                    stringify!($signed, $word_length, $integer_word_length)
+                );
+            }
+        }};
+    }
+
+    #[test]
+    fn test_every_path_matches_reference() {
+        // 32 bit paths.
+        check_format!(true, 1, 1);
+        check_format!(true, 8, 4);
+        check_format!(false, 8, -3);
+        check_format!(true, 23, 10);
+        check_format!(true, 24, 0);
+        check_format!(false, 31, 31);
+        check_format!(true, 32, 16);
+        check_format!(true, 32, 40);
+        // Through the significand of a double.
+        check_format!(false, 32, 0);
+        check_format!(true, 33, 17);
+        check_format!(true, 52, 20);
+        check_format!(false, 52, 70);
+        // 64 bit conversions.
+        check_format!(true, 53, 0);
+        check_format!(false, 64, 32);
+        check_format!(true, 64, 64);
+        // Deltas outside the range of a float.
+        check_format!(true, 16, -200);
+        check_format!(true, 16, 200);
+    }
+
+    #[test]
+    fn test_delta() {
+        assert_eq!(Fxp::<true, 32, 16>::DELTA, 1.0 / 65536.0);
+        assert_eq!(Fxp::<false, 8, 8>::DELTA, 1.0);
+        assert_eq!(Fxp::<false, 8, 10>::DELTA, 4.0);
+        assert_eq!(pow2(-1074), f64::from_bits(1));
+        assert_eq!(pow2(-2000), 0.0);
+    }
+
+    #[test]
+    fn test_signed_matches_c_api() {
+        for raw in [
+            0u64,
+            1,
+            0x7FFF_FFFF,
+            0x8000_0000,
+            0xFFFF_FFFF,
+            0x1_2345_6789,
+            0x1_FFFF_FFFF,
+        ] {
+            assert_eq!(
+                Fxp::<true, 33, 17>::to_f64(raw),
+                reference_to_f64(true, 33, 17, raw),
+                "raw {raw:#x}"
+            );
+        }
+    }
+
+    #[test]
+    fn test_unsigned_matches_c_api() {
+        for raw in [0u64, 1, 0x8000, 0xFFFF, 0x1_0000] {
+            assert_eq!(
+                Fxp::<false, 16, 4>::to_f64(raw),
+                reference_to_f64(false, 16, 4, raw),
+                "raw {raw:#x}"
+            );
+        }
+    }
+
+    #[test]
+    fn test_full_width_words() {
+        assert_eq!(Fxp::<true, 64, 64>::to_f64(u64::MAX), -1.0);
+        assert_eq!(Fxp::<false, 64, 64>::to_f64(u64::MAX), u64::MAX as f64);
+        assert_eq!(Fxp::<true, 64, 64>::from_f64(-1.0), u64::MAX);
+    }
+
+    #[test]
+    fn test_from_f64_truncates_and_saturates() {
+        type Format = Fxp<true, 16, 8>;
+        assert_eq!(Format::from_f64(1.5), 0x0180);
+        assert_eq!(Format::from_f64(-1.0), 0xFF00);
+        // Truncates towards zero.
+        assert_eq!(Format::from_f64(1.0 + Format::DELTA * 0.9), 0x0100);
+        assert_eq!(Format::from_f64(1000.0), 0x7FFF);
+        assert_eq!(Format::from_f64(-1000.0), 0x8000);
+
+        type Unsigned = Fxp<false, 8, 4>;
+        assert_eq!(Unsigned::from_f64(-1.0), 0);
+        assert_eq!(Unsigned::from_f64(100.0), 0xFF);
+    }
+
+    #[test]
+    fn test_round_trip() {
+        type Format = Fxp<true, 20, 6>;
+        for raw in [0u64, 1, 0x7FFFF, 0x80000, 0xFFFFF, 0x12345] {
+            assert_eq!(Format::from_f64(Format::to_f64(raw)), raw);
+        }
+    }
+
+    #[test]
+    fn test_slices() {
+        type Format = Fxp<true, 32, 16>;
+        let raw: Vec<u32> = vec![0x0001_0000, 0xFFFF_0000, 0x0000_8000];
+        let mut values = vec![0f64; 3];
+        Format::to_f64_slice(&raw, &mut values);
+        assert_eq!(values, vec![1.0, -1.0, 0.5]);
+
+        let mut floats = vec![0f32; 3];
+        Format::to_f32_slice(&raw, &mut floats);
+        assert_eq!(floats, vec![1.0, -1.0, 0.5]);
+
+        let mut back = vec![0u32; 3];
+        Format::from_f64_slice_u32(&values, &mut back);
+        assert_eq!(back, raw);
+
+        let mut back = vec![0u64; 3];
+        Format::from_f64_slice(&values, &mut back);
+        assert_eq!(back, vec![0x0001_0000, 0xFFFF_0000, 0x0000_8000]);
+    }
+
+    type Format = Fxp<true, 32, 16>;
+    const FXP_CONTROL: FxpRegister<u32, Format> = FxpRegister::new(0x18044);
+    const FXP_READ_FIFO: FxpReadFifo<u32, Format> = FxpReadFifo::new(1);
+    const FXP_WRITE_FIFO: FxpWriteFifo<u32, Format> = FxpWriteFifo::new(2);
+
+    #[test]
+    fn test_register_converts() {
+        let session = SimSession::new().with_register(FXP_CONTROL.raw(), 0xFFFF_8000);
+        assert_eq!(FXP_CONTROL.read(&session).unwrap(), -0.5);
+        FXP_CONTROL.write(&session, 1.25).unwrap();
+        assert_eq!(FXP_CONTROL.raw().read(&session).unwrap(), 0x0001_4000);
+        assert_eq!(FXP_CONTROL.read(&session).unwrap(), 1.25);
+    }
+
+    #[test]
+    fn test_fifos_convert_across_the_wrap() {
+        let config = SimFifoConfig {
+            depth: 8,
+            ..Default::default()
+        };
+        let mut fifo = FXP_READ_FIFO;
+        let raw = (0..12).map(|value: u32| value << 16).collect();
+        let session = SimSession::new()
+            .with_read_fifo(&ReadFifo::new(1), raw, config)
+            .with_write_fifo(&WriteFifo::<u32>::new(2), config);
+
+        let mut values = [0f64; 5];
+        fifo.read(&session, Some(Duration::ZERO), &mut values)
+            .unwrap();
+        assert_eq!(values, [0.0, 1.0, 2.0, 3.0, 4.0]);
+        // Starts 5 elements into the 8 element buffer so needs two regions.
+        let mut values = [0f64; 7];
+        fifo.read(&session, Some(Duration::ZERO), &mut values)
+            .unwrap();
+        assert_eq!(values, [5.0, 6.0, 7.0, 8.0, 9.0, 10.0, 11.0]);
+
+        let mut fifo = FXP_WRITE_FIFO;
+        fifo.write(&session, Some(Duration::ZERO), &[0.5; 5])
+            .unwrap();
+        fifo.write(&session, Some(Duration::ZERO), &[0.5; 7])
+            .unwrap();
+        let statistics = session.fifo_statistics(fifo.raw()).unwrap();
+        assert_eq!(statistics.transferred, 12);
+    }
+}
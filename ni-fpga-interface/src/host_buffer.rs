@@ -0,0 +1,536 @@
+//! Allocating DMA FIFO host buffers from hugepages on a chosen NUMA node.
+//!
+//! The buffer the driver allocates for a FIFO uses standard pages, so at high
+//! rates the host spends time on TLB misses, and on a multi-socket system it
+//! may be on the far node from the thread reading it. A [`HostBufferAllocation`]
+//! maps the buffer from 2 MiB or 1 GiB hugepages, binds it to a NUMA node,
+//! faults it in and locks it into RAM before it is passed to the driver with
+//! [`FifoConfig::allocated_host_buffer`](crate::fifos::FifoConfig::allocated_host_buffer).
+//!
+//! The buffer has no room for mirrored elements so the mirror size is set to
+//! zero, and the host buffer size and granularity are set to match the
+//! allocation. A configuration asking for anything else is rejected, as is
+//! a FIFO whose elements are too large for the mapping.
+//!
+//! Once committed the session holds the allocation, so it is only unmapped
+//! after the FIFO is given another buffer or the session is closed.
+//!
+//! Hugepages must be reserved by the system first, for example through
+//! `/sys/kernel/mm/hugepages/hugepages-2048kB/nr_hugepages`. This is only
+//! supported on Linux.
+//!
+//! # Example
+//!
+//! ```rust
+//! # use ni_fpga_interface::session::{NiFpgaContext, Session};
+//! use ni_fpga_interface::fifos::{Fifo, ReadFifo};
+//! use ni_fpga_interface::host_buffer::{HostBufferAllocation, HostBufferOptions, PageSize};
+//! use std::sync::Arc;
+//!
+//! # let context = NiFpgaContext::new().unwrap();
+//! # let session = Session::new(&context, "main.lvbitx", "sig", "RIO0", &Default::default()).unwrap();
+//! let mut fifo = ReadFifo::<u64>::new(1);
+//! let options = HostBufferOptions {
+//!     page_size: PageSize::Huge1G,
+//!     numa_node: Some(1),
+//!     ..Default::default()
+//! };
+//! let buffer = HostBufferAllocation::for_fifo(&session, &fifo, 1 << 24, &options).unwrap();
+//!
+//! fifo.stop(&session).unwrap();
+//! fifo.config()
+//!     .allocated_host_buffer(Arc::new(buffer))
+//!     .commit(&session)
+//!     .unwrap();
+//! ```
+
+use crate::error::FPGAError;
+use crate::fifos::Fifo;
+use crate::nifpga_sys::FifoAddress;
+use crate::session::Session;
+use libc::c_void;
+use std::fmt;
+use std::io;
+use std::ptr::NonNull;
+use std::sync::{Arc, Mutex};
+
+/// The size of the pages backing a host buffer.
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub enum PageSize {
+    /// The standard 4 KiB pages.
+    Standard,
+    /// 2 MiB hugepages.
+    Huge2M,
+    /// 1 GiB hugepages.
+    Huge1G,
+}
+
+impl PageSize {
+    /// The size of a page in bytes.
+    pub const fn bytes(self) -> usize {
+        match self {
+            PageSize::Standard => 4096,
+            PageSize::Huge2M => 2 << 20,
+            PageSize::Huge1G => 1 << 30,
+        }
+    }
+}
+
+impl fmt::Display for PageSize {
+    fn fmt(&self, f: &mut fmt::Formatter<'_>) -> fmt::Result {
+        match self {
+            PageSize::Standard => write!(f, "4 KiB"),
+            PageSize::Huge2M => write!(f, "2 MiB"),
+            PageSize::Huge1G => write!(f, "1 GiB"),
+        }
+    }
+}
+
+/// How a host buffer is allocated.
+#[derive(Debug, Clone)]
+pub struct HostBufferOptions {
+    /// The pages backing the buffer (default: [`PageSize::Huge2M`]).
+    pub page_size: PageSize,
+    /// The NUMA node the memory must come from (default: the node of the allocating thread).
+    pub numa_node: Option<u32>,
+    /// Lock the buffer into RAM (default: true).
+    ///
+    /// Hugepages are never swapped so this mainly matters for standard pages.
+    /// This is limited by `RLIMIT_MEMLOCK` for processes without `CAP_IPC_LOCK`.
+    pub lock_pages: bool,
+}
+
+impl Default for HostBufferOptions {
+    fn default() -> Self {
+        Self {
+            page_size: PageSize::Huge2M,
+            numa_node: None,
+            lock_pages: true,
+        }
+    }
+}
+
+/// The sizes of a host buffer, worked out before anything is mapped.
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+struct BufferLayout {
+    /// The host buffer size rounded up to the allocation granularity.
+    elements: u64,
+    /// The element size the buffer was sized for.
+    bytes_per_element: usize,
+    /// The allocation granularity in elements the size was rounded to.
+    granularity: u32,
+    /// The mapped length, a whole number of pages.
+    bytes: usize,
+    /// The alignment of the start, at least a page and at least the granularity.
+    alignment: usize,
+}
+
+impl BufferLayout {
+    fn new(
+        elements: u64,
+        bytes_per_element: usize,
+        granularity: u32,
+        page_size: PageSize,
+    ) -> io::Result<Self> {
+        let invalid = |message: &str| io::Error::new(io::ErrorKind::InvalidInput, message);
+        if elements == 0 || bytes_per_element == 0 {
+            return Err(invalid("A host buffer must hold at least one element"));
+        }
+        if !granularity.is_power_of_two() {
+            return Err(invalid("The allocation granularity must be a power of two"));
+        }
+        let too_large = || invalid("The host buffer is too large to map");
+        let elements = elements
+            .checked_next_multiple_of(granularity as u64)
+            .ok_or_else(too_large)?;
+        let bytes = usize::try_from(elements)
+            .ok()
+            .and_then(|elements| elements.checked_mul(bytes_per_element))
+            .and_then(|bytes| bytes.checked_next_multiple_of(page_size.bytes()))
+            .ok_or_else(too_large)?;
+        // Each granularity unit of the buffer should start on a multiple of its size.
+        let granule_bytes = bytes_per_element
+            .checked_mul(granularity as usize)
+            .and_then(usize::checked_next_power_of_two)
+            .ok_or_else(too_large)?;
+        Ok(Self {
+            elements,
+            bytes_per_element,
+            granularity,
+            bytes,
+            alignment: granule_bytes.max(page_size.bytes()),
+        })
+    }
+}
+
+/// Memory mapped for the host part of a DMA FIFO.
+///
+/// Pass it to the FIFO configuration with
+/// [`FifoConfig::allocated_host_buffer`](crate::fifos::FifoConfig::allocated_host_buffer).
+/// The memory is unmapped when the last reference is dropped.
+/// See the [module documentation](self) for an example.
+pub struct HostBufferAllocation {
+    ptr: NonNull<u8>,
+    layout: BufferLayout,
+    page_size: PageSize,
+}
+
+// Safety: the allocation is plain memory owned by this value. It is only
+// written by the DMA engine and read through the FIFO API.
+unsafe impl Send for HostBufferAllocation {}
+unsafe impl Sync for HostBufferAllocation {}
+
+impl HostBufferAllocation {
+    /// Allocates a buffer for `elements` elements of the FIFO.
+    ///
+    /// The element size and the allocation granularity are read from the FIFO.
+    /// Set any new granularity before allocating so the buffer matches it.
+    pub fn for_fifo(
+        session: &Session,
+        fifo: &impl Fifo,
+        elements: u64,
+        options: &HostBufferOptions,
+    ) -> Result<Self, FPGAError> {
+        let bytes_per_element = fifo.bytes_per_element(session)? as usize;
+        let granularity = fifo.host_buffer_allocation_granularity(session)?;
+        Self::new(elements, bytes_per_element, granularity, options)
+    }
+
+    /// Allocates a buffer without querying a FIFO.
+    ///
+    /// The element count is rounded up to the granularity, in elements, and the
+    /// start is aligned to the granularity as well as the page size.
+    pub fn new(
+        elements: u64,
+        bytes_per_element: usize,
+        granularity: u32,
+        options: &HostBufferOptions,
+    ) -> Result<Self, FPGAError> {
+        let layout =
+            BufferLayout::new(elements, bytes_per_element, granularity, options.page_size)?;
+        let ptr = map_buffer(&layout, options)?;
+        Ok(Self {
+            ptr,
+            layout,
+            page_size: options.page_size,
+        })
+    }
+
+    /// The number of elements the buffer holds, which the FIFO host buffer size is set to.
+    pub fn elements(&self) -> u64 {
+        self.layout.elements
+    }
+
+    /// The element size in bytes the buffer was sized for.
+    ///
+    /// Committing checks the FIFO elements of this size or smaller fit in the mapping.
+    pub fn bytes_per_element(&self) -> usize {
+        self.layout.bytes_per_element
+    }
+
+    /// The allocation granularity in elements the buffer was sized and aligned for.
+    ///
+    /// Committing the buffer sets the FIFO granularity to this.
+    pub fn granularity(&self) -> u32 {
+        self.layout.granularity
+    }
+
+    /// The mapped length in bytes.
+    pub fn len_bytes(&self) -> usize {
+        self.layout.bytes
+    }
+
+    /// The pages backing the buffer.
+    pub fn page_size(&self) -> PageSize {
+        self.page_size
+    }
+
+    /// The start of the buffer.
+    pub fn as_ptr(&self) -> *mut c_void {
+        self.ptr.as_ptr() as *mut c_void
+    }
+}
+
+impl fmt::Debug for HostBufferAllocation {
+    fn fmt(&self, f: &mut fmt::Formatter<'_>) -> fmt::Result {
+        f.debug_struct("HostBufferAllocation")
+            .field("ptr", &self.ptr)
+            .field("elements", &self.layout.elements)
+            .field("bytes_per_element", &self.layout.bytes_per_element)
+            .field("granularity", &self.layout.granularity)
+            .field("bytes", &self.layout.bytes)
+            .field("page_size", &self.page_size)
+            .finish()
+    }
+}
+
+impl Drop for HostBufferAllocation {
+    fn drop(&mut self) {
+        unmap(self.ptr.as_ptr(), self.layout.bytes);
+    }
+}
+
+/// The allocations a session has given to FIFOs, each bound to a single FIFO.
+#[derive(Default)]
+pub(crate) struct HostBufferBindings {
+    bindings: Mutex<Vec<(FifoAddress, Arc<HostBufferAllocation>)>>,
+}
+
+impl HostBufferBindings {
+    /// Holds the allocation for the FIFO.
+    ///
+    /// Fails with [`FPGAError::InvalidFifoConfig`] if it is still bound to another FIFO,
+    /// since two FIFOs would DMA into the same memory.
+    pub(crate) fn bind(
+        &self,
+        fifo: FifoAddress,
+        buffer: &Arc<HostBufferAllocation>,
+    ) -> Result<(), FPGAError> {
+        let mut bindings = self.bindings.lock().unwrap();
+        let bound = bindings
+            .iter()
+            .find(|(_, existing)| Arc::ptr_eq(existing, buffer));
+        match bound {
+            Some((address, _)) if *address == fifo => Ok(()),
+            Some((address, _)) => Err(FPGAError::InvalidFifoConfig(format!(
+                "The allocation is already bound to FIFO {address}"
+            ))),
+            None => {
+                bindings.push((fifo, buffer.clone()));
+                Ok(())
+            }
+        }
+    }
+
+    /// Drops the allocations bound to the FIFO other than `keep`.
+    pub(crate) fn release(&self, fifo: FifoAddress, keep: Option<&Arc<HostBufferAllocation>>) {
+        self.bindings.lock().unwrap().retain(|(address, buffer)| {
+            *address != fifo || keep.is_some_and(|keep| Arc::ptr_eq(keep, buffer))
+        });
+    }
+}
+
+/// The highest NUMA node which can be bound to.
+#[cfg(target_os = "linux")]
+const MAX_NUMA_NODES: usize = 1024;
+
+/// Maps the buffer, binds it to the node and faults it in so the driver gets resident memory.
+#[cfg(target_os = "linux")]
+fn map_buffer(layout: &BufferLayout, options: &HostBufferOptions) -> io::Result<NonNull<u8>> {
+    // Not in every libc version so build the flags from the kernel encoding.
+    const MAP_HUGE_SHIFT: libc::c_int = 26;
+    let huge_flags = match options.page_size {
+        PageSize::Standard => 0,
+        PageSize::Huge2M => libc::MAP_HUGETLB | (21 << MAP_HUGE_SHIFT),
+        PageSize::Huge1G => libc::MAP_HUGETLB | (30 << MAP_HUGE_SHIFT),
+    };
+    // mmap only aligns to the page so map the extra needed to align and trim it.
+    let slack = layout.alignment - options.page_size.bytes();
+    let mapped_bytes = layout.bytes + slack;
+    let mapped = unsafe {
+        libc::mmap(
+            std::ptr::null_mut(),
+            mapped_bytes,
+            libc::PROT_READ | libc::PROT_WRITE,
+            libc::MAP_PRIVATE | libc::MAP_ANONYMOUS | huge_flags,
+            -1,
+            0,
+        )
+    };
+    if mapped == libc::MAP_FAILED {
+        let error = io::Error::last_os_error();
+        return Err(match options.page_size {
+            PageSize::Standard => error,
+            page_size => io::Error::new(
+                error.kind(),
+                format!("Couldn't map {} bytes of {page_size} hugepages. Check enough are reserved: {error}", layout.bytes),
+            ),
+        });
+    }
+
+    let start = mapped as usize;
+    let aligned = start.next_multiple_of(layout.alignment);
+    let head = aligned - start;
+    let tail = slack - head;
+    if head > 0 {
+        unmap(mapped as *mut u8, head);
+    }
+    if tail > 0 {
+        unmap((aligned + layout.bytes) as *mut u8, tail);
+    }
+    let ptr = aligned as *mut u8;
+
+    let result = bind_and_fault_in(ptr, layout, options);
+    if let Err(error) = result {
+        unmap(ptr, layout.bytes);
+        return Err(error);
+    }
+    Ok(NonNull::new(ptr).expect("mmap never returns null on success"))
+}
+
+#[cfg(target_os = "linux")]
+fn bind_and_fault_in(
+    ptr: *mut u8,
+    layout: &BufferLayout,
+    options: &HostBufferOptions,
+) -> io::Result<()> {
+    // The policy must be set before the pages are first touched.
+    if let Some(node) = options.numa_node {
+        let node = node as usize;
+        if node >= MAX_NUMA_NODES {
+            return Err(io::Error::new(
+                io::ErrorKind::InvalidInput,
+                format!("NUMA node {node} is out of range"),
+            ));
+        }
+        const BITS: usize = libc::c_ulong::BITS as usize;
+        let mut mask = [0 as libc::c_ulong; MAX_NUMA_NODES / BITS];
+        mask[node / BITS] |= 1 << (node % BITS);
+        let result = unsafe {
+            libc::syscall(
+                libc::SYS_mbind,
+                ptr as *mut c_void,
+                layout.bytes,
+                libc::MPOL_BIND,
+                mask.as_ptr(),
+                // The kernel reads one less bit than it is told.
+                MAX_NUMA_NODES + 1,
+                0,
+            )
+        };
+        if result != 0 {
+            return Err(io::Error::last_os_error());
+        }
+    }
+
+    if options.lock_pages {
+        // Locking faults in every page.
+        if unsafe { libc::mlock(ptr as *const c_void, layout.bytes) } != 0 {
+            return Err(io::Error::last_os_error());
+        }
+    } else {
+        for page in (0..layout.bytes).step_by(options.page_size.bytes()) {
+            // Safety: the page is inside the mapping, which is writable.
+            unsafe { ptr.add(page).write_volatile(0) };
+        }
+    }
+    Ok(())
+}
+
+#[cfg(target_os = "linux")]
+fn unmap(ptr: *mut u8, bytes: usize) {
+    // Cant do anything useful if this fails so ignore it.
+    let _ = unsafe { libc::munmap(ptr as *mut c_void, bytes) };
+}
+
+#[cfg(not(target_os = "linux"))]
+fn map_buffer(_layout: &BufferLayout, _options: &HostBufferOptions) -> io::Result<NonNull<u8>> {
+    Err(io::Error::new(
+        io::ErrorKind::Unsupported,
+        "Allocating host buffers is only supported on Linux",
+    ))
+}
+
+#[cfg(not(target_os = "linux"))]
+fn unmap(_ptr: *mut u8, _bytes: usize) {}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    fn standard_pages() -> HostBufferOptions {
+        HostBufferOptions {
+            page_size: PageSize::Standard,
+            // Keep within the default memlock limit.
+            lock_pages: false,
+            ..Default::default()
+        }
+    }
+
+    #[test]
+    fn test_layout_rounds_to_granularity_and_pages() {
+        let layout = BufferLayout::new(1000, 8, 256, PageSize::Standard).unwrap();
+        assert_eq!(layout.elements, 1024);
+        assert_eq!(layout.bytes, 8192);
+        assert_eq!(layout.alignment, 4096);
+
+        let layout = BufferLayout::new(100, 4, 1, PageSize::Huge2M).unwrap();
+        assert_eq!(layout.elements, 100);
+        assert_eq!(layout.bytes, 2 << 20);
+        assert_eq!(layout.alignment, 2 << 20);
+    }
+
+    #[test]
+    fn test_layout_aligns_to_large_granularity() {
+        // 64 KiB granules on standard pages.
+        let layout = BufferLayout::new(8192, 8, 8192, PageSize::Standard).unwrap();
+        assert_eq!(layout.alignment, 64 << 10);
+        // Odd element sizes align to the next power of two.
+        let layout = BufferLayout::new(3, 12, 2, PageSize::Standard).unwrap();
+        assert_eq!(layout.alignment, 4096);
+    }
+
+    #[test]
+    fn test_layout_rejects_invalid_sizes() {
+        for (elements, bytes_per_element, granularity) in [(0, 8, 1), (10, 0, 1), (10, 8, 3)] {
+            let error =
+                BufferLayout::new(elements, bytes_per_element, granularity, PageSize::Standard)
+                    .unwrap_err();
+            assert_eq!(error.kind(), io::ErrorKind::InvalidInput);
+        }
+        assert!(BufferLayout::new(u64::MAX, 8, 1, PageSize::Standard).is_err());
+        assert!(BufferLayout::new(u64::MAX, 8, 4, PageSize::Standard).is_err());
+    }
+
+    #[cfg(target_os = "linux")]
+    #[test]
+    fn test_allocate_aligned_standard_pages() {
+        let buffer = HostBufferAllocation::new(100_000, 4, 65536, &standard_pages()).unwrap();
+        assert_eq!(buffer.elements(), 131_072);
+        assert_eq!(buffer.len_bytes(), 512 << 10);
+        assert_eq!(buffer.as_ptr() as usize % (256 << 10), 0);
+        // The whole mapping is usable.
+        unsafe {
+            std::ptr::write_bytes(buffer.as_ptr() as *mut u8, 0xAB, buffer.len_bytes());
+        }
+    }
+
+    #[cfg(target_os = "linux")]
+    #[test]
+    fn test_allocate_locked_on_node_zero() {
+        let options = HostBufferOptions {
+            numa_node: Some(0),
+            lock_pages: true,
+            ..standard_pages()
+        };
+        let buffer = HostBufferAllocation::new(1024, 8, 1, &options).unwrap();
+        assert_eq!(buffer.len_bytes(), 8192);
+
+        let options = HostBufferOptions {
+            numa_node: Some(MAX_NUMA_NODES as u32),
+            ..standard_pages()
+        };
+        assert!(HostBufferAllocation::new(1024, 8, 1, &options).is_err());
+    }
+
+    #[cfg(target_os = "linux")]
+    #[test]
+    fn test_allocation_binds_to_one_fifo_at_a_time() {
+        let buffer = Arc::new(HostBufferAllocation::new(1024, 8, 1, &standard_pages()).unwrap());
+        let bindings = HostBufferBindings::default();
+        bindings.bind(1, &buffer).unwrap();
+        // Committing the same FIFO again is fine.
+        bindings.bind(1, &buffer).unwrap();
+        assert!(matches!(
+            bindings.bind(2, &buffer),
+            Err(FPGAError::InvalidFifoConfig(_))
+        ));
+        // Keeping it for the first FIFO still blocks the second.
+        bindings.release(1, Some(&buffer));
+        assert!(bindings.bind(2, &buffer).is_err());
+
+        bindings.release(1, None);
+        bindings.bind(2, &buffer).unwrap();
+        assert_eq!(Arc::strong_count(&buffer), 2);
+    }
+}
@@ -0,0 +1,166 @@
+//! A fixed size histogram of call latencies.
+
+use std::time::Duration;
+
+/// Sub-buckets per power of two as a power of two, giving a resolution of 25%.
+const SUB_BUCKET_BITS: u32 = 2;
+const SUB_BUCKETS: u64 = 1 << SUB_BUCKET_BITS;
+/// Enough buckets to cover every nanosecond value in a u64.
+const BUCKETS: usize = ((64 - SUB_BUCKET_BITS) as usize + 1) * SUB_BUCKETS as usize;
+
+/// Maps a value to its bucket. Values below [`SUB_BUCKETS`] get a bucket each,
+/// after that each power of two is split into [`SUB_BUCKETS`] equal parts.
+fn bucket_index(value: u64) -> usize {
+    if value < SUB_BUCKETS {
+        return value as usize;
+    }
+    let exponent = 63 - value.leading_zeros();
+    let sub_bucket = (value >> (exponent - SUB_BUCKET_BITS)) & (SUB_BUCKETS - 1);
+    ((exponent - SUB_BUCKET_BITS + 1) as u64 * SUB_BUCKETS + sub_bucket) as usize
+}
+
+/// The smallest value which maps to the bucket.
+fn bucket_lower_bound(index: usize) -> u64 {
+    let index = index as u64;
+    if index < SUB_BUCKETS {
+        return index;
+    }
+    let exponent = index / SUB_BUCKETS - 1 + SUB_BUCKET_BITS as u64;
+    let sub_bucket = index % SUB_BUCKETS;
+    (SUB_BUCKETS + sub_bucket) << (exponent - SUB_BUCKET_BITS as u64)
+}
+
+/// Call latencies with a logarithmic bucket layout in the style of HDR histograms.
+///
+/// Recording is a couple of integer operations and never allocates.
+#[derive(Clone, PartialEq, Eq)]
+pub struct LatencyHistogram {
+    counts: Box<[u64; BUCKETS]>,
+    count: u64,
+    sum_nanos: u64,
+    max_nanos: u64,
+}
+
+impl Default for LatencyHistogram {
+    fn default() -> Self {
+        Self {
+            counts: Box::new([0; BUCKETS]),
+            count: 0,
+            sum_nanos: 0,
+            max_nanos: 0,
+        }
+    }
+}
+
+impl std::fmt::Debug for LatencyHistogram {
+    fn fmt(&self, f: &mut std::fmt::Formatter<'_>) -> std::fmt::Result {
+        f.debug_struct("LatencyHistogram")
+            .field("count", &self.count)
+            .field("mean", &self.mean())
+            .field("p50", &self.percentile(0.5))
+            .field("p99", &self.percentile(0.99))
+            .field("max", &self.max())
+            .finish()
+    }
+}
+
+impl LatencyHistogram {
+    pub fn record(&mut self, latency: Duration) {
+        let nanos = latency.as_nanos().min(u64::MAX as u128) as u64;
+        self.counts[bucket_index(nanos)] += 1;
+        self.count += 1;
+        self.sum_nanos = self.sum_nanos.saturating_add(nanos);
+        self.max_nanos = self.max_nanos.max(nanos);
+    }
+
+    /// Adds the values recorded in another histogram to this one.
+    pub fn merge(&mut self, other: &LatencyHistogram) {
+        for (count, other) in self.counts.iter_mut().zip(other.counts.iter()) {
+            *count += other;
+        }
+        self.count += other.count;
+        self.sum_nanos = self.sum_nanos.saturating_add(other.sum_nanos);
+        self.max_nanos = self.max_nanos.max(other.max_nanos);
+    }
+
+    /// The number of values recorded.
+    pub fn count(&self) -> u64 {
+        self.count
+    }
+
+    /// The total of all values recorded.
+    pub fn sum(&self) -> Duration {
+        Duration::from_nanos(self.sum_nanos)
+    }
+
+    pub fn mean(&self) -> Duration {
+        if self.count == 0 {
+            Duration::ZERO
+        } else {
+            Duration::from_nanos(self.sum_nanos / self.count)
+        }
+    }
+
+    pub fn max(&self) -> Duration {
+        Duration::from_nanos(self.max_nanos)
+    }
+
+    /// The value below which the `quantile` (0 to 1) fraction of calls fall.
+    ///
+    /// This is the upper end of the bucket holding that call so is within 25% of the exact value.
+    pub fn percentile(&self, quantile: f64) -> Duration {
+        if self.count == 0 {
+            return Duration::ZERO;
+        }
+        let target = ((quantile.clamp(0.0, 1.0) * self.count as f64).ceil() as u64).max(1);
+        let mut seen = 0;
+        for (index, count) in self.counts.iter().enumerate() {
+            seen += count;
+            if seen >= target {
+                let upper = bucket_lower_bound(index + 1).saturating_sub(1);
+                return Duration::from_nanos(upper.min(self.max_nanos));
+            }
+        }
+        self.max()
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn test_buckets_are_contiguous() {
+        for index in 0..BUCKETS - 1 {
+            let lower = bucket_lower_bound(index);
+            assert_eq!(bucket_index(lower), index);
+            assert_eq!(bucket_index(bucket_lower_bound(index + 1) - 1), index);
+        }
+        assert_eq!(bucket_index(u64::MAX), BUCKETS - 1);
+    }
+
+    #[test]
+    fn test_percentiles_within_resolution() {
+        let mut histogram = LatencyHistogram::default();
+        for micros in 1..=1000 {
+            histogram.record(Duration::from_micros(micros));
+        }
+        let p50 = histogram.percentile(0.5).as_micros() as f64;
+        assert!((500.0..=500.0 * 1.25).contains(&p50), "{p50}");
+        assert_eq!(histogram.percentile(1.0), Duration::from_micros(1000));
+        assert_eq!(histogram.max(), Duration::from_micros(1000));
+        assert_eq!(histogram.count(), 1000);
+    }
+
+    #[test]
+    fn test_merge() {
+        let mut first = LatencyHistogram::default();
+        let mut second = LatencyHistogram::default();
+        first.record(Duration::from_nanos(10));
+        second.record(Duration::from_nanos(30));
+        first.merge(&second);
+        assert_eq!(first.count(), 2);
+        assert_eq!(first.mean(), Duration::from_nanos(20));
+        assert_eq!(first.max(), Duration::from_nanos(30));
+    }
+}
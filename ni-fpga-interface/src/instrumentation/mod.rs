@@ -0,0 +1,67 @@
+//! Timing and counters for the calls made into the NI FPGA driver.
+//!
+//! With the `instrumentation` feature enabled every driver call made by the
+//! session, register, FIFO and IRQ interfaces is timed with the monotonic
+//! clock and counted against its operation and the register, FIFO or IRQs it
+//! accessed. Each thread records into its own table so threads don't contend
+//! with each other. [`snapshot`] merges the tables and [`write_prometheus`]
+//! formats the result for a metrics endpoint.
+//!
+//! Without the feature the calls are made directly and nothing is recorded.
+//!
+//! # Example
+//!
+//! ```rust
+//! use ni_fpga_interface::instrumentation;
+//!
+//! // ... run the application ...
+//!
+//! for call in instrumentation::snapshot() {
+//!     println!(
+//!         "{} {:#x}: {} calls, p99 {:?}",
+//!         call.operation.name(),
+//!         call.address,
+//!         call.calls,
+//!         call.latency.percentile(0.99)
+//!     );
+//! }
+//! instrumentation::write_prometheus(&mut std::io::stdout()).unwrap();
+//! ```
+
+mod histogram;
+#[cfg(feature = "instrumentation")]
+mod recorder;
+
+// The histogram is also used to time control loops so it is always available.
+pub use histogram::LatencyHistogram;
+#[cfg(feature = "instrumentation")]
+pub use recorder::*;
+
+/// Wraps a driver call which returns a status, recording it with the `instrumentation` feature.
+///
+/// Takes the [`Operation`] variant, the address accessed and the bytes moved.
+/// The bytes are evaluated after the call so they can use output parameters.
+/// An optional `timed_out = ` expression marks timeouts which aren't reported
+/// through the status, such as IRQ waits.
+macro_rules! instrument {
+    ($operation:ident, $address:expr, $bytes:expr, $call:expr) => {
+        $crate::instrumentation::instrument!($operation, $address, $bytes, timed_out = false, $call)
+    };
+    ($operation:ident, $address:expr, $bytes:expr, timed_out = $timed_out:expr, $call:expr) => {{
+        #[cfg(feature = "instrumentation")]
+        let start = std::time::Instant::now();
+        let status = $call;
+        #[cfg(feature = "instrumentation")]
+        $crate::instrumentation::record(
+            $crate::instrumentation::Operation::$operation,
+            $address as u32,
+            $bytes as u64,
+            start.elapsed(),
+            status,
+            $timed_out,
+        );
+        status
+    }};
+}
+
+pub(crate) use instrument;
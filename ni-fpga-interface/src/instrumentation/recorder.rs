@@ -0,0 +1,361 @@
+//! Per thread call tables and the snapshot of them.
+
+use super::LatencyHistogram;
+use crate::error::NiFpgaStatus;
+use std::collections::{BTreeMap, HashMap};
+use std::io::Write;
+use std::sync::{Arc, Mutex};
+use std::time::Duration;
+
+/// The kind of driver call.
+#[derive(Debug, Clone, Copy, PartialEq, Eq, Hash, PartialOrd, Ord)]
+pub enum Operation {
+    Open,
+    Close,
+    Run,
+    Reset,
+    Abort,
+    Download,
+    RegisterRead,
+    RegisterWrite,
+    FifoRead,
+    FifoWrite,
+    FifoAcquireRead,
+    FifoAcquireWrite,
+    FifoRelease,
+    FifoConfigure,
+    FifoStart,
+    FifoStop,
+    IrqWait,
+    IrqAcknowledge,
+}
+
+impl Operation {
+    /// The name used for the operation in exported metrics.
+    pub fn name(&self) -> &'static str {
+        match self {
+            Operation::Open => "open",
+            Operation::Close => "close",
+            Operation::Run => "run",
+            Operation::Reset => "reset",
+            Operation::Abort => "abort",
+            Operation::Download => "download",
+            Operation::RegisterRead => "register_read",
+            Operation::RegisterWrite => "register_write",
+            Operation::FifoRead => "fifo_read",
+            Operation::FifoWrite => "fifo_write",
+            Operation::FifoAcquireRead => "fifo_acquire_read",
+            Operation::FifoAcquireWrite => "fifo_acquire_write",
+            Operation::FifoRelease => "fifo_release",
+            Operation::FifoConfigure => "fifo_configure",
+            Operation::FifoStart => "fifo_start",
+            Operation::FifoStop => "fifo_stop",
+            Operation::IrqWait => "irq_wait",
+            Operation::IrqAcknowledge => "irq_acknowledge",
+        }
+    }
+}
+
+/// The recorded calls for one operation on one address.
+///
+/// The address is the register or FIFO address, the IRQ selection for IRQ
+/// operations or 0 for session operations.
+#[derive(Debug, Clone)]
+pub struct CallSnapshot {
+    pub operation: Operation,
+    pub address: u32,
+    pub calls: u64,
+    /// Calls which returned an error status other than a timeout.
+    pub errors: u64,
+    /// FIFO calls which returned the timeout status and IRQ waits which timed out.
+    pub timeouts: u64,
+    /// Bytes transferred by register and FIFO calls.
+    pub bytes: u64,
+    pub latency: LatencyHistogram,
+}
+
+impl CallSnapshot {
+    fn new(operation: Operation, address: u32) -> Self {
+        Self {
+            operation,
+            address,
+            calls: 0,
+            errors: 0,
+            timeouts: 0,
+            bytes: 0,
+            latency: LatencyHistogram::default(),
+        }
+    }
+
+    fn add(&mut self, other: &CallSnapshot) {
+        self.calls += other.calls;
+        self.errors += other.errors;
+        self.timeouts += other.timeouts;
+        self.bytes += other.bytes;
+        self.latency.merge(&other.latency);
+    }
+}
+
+type Key = (Operation, u32);
+type ThreadTable = Arc<Mutex<HashMap<Key, CallSnapshot>>>;
+
+/// The tables of running threads and the totals of threads which have exited.
+struct Tables {
+    threads: Vec<ThreadTable>,
+    exited: BTreeMap<Key, CallSnapshot>,
+}
+
+impl Tables {
+    /// Folds the tables of threads which have exited into the totals so only running threads are kept.
+    ///
+    /// Once its thread local is destroyed the list holds the only reference to a table.
+    fn prune(&mut self) {
+        let exited = &mut self.exited;
+        self.threads.retain(|table| {
+            if Arc::strong_count(table) > 1 {
+                return true;
+            }
+            for (key, calls) in table.lock().expect("Instrumentation poisoned").iter() {
+                exited
+                    .entry(*key)
+                    .or_insert_with(|| CallSnapshot::new(calls.operation, calls.address))
+                    .add(calls);
+            }
+            false
+        });
+    }
+}
+
+static TABLES: Mutex<Tables> = Mutex::new(Tables {
+    threads: Vec::new(),
+    exited: BTreeMap::new(),
+});
+
+thread_local! {
+    static TABLE: ThreadTable = {
+        let table = ThreadTable::default();
+        let mut tables = TABLES.lock().expect("Instrumentation poisoned");
+        tables.prune();
+        tables.threads.push(table.clone());
+        table
+    };
+}
+
+/// Adds a call to the table for the current thread.
+///
+/// Only the snapshot takes this lock from another thread so it is uncontended on the call path.
+pub(crate) fn record(
+    operation: Operation,
+    address: u32,
+    bytes: u64,
+    latency: Duration,
+    status: NiFpgaStatus,
+    timed_out: bool,
+) {
+    TABLE.with(|table| {
+        let mut table = table.lock().expect("Instrumentation poisoned");
+        let entry = table
+            .entry((operation, address))
+            .or_insert_with(|| CallSnapshot::new(operation, address));
+        entry.calls += 1;
+        if timed_out || status == NiFpgaStatus::FIFO_TIMEOUT || status == NiFpgaStatus::IRQ_TIMEOUT
+        {
+            entry.timeouts += 1;
+        } else if status.is_error() {
+            entry.errors += 1;
+        } else {
+            entry.bytes += bytes;
+        }
+        entry.latency.record(latency);
+    });
+}
+
+/// Merges the calls recorded by every thread, ordered by operation then address.
+pub fn snapshot() -> Vec<CallSnapshot> {
+    let mut tables = TABLES.lock().expect("Instrumentation poisoned");
+    tables.prune();
+    let mut merged = tables.exited.clone();
+    for table in &tables.threads {
+        for (key, calls) in table.lock().expect("Instrumentation poisoned").iter() {
+            merged
+                .entry(*key)
+                .or_insert_with(|| CallSnapshot::new(calls.operation, calls.address))
+                .add(calls);
+        }
+    }
+    merged.into_values().collect()
+}
+
+/// Clears the calls recorded by every thread.
+pub fn reset() {
+    let mut tables = TABLES.lock().expect("Instrumentation poisoned");
+    tables.prune();
+    tables.exited.clear();
+    for table in &tables.threads {
+        table.lock().expect("Instrumentation poisoned").clear();
+    }
+}
+
+/// Writes the current snapshot in the Prometheus text exposition format.
+///
+/// The counters are labelled by operation and address. Latency is exported
+/// as a summary in seconds.
+pub fn write_prometheus(writer: &mut impl Write) -> std::io::Result<()> {
+    let calls = snapshot();
+    let labels = |call: &CallSnapshot| {
+        format!(
+            "operation=\"{}\",address=\"{:#x}\"",
+            call.operation.name(),
+            call.address
+        )
+    };
+
+    type Counter = (&'static str, &'static str, fn(&CallSnapshot) -> u64);
+    let counters: [Counter; 4] = [
+        (
+            "nifpga_calls_total",
+            "Calls into the NI FPGA driver.",
+            |call| call.calls,
+        ),
+        (
+            "nifpga_errors_total",
+            "Calls which returned an error.",
+            |call| call.errors,
+        ),
+        ("nifpga_timeouts_total", "Calls which timed out.", |call| {
+            call.timeouts
+        }),
+        ("nifpga_bytes_total", "Bytes transferred.", |call| {
+            call.bytes
+        }),
+    ];
+    for (name, help, value) in counters {
+        writeln!(writer, "# HELP {name} {help}")?;
+        writeln!(writer, "# TYPE {name} counter")?;
+        for call in &calls {
+            writeln!(writer, "{name}{{{}}} {}", labels(call), value(call))?;
+        }
+    }
+
+    let name = "nifpga_call_duration_seconds";
+    writeln!(writer, "# HELP {name} Time spent in NI FPGA driver calls.")?;
+    writeln!(writer, "# TYPE {name} summary")?;
+    for call in &calls {
+        let labels = labels(call);
+        for quantile in [0.5, 0.9, 0.99, 0.999] {
+            let seconds = call.latency.percentile(quantile).as_secs_f64();
+            writeln!(
+                writer,
+                "{name}{{{labels},quantile=\"{quantile}\"}} {seconds}"
+            )?;
+        }
+        let sum = call.latency.sum().as_secs_f64();
+        writeln!(writer, "{name}_sum{{{labels}}} {sum}")?;
+        writeln!(writer, "{name}_count{{{labels}}} {}", call.latency.count())?;
+    }
+    Ok(())
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    /// Other tests record into the same global tables so only look at our own addresses.
+    fn find(operation: Operation, address: u32) -> Option<CallSnapshot> {
+        snapshot()
+            .into_iter()
+            .find(|call| call.operation == operation && call.address == address)
+    }
+
+    #[test]
+    fn test_records_across_threads() {
+        let address = 0xA0000;
+        let latency = Duration::from_micros(5);
+        record(
+            Operation::FifoRead,
+            address,
+            64,
+            latency,
+            NiFpgaStatus::SUCCESS,
+            false,
+        );
+        std::thread::spawn(move || {
+            record(
+                Operation::FifoRead,
+                address,
+                64,
+                latency,
+                NiFpgaStatus::FIFO_TIMEOUT,
+                false,
+            );
+            record(
+                Operation::FifoRead,
+                address,
+                64,
+                latency,
+                NiFpgaStatus::INVALID_PARAMETER,
+                false,
+            );
+        })
+        .join()
+        .unwrap();
+
+        let calls = find(Operation::FifoRead, address).unwrap();
+        assert_eq!(calls.calls, 3);
+        assert_eq!(calls.timeouts, 1);
+        assert_eq!(calls.errors, 1);
+        assert_eq!(calls.bytes, 64);
+        assert_eq!(calls.latency.count(), 3);
+    }
+
+    #[test]
+    fn test_exited_thread_tables_are_dropped() {
+        let address = 0xD0000;
+        let table = std::thread::spawn(move || {
+            let status = NiFpgaStatus::SUCCESS;
+            record(
+                Operation::FifoWrite,
+                address,
+                8,
+                Duration::ZERO,
+                status,
+                false,
+            );
+            TABLE.with(Arc::downgrade)
+        })
+        .join()
+        .unwrap();
+
+        // The calls are kept in the totals after the table goes.
+        assert_eq!(find(Operation::FifoWrite, address).unwrap().calls, 1);
+        assert!(table.upgrade().is_none());
+    }
+
+    #[test]
+    fn test_irq_timeouts() {
+        let status = NiFpgaStatus::SUCCESS;
+        record(Operation::IrqWait, 0xB0000, 0, Duration::ZERO, status, true);
+        assert_eq!(find(Operation::IrqWait, 0xB0000).unwrap().timeouts, 1);
+    }
+
+    #[test]
+    fn test_prometheus_format() {
+        let status = NiFpgaStatus::SUCCESS;
+        record(
+            Operation::RegisterWrite,
+            0xC0000,
+            4,
+            Duration::ZERO,
+            status,
+            false,
+        );
+        let mut text = Vec::new();
+        write_prometheus(&mut text).unwrap();
+        let text = String::from_utf8(text).unwrap();
+        assert!(text.contains("# TYPE nifpga_calls_total counter"));
+        assert!(
+            text.contains("nifpga_bytes_total{operation=\"register_write\",address=\"0xc0000\"} 4")
+        );
+        assert!(text.contains("nifpga_call_duration_seconds_count{operation=\"register_write\",address=\"0xc0000\"} 1"));
+    }
+}
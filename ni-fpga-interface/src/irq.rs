@@ -1,8 +1,21 @@
 //! The IRQ module implements handling for interrupts to and from the FPGA.
 
-use std::{fmt::Debug, time::Duration};
+use std::{
+    fmt::Debug,
+    sync::{
+        atomic::{AtomicU64, Ordering},
+        Arc,
+    },
+    time::Duration,
+};
 
-use crate::{error::FPGAError, nifpga_sys::*, session::Session, types::FpgaBool};
+use crate::{
+    error::{to_fpga_result, FPGAError, NiFpgaStatus},
+    instrumentation::instrument,
+    nifpga_sys::*,
+    session::Session,
+    types::FpgaBool,
+};
 
 // Re-excport the IRQ selection types from here for a better dev experience.
 pub use crate::types::IrqSelection;
@@ -69,29 +82,67 @@ impl<'session> IrqContext<'session> {
         irq: IrqSelection,
         timeout: Duration,
     ) -> Result<IrqWaitResult, FPGAError> {
-        let mut irqs_asserted: IrqSelection = IrqSelection::NONE;
-        let mut timed_out: FpgaBool = FpgaBool::FALSE;
+        wait_on_irqs(*self.session, self.handle, irq, timeout)
+    }
+}
+
+/// A reserved context handle which can be moved to another thread.
+///
+/// The raw context handle must still only be used by one thread at a time.
+/// The owner is responsible for enforcing that.
+pub(crate) struct SendIrqContextHandle(pub(crate) IrqContextHandle);
 
+unsafe impl Send for SendIrqContextHandle {}
+
+/// Reserves a new IRQ context on the session handle.
+///
+/// The caller is responsible for unreserving the context.
+pub(crate) fn reserve_irq_context(session: SessionHandle) -> Result<IrqContextHandle, FPGAError> {
+    let mut handle: IrqContextHandle = std::ptr::null();
+    let status = unsafe { NiFpga_ReserveIrqContext(session, &mut handle) };
+    to_fpga_result(handle, status)
+}
+
+/// Waits on the IRQs using a reserved context.
+///
+/// The context must only be used by one thread at a time.
+pub(crate) fn wait_on_irqs(
+    session: SessionHandle,
+    context: IrqContextHandle,
+    irq: IrqSelection,
+    timeout: Duration,
+) -> Result<IrqWaitResult, FPGAError> {
+    let mut irqs_asserted: IrqSelection = IrqSelection::NONE;
+    let mut timed_out: FpgaBool = FpgaBool::FALSE;
+
+    let status = instrument!(
+        IrqWait,
+        u32::from(irq),
+        0,
+        timed_out = timed_out == FpgaBool::TRUE,
         unsafe {
-            let status = NiFpga_WaitOnIrqs(
-                *self.session,
-                self.handle,
+            NiFpga_WaitOnIrqs(
+                session,
+                context,
                 irq,
                 timeout.as_millis() as u32,
                 &mut irqs_asserted,
                 &mut timed_out,
-            );
-
-            if status.is_error() {
-                return Err(status.into());
-            }
+            )
         }
+    );
+    // Some driver versions report the timeout through the status as well as the flag.
+    if status == NiFpgaStatus::IRQ_TIMEOUT {
+        return Ok(IrqWaitResult::TimedOut);
+    }
+    if status.is_error() {
+        return Err(status.into());
+    }
 
-        if timed_out == FpgaBool::TRUE {
-            Ok(IrqWaitResult::TimedOut)
-        } else {
-            Ok(IrqWaitResult::IrqsAsserted(irqs_asserted))
-        }
+    if timed_out == FpgaBool::TRUE {
+        Ok(IrqWaitResult::TimedOut)
+    } else {
+        Ok(IrqWaitResult::IrqsAsserted(irqs_asserted))
     }
 }
 
@@ -103,6 +154,188 @@ impl Drop for IrqContext<'_> {
     }
 }
 
+/// A lock-free set of up to 64 free slots stored as bits.
+struct FreeList {
+    free: AtomicU64,
+}
+
+impl FreeList {
+    const MAX_SIZE: usize = 64;
+
+    fn new(size: usize) -> Self {
+        assert!(size <= Self::MAX_SIZE, "At most 64 entries are supported");
+        let free = if size == Self::MAX_SIZE {
+            u64::MAX
+        } else {
+            (1u64 << size) - 1
+        };
+        Self {
+            free: AtomicU64::new(free),
+        }
+    }
+
+    /// Takes the lowest free slot.
+    fn take(&self) -> Option<usize> {
+        let mut free = self.free.load(Ordering::Acquire);
+        loop {
+            if free == 0 {
+                return None;
+            }
+            let index = free.trailing_zeros();
+            match self.free.compare_exchange_weak(
+                free,
+                free & !(1 << index),
+                Ordering::AcqRel,
+                Ordering::Acquire,
+            ) {
+                Ok(_) => return Some(index as usize),
+                Err(current) => free = current,
+            }
+        }
+    }
+
+    fn put(&self, index: usize) {
+        self.free.fetch_or(1 << index, Ordering::Release);
+    }
+
+    fn available(&self) -> usize {
+        self.free.load(Ordering::Relaxed).count_ones() as usize
+    }
+}
+
+/// A set of IRQ contexts reserved up front so threads can take one without
+/// the cost of reserving it on a time critical path.
+///
+/// Taking and returning contexts is lock-free. The contexts are unreserved when the pool is dropped.
+///
+/// ```rust
+/// # use ni_fpga_interface::session::{NiFpgaContext, Session};
+/// use ni_fpga_interface::irq::{IrqContextPool, IRQ0};
+/// use std::sync::Arc;
+/// use std::time::Duration;
+///
+/// # let context = NiFpgaContext::new().unwrap();
+/// let session = Arc::new(
+///     Session::new(&context, "main.lvbitx", "sig", "RIO0", &Default::default()).unwrap(),
+/// );
+/// let pool = Arc::new(IrqContextPool::new(session.clone(), 4).unwrap());
+///
+/// let thread_pool = pool.clone();
+/// std::thread::spawn(move || {
+///     let mut irq_context = thread_pool.acquire().expect("No free IRQ contexts");
+///     irq_context.wait_on_irq(IRQ0, Duration::from_millis(100)).unwrap();
+///     // The context goes back to the pool when dropped.
+/// })
+/// .join()
+/// .unwrap();
+/// ```
+pub struct IrqContextPool {
+    session: Arc<Session>,
+    handles: Vec<IrqContextHandle>,
+    free: FreeList,
+}
+
+// Each handle is only used by the holder of the guard taken from the free list.
+unsafe impl Send for IrqContextPool {}
+unsafe impl Sync for IrqContextPool {}
+
+impl IrqContextPool {
+    /// The most contexts a single pool can hold.
+    pub const MAX_SIZE: usize = FreeList::MAX_SIZE;
+
+    /// Reserves `size` IRQ contexts on the session.
+    ///
+    /// # Panics
+    ///
+    /// If size is larger than [`IrqContextPool::MAX_SIZE`].
+    pub fn new(session: Arc<Session>, size: usize) -> Result<Self, FPGAError> {
+        let free = FreeList::new(size);
+        let mut handles = Vec::with_capacity(size);
+        for _ in 0..size {
+            match reserve_irq_context(session.handle) {
+                Ok(handle) => handles.push(handle),
+                Err(error) => {
+                    for handle in handles {
+                        unsafe {
+                            NiFpga_UnreserveIrqContext(session.handle, handle);
+                        }
+                    }
+                    return Err(error);
+                }
+            }
+        }
+        Ok(Self {
+            session,
+            handles,
+            free,
+        })
+    }
+
+    /// Takes a free context from the pool or returns [`None`] if they are all in use.
+    ///
+    /// This never blocks or calls the driver.
+    pub fn acquire(&self) -> Option<PooledIrqContext<'_>> {
+        self.free
+            .take()
+            .map(|index| PooledIrqContext { pool: self, index })
+    }
+
+    /// The number of contexts not currently in use.
+    pub fn available(&self) -> usize {
+        self.free.available()
+    }
+
+    /// The total number of contexts in the pool.
+    pub fn size(&self) -> usize {
+        self.handles.len()
+    }
+}
+
+impl Drop for IrqContextPool {
+    fn drop(&mut self) {
+        for handle in &self.handles {
+            unsafe {
+                NiFpga_UnreserveIrqContext(self.session.handle, *handle);
+            }
+        }
+    }
+}
+
+/// An IRQ context taken from an [`IrqContextPool`].
+///
+/// It is returned to the pool when dropped.
+pub struct PooledIrqContext<'pool> {
+    pool: &'pool IrqContextPool,
+    index: usize,
+}
+
+// The guard is the only user of its handle so it can move between threads.
+unsafe impl Send for PooledIrqContext<'_> {}
+
+impl PooledIrqContext<'_> {
+    /// Wait on the specified IRQs for the specified timeout.
+    ///
+    /// See [`IrqSelection`] for details on setting specific IRQs.
+    pub fn wait_on_irq(
+        &mut self,
+        irq: IrqSelection,
+        timeout: Duration,
+    ) -> Result<IrqWaitResult, FPGAError> {
+        wait_on_irqs(
+            self.pool.session.handle,
+            self.pool.handles[self.index],
+            irq,
+            timeout,
+        )
+    }
+}
+
+impl Drop for PooledIrqContext<'_> {
+    fn drop(&mut self) {
+        self.pool.free.put(self.index);
+    }
+}
+
 impl Session {
     /// Creates an IRQ Context for the session.
     ///
@@ -111,15 +344,9 @@ impl Session {
     /// The context is then used to wait on specific IRQs. See [`IrqContext`].
     ///
     /// To minimize jitter when first waiting on IRQs, reserve as many contexts as the application requires.
+    /// An [`IrqContextPool`] can hold these for threads started later.
     pub fn create_irq_context(&self) -> Result<IrqContext, FPGAError> {
-        let mut handle: IrqContextHandle = std::ptr::null();
-        unsafe {
-            let status = NiFpga_ReserveIrqContext(self.handle, &mut handle);
-
-            if status.is_error() {
-                return Err(status.into());
-            }
-        }
+        let handle = reserve_irq_context(self.handle)?;
         Ok(IrqContext {
             handle,
             session: &self.handle,
@@ -128,13 +355,58 @@ impl Session {
 
     /// Acknowledge the specified IRQs. See [`IrqSelection`] for details on setting specific IRQs.
     pub fn acknowledge_irqs(&self, irqs: IrqSelection) -> Result<(), FPGAError> {
-        unsafe {
-            let status = NiFpga_AcknowledgeIrqs(self.handle, irqs);
-
-            if status.is_error() {
-                return Err(status.into());
-            }
+        let status = instrument!(IrqAcknowledge, u32::from(irqs), 0, unsafe {
+            NiFpga_AcknowledgeIrqs(self.handle, irqs)
+        });
+        if status.is_error() {
+            return Err(status.into());
         }
         Ok(())
     }
 }
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn test_free_list_take_and_put() {
+        let free = FreeList::new(3);
+        assert_eq!(free.available(), 3);
+        assert_eq!(free.take(), Some(0));
+        assert_eq!(free.take(), Some(1));
+        assert_eq!(free.take(), Some(2));
+        assert_eq!(free.take(), None);
+        free.put(1);
+        assert_eq!(free.available(), 1);
+        assert_eq!(free.take(), Some(1));
+    }
+
+    #[test]
+    fn test_free_list_full_size() {
+        let free = FreeList::new(64);
+        assert_eq!(free.available(), 64);
+        let empty = FreeList::new(0);
+        assert_eq!(empty.take(), None);
+    }
+
+    #[test]
+    fn test_free_list_across_threads() {
+        let free = Arc::new(FreeList::new(8));
+        let threads: Vec<_> = (0..4)
+            .map(|_| {
+                let free = free.clone();
+                std::thread::spawn(move || {
+                    for _ in 0..1000 {
+                        let index = free.take().unwrap();
+                        free.put(index);
+                    }
+                })
+            })
+            .collect();
+        for thread in threads {
+            thread.join().unwrap();
+        }
+        assert_eq!(free.available(), 8);
+    }
+}
@@ -0,0 +1,431 @@
+//! Shares a single IRQ context between many waiting threads.
+//!
+//! An [`crate::irq::IrqContext`] can only be used by one thread so each
+//! thread waiting on IRQs normally reserves its own context. The
+//! [`IrqDispatcher`] instead reserves one context on a dedicated thread which
+//! waits on every IRQ that has a subscriber. When IRQs are asserted it wakes
+//! the subscribers for those IRQs.
+//!
+//! # Example
+//!
+//! ```rust
+//! # use ni_fpga_interface::session::{NiFpgaContext, Session};
+//! use ni_fpga_interface::irq::IrqWaitResult;
+//! use ni_fpga_interface::irq_dispatcher::{DispatcherConfig, IrqDispatcher};
+//! use std::sync::Arc;
+//! use std::time::Duration;
+//!
+//! # let context = NiFpgaContext::new().unwrap();
+//! let session = Arc::new(
+//!     Session::new(&context, "main.lvbitx", "sig", "RIO0", &Default::default()).unwrap(),
+//! );
+//! let dispatcher = IrqDispatcher::start(session, DispatcherConfig::default()).unwrap();
+//!
+//! let mut subscription = dispatcher.subscribe(0);
+//! let worker = std::thread::spawn(move || {
+//!     if let IrqWaitResult::IrqsAsserted(_) = subscription.wait(Duration::from_secs(1)).unwrap() {
+//!         println!("IRQ 0 asserted");
+//!     }
+//! });
+//!
+//! worker.join().unwrap();
+//! println!("{:?}", dispatcher.statistics(0));
+//! dispatcher.stop().unwrap();
+//! ```
+
+use crate::error::FPGAError;
+use crate::irq::{
+    reserve_irq_context, wait_on_irqs, IrqSelection, IrqWaitResult, SendIrqContextHandle,
+};
+use crate::nifpga_sys::NiFpga_UnreserveIrqContext;
+use crate::session::Session;
+use std::sync::atomic::{AtomicBool, AtomicU32, AtomicU64, Ordering};
+use std::sync::{Arc, Condvar, Mutex};
+use std::thread::JoinHandle;
+use std::time::{Duration, Instant};
+
+/// The number of IRQs supported by the hardware.
+const IRQ_COUNT: usize = 32;
+
+/// Configuration for the dispatcher thread.
+#[derive(Debug, Clone)]
+pub struct DispatcherConfig {
+    /// Acknowledge IRQs as soon as they are seen (default: true).
+    ///
+    /// If false, a subscriber must call [`IrqSubscription::acknowledge`] before
+    /// the dispatcher waits on that IRQ again.
+    pub auto_acknowledge: bool,
+    /// The longest single wait on the IRQs (default: 100ms).
+    ///
+    /// This bounds how long new subscriptions and stop requests take to be seen.
+    pub poll_timeout: Duration,
+}
+
+impl Default for DispatcherConfig {
+    fn default() -> Self {
+        Self {
+            auto_acknowledge: true,
+            poll_timeout: Duration::from_millis(100),
+        }
+    }
+}
+
+/// The counters for a single IRQ.
+#[derive(Debug, Default, Clone, Copy, PartialEq, Eq)]
+pub struct IrqStatistics {
+    /// The number of times the dispatcher has seen the IRQ asserted.
+    pub asserted: u64,
+    /// The number of times a subscriber was woken by the IRQ.
+    pub deliveries: u64,
+    /// Assertions a subscriber didn't see because it wasn't waiting in time.
+    pub missed: u64,
+    /// The mean time from the dispatcher seeing the IRQ to a subscriber waking.
+    pub mean_dispatch_latency: Duration,
+    /// The longest time from the dispatcher seeing the IRQ to a subscriber waking.
+    pub max_dispatch_latency: Duration,
+}
+
+#[derive(Default)]
+struct SlotState {
+    /// Incremented each time the IRQ is asserted.
+    generation: u64,
+    asserted_at: Option<Instant>,
+}
+
+#[derive(Default)]
+struct IrqSlot {
+    state: Mutex<SlotState>,
+    wake: Condvar,
+    deliveries: AtomicU64,
+    missed: AtomicU64,
+    total_latency_ns: AtomicU64,
+    max_latency_ns: AtomicU64,
+}
+
+impl IrqSlot {
+    fn notify(&self, asserted_at: Instant) {
+        let mut state = self.state.lock().unwrap();
+        state.generation += 1;
+        state.asserted_at = Some(asserted_at);
+        drop(state);
+        self.wake.notify_all();
+    }
+
+    fn record_delivery(&self, missed: u64, latency: Duration) {
+        let latency_ns = latency.as_nanos() as u64;
+        self.deliveries.fetch_add(1, Ordering::Relaxed);
+        self.missed.fetch_add(missed, Ordering::Relaxed);
+        self.total_latency_ns
+            .fetch_add(latency_ns, Ordering::Relaxed);
+        self.max_latency_ns.fetch_max(latency_ns, Ordering::Relaxed);
+    }
+
+    fn statistics(&self) -> IrqStatistics {
+        let asserted = self.state.lock().unwrap().generation;
+        let deliveries = self.deliveries.load(Ordering::Relaxed);
+        let total_latency_ns = self.total_latency_ns.load(Ordering::Relaxed);
+        IrqStatistics {
+            asserted,
+            deliveries,
+            missed: self.missed.load(Ordering::Relaxed),
+            mean_dispatch_latency: Duration::from_nanos(
+                total_latency_ns.checked_div(deliveries).unwrap_or(0),
+            ),
+            max_dispatch_latency: Duration::from_nanos(self.max_latency_ns.load(Ordering::Relaxed)),
+        }
+    }
+}
+
+struct Shared {
+    session: Arc<Session>,
+    slots: [IrqSlot; IRQ_COUNT],
+    /// The number of subscriptions to each IRQ.
+    subscribers: Mutex<[usize; IRQ_COUNT]>,
+    /// The IRQs with at least one subscriber.
+    subscribed: AtomicU32,
+    /// IRQs which have been asserted and are waiting on a subscriber to acknowledge them.
+    pending_acknowledge: AtomicU32,
+    stop: AtomicBool,
+    stopped: AtomicBool,
+}
+
+impl Shared {
+    fn new(session: Arc<Session>) -> Self {
+        Self {
+            session,
+            slots: std::array::from_fn(|_| IrqSlot::default()),
+            subscribers: Mutex::new([0; IRQ_COUNT]),
+            subscribed: AtomicU32::new(0),
+            pending_acknowledge: AtomicU32::new(0),
+            stop: AtomicBool::new(false),
+            stopped: AtomicBool::new(false),
+        }
+    }
+
+    fn add_subscriber(&self, irq: u8) {
+        let mut subscribers = self.subscribers.lock().unwrap();
+        subscribers[irq as usize] += 1;
+        self.subscribed
+            .fetch_or(IrqSelection::new(irq).into(), Ordering::Relaxed);
+    }
+
+    fn remove_subscriber(&self, irq: u8) {
+        let mut subscribers = self.subscribers.lock().unwrap();
+        subscribers[irq as usize] -= 1;
+        if subscribers[irq as usize] == 0 {
+            self.subscribed
+                .fetch_and(!u32::from(IrqSelection::new(irq)), Ordering::Relaxed);
+        }
+    }
+
+    /// The IRQs the dispatcher should currently wait on.
+    fn wait_mask(&self) -> u32 {
+        self.subscribed.load(Ordering::Relaxed) & !self.pending_acknowledge.load(Ordering::Relaxed)
+    }
+
+    /// Marks the dispatcher as stopped and wakes every subscriber so they can see it.
+    fn mark_stopped(&self) {
+        self.stopped.store(true, Ordering::Relaxed);
+        for slot in &self.slots {
+            // Take the lock so a subscriber can't miss the wake between checking and waiting.
+            drop(slot.state.lock().unwrap());
+            slot.wake.notify_all();
+        }
+    }
+}
+
+/// Waits on the IRQs of every subscriber from a single thread and context.
+///
+/// The thread is stopped when this is dropped or [`IrqDispatcher::stop`] is called.
+pub struct IrqDispatcher {
+    shared: Arc<Shared>,
+    thread: Option<JoinHandle<Result<(), FPGAError>>>,
+}
+
+impl IrqDispatcher {
+    /// Reserves an IRQ context and starts the dispatcher thread.
+    pub fn start(session: Arc<Session>, config: DispatcherConfig) -> Result<Self, FPGAError> {
+        let context = SendIrqContextHandle(reserve_irq_context(session.handle)?);
+        let shared = Arc::new(Shared::new(session));
+
+        let thread_shared = shared.clone();
+        let thread = std::thread::Builder::new()
+            .name("irq-dispatcher".to_string())
+            .spawn(move || {
+                let result = dispatch_loop(&thread_shared, &context, &config);
+                // Cant do anything useful if this fails so ignore it.
+                let _ =
+                    unsafe { NiFpga_UnreserveIrqContext(thread_shared.session.handle, context.0) };
+                thread_shared.mark_stopped();
+                result
+            })
+            .expect("Failed to spawn IRQ dispatcher thread");
+
+        Ok(Self {
+            shared,
+            thread: Some(thread),
+        })
+    }
+
+    /// Subscribes to an IRQ from 0 to 31.
+    ///
+    /// The subscription only sees assertions from after it was created.
+    /// Any number of subscriptions can share an IRQ.
+    pub fn subscribe(&self, irq: u8) -> IrqSubscription {
+        assert!((irq as usize) < IRQ_COUNT, "IRQ {irq} is out of range");
+        self.shared.add_subscriber(irq);
+        let seen = self.shared.slots[irq as usize]
+            .state
+            .lock()
+            .unwrap()
+            .generation;
+        IrqSubscription {
+            shared: self.shared.clone(),
+            irq,
+            seen,
+        }
+    }
+
+    /// A snapshot of the counters for an IRQ.
+    pub fn statistics(&self, irq: u8) -> IrqStatistics {
+        self.shared.slots[irq as usize].statistics()
+    }
+
+    /// Returns false if the dispatcher thread has exited, for example due to an error.
+    ///
+    /// Call [`IrqDispatcher::stop`] to retrieve the error.
+    pub fn is_running(&self) -> bool {
+        self.thread
+            .as_ref()
+            .map(|thread| !thread.is_finished())
+            .unwrap_or(false)
+    }
+
+    /// Stops the dispatcher thread and returns any error it encountered.
+    ///
+    /// Waiting subscribers return [`FPGAError::Cancelled`].
+    pub fn stop(mut self) -> Result<(), FPGAError> {
+        self.stop_thread()
+    }
+
+    fn stop_thread(&mut self) -> Result<(), FPGAError> {
+        self.shared.stop.store(true, Ordering::Relaxed);
+        match self.thread.take() {
+            Some(thread) => thread.join().expect("IRQ dispatcher thread panicked"),
+            None => Ok(()),
+        }
+    }
+}
+
+impl Drop for IrqDispatcher {
+    fn drop(&mut self) {
+        // Cant return result from drop so ignore it.
+        let _ = self.stop_thread();
+    }
+}
+
+fn dispatch_loop(
+    shared: &Shared,
+    context: &SendIrqContextHandle,
+    config: &DispatcherConfig,
+) -> Result<(), FPGAError> {
+    while !shared.stop.load(Ordering::Relaxed) {
+        let mask = shared.wait_mask();
+        if mask == 0 {
+            std::thread::sleep(config.poll_timeout);
+            continue;
+        }
+
+        let result = wait_on_irqs(
+            shared.session.handle,
+            context.0,
+            mask.into(),
+            config.poll_timeout,
+        )?;
+        if let IrqWaitResult::IrqsAsserted(asserted) = result {
+            let asserted_at = Instant::now();
+            let asserted = u32::from(asserted) & mask;
+            if asserted == 0 {
+                continue;
+            }
+            if config.auto_acknowledge {
+                shared.session.acknowledge_irqs(asserted.into())?;
+            } else {
+                shared
+                    .pending_acknowledge
+                    .fetch_or(asserted, Ordering::Relaxed);
+            }
+            for irq in IrqSelection::from(asserted).iter() {
+                shared.slots[irq as usize].notify(asserted_at);
+            }
+        }
+    }
+    Ok(())
+}
+
+/// A subscription to a single IRQ through an [`IrqDispatcher`].
+///
+/// Subscriptions can be moved to other threads. Dropping it removes the IRQ
+/// from the dispatcher wait once no other subscriptions use it.
+pub struct IrqSubscription {
+    shared: Arc<Shared>,
+    irq: u8,
+    /// The last generation this subscriber has seen.
+    seen: u64,
+}
+
+impl IrqSubscription {
+    /// The IRQ this subscription is for.
+    pub fn irq(&self) -> u8 {
+        self.irq
+    }
+
+    /// Waits for the IRQ to be asserted.
+    ///
+    /// This returns immediately if the IRQ was asserted since the last wait.
+    /// Returns [`FPGAError::Cancelled`] if the dispatcher stops.
+    pub fn wait(&mut self, timeout: Duration) -> Result<IrqWaitResult, FPGAError> {
+        let slot = &self.shared.slots[self.irq as usize];
+        let state = slot.state.lock().unwrap();
+        let (state, _) = slot
+            .wake
+            .wait_timeout_while(state, timeout, |state| {
+                state.generation == self.seen && !self.shared.stopped.load(Ordering::Relaxed)
+            })
+            .unwrap();
+
+        if state.generation == self.seen {
+            return if self.shared.stopped.load(Ordering::Relaxed) {
+                Err(FPGAError::Cancelled)
+            } else {
+                Ok(IrqWaitResult::TimedOut)
+            };
+        }
+
+        let missed = state.generation - self.seen - 1;
+        let latency = state
+            .asserted_at
+            .map(|asserted_at| asserted_at.elapsed())
+            .unwrap_or_default();
+        self.seen = state.generation;
+        drop(state);
+
+        slot.record_delivery(missed, latency);
+        Ok(IrqWaitResult::IrqsAsserted(IrqSelection::new(self.irq)))
+    }
+
+    /// Acknowledges the IRQ so the FPGA can continue.
+    ///
+    /// This is only needed when [`DispatcherConfig::auto_acknowledge`] is false.
+    /// The dispatcher won't wait on the IRQ again until it is acknowledged.
+    pub fn acknowledge(&self) -> Result<(), FPGAError> {
+        let selection = IrqSelection::new(self.irq);
+        self.shared.session.acknowledge_irqs(selection)?;
+        self.shared
+            .pending_acknowledge
+            .fetch_and(!u32::from(selection), Ordering::Relaxed);
+        Ok(())
+    }
+}
+
+impl Drop for IrqSubscription {
+    fn drop(&mut self) {
+        self.shared.remove_subscriber(self.irq);
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn test_slot_statistics() {
+        let slot = IrqSlot::default();
+        slot.notify(Instant::now());
+        slot.notify(Instant::now());
+        slot.record_delivery(1, Duration::from_micros(10));
+        slot.record_delivery(0, Duration::from_micros(30));
+
+        let statistics = slot.statistics();
+        assert_eq!(statistics.asserted, 2);
+        assert_eq!(statistics.deliveries, 2);
+        assert_eq!(statistics.missed, 1);
+        assert_eq!(statistics.mean_dispatch_latency, Duration::from_micros(20));
+        assert_eq!(statistics.max_dispatch_latency, Duration::from_micros(30));
+    }
+
+    #[test]
+    fn test_empty_slot_statistics() {
+        let slot = IrqSlot::default();
+        assert_eq!(slot.statistics(), IrqStatistics::default());
+    }
+
+    #[test]
+    fn test_irq_selection_raw_round_trip() {
+        let mut selection = IrqSelection::new(3);
+        selection.add_irq(31);
+        let raw = u32::from(selection);
+        assert_eq!(raw, 0x8000_0008);
+        assert_eq!(IrqSelection::from(raw), selection);
+    }
+}
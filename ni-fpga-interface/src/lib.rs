@@ -7,18 +7,59 @@
 //!
 //! * [`session::Session`] - This is the main wrapper for the NI FPGA C interface.
 //!   Some elements will be used directly but some will be easier to use in the higher level.
+//!   Wrap it in a [`session::SharedSession`] to use it from several threads.
+//!   Use [`session_manager`] to open sessions to several targets in parallel.
 //! * The other modules define FPGA resources and can be used with session as a higher level interface. These include:
 //!   * [`registers`] - For reading and writing registers i.e. front panel controls and indicators.
 //!   * [`fifos`] - For reading and writing DMA FIFOs.
+//!   * [`clusters`] - For DMA FIFOs of clusters.
 //!   * [`irq`] - For waiting on and acknowledging IRQs.
+//!   * [`irq_dispatcher`] - For sharing one IRQ context between many waiting threads.
+//!   * [`register_watcher`] - For watching registers for changes from a single sampling thread.
+//! * [`dynamic_interface`] - Loading the registers and FIFOs from a bitfile at runtime instead of generating them.
+//! * [`fxp`] - Conversion of fixed point data to and from floating point.
+//! * [`demux`] - Splitting interleaved multi-channel FIFO data into a buffer per channel.
+//! * [`host_buffer`] - Hugepage backed, NUMA bound host buffers for DMA FIFOs.
+//! * [`buffer_pool`] - Reusable preallocated blocks for handing FIFO data between threads.
+//! * [`streaming`] - Background acquisition of DMA FIFOs into a lock-free ring buffer.
+//! * [`fifo_group`] - Servicing several DMA FIFOs from a single thread.
+//! * [`peer_to_peer`] - Streaming directly between FIFOs on two FPGAs without passing through the host.
+//! * [`buffered_write`] - Batching small writes to a DMA FIFO.
+//! * [`region_queue`] - Holding several zero copy read regions of a FIFO at once.
+//! * [`recording`] - Recording a DMA FIFO to self describing files.
+//! * [`sim`] - An in-memory session for running without an FPGA.
+//! * `reactor` - Futures for FIFO reads, writes and IRQ waits. Requires the `async` feature.
+//! * [`instrumentation`] - Latency and counters for every driver call. Recorded with the `instrumentation` feature.
 //!
 //! Registers and FIFOs are dynamic according to the particular bitfile you load.
 //! For this reason, the build module generates a module with the definitions of the registers and FIFOs for you.
 
-mod error;
+pub mod buffer_pool;
+pub mod buffered_write;
+pub mod clusters;
+pub mod control_loop;
+pub mod demux;
+pub mod dynamic_interface;
+pub mod error;
+pub mod fifo_group;
 pub mod fifos;
+pub mod fxp;
+pub mod host_buffer;
+pub mod instrumentation;
 pub mod irq;
+pub mod irq_dispatcher;
 mod nifpga_sys;
+pub mod peer_to_peer;
+#[cfg(feature = "async")]
+pub mod reactor;
+mod realtime;
+pub mod recording;
+pub mod region_queue;
+pub mod register_watcher;
 pub mod registers;
+mod ring_buffer;
 pub mod session;
+pub mod session_manager;
+pub mod sim;
+pub mod streaming;
 mod types;
@@ -1,5 +1,5 @@
 use crate::error::NiFpgaStatus;
-use crate::types::{FpgaBool, FpgaTimeoutMs, IrqSelection};
+use crate::types::{FifoProperty, FpgaBool, FpgaTimeoutMs, IrqSelection};
 use libc::{c_char, c_void, size_t};
 use paste::paste;
 
@@ -10,18 +10,54 @@ pub type PeerToPeerEndpoint = u32;
 
 pub type IrqContextHandle = *const c_void;
 
+/// First entry is the rust type, second is the text used for that type in the FIFO property API.
+macro_rules! impl_fifo_property_interface {
+    ($rust_type:ty, $fpga_type:literal) => {
+            paste! { pub fn [<NiFpga_SetFifoProperty $fpga_type >](session: SessionHandle, fifo: FifoAddress, property: FifoProperty, value: $rust_type) -> NiFpgaStatus; }
+            paste! { pub fn [<NiFpga_GetFifoProperty $fpga_type >](session: SessionHandle, fifo: FifoAddress, property: FifoProperty, value: *mut $rust_type) -> NiFpgaStatus; }
+    }
+}
+
 /// First entry is the rust type, second is the text used for that type in the FPGA interface.
+///
+/// These are the calls made on every register and FIFO access. With the `direct-link` feature
+/// they bind straight to the `NiFpgaDll_` exports of the driver library instead of the
+/// wrappers in NiFpga.c which check and call through a function pointer.
 macro_rules! impl_type_session_interface {
     ($rust_type:ty, $fpga_type:literal) => {
 
-            paste! { pub fn [<NiFpga_Read $fpga_type >](session: SessionHandle, offset: u32, value: *mut $rust_type) -> NiFpgaStatus; }
-            paste! { pub fn [<NiFpga_Write $fpga_type >](session: SessionHandle, offset: u32, value: $rust_type) -> NiFpgaStatus; }
-            paste! { pub fn [<NiFpga_ReadArray $fpga_type >](session: SessionHandle, offset: u32, value: *mut $rust_type, size: size_t) -> NiFpgaStatus; }
-            paste! { pub fn [<NiFpga_WriteArray $fpga_type >](session: SessionHandle, offset: u32, value: *const $rust_type, size: size_t) -> NiFpgaStatus; }
-            paste! { pub fn [<NiFpga_ReadFifo $fpga_type >](session: SessionHandle, fifo: u32, data: *mut $rust_type, number_of_elements: size_t, timeout_ms: FpgaTimeoutMs, elements_remaining: *mut size_t) -> NiFpgaStatus; }
-            paste! { pub fn [<NiFpga_WriteFifo $fpga_type >](session: SessionHandle, fifo: u32, data: *const $rust_type, number_of_elements: size_t, timeout_ms: FpgaTimeoutMs, elements_remaining: *mut size_t) -> NiFpgaStatus;}
-            paste! { pub fn [<NiFpga_AcquireFifoReadElements $fpga_type >](session: SessionHandle, fifo: u32, elements: *mut *const $rust_type, elements_requested: size_t, timeout_ms: FpgaTimeoutMs, elements_acquired: *mut size_t, elements_remaining: *mut size_t) -> NiFpgaStatus; }
-            paste! { pub fn [<NiFpga_AcquireFifoWriteElements $fpga_type >](session: SessionHandle, fifo: u32, elements: *mut *mut $rust_type, elements_requested: size_t, timeout_ms: FpgaTimeoutMs, elements_acquired: *mut size_t, elements_remaining: *mut size_t) -> NiFpgaStatus; }
+            paste! {
+                #[cfg_attr(feature = "direct-link", link_name = concat!("NiFpgaDll_Read", $fpga_type))]
+                pub fn [<NiFpga_Read $fpga_type >](session: SessionHandle, offset: u32, value: *mut $rust_type) -> NiFpgaStatus;
+            }
+            paste! {
+                #[cfg_attr(feature = "direct-link", link_name = concat!("NiFpgaDll_Write", $fpga_type))]
+                pub fn [<NiFpga_Write $fpga_type >](session: SessionHandle, offset: u32, value: $rust_type) -> NiFpgaStatus;
+            }
+            paste! {
+                #[cfg_attr(feature = "direct-link", link_name = concat!("NiFpgaDll_ReadArray", $fpga_type))]
+                pub fn [<NiFpga_ReadArray $fpga_type >](session: SessionHandle, offset: u32, value: *mut $rust_type, size: size_t) -> NiFpgaStatus;
+            }
+            paste! {
+                #[cfg_attr(feature = "direct-link", link_name = concat!("NiFpgaDll_WriteArray", $fpga_type))]
+                pub fn [<NiFpga_WriteArray $fpga_type >](session: SessionHandle, offset: u32, value: *const $rust_type, size: size_t) -> NiFpgaStatus;
+            }
+            paste! {
+                #[cfg_attr(feature = "direct-link", link_name = concat!("NiFpgaDll_ReadFifo", $fpga_type))]
+                pub fn [<NiFpga_ReadFifo $fpga_type >](session: SessionHandle, fifo: u32, data: *mut $rust_type, number_of_elements: size_t, timeout_ms: FpgaTimeoutMs, elements_remaining: *mut size_t) -> NiFpgaStatus;
+            }
+            paste! {
+                #[cfg_attr(feature = "direct-link", link_name = concat!("NiFpgaDll_WriteFifo", $fpga_type))]
+                pub fn [<NiFpga_WriteFifo $fpga_type >](session: SessionHandle, fifo: u32, data: *const $rust_type, number_of_elements: size_t, timeout_ms: FpgaTimeoutMs, elements_remaining: *mut size_t) -> NiFpgaStatus;
+            }
+            paste! {
+                #[cfg_attr(feature = "direct-link", link_name = concat!("NiFpgaDll_AcquireFifoReadElements", $fpga_type))]
+                pub fn [<NiFpga_AcquireFifoReadElements $fpga_type >](session: SessionHandle, fifo: u32, elements: *mut *const $rust_type, elements_requested: size_t, timeout_ms: FpgaTimeoutMs, elements_acquired: *mut size_t, elements_remaining: *mut size_t) -> NiFpgaStatus;
+            }
+            paste! {
+                #[cfg_attr(feature = "direct-link", link_name = concat!("NiFpgaDll_AcquireFifoWriteElements", $fpga_type))]
+                pub fn [<NiFpga_AcquireFifoWriteElements $fpga_type >](session: SessionHandle, fifo: u32, elements: *mut *mut $rust_type, elements_requested: size_t, timeout_ms: FpgaTimeoutMs, elements_acquired: *mut size_t, elements_remaining: *mut size_t) -> NiFpgaStatus;
+            }
     }
 }
 
@@ -41,6 +77,10 @@ extern "C" {
     pub fn NiFpga_Download(session: SessionHandle) -> NiFpgaStatus;
     pub fn NiFpga_Run(session: SessionHandle, attributes: u32) -> NiFpgaStatus;
     pub fn NiFpga_Close(session: SessionHandle, attribute: u32) -> NiFpgaStatus;
+    pub fn NiFpga_GetBitfileContents(
+        session: SessionHandle,
+        contents: *mut *const c_char,
+    ) -> NiFpgaStatus;
 
     pub fn NiFpga_ReserveIrqContext(
         session: SessionHandle,
@@ -70,10 +110,42 @@ extern "C" {
         actual_depth: *mut size_t,
     ) -> NiFpgaStatus;
 
+    impl_fifo_property_interface!(u32, "U32");
+    impl_fifo_property_interface!(i32, "I32");
+    impl_fifo_property_interface!(u64, "U64");
+    impl_fifo_property_interface!(i64, "I64");
+    impl_fifo_property_interface!(*mut c_void, "Ptr");
+
+    pub fn NiFpga_CommitFifoConfiguration(
+        session: SessionHandle,
+        fifo: FifoAddress,
+    ) -> NiFpgaStatus;
+
+    pub fn NiFpga_ReadFifoComposite(
+        session: SessionHandle,
+        fifo: FifoAddress,
+        data: *mut c_void,
+        bytes_per_element: u32,
+        number_of_elements: size_t,
+        timeout_ms: FpgaTimeoutMs,
+        elements_remaining: *mut size_t,
+    ) -> NiFpgaStatus;
+
+    pub fn NiFpga_WriteFifoComposite(
+        session: SessionHandle,
+        fifo: FifoAddress,
+        data: *const c_void,
+        bytes_per_element: u32,
+        number_of_elements: size_t,
+        timeout_ms: FpgaTimeoutMs,
+        empty_elements_remaining: *mut size_t,
+    ) -> NiFpgaStatus;
+
     pub fn NiFpga_StartFifo(session: SessionHandle, fifo: FifoAddress) -> NiFpgaStatus;
 
     pub fn NiFpga_StopFifo(session: SessionHandle, fifo: FifoAddress) -> NiFpgaStatus;
 
+    #[cfg_attr(feature = "direct-link", link_name = "NiFpgaDll_ReleaseFifoElements")]
     pub fn NiFpga_ReleaseFifoElements(
         session: SessionHandle,
         fifo: FifoAddress,
@@ -0,0 +1,502 @@
+//! Streams which move data directly from a FIFO on one FPGA to a FIFO on another.
+//!
+//! A peer-to-peer stream connects a writer FIFO on one FPGA to a reader FIFO
+//! on another, across the PXI backplane or between chassis, without the data
+//! passing through host memory. The host only sets the stream up, starts and
+//! stops it and watches its health.
+//!
+//! The FIFOs are found through the FPGA interface with
+//! [`PeerToPeerEnd::new`]. The stream itself is controlled by the NI
+//! Peer-to-Peer Streaming library, which is separate from the FPGA interface
+//! and so is called through a [`PeerToPeerDriver`] you implement over it.
+//!
+//! [`PeerToPeerStream`] then handles the order of the calls. The stream is
+//! created and checked to be linked before it can be enabled. Stopping flushes
+//! the data in flight to the reader before disabling, and the stream is
+//! disabled and destroyed when dropped.
+//!
+//! The host can't see the data so throughput is measured from element
+//! counters kept by the FPGA VIs. When each end has a U64 indicator counting
+//! the elements it has transferred, [`PeerToPeerStream::health`] reports the
+//! rate and the elements in flight, and flags a stall when the reader stops
+//! making progress while data is waiting.
+//!
+//! # Example
+//!
+//! ```rust
+//! # mod fpga_defs { pub mod registers {
+//! #     use ni_fpga_interface::registers::Register;
+//! #     pub const ElementsWritten: Register<u64> = Register::new(0x18000);
+//! #     pub const ElementsRead: Register<u64> = Register::new(0x18008);
+//! # } }
+//! # use ni_fpga_interface::error::FPGAError;
+//! # struct NiP2p;
+//! # impl PeerToPeerDriver for NiP2p {
+//! #     type Stream = u32;
+//! #     fn create_stream(&self, _: PeerToPeerEndpoint, _: PeerToPeerEndpoint) -> Result<u32, FPGAError> { Ok(0) }
+//! #     fn is_linked(&self, _: u32) -> Result<bool, FPGAError> { Ok(true) }
+//! #     fn enable_stream(&self, _: u32) -> Result<(), FPGAError> { Ok(()) }
+//! #     fn disable_stream(&self, _: u32) -> Result<(), FPGAError> { Ok(()) }
+//! #     fn destroy_stream(&self, _: u32) -> Result<(), FPGAError> { Ok(()) }
+//! # }
+//! use ni_fpga_interface::peer_to_peer::{PeerToPeerDriver, PeerToPeerEnd, PeerToPeerEndpoint, PeerToPeerStream};
+//! use ni_fpga_interface::session::{NiFpgaContext, Session, SharedSession};
+//!
+//! let context = NiFpgaContext::new().unwrap();
+//! let source = SharedSession::new(
+//!     Session::new(&context, "source.lvbitx", "sig", "PXI1Slot2", &Default::default()).unwrap(),
+//! );
+//! let sink = SharedSession::new(
+//!     Session::new(&context, "sink.lvbitx", "sig", "PXI1Slot3", &Default::default()).unwrap(),
+//! );
+//!
+//! let writer = PeerToPeerEnd::new(&source, 0)
+//!     .unwrap()
+//!     .with_counter(&fpga_defs::registers::ElementsWritten);
+//! let reader = PeerToPeerEnd::new(&sink, 1)
+//!     .unwrap()
+//!     .with_counter(&fpga_defs::registers::ElementsRead);
+//!
+//! let mut stream = PeerToPeerStream::create(NiP2p, writer, reader).unwrap();
+//! stream.start().unwrap();
+//! let health = stream.health().unwrap();
+//! println!("{:?} elements/s, stalled: {}", health.throughput, health.stalled);
+//! stream.stop().unwrap();
+//! ```
+
+use crate::error::{FPGAError, Result};
+use crate::nifpga_sys::FifoAddress;
+pub use crate::nifpga_sys::PeerToPeerEndpoint;
+use crate::registers::Register;
+use crate::session::{RegisterAddress, RegisterInterface, SharedSession};
+use std::time::{Duration, Instant};
+
+/// The calls into the peer-to-peer streaming library.
+///
+/// The library reports its own status codes. Return them as [`FPGAError::PeerToPeer`].
+pub trait PeerToPeerDriver {
+    /// The handle to a stream created by the library.
+    type Stream: Copy;
+
+    /// Creates the stream between the endpoints and links them.
+    fn create_stream(
+        &self,
+        writer: PeerToPeerEndpoint,
+        reader: PeerToPeerEndpoint,
+    ) -> Result<Self::Stream>;
+
+    /// Returns true once both endpoints are linked and the stream can be enabled.
+    fn is_linked(&self, stream: Self::Stream) -> Result<bool>;
+
+    /// Allows data to flow from the writer to the reader.
+    fn enable_stream(&self, stream: Self::Stream) -> Result<()>;
+
+    /// Stops the data flow immediately. Data in flight may be lost.
+    fn disable_stream(&self, stream: Self::Stream) -> Result<()>;
+
+    /// Waits for the data in flight to reach the reader and then disables the stream.
+    ///
+    /// The default disables without flushing for libraries which can't flush.
+    fn flush_and_disable_stream(&self, stream: Self::Stream) -> Result<()> {
+        self.disable_stream(stream)
+    }
+
+    /// Unlinks the endpoints and releases the stream.
+    fn destroy_stream(&self, stream: Self::Stream) -> Result<()>;
+}
+
+/// A peer-to-peer FIFO on one session with its endpoint.
+#[derive(Clone)]
+pub struct PeerToPeerEnd {
+    session: SharedSession,
+    fifo: FifoAddress,
+    endpoint: PeerToPeerEndpoint,
+    counter: Option<RegisterAddress>,
+}
+
+impl PeerToPeerEnd {
+    /// Looks up the endpoint of the peer-to-peer FIFO on the session.
+    pub fn new(session: &SharedSession, fifo: FifoAddress) -> Result<Self> {
+        let endpoint = session.get_peer_to_peer_fifo_endpoint(fifo)?;
+        Ok(Self {
+            session: session.clone(),
+            fifo,
+            endpoint,
+            counter: None,
+        })
+    }
+
+    /// Sets the indicator the FPGA VI counts the elements transferred by this FIFO in.
+    pub fn with_counter(mut self, counter: &Register<u64>) -> Self {
+        self.counter = Some(counter.address());
+        self
+    }
+
+    pub fn fifo(&self) -> FifoAddress {
+        self.fifo
+    }
+
+    pub fn endpoint(&self) -> PeerToPeerEndpoint {
+        self.endpoint
+    }
+
+    pub fn session(&self) -> &SharedSession {
+        &self.session
+    }
+
+    fn read_counter(&self) -> Result<Option<u64>> {
+        self.counter
+            .map(|address| RegisterInterface::<u64>::read(&self.session, address))
+            .transpose()
+    }
+}
+
+/// Where the stream is in its life.
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub enum StreamState {
+    /// Created and linked but no data flowing.
+    Stopped,
+    /// Enabled so data can flow.
+    Running,
+}
+
+/// The health of the stream since the last check.
+#[derive(Debug, Clone, Copy, PartialEq)]
+pub struct LinkHealth {
+    pub state: StreamState,
+    /// If the library reports both endpoints linked.
+    pub linked: bool,
+    /// The writer element counter, if it has one.
+    pub elements_written: Option<u64>,
+    /// The reader element counter, if it has one.
+    pub elements_read: Option<u64>,
+    /// Elements written but not yet read. Needs both counters.
+    pub in_flight: Option<u64>,
+    /// Elements per second read over the time since the last check. Needs the reader counter and a previous check.
+    pub throughput: Option<f64>,
+    /// True when running with data in flight but the reader made no progress since the last check.
+    pub stalled: bool,
+}
+
+/// Turns successive counter readings into rates and stall detection.
+#[derive(Default)]
+struct HealthTracker {
+    last: Option<(Instant, Option<u64>)>,
+}
+
+impl HealthTracker {
+    fn update(
+        &mut self,
+        now: Instant,
+        state: StreamState,
+        linked: bool,
+        elements_written: Option<u64>,
+        elements_read: Option<u64>,
+    ) -> LinkHealth {
+        let in_flight = elements_written
+            .zip(elements_read)
+            .map(|(written, read)| written.saturating_sub(read));
+        let progress = match (self.last, elements_read) {
+            (Some((at, Some(previous))), Some(read)) => Some((
+                now.saturating_duration_since(at),
+                read.saturating_sub(previous),
+            )),
+            _ => None,
+        };
+        let throughput = progress
+            .filter(|(elapsed, _)| *elapsed > Duration::ZERO)
+            .map(|(elapsed, read)| read as f64 / elapsed.as_secs_f64());
+        let stalled = state == StreamState::Running
+            && matches!(in_flight, Some(in_flight) if in_flight > 0)
+            && matches!(progress, Some((_, 0)));
+        self.last = Some((now, elements_read));
+
+        LinkHealth {
+            state,
+            linked,
+            elements_written,
+            elements_read,
+            in_flight,
+            throughput,
+            stalled,
+        }
+    }
+
+    /// Rates shouldn't span a stop and start.
+    fn reset(&mut self) {
+        self.last = None;
+    }
+}
+
+/// The calls to the library in the order the stream needs them.
+struct StreamControl<D: PeerToPeerDriver> {
+    driver: D,
+    stream: D::Stream,
+    state: StreamState,
+}
+
+impl<D: PeerToPeerDriver> StreamControl<D> {
+    fn create(driver: D, writer: PeerToPeerEndpoint, reader: PeerToPeerEndpoint) -> Result<Self> {
+        let stream = driver.create_stream(writer, reader)?;
+        Ok(Self {
+            driver,
+            stream,
+            state: StreamState::Stopped,
+        })
+    }
+
+    fn start(&mut self) -> Result<()> {
+        if self.state == StreamState::Running {
+            return Ok(());
+        }
+        if !self.driver.is_linked(self.stream)? {
+            return Err(FPGAError::PeerToPeer(
+                "The stream endpoints are not linked".to_string(),
+            ));
+        }
+        self.driver.enable_stream(self.stream)?;
+        self.state = StreamState::Running;
+        Ok(())
+    }
+
+    fn stop(&mut self, flush: bool) -> Result<()> {
+        if self.state == StreamState::Stopped {
+            return Ok(());
+        }
+        if flush {
+            self.driver.flush_and_disable_stream(self.stream)?;
+        } else {
+            self.driver.disable_stream(self.stream)?;
+        }
+        self.state = StreamState::Stopped;
+        Ok(())
+    }
+}
+
+impl<D: PeerToPeerDriver> Drop for StreamControl<D> {
+    fn drop(&mut self) {
+        // Cant return result from drop so ignore it.
+        let _ = self.stop(false);
+        let _ = self.driver.destroy_stream(self.stream);
+    }
+}
+
+/// A stream from a writer FIFO on one session to a reader FIFO on another.
+///
+/// See the [module documentation](self) for an example.
+pub struct PeerToPeerStream<D: PeerToPeerDriver> {
+    control: StreamControl<D>,
+    writer: PeerToPeerEnd,
+    reader: PeerToPeerEnd,
+    tracker: HealthTracker,
+}
+
+impl<D: PeerToPeerDriver> PeerToPeerStream<D> {
+    /// Creates and links the stream between the ends. It starts stopped.
+    pub fn create(driver: D, writer: PeerToPeerEnd, reader: PeerToPeerEnd) -> Result<Self> {
+        let control = StreamControl::create(driver, writer.endpoint, reader.endpoint)?;
+        Ok(Self {
+            control,
+            writer,
+            reader,
+            tracker: HealthTracker::default(),
+        })
+    }
+
+    /// Enables the stream once the endpoints are linked.
+    ///
+    /// Returns [`FPGAError::PeerToPeer`] if they aren't linked.
+    pub fn start(&mut self) -> Result<()> {
+        self.control.start()?;
+        self.tracker.reset();
+        Ok(())
+    }
+
+    /// Flushes the data in flight to the reader and disables the stream.
+    pub fn stop(&mut self) -> Result<()> {
+        self.control.stop(true)
+    }
+
+    /// Disables the stream without waiting for the data in flight.
+    pub fn abort(&mut self) -> Result<()> {
+        self.control.stop(false)
+    }
+
+    pub fn state(&self) -> StreamState {
+        self.control.state
+    }
+
+    pub fn writer(&self) -> &PeerToPeerEnd {
+        &self.writer
+    }
+
+    pub fn reader(&self) -> &PeerToPeerEnd {
+        &self.reader
+    }
+
+    /// Checks the link and reads the element counters.
+    ///
+    /// Throughput and stalls are measured since the previous call so call this
+    /// periodically, for example once a second.
+    pub fn health(&mut self) -> Result<LinkHealth> {
+        let linked = self.control.driver.is_linked(self.control.stream)?;
+        let elements_written = self.writer.read_counter()?;
+        let elements_read = self.reader.read_counter()?;
+        Ok(self.tracker.update(
+            Instant::now(),
+            self.control.state,
+            linked,
+            elements_written,
+            elements_read,
+        ))
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use std::cell::RefCell;
+    use std::rc::Rc;
+
+    #[derive(Clone, Default)]
+    struct MockDriver {
+        calls: Rc<RefCell<Vec<&'static str>>>,
+        unlinked: bool,
+    }
+
+    impl MockDriver {
+        fn record(&self, call: &'static str) {
+            self.calls.borrow_mut().push(call);
+        }
+    }
+
+    impl PeerToPeerDriver for MockDriver {
+        type Stream = u32;
+
+        fn create_stream(
+            &self,
+            writer: PeerToPeerEndpoint,
+            reader: PeerToPeerEndpoint,
+        ) -> Result<u32> {
+            self.record("create");
+            Ok(writer * 100 + reader)
+        }
+        fn is_linked(&self, _stream: u32) -> Result<bool> {
+            self.record("linked");
+            Ok(!self.unlinked)
+        }
+        fn enable_stream(&self, _stream: u32) -> Result<()> {
+            self.record("enable");
+            Ok(())
+        }
+        fn disable_stream(&self, _stream: u32) -> Result<()> {
+            self.record("disable");
+            Ok(())
+        }
+        fn flush_and_disable_stream(&self, _stream: u32) -> Result<()> {
+            self.record("flush");
+            Ok(())
+        }
+        fn destroy_stream(&self, _stream: u32) -> Result<()> {
+            self.record("destroy");
+            Ok(())
+        }
+    }
+
+    #[test]
+    fn test_start_stop_order() {
+        let driver = MockDriver::default();
+        let mut control = StreamControl::create(driver.clone(), 1, 2).unwrap();
+        assert_eq!(control.stream, 102);
+        control.start().unwrap();
+        control.start().unwrap();
+        assert_eq!(control.state, StreamState::Running);
+        control.stop(true).unwrap();
+        control.stop(true).unwrap();
+        drop(control);
+        assert_eq!(
+            *driver.calls.borrow(),
+            ["create", "linked", "enable", "flush", "destroy"]
+        );
+    }
+
+    #[test]
+    fn test_drop_disables_a_running_stream() {
+        let driver = MockDriver::default();
+        let mut control = StreamControl::create(driver.clone(), 1, 2).unwrap();
+        control.start().unwrap();
+        drop(control);
+        assert_eq!(
+            *driver.calls.borrow(),
+            ["create", "linked", "enable", "disable", "destroy"]
+        );
+    }
+
+    #[test]
+    fn test_unlinked_stream_does_not_start() {
+        let driver = MockDriver {
+            unlinked: true,
+            ..Default::default()
+        };
+        let mut control = StreamControl::create(driver.clone(), 1, 2).unwrap();
+        assert!(matches!(control.start(), Err(FPGAError::PeerToPeer(_))));
+        assert_eq!(control.state, StreamState::Stopped);
+        assert!(!driver.calls.borrow().contains(&"enable"));
+    }
+
+    #[test]
+    fn test_health_throughput_and_in_flight() {
+        let mut tracker = HealthTracker::default();
+        let start = Instant::now();
+        let first = tracker.update(start, StreamState::Running, true, Some(1000), Some(600));
+        assert_eq!(first.in_flight, Some(400));
+        assert_eq!(first.throughput, None);
+        assert!(!first.stalled);
+
+        let second = tracker.update(
+            start + Duration::from_millis(500),
+            StreamState::Running,
+            true,
+            Some(2000),
+            Some(1600),
+        );
+        assert_eq!(second.throughput, Some(2000.0));
+        assert!(!second.stalled);
+    }
+
+    #[test]
+    fn test_health_detects_stall() {
+        let mut tracker = HealthTracker::default();
+        let start = Instant::now();
+        tracker.update(start, StreamState::Running, true, Some(100), Some(50));
+        let stalled = tracker.update(
+            start + Duration::from_secs(1),
+            StreamState::Running,
+            true,
+            Some(100),
+            Some(50),
+        );
+        assert!(stalled.stalled);
+        assert_eq!(stalled.throughput, Some(0.0));
+
+        // Nothing waiting is idle rather than stalled.
+        let idle = tracker.update(
+            start + Duration::from_secs(2),
+            StreamState::Running,
+            true,
+            Some(100),
+            Some(100),
+        );
+        assert!(!idle.stalled);
+    }
+
+    #[test]
+    fn test_health_without_counters() {
+        let mut tracker = HealthTracker::default();
+        let health = tracker.update(Instant::now(), StreamState::Stopped, false, None, None);
+        assert_eq!(health.in_flight, None);
+        assert_eq!(health.throughput, None);
+        assert!(!health.linked);
+        assert!(!health.stalled);
+    }
+}
@@ -0,0 +1,613 @@
+//! Provides futures for FIFO reads and writes and IRQ waits.
+//!
+//! This is enabled by the `async` feature.
+//!
+//! The NI FPGA C API only provides blocking calls so waiting on many FIFOs
+//! or IRQs normally needs a thread for each one. The [`Reactor`] instead
+//! runs a small pool of threads which cycle through all the pending operations
+//! calling the C API with a short timeout each time. When an operation
+//! completes its future is woken on whatever executor is polling it.
+//!
+//! The futures are plain [`std::future::Future`]s so this works with any executor.
+//!
+//! Buffers are passed by value and returned on completion so the driver never
+//! writes into memory the future no longer owns.
+//!
+//! # Example
+//!
+//! ```rust
+//! # use ni_fpga_interface::fifos::ReadFifo;
+//! # use ni_fpga_interface::irq::{IrqSelection, IrqWaitResult};
+//! # use ni_fpga_interface::session::{NiFpgaContext, Session};
+//! use ni_fpga_interface::reactor::{Reactor, ReactorConfig};
+//! use std::sync::Arc;
+//! use std::time::Duration;
+//!
+//! # async fn example() {
+//! # let context = NiFpgaContext::new().unwrap();
+//! let session = Arc::new(
+//!     Session::new(&context, "main.lvbitx", "sig", "RIO0", &Default::default()).unwrap(),
+//! );
+//! let reactor = Reactor::new(ReactorConfig::default());
+//!
+//! let fifo = ReadFifo::<u64>::new(1);
+//! let (data, remaining) = reactor
+//!     .read_fifo(&session, &fifo, vec![0u64; 1000], Some(Duration::from_secs(1)))
+//!     .await
+//!     .unwrap();
+//! println!("Read {} elements, {remaining} remaining", data.len());
+//!
+//! let mut irq_context = reactor.create_irq_context(&session).unwrap();
+//! match irq_context
+//!     .wait_on_irq(IrqSelection::IRQ0, Duration::from_millis(100))
+//!     .await
+//!     .unwrap()
+//! {
+//!     IrqWaitResult::IrqsAsserted(irqs) => session.acknowledge_irqs(irqs).unwrap(),
+//!     IrqWaitResult::TimedOut => println!("No IRQ"),
+//! }
+//! # }
+//! ```
+
+use crate::error::FPGAError;
+use crate::fifos::{Fifo, ReadFifo, WriteFifo};
+use crate::irq::{
+    reserve_irq_context, wait_on_irqs, IrqSelection, IrqWaitResult, SendIrqContextHandle,
+};
+use crate::nifpga_sys::{FifoAddress, NiFpga_UnreserveIrqContext};
+use crate::session::{FifoInterface, FifoTransfer, NativeFpgaType, Session};
+use std::collections::VecDeque;
+use std::future::Future;
+use std::marker::PhantomData;
+use std::pin::Pin;
+use std::sync::atomic::{AtomicBool, Ordering};
+use std::sync::{Arc, Condvar, Mutex};
+use std::task::{Context, Poll, Waker};
+use std::thread::JoinHandle;
+use std::time::{Duration, Instant};
+
+/// Configuration for the reactor thread pool.
+#[derive(Debug, Clone)]
+pub struct ReactorConfig {
+    /// The number of threads calling into the driver (default: 2).
+    pub threads: usize,
+    /// The longest a single driver call will block for (default: 1ms).
+    ///
+    /// Shorter slices reduce latency when many operations share a thread
+    /// at the cost of more driver calls. It is rounded up to 1ms as that is the resolution of the C API.
+    pub poll_slice: Duration,
+}
+
+impl Default for ReactorConfig {
+    fn default() -> Self {
+        Self {
+            threads: 2,
+            poll_slice: Duration::from_millis(1),
+        }
+    }
+}
+
+/// The result slot shared between an operation and its future.
+struct Completion<R> {
+    state: Mutex<CompletionState<R>>,
+}
+
+struct CompletionState<R> {
+    result: Option<R>,
+    waker: Option<Waker>,
+}
+
+impl<R> Completion<R> {
+    fn new() -> Arc<Self> {
+        Arc::new(Self {
+            state: Mutex::new(CompletionState {
+                result: None,
+                waker: None,
+            }),
+        })
+    }
+
+    fn complete(&self, result: R) {
+        let waker = {
+            let mut state = self.state.lock().unwrap();
+            state.result = Some(result);
+            state.waker.take()
+        };
+        if let Some(waker) = waker {
+            waker.wake();
+        }
+    }
+}
+
+/// A future which resolves when the reactor completes the operation.
+///
+/// Dropping the future cancels the operation the next time the reactor sees it.
+pub struct ReactorFuture<R> {
+    completion: Arc<Completion<R>>,
+}
+
+impl<R> Future for ReactorFuture<R> {
+    type Output = R;
+
+    fn poll(self: Pin<&mut Self>, cx: &mut Context<'_>) -> Poll<R> {
+        let mut state = self.completion.state.lock().unwrap();
+        match state.result.take() {
+            Some(result) => Poll::Ready(result),
+            None => {
+                state.waker = Some(cx.waker().clone());
+                Poll::Pending
+            }
+        }
+    }
+}
+
+/// An operation the reactor calls repeatedly until it is done.
+trait Operation: Send {
+    /// Make one attempt at the operation blocking for no longer than slice.
+    ///
+    /// Returns true when the operation is finished and shouldn't be queued again.
+    fn attempt(&mut self, slice: Duration) -> bool;
+
+    /// Called if the reactor shuts down before the operation finishes.
+    fn cancel(self: Box<Self>);
+}
+
+/// Returns the time to block for in this attempt or None if the deadline has passed.
+fn slice_until(deadline: Option<Instant>, slice: Duration) -> Option<Duration> {
+    match deadline {
+        None => Some(slice),
+        Some(deadline) => {
+            let now = Instant::now();
+            if now >= deadline {
+                None
+            } else {
+                Some(slice.min(deadline - now))
+            }
+        }
+    }
+}
+
+struct ReactorShared {
+    queue: Mutex<VecDeque<Box<dyn Operation>>>,
+    available: Condvar,
+    shutdown: AtomicBool,
+    poll_slice: Duration,
+}
+
+impl ReactorShared {
+    fn submit(&self, operation: Box<dyn Operation>) {
+        self.queue.lock().unwrap().push_back(operation);
+        self.available.notify_one();
+    }
+}
+
+/// A thread pool which drives the FPGA futures.
+///
+/// Dropping the reactor stops the threads and any outstanding futures
+/// resolve to [`FPGAError::Cancelled`].
+pub struct Reactor {
+    shared: Arc<ReactorShared>,
+    workers: Vec<JoinHandle<()>>,
+}
+
+impl Reactor {
+    /// Starts the reactor threads.
+    pub fn new(config: ReactorConfig) -> Self {
+        let shared = Arc::new(ReactorShared {
+            queue: Mutex::new(VecDeque::new()),
+            available: Condvar::new(),
+            shutdown: AtomicBool::new(false),
+            poll_slice: config.poll_slice.max(Duration::from_millis(1)),
+        });
+
+        let workers = (0..config.threads.max(1))
+            .map(|index| {
+                let shared = shared.clone();
+                std::thread::Builder::new()
+                    .name(format!("fpga-reactor-{index}"))
+                    .spawn(move || worker_loop(shared))
+                    .expect("Failed to spawn FPGA reactor thread")
+            })
+            .collect();
+
+        Self { shared, workers }
+    }
+
+    /// Reads from the FIFO until the buffer is full.
+    ///
+    /// Resolves to the buffer and the number of elements remaining in the FIFO.
+    /// If the timeout expires the FIFO timeout error is returned and no data is read.
+    pub fn read_fifo<T>(
+        &self,
+        session: &Arc<Session>,
+        fifo: &ReadFifo<T>,
+        buffer: Vec<T>,
+        timeout: Option<Duration>,
+    ) -> ReactorFuture<Result<(Vec<T>, usize), FPGAError>>
+    where
+        T: NativeFpgaType + Send + 'static,
+        Session: FifoInterface<T>,
+    {
+        let completion = Completion::new();
+        self.shared.submit(Box::new(FifoReadOperation {
+            session: session.clone(),
+            address: fifo.address(),
+            buffer: Some(buffer),
+            deadline: timeout.map(|timeout| Instant::now() + timeout),
+            completion: completion.clone(),
+        }));
+        ReactorFuture { completion }
+    }
+
+    /// Writes all of the data to the FIFO.
+    ///
+    /// Resolves to the data and the free space remaining in the FIFO.
+    /// If the timeout expires the FIFO timeout error is returned and no data is written.
+    pub fn write_fifo<T>(
+        &self,
+        session: &Arc<Session>,
+        fifo: &WriteFifo<T>,
+        data: Vec<T>,
+        timeout: Option<Duration>,
+    ) -> ReactorFuture<Result<(Vec<T>, usize), FPGAError>>
+    where
+        T: NativeFpgaType + Send + 'static,
+        Session: FifoInterface<T>,
+    {
+        let completion = Completion::new();
+        self.shared.submit(Box::new(FifoWriteOperation {
+            session: session.clone(),
+            address: fifo.address(),
+            data: Some(data),
+            deadline: timeout.map(|timeout| Instant::now() + timeout),
+            completion: completion.clone(),
+        }));
+        ReactorFuture { completion }
+    }
+
+    /// Reserves an IRQ context for waiting on IRQs through the reactor.
+    pub fn create_irq_context(&self, session: &Arc<Session>) -> Result<AsyncIrqContext, FPGAError> {
+        let handle = reserve_irq_context(session.handle)?;
+        Ok(AsyncIrqContext {
+            inner: Arc::new(IrqContextInner {
+                session: session.clone(),
+                handle: Mutex::new(SendIrqContextHandle(handle)),
+            }),
+            reactor: self.shared.clone(),
+        })
+    }
+}
+
+impl Drop for Reactor {
+    fn drop(&mut self) {
+        self.shared.shutdown.store(true, Ordering::SeqCst);
+        self.shared.available.notify_all();
+        for worker in self.workers.drain(..) {
+            let _ = worker.join();
+        }
+        let remaining: Vec<_> = self.shared.queue.lock().unwrap().drain(..).collect();
+        for operation in remaining {
+            operation.cancel();
+        }
+    }
+}
+
+fn worker_loop(shared: Arc<ReactorShared>) {
+    loop {
+        let mut operation = {
+            let mut queue = shared.queue.lock().unwrap();
+            loop {
+                if shared.shutdown.load(Ordering::SeqCst) {
+                    return;
+                }
+                if let Some(operation) = queue.pop_front() {
+                    break operation;
+                }
+                queue = shared.available.wait(queue).unwrap();
+            }
+        };
+
+        if !operation.attempt(shared.poll_slice) {
+            shared.queue.lock().unwrap().push_back(operation);
+        }
+    }
+}
+
+struct FifoReadOperation<T> {
+    session: Arc<Session>,
+    address: FifoAddress,
+    buffer: Option<Vec<T>>,
+    deadline: Option<Instant>,
+    completion: Arc<Completion<Result<(Vec<T>, usize), FPGAError>>>,
+}
+
+impl<T> Operation for FifoReadOperation<T>
+where
+    T: NativeFpgaType + Send + 'static,
+    Session: FifoInterface<T>,
+{
+    fn attempt(&mut self, slice: Duration) -> bool {
+        // Nobody is waiting for this any more.
+        if Arc::strong_count(&self.completion) == 1 {
+            return true;
+        }
+        let mut buffer = self
+            .buffer
+            .take()
+            .expect("Operation attempted after completion");
+        let timeout = slice_until(self.deadline, slice).unwrap_or(Duration::ZERO);
+        match self
+            .session
+            .try_read_fifo(self.address, &mut buffer, Some(timeout))
+        {
+            Ok(FifoTransfer::TimedOut { .. }) if !timeout.is_zero() => {
+                self.buffer = Some(buffer);
+                false
+            }
+            result => {
+                let result = result.and_then(FifoTransfer::into_result);
+                self.completion
+                    .complete(result.map(|remaining| (buffer, remaining)));
+                true
+            }
+        }
+    }
+
+    fn cancel(self: Box<Self>) {
+        self.completion.complete(Err(FPGAError::Cancelled));
+    }
+}
+
+struct FifoWriteOperation<T> {
+    session: Arc<Session>,
+    address: FifoAddress,
+    data: Option<Vec<T>>,
+    deadline: Option<Instant>,
+    completion: Arc<Completion<Result<(Vec<T>, usize), FPGAError>>>,
+}
+
+impl<T> Operation for FifoWriteOperation<T>
+where
+    T: NativeFpgaType + Send + 'static,
+    Session: FifoInterface<T>,
+{
+    fn attempt(&mut self, slice: Duration) -> bool {
+        // Nobody is waiting for this any more.
+        if Arc::strong_count(&self.completion) == 1 {
+            return true;
+        }
+        let data = self
+            .data
+            .take()
+            .expect("Operation attempted after completion");
+        let timeout = slice_until(self.deadline, slice).unwrap_or(Duration::ZERO);
+        match self
+            .session
+            .try_write_fifo(self.address, &data, Some(timeout))
+        {
+            Ok(FifoTransfer::TimedOut { .. }) if !timeout.is_zero() => {
+                self.data = Some(data);
+                false
+            }
+            result => {
+                let result = result.and_then(FifoTransfer::into_result);
+                self.completion
+                    .complete(result.map(|remaining| (data, remaining)));
+                true
+            }
+        }
+    }
+
+    fn cancel(self: Box<Self>) {
+        self.completion.complete(Err(FPGAError::Cancelled));
+    }
+}
+
+struct IrqContextInner {
+    session: Arc<Session>,
+    handle: Mutex<SendIrqContextHandle>,
+}
+
+impl Drop for IrqContextInner {
+    fn drop(&mut self) {
+        let handle = self.handle.get_mut().unwrap();
+        // Cant return result from drop so ignore it.
+        let _ = unsafe { NiFpga_UnreserveIrqContext(self.session.handle, handle.0) };
+    }
+}
+
+/// An IRQ context which waits through the reactor.
+///
+/// The context is unreserved once it and any outstanding waits are dropped.
+pub struct AsyncIrqContext {
+    inner: Arc<IrqContextInner>,
+    reactor: Arc<ReactorShared>,
+}
+
+impl AsyncIrqContext {
+    /// Waits on the IRQs or until the timeout is reached.
+    ///
+    /// As with the blocking version the IRQs must still be acknowledged on the session.
+    pub fn wait_on_irq(&mut self, irq: IrqSelection, timeout: Duration) -> IrqWaitFuture<'_> {
+        let completion = Completion::new();
+        self.reactor.submit(Box::new(IrqWaitOperation {
+            context: self.inner.clone(),
+            irq,
+            deadline: Instant::now() + timeout,
+            completion: completion.clone(),
+        }));
+        IrqWaitFuture {
+            inner: ReactorFuture { completion },
+            _context: PhantomData,
+        }
+    }
+}
+
+/// The future for [`AsyncIrqContext::wait_on_irq`].
+///
+/// This borrows the context as it can only wait on one set of IRQs at a time.
+pub struct IrqWaitFuture<'context> {
+    inner: ReactorFuture<Result<IrqWaitResult, FPGAError>>,
+    _context: PhantomData<&'context mut AsyncIrqContext>,
+}
+
+impl Future for IrqWaitFuture<'_> {
+    type Output = Result<IrqWaitResult, FPGAError>;
+
+    fn poll(mut self: Pin<&mut Self>, cx: &mut Context<'_>) -> Poll<Self::Output> {
+        Pin::new(&mut self.inner).poll(cx)
+    }
+}
+
+struct IrqWaitOperation {
+    context: Arc<IrqContextInner>,
+    irq: IrqSelection,
+    deadline: Instant,
+    completion: Arc<Completion<Result<IrqWaitResult, FPGAError>>>,
+}
+
+impl Operation for IrqWaitOperation {
+    fn attempt(&mut self, slice: Duration) -> bool {
+        // Nobody is waiting for this any more.
+        if Arc::strong_count(&self.completion) == 1 {
+            return true;
+        }
+        let Some(timeout) = slice_until(Some(self.deadline), slice) else {
+            self.completion.complete(Ok(IrqWaitResult::TimedOut));
+            return true;
+        };
+        // A cancelled wait may still be running on another thread. Give it the slice
+        // rather than coming straight back to spin on the lock.
+        let Ok(handle) = self.context.handle.try_lock() else {
+            std::thread::sleep(timeout);
+            return false;
+        };
+        match wait_on_irqs(self.context.session.handle, handle.0, self.irq, timeout) {
+            Ok(IrqWaitResult::TimedOut) => false,
+            result => {
+                drop(handle);
+                self.completion.complete(result);
+                true
+            }
+        }
+    }
+
+    fn cancel(self: Box<Self>) {
+        self.completion.complete(Err(FPGAError::Cancelled));
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use std::task::Wake;
+
+    struct FlagWaker(AtomicBool);
+
+    impl Wake for FlagWaker {
+        fn wake(self: Arc<Self>) {
+            self.0.store(true, Ordering::SeqCst);
+        }
+    }
+
+    #[test]
+    fn test_slice_is_limited_by_deadline() {
+        let deadline = Instant::now() + Duration::from_millis(500);
+        let slice = slice_until(Some(deadline), Duration::from_secs(1)).unwrap();
+        assert!(slice <= Duration::from_millis(500));
+
+        assert_eq!(
+            slice_until(None, Duration::from_millis(1)),
+            Some(Duration::from_millis(1))
+        );
+        assert_eq!(
+            slice_until(Some(Instant::now()), Duration::from_millis(1)),
+            None
+        );
+    }
+
+    #[test]
+    fn test_future_wakes_on_completion() {
+        let completion = Completion::<u32>::new();
+        let mut future = ReactorFuture {
+            completion: completion.clone(),
+        };
+        let flag = Arc::new(FlagWaker(AtomicBool::new(false)));
+        let waker = Waker::from(flag.clone());
+        let mut cx = Context::from_waker(&waker);
+
+        assert_eq!(Pin::new(&mut future).poll(&mut cx), Poll::Pending);
+        completion.complete(5);
+        assert!(flag.0.load(Ordering::SeqCst));
+        assert_eq!(Pin::new(&mut future).poll(&mut cx), Poll::Ready(5));
+    }
+
+    /// Completes after a number of attempts.
+    struct CountdownOperation {
+        attempts: u32,
+        completion: Arc<Completion<Result<u32, FPGAError>>>,
+    }
+
+    impl Operation for CountdownOperation {
+        fn attempt(&mut self, _slice: Duration) -> bool {
+            self.attempts -= 1;
+            if self.attempts == 0 {
+                self.completion.complete(Ok(0));
+            }
+            self.attempts == 0
+        }
+
+        fn cancel(self: Box<Self>) {
+            self.completion.complete(Err(FPGAError::Cancelled));
+        }
+    }
+
+    fn wait_for<R>(completion: &Completion<R>) -> R {
+        let start = Instant::now();
+        loop {
+            if let Some(result) = completion.state.lock().unwrap().result.take() {
+                return result;
+            }
+            assert!(
+                start.elapsed() < Duration::from_secs(5),
+                "Operation never completed"
+            );
+            std::thread::sleep(Duration::from_millis(1));
+        }
+    }
+
+    #[test]
+    fn test_operations_are_requeued_until_done() {
+        let reactor = Reactor::new(ReactorConfig::default());
+        let completions: Vec<_> = (0..20)
+            .map(|index| {
+                let completion = Completion::new();
+                reactor.shared.submit(Box::new(CountdownOperation {
+                    attempts: index + 1,
+                    completion: completion.clone(),
+                }));
+                completion
+            })
+            .collect();
+
+        for completion in completions {
+            assert!(wait_for(&completion).is_ok());
+        }
+    }
+
+    #[test]
+    fn test_drop_cancels_outstanding_operations() {
+        let completion = Completion::new();
+        {
+            let reactor = Reactor::new(ReactorConfig {
+                threads: 1,
+                ..Default::default()
+            });
+            reactor.shared.submit(Box::new(CountdownOperation {
+                attempts: u32::MAX,
+                completion: completion.clone(),
+            }));
+        }
+        assert!(matches!(wait_for(&completion), Err(FPGAError::Cancelled)));
+    }
+}
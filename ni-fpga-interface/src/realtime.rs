@@ -0,0 +1,98 @@
+//! Scheduling controls for time critical threads.
+//!
+//! These only apply to the calling thread. They are supported on Linux,
+//! including NI Linux RT, and return an unsupported error elsewhere.
+
+use std::io;
+
+/// Restricts the calling thread to run only on the given core.
+#[cfg(target_os = "linux")]
+pub(crate) fn pin_current_thread(core: usize) -> io::Result<()> {
+    if core >= libc::CPU_SETSIZE as usize {
+        return Err(io::Error::new(
+            io::ErrorKind::InvalidInput,
+            format!("Core {core} is outside the CPU set"),
+        ));
+    }
+    unsafe {
+        let mut set: libc::cpu_set_t = std::mem::zeroed();
+        libc::CPU_SET(core, &mut set);
+        // A pid of 0 is the calling thread.
+        if libc::sched_setaffinity(0, std::mem::size_of::<libc::cpu_set_t>(), &set) != 0 {
+            return Err(io::Error::last_os_error());
+        }
+    }
+    Ok(())
+}
+
+/// Moves the calling thread to the `SCHED_FIFO` real time policy at the priority (1 to 99).
+///
+/// This normally needs root or the `CAP_SYS_NICE` capability.
+#[cfg(target_os = "linux")]
+pub(crate) fn set_fifo_priority(priority: i32) -> io::Result<()> {
+    let param = libc::sched_param {
+        sched_priority: priority,
+    };
+    // Unlike most calls this returns the error rather than setting errno.
+    let result =
+        unsafe { libc::pthread_setschedparam(libc::pthread_self(), libc::SCHED_FIFO, &param) };
+    if result != 0 {
+        return Err(io::Error::from_raw_os_error(result));
+    }
+    Ok(())
+}
+
+#[cfg(not(target_os = "linux"))]
+pub(crate) fn pin_current_thread(_core: usize) -> io::Result<()> {
+    Err(io::Error::new(
+        io::ErrorKind::Unsupported,
+        "Pinning threads is only supported on Linux",
+    ))
+}
+
+#[cfg(not(target_os = "linux"))]
+pub(crate) fn set_fifo_priority(_priority: i32) -> io::Result<()> {
+    Err(io::Error::new(
+        io::ErrorKind::Unsupported,
+        "Real time priorities are only supported on Linux",
+    ))
+}
+
+#[cfg(all(test, target_os = "linux"))]
+mod tests {
+    use super::*;
+
+    /// The cores the calling thread may run on.
+    fn allowed_cores() -> Vec<usize> {
+        unsafe {
+            let mut set: libc::cpu_set_t = std::mem::zeroed();
+            let result =
+                libc::sched_getaffinity(0, std::mem::size_of::<libc::cpu_set_t>(), &mut set);
+            assert_eq!(result, 0, "{}", io::Error::last_os_error());
+            (0..libc::CPU_SETSIZE as usize)
+                .filter(|&core| libc::CPU_ISSET(core, &set))
+                .collect()
+        }
+    }
+
+    #[test]
+    fn test_pin_current_thread() {
+        std::thread::spawn(|| {
+            // Core 0 may not be in the mask, for example in a container.
+            let core = allowed_cores()[0];
+            pin_current_thread(core).unwrap();
+            assert_eq!(allowed_cores(), [core]);
+            let error = pin_current_thread(usize::MAX).unwrap_err();
+            assert_eq!(error.kind(), io::ErrorKind::InvalidInput);
+        })
+        .join()
+        .unwrap();
+    }
+
+    #[test]
+    fn test_invalid_priority_fails() {
+        std::thread::spawn(|| assert!(set_fifo_priority(1000).is_err()))
+            .join()
+            .unwrap();
+    }
+}
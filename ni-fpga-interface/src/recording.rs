@@ -0,0 +1,505 @@
+//! Records a target to host DMA FIFO straight to disk.
+//!
+//! [`FifoRecorder`] acquires zero copy regions from the FIFO and writes them
+//! to the file directly from the DMA host buffer, so the data isn't copied
+//! into an intermediate buffer first.
+//!
+//! Each file starts with a [`RecordingHeader`] holding the bitfile signature,
+//! the FIFO address and the element type so a capture can be identified and
+//! replayed later. Once a file reaches [`RecordingConfig::max_file_bytes`] the
+//! recorder moves on to the next one. Files are only changed between regions
+//! so every element ends up in exactly one file. Existing files are never
+//! overwritten, so a restarted recording skips past them to the next free index.
+//!
+//! # Example
+//!
+//! ```rust
+//! # use ni_fpga_interface::session::{NiFpgaContext, Session};
+//! # mod fpga_defs {
+//! #     pub const SIGNATURE: &str = "A0613989B20F45FC6E79EB71383493E8";
+//! #     pub mod fifos {
+//! #         use ni_fpga_interface::fifos::ReadFifo;
+//! #         pub const NumbersFromFPGA: ReadFifo<u32> = ReadFifo::new(1);
+//! #     }
+//! # }
+//! use ni_fpga_interface::recording::{FifoRecorder, RecordingConfig};
+//! use std::sync::Arc;
+//!
+//! # let context = NiFpgaContext::new().unwrap();
+//! let session = Arc::new(
+//!     Session::new(&context, "main.lvbitx", "sig", "RIO0", &Default::default()).unwrap(),
+//! );
+//! let config = RecordingConfig {
+//!     directory: "/data/captures".into(),
+//!     ..Default::default()
+//! };
+//! let recorder = FifoRecorder::new(fpga_defs::SIGNATURE, fpga_defs::fifos::NumbersFromFPGA, config);
+//! let running = recorder.start(session);
+//! // ...
+//! running.stop().unwrap();
+//! ```
+
+use crate::error::FPGAError;
+use crate::fifos::{Fifo, ReadFifo};
+use crate::nifpga_sys::FifoAddress;
+use crate::session::{FifoInterface, NativeFpgaType, Session};
+use std::fs::{File, OpenOptions};
+use std::io::{BufReader, Read, Write};
+use std::mem::{size_of, size_of_val};
+use std::path::{Path, PathBuf};
+use std::sync::atomic::{AtomicBool, Ordering};
+use std::sync::Arc;
+use std::thread::JoinHandle;
+use std::time::Duration;
+
+/// Identifies a recording file.
+const MAGIC: &[u8; 8] = b"NIFPGREC";
+/// The version of the header layout.
+const VERSION: u16 = 1;
+
+/// The description written at the start of every recording file.
+///
+/// All values are little endian. The element data follows the header directly
+/// in the native byte order of the host.
+#[derive(Debug, Clone, PartialEq, Eq)]
+pub struct RecordingHeader {
+    /// The signature of the bitfile the data was recorded from.
+    pub signature: String,
+    /// The address of the FIFO in the bitfile.
+    pub fifo: FifoAddress,
+    /// The FPGA interface name of the element type, for example `U32`.
+    pub element_type: String,
+    /// The size of each element in bytes.
+    pub element_size: u16,
+    /// The position of this file in the recording, starting at 0.
+    pub file_index: u32,
+}
+
+impl RecordingHeader {
+    /// Writes the header to the start of a recording.
+    pub fn write_to(&self, writer: &mut impl Write) -> std::io::Result<()> {
+        writer.write_all(MAGIC)?;
+        writer.write_all(&VERSION.to_le_bytes())?;
+        writer.write_all(&self.element_size.to_le_bytes())?;
+        writer.write_all(&self.fifo.to_le_bytes())?;
+        writer.write_all(&self.file_index.to_le_bytes())?;
+        write_string(writer, &self.element_type)?;
+        write_string(writer, &self.signature)
+    }
+
+    /// Reads the header from the start of a recording, leaving the reader at the first element.
+    pub fn read_from(reader: &mut impl Read) -> std::io::Result<Self> {
+        let mut magic = [0u8; 8];
+        reader.read_exact(&mut magic)?;
+        if &magic != MAGIC {
+            return Err(invalid_data("Not a FIFO recording"));
+        }
+        let version = u16::from_le_bytes(read_array(reader)?);
+        if version != VERSION {
+            return Err(invalid_data("Unsupported recording version"));
+        }
+        let element_size = u16::from_le_bytes(read_array(reader)?);
+        let fifo = u32::from_le_bytes(read_array(reader)?);
+        let file_index = u32::from_le_bytes(read_array(reader)?);
+        let element_type = read_string(reader)?;
+        let signature = read_string(reader)?;
+        Ok(Self {
+            signature,
+            fifo,
+            element_type,
+            element_size,
+            file_index,
+        })
+    }
+}
+
+/// Reads a recording file back for replay, checking it holds elements of type `T`.
+///
+/// A partial element at the end, for example from a recording which was
+/// interrupted, is ignored.
+pub fn read_recording<T: NativeFpgaType + Default>(
+    path: impl AsRef<Path>,
+) -> Result<(RecordingHeader, Vec<T>), FPGAError> {
+    let mut file = BufReader::new(File::open(path)?);
+    let header = RecordingHeader::read_from(&mut file)?;
+    if header.element_type != T::FPGA_TYPE || header.element_size as usize != size_of::<T>() {
+        return Err(invalid_data("Recording holds a different element type").into());
+    }
+
+    let mut bytes = Vec::new();
+    file.read_to_end(&mut bytes)?;
+    let mut elements = vec![T::default(); bytes.len() / size_of::<T>()];
+    // Safety: the native types are plain data so any bytes are a valid value.
+    unsafe {
+        std::ptr::copy_nonoverlapping(
+            bytes.as_ptr(),
+            elements.as_mut_ptr() as *mut u8,
+            size_of_val(elements.as_slice()),
+        );
+    }
+    Ok((header, elements))
+}
+
+fn write_string(writer: &mut impl Write, value: &str) -> std::io::Result<()> {
+    let length = u16::try_from(value.len()).map_err(|_| invalid_data("Header string too long"))?;
+    writer.write_all(&length.to_le_bytes())?;
+    writer.write_all(value.as_bytes())
+}
+
+fn read_string(reader: &mut impl Read) -> std::io::Result<String> {
+    let length = u16::from_le_bytes(read_array(reader)?);
+    let mut value = vec![0u8; length as usize];
+    reader.read_exact(&mut value)?;
+    String::from_utf8(value).map_err(|_| invalid_data("Header string is not UTF-8"))
+}
+
+fn read_array<const N: usize>(reader: &mut impl Read) -> std::io::Result<[u8; N]> {
+    let mut bytes = [0u8; N];
+    reader.read_exact(&mut bytes)?;
+    Ok(bytes)
+}
+
+fn invalid_data(message: &str) -> std::io::Error {
+    std::io::Error::new(std::io::ErrorKind::InvalidData, message)
+}
+
+/// Configuration for a [`FifoRecorder`].
+#[derive(Debug, Clone)]
+pub struct RecordingConfig {
+    /// The directory the files are written to (default: the working directory).
+    pub directory: PathBuf,
+    /// The start of each file name, followed by the file index (default: "capture").
+    pub file_prefix: String,
+    /// Moves to a new file once this many bytes of data are in the current one (default: 1 GiB).
+    pub max_file_bytes: u64,
+    /// The most elements written in a single block (default: 65536).
+    pub block_elements: usize,
+    /// How long to wait for data before checking if the recording should stop (default: 100ms).
+    pub poll_timeout: Duration,
+}
+
+impl Default for RecordingConfig {
+    fn default() -> Self {
+        Self {
+            directory: PathBuf::from("."),
+            file_prefix: "capture".to_string(),
+            max_file_bytes: 1 << 30,
+            block_elements: 65536,
+            poll_timeout: Duration::from_millis(100),
+        }
+    }
+}
+
+impl RecordingConfig {
+    fn file_path(&self, index: u32) -> PathBuf {
+        self.directory
+            .join(format!("{}-{:06}.nirec", self.file_prefix, index))
+    }
+}
+
+struct OpenFile {
+    file: File,
+    path: PathBuf,
+    data_bytes: u64,
+}
+
+/// Writes the data from a FIFO to a series of files.
+///
+/// See the [module documentation](self) for an example.
+pub struct FifoRecorder<T: NativeFpgaType> {
+    fifo: ReadFifo<T>,
+    config: RecordingConfig,
+    signature: String,
+    next_index: u32,
+    current: Option<OpenFile>,
+}
+
+impl<T> FifoRecorder<T>
+where
+    T: NativeFpgaType + Send + 'static,
+    Session: FifoInterface<T>,
+{
+    /// Creates a recorder for the FIFO. Use the `SIGNATURE` from the generated module
+    /// so the files can be matched to the bitfile. No files are created until data is recorded.
+    pub fn new(signature: &str, fifo: ReadFifo<T>, config: RecordingConfig) -> Self {
+        Self {
+            fifo,
+            config,
+            signature: signature.to_string(),
+            next_index: 0,
+            current: None,
+        }
+    }
+
+    /// Waits up to the poll timeout for data and writes what is available.
+    ///
+    /// Returns the number of elements written, which is 0 if no data arrived.
+    pub fn record_block(&mut self, session: &impl FifoInterface<T>) -> Result<usize, FPGAError> {
+        let available = self.fifo.elements_available(session)?;
+        let elements = available.clamp(1, self.config.block_elements.max(1));
+        let block_bytes = (elements * size_of::<T>()) as u64;
+
+        // Change file before acquiring so the region isn't held while the file is created.
+        // The FPGA keeps filling the host buffer in the meantime so nothing is lost.
+        let needs_new_file = match &self.current {
+            Some(current) => {
+                current.data_bytes > 0
+                    && current.data_bytes + block_bytes > self.config.max_file_bytes
+            }
+            None => true,
+        };
+        if needs_new_file {
+            self.open_next_file()?;
+        }
+
+        let (region, _remaining) =
+            match self
+                .fifo
+                .get_read_region(session, elements, Some(self.config.poll_timeout))
+            {
+                Ok(result) => result,
+                Err(error) if error.is_fifo_timeout() => return Ok(0),
+                Err(error) => return Err(error),
+            };
+
+        // View the DMA region as bytes so it is written without a copy.
+        let bytes = unsafe {
+            std::slice::from_raw_parts(
+                region.elements.as_ptr() as *const u8,
+                size_of_val(region.elements),
+            )
+        };
+        let current = self.current.as_mut().expect("File opened above");
+        current.file.write_all(bytes)?;
+        current.data_bytes += bytes.len() as u64;
+        Ok(region.elements.len())
+    }
+
+    /// Records until stop is set, then flushes the current file.
+    pub fn run(
+        &mut self,
+        session: &impl FifoInterface<T>,
+        stop: &AtomicBool,
+    ) -> Result<(), FPGAError> {
+        while !stop.load(Ordering::Relaxed) {
+            self.record_block(session)?;
+        }
+        self.flush()
+    }
+
+    /// Moves the recorder to a new thread which runs it until stopped.
+    pub fn start(mut self, session: Arc<Session>) -> RunningRecorder {
+        let stop = Arc::new(AtomicBool::new(false));
+        let thread_stop = stop.clone();
+        let thread = std::thread::Builder::new()
+            .name("fifo-recorder".to_string())
+            .spawn(move || self.run(session.as_ref(), &thread_stop))
+            .expect("Failed to spawn recorder thread");
+
+        RunningRecorder {
+            stop,
+            thread: Some(thread),
+        }
+    }
+
+    /// The file currently being written, if any.
+    pub fn current_path(&self) -> Option<&Path> {
+        self.current.as_ref().map(|current| current.path.as_path())
+    }
+
+    /// Flushes the current file to disk.
+    pub fn flush(&mut self) -> Result<(), FPGAError> {
+        if let Some(current) = &mut self.current {
+            current.file.sync_data()?;
+        }
+        Ok(())
+    }
+
+    fn open_next_file(&mut self) -> Result<(), FPGAError> {
+        let (mut file, path) = loop {
+            let path = self.config.file_path(self.next_index);
+            match OpenOptions::new().write(true).create_new(true).open(&path) {
+                Ok(file) => break (file, path),
+                // Left by an earlier recording so keep it.
+                Err(error) if error.kind() == std::io::ErrorKind::AlreadyExists => {
+                    self.next_index += 1;
+                }
+                Err(error) => return Err(error.into()),
+            }
+        };
+        let header = RecordingHeader {
+            signature: self.signature.clone(),
+            fifo: self.fifo.address(),
+            element_type: T::FPGA_TYPE.to_string(),
+            element_size: size_of::<T>() as u16,
+            file_index: self.next_index,
+        };
+        header.write_to(&mut file)?;
+
+        self.next_index += 1;
+        self.current = Some(OpenFile {
+            file,
+            path,
+            data_bytes: 0,
+        });
+        Ok(())
+    }
+}
+
+/// A [`FifoRecorder`] running on its own thread.
+///
+/// The thread is stopped when this is dropped or [`RunningRecorder::stop`] is called.
+pub struct RunningRecorder {
+    stop: Arc<AtomicBool>,
+    thread: Option<JoinHandle<Result<(), FPGAError>>>,
+}
+
+impl RunningRecorder {
+    /// Returns false if the thread has exited, for example due to an error.
+    ///
+    /// Call [`RunningRecorder::stop`] to retrieve the error.
+    pub fn is_running(&self) -> bool {
+        self.thread
+            .as_ref()
+            .map(|thread| !thread.is_finished())
+            .unwrap_or(false)
+    }
+
+    /// Stops the thread and returns any error it encountered.
+    pub fn stop(mut self) -> Result<(), FPGAError> {
+        self.stop_thread()
+    }
+
+    fn stop_thread(&mut self) -> Result<(), FPGAError> {
+        self.stop.store(true, Ordering::Relaxed);
+        match self.thread.take() {
+            Some(thread) => thread.join().expect("Recorder thread panicked"),
+            None => Ok(()),
+        }
+    }
+}
+
+impl Drop for RunningRecorder {
+    fn drop(&mut self) {
+        // Cant return result from drop so ignore it.
+        let _ = self.stop_thread();
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    fn example_header() -> RecordingHeader {
+        RecordingHeader {
+            signature: "A0613989B20F45FC6E79EB71383493E8".to_string(),
+            fifo: 3,
+            element_type: u32::FPGA_TYPE.to_string(),
+            element_size: 4,
+            file_index: 7,
+        }
+    }
+
+    #[test]
+    fn test_header_round_trip() {
+        let header = example_header();
+        let mut bytes = Vec::new();
+        header.write_to(&mut bytes).unwrap();
+        bytes.extend_from_slice(&[1, 2, 3, 4]);
+
+        let mut reader = bytes.as_slice();
+        assert_eq!(RecordingHeader::read_from(&mut reader).unwrap(), header);
+        // Left at the first element.
+        assert_eq!(reader, &[1, 2, 3, 4]);
+    }
+
+    #[test]
+    fn test_header_rejects_other_files() {
+        let mut reader: &[u8] = b"NOTARECORDING...";
+        let error = RecordingHeader::read_from(&mut reader).unwrap_err();
+        assert_eq!(error.kind(), std::io::ErrorKind::InvalidData);
+    }
+
+    #[test]
+    fn test_record_and_replay_across_files() {
+        use crate::sim::{SimFifoConfig, SimSession};
+
+        let fifo = ReadFifo::<u32>::new(3);
+        let session =
+            SimSession::new().with_read_fifo(&fifo, (0..100).collect(), SimFifoConfig::default());
+        let directory = std::env::temp_dir().join(format!("nirec-{}", std::process::id()));
+        std::fs::create_dir_all(&directory).unwrap();
+        let config = RecordingConfig {
+            directory: directory.clone(),
+            max_file_bytes: 40 * 4,
+            block_elements: 30,
+            poll_timeout: Duration::from_millis(1),
+            ..Default::default()
+        };
+
+        let mut recorder = FifoRecorder::new("SIG", fifo, config.clone());
+        let mut recorded = 0;
+        while recorded < 100 {
+            recorded += recorder.record_block(&session).unwrap();
+        }
+        recorder.flush().unwrap();
+
+        // The last 10 elements still fit in the third file.
+        assert!(!config.file_path(3).exists());
+        let mut replayed = Vec::new();
+        for index in 0..3 {
+            let (header, data) = read_recording::<u32>(config.file_path(index)).unwrap();
+            assert_eq!(header.file_index, index);
+            assert_eq!(header.fifo, 3);
+            assert_eq!(header.signature, "SIG");
+            replayed.extend(data);
+        }
+        assert!(read_recording::<i16>(config.file_path(0)).is_err());
+        std::fs::remove_dir_all(&directory).unwrap();
+        assert_eq!(replayed, (0..100).collect::<Vec<_>>());
+    }
+
+    #[test]
+    fn test_restart_keeps_earlier_files() {
+        use crate::sim::{SimFifoConfig, SimSession};
+
+        let fifo = ReadFifo::<u32>::new(3);
+        let session =
+            SimSession::new().with_read_fifo(&fifo, (0..10).collect(), SimFifoConfig::default());
+        let directory = std::env::temp_dir().join(format!("nirec-restart-{}", std::process::id()));
+        std::fs::create_dir_all(&directory).unwrap();
+        let config = RecordingConfig {
+            directory: directory.clone(),
+            poll_timeout: Duration::from_millis(1),
+            ..Default::default()
+        };
+        std::fs::write(config.file_path(0), b"earlier").unwrap();
+
+        let mut recorder = FifoRecorder::new("SIG", fifo, config.clone());
+        let mut recorded = 0;
+        while recorded < 10 {
+            recorded += recorder.record_block(&session).unwrap();
+        }
+        recorder.flush().unwrap();
+
+        assert_eq!(std::fs::read(config.file_path(0)).unwrap(), b"earlier");
+        assert_eq!(recorder.current_path(), Some(config.file_path(1).as_path()));
+        let (header, data) = read_recording::<u32>(config.file_path(1)).unwrap();
+        std::fs::remove_dir_all(&directory).unwrap();
+        assert_eq!(header.file_index, 1);
+        assert_eq!(data, (0..10).collect::<Vec<_>>());
+    }
+
+    #[test]
+    fn test_file_names_sort_in_order() {
+        let config = RecordingConfig {
+            directory: PathBuf::from("/data"),
+            ..Default::default()
+        };
+        assert_eq!(
+            config.file_path(12),
+            PathBuf::from("/data/capture-000012.nirec")
+        );
+        assert!(config.file_path(9) < config.file_path(10));
+    }
+}
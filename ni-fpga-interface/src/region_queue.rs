@@ -0,0 +1,231 @@
+//! Keeps several zero copy read regions of one FIFO outstanding at once.
+//!
+//! [`ReadFifo::get_read_region`] borrows the FIFO until the region is dropped,
+//! so the next block can't be acquired until the last one is processed.
+//!
+//! The driver allows several acquisitions before a release but always releases
+//! elements from the front of the FIFO. A [`ReadRegionQueue`] tracks the order
+//! the regions were acquired in so they can be dropped in any order, even on
+//! different threads, and only releases elements once every earlier region is done.
+//!
+//! # Example
+//!
+//! ```rust
+//! # use ni_fpga_interface::fifos::ReadFifo;
+//! # use ni_fpga_interface::session::{NiFpgaContext, Session};
+//! use std::sync::mpsc;
+//!
+//! # let context = NiFpgaContext::new().unwrap();
+//! # let session = Session::new(&context, "main.lvbitx", "sig", "RIO0", &Default::default()).unwrap();
+//! let mut fifo = ReadFifo::<i16>::new(1);
+//! let queue = fifo.region_queue(&session);
+//! let (sender, receiver) = mpsc::sync_channel(2);
+//!
+//! std::thread::scope(|scope| {
+//!     // Process one block while the next is acquired.
+//!     scope.spawn(move || {
+//!         for region in receiver {
+//!             println!("{} elements", region.elements.len());
+//!         }
+//!     });
+//!     for _ in 0..100 {
+//!         let (region, _remaining) = queue.acquire(4096, None).unwrap();
+//!         sender.send(region).unwrap();
+//!     }
+//!     drop(sender);
+//! });
+//! ```
+
+use crate::error::FPGAError;
+use crate::fifos::{Fifo, ReadFifo};
+use crate::nifpga_sys::FifoAddress;
+use crate::session::{FifoInterface, NativeFpgaType, Session};
+use std::collections::VecDeque;
+use std::sync::Mutex;
+use std::time::Duration;
+
+/// Tracks which acquisitions are complete so they are released from the front.
+#[derive(Debug, Default)]
+struct ReleaseOrder {
+    /// The sequence number of the region at the front of `pending`.
+    front: u64,
+    /// The size of each outstanding region and whether it has been dropped.
+    pending: VecDeque<(usize, bool)>,
+}
+
+impl ReleaseOrder {
+    /// Registers a newly acquired region and returns its sequence number.
+    fn push(&mut self, elements: usize) -> u64 {
+        self.pending.push_back((elements, false));
+        self.front + self.pending.len() as u64 - 1
+    }
+
+    /// Marks a region as done and returns the number of elements which can now be released.
+    fn complete(&mut self, sequence: u64) -> usize {
+        let index = (sequence - self.front) as usize;
+        self.pending[index].1 = true;
+
+        let mut releasable = 0;
+        while let Some(&(elements, true)) = self.pending.front() {
+            releasable += elements;
+            self.pending.pop_front();
+            self.front += 1;
+        }
+        releasable
+    }
+
+    fn outstanding(&self) -> usize {
+        self.pending.len()
+    }
+}
+
+/// Acquires read regions from a FIFO which can be held at the same time.
+///
+/// Created by [`ReadFifo::region_queue`]. The FIFO is borrowed by the queue so
+/// no other reads can interfere with the release order.
+///
+/// See the [module documentation](self) for an example.
+pub struct ReadRegionQueue<'s, 'f, T: NativeFpgaType> {
+    session: &'s Session,
+    fifo: &'f mut ReadFifo<T>,
+    address: FifoAddress,
+    /// Held during acquisition so regions are registered in the order the driver returned them.
+    ///
+    /// This is separate from the release order so dropping a region never waits for an acquire.
+    acquire_lock: Mutex<()>,
+    order: Mutex<ReleaseOrder>,
+}
+
+impl<'s, 'f, T: NativeFpgaType + 'static> ReadRegionQueue<'s, 'f, T>
+where
+    Session: FifoInterface<T>,
+{
+    pub(crate) fn new(session: &'s Session, fifo: &'f mut ReadFifo<T>) -> Self {
+        Self {
+            address: fifo.address(),
+            session,
+            fifo,
+            acquire_lock: Mutex::new(()),
+            order: Mutex::new(ReleaseOrder::default()),
+        }
+    }
+
+    /// Acquires the next region of up to `elements` from the FIFO.
+    ///
+    /// Earlier regions may still be held. As with [`ReadFifo::get_read_region`]
+    /// it also returns the number of elements remaining.
+    ///
+    /// Hold fewer elements than the host buffer depth in total or this will time out
+    /// as the FPGA has nowhere to write new data.
+    pub fn acquire(
+        &self,
+        elements: usize,
+        timeout: Option<Duration>,
+    ) -> Result<(QueuedReadRegion<'_, T>, usize), FPGAError> {
+        let _acquiring = self.acquire_lock.lock().expect("Region queue poisoned");
+        let (region, remaining) = self
+            .session
+            .zero_copy_read(self.address, elements, timeout)?;
+        let elements = region.elements;
+        // The queue takes over releasing the elements in order.
+        std::mem::forget(region);
+
+        self.fifo.record_level(self.session, remaining);
+        let sequence = self
+            .order
+            .lock()
+            .expect("Region queue poisoned")
+            .push(elements.len());
+        Ok((
+            QueuedReadRegion {
+                queue: self,
+                sequence,
+                elements,
+            },
+            remaining,
+        ))
+    }
+}
+
+impl<T: NativeFpgaType> ReadRegionQueue<'_, '_, T> {
+    /// The number of regions acquired which have not yet been released to the driver.
+    pub fn outstanding(&self) -> usize {
+        self.order
+            .lock()
+            .expect("Region queue poisoned")
+            .outstanding()
+    }
+
+    fn complete(&self, sequence: u64) -> Result<(), FPGAError> {
+        // Release under the lock so concurrent drops reach the driver in order.
+        let mut order = self.order.lock().expect("Region queue poisoned");
+        let releasable = order.complete(sequence);
+        if releasable > 0 {
+            self.session
+                .release_fifo_elements(self.address, releasable)?;
+        }
+        Ok(())
+    }
+}
+
+/// A region acquired from a [`ReadRegionQueue`].
+///
+/// When this is dropped the elements are released back to the FIFO once all
+/// regions acquired before it have also been dropped.
+pub struct QueuedReadRegion<'q, T: NativeFpgaType> {
+    queue: &'q ReadRegionQueue<'q, 'q, T>,
+    sequence: u64,
+    pub elements: &'q [T],
+}
+
+impl<T: NativeFpgaType> Drop for QueuedReadRegion<'_, T> {
+    fn drop(&mut self) {
+        // Cant return result from drop so ignore it.
+        let _ = self.queue.complete(self.sequence);
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    fn assert_send<T: Send>() {}
+
+    #[test]
+    fn test_regions_can_move_between_threads() {
+        assert_send::<QueuedReadRegion<'static, i16>>();
+    }
+
+    #[test]
+    fn test_in_order_release() {
+        let mut order = ReleaseOrder::default();
+        let first = order.push(10);
+        let second = order.push(20);
+        assert_eq!(order.complete(first), 10);
+        assert_eq!(order.complete(second), 20);
+        assert_eq!(order.outstanding(), 0);
+    }
+
+    #[test]
+    fn test_out_of_order_release_waits_for_earlier_regions() {
+        let mut order = ReleaseOrder::default();
+        let first = order.push(10);
+        let second = order.push(20);
+        let third = order.push(30);
+        assert_eq!(order.complete(third), 0);
+        assert_eq!(order.complete(second), 0);
+        assert_eq!(order.outstanding(), 3);
+        assert_eq!(order.complete(first), 60);
+        assert_eq!(order.outstanding(), 0);
+    }
+
+    #[test]
+    fn test_sequence_continues_after_release() {
+        let mut order = ReleaseOrder::default();
+        let first = order.push(1);
+        order.complete(first);
+        let second = order.push(2);
+        assert_eq!(second, first + 1);
+        assert_eq!(order.complete(second), 2);
+    }
+}
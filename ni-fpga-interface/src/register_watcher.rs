@@ -0,0 +1,916 @@
+//! Watches registers for changes from a single sampling thread.
+//!
+//! Polling an indicator from every thread that needs to see it change costs
+//! a driver call per thread per poll. A [`RegisterWatcher`] samples every
+//! watched register from one thread instead and sends a [`Change`] to each
+//! [`Watch`] whose [`Trigger`] fires. A register is read once per sample no
+//! matter how many watches share it.
+//!
+//! Sampling runs at [`WatcherConfig::period`]. With [`WatcherConfig::irq`] set
+//! the thread also samples as soon as one of the IRQs is asserted and then
+//! acknowledges it, so the FPGA can signal an update without waiting for
+//! the next period.
+//!
+//! # Example
+//!
+//! ```rust
+//! # mod fpga_defs { pub mod registers {
+//! #     use ni_fpga_interface::registers::Register;
+//! #     pub const Temperature: Register<f32> = Register::new(0x18000);
+//! #     pub const Faults: Register<u32> = Register::new(0x18004);
+//! # } }
+//! # use ni_fpga_interface::session::{NiFpgaContext, Session};
+//! use ni_fpga_interface::register_watcher::{RegisterWatcher, Trigger, WatcherConfig};
+//! use std::sync::Arc;
+//! use std::time::Duration;
+//!
+//! # let context = NiFpgaContext::new().unwrap();
+//! let session = Arc::new(
+//!     Session::new(&context, "main.lvbitx", "sig", "RIO0", &Default::default()).unwrap(),
+//! );
+//! let watcher = RegisterWatcher::start(session, WatcherConfig::default()).unwrap();
+//!
+//! let faults = watcher.watch(&fpga_defs::registers::Faults, Trigger::Changed);
+//! let overheat = watcher.watch(&fpga_defs::registers::Temperature, Trigger::Rising(80.0));
+//!
+//! let worker = std::thread::spawn(move || {
+//!     if let Some(change) = overheat.wait(Duration::from_secs(1)).unwrap() {
+//!         println!("Temperature rose to {}", change.value);
+//!     }
+//! });
+//!
+//! if let Some(change) = faults.wait(Duration::from_secs(1)).unwrap() {
+//!     println!("Faults changed from {:?} to {:#x}", change.previous, change.value);
+//! }
+//! worker.join().unwrap();
+//! println!("{:?}", watcher.statistics());
+//! watcher.stop().unwrap();
+//! ```
+
+use crate::error::FPGAError;
+use crate::irq::{
+    reserve_irq_context, wait_on_irqs, IrqSelection, IrqWaitResult, SendIrqContextHandle,
+};
+use crate::nifpga_sys::NiFpga_UnreserveIrqContext;
+use crate::registers::Register;
+use crate::session::{RegisterAddress, RegisterInterface, Session};
+use crate::types::FpgaBool;
+use std::any::{Any, TypeId};
+use std::cmp::Ordering as Order;
+use std::collections::HashMap;
+use std::sync::atomic::{AtomicBool, AtomicU64, Ordering};
+use std::sync::mpsc::{sync_channel, Receiver, RecvTimeoutError, SyncSender, TrySendError};
+use std::sync::{Arc, Mutex, Weak};
+use std::thread::JoinHandle;
+use std::time::{Duration, Instant};
+
+/// Configuration for the sampling thread.
+#[derive(Debug, Clone)]
+pub struct WatcherConfig {
+    /// The time between samples of every watched register (default: 10ms).
+    ///
+    /// This also bounds how long stop requests take to be seen.
+    pub period: Duration,
+    /// IRQs which trigger a sample as soon as they are asserted (default: none).
+    ///
+    /// The asserted IRQs are acknowledged once the registers have been read.
+    pub irq: Option<IrqSelection>,
+    /// The number of changes each watch holds before new ones are dropped (default: 64).
+    pub queue_depth: usize,
+}
+
+impl Default for WatcherConfig {
+    fn default() -> Self {
+        Self {
+            period: Duration::from_millis(10),
+            irq: None,
+            queue_depth: 64,
+        }
+    }
+}
+
+/// A register type which can be watched.
+///
+/// This is implemented for the numeric register types, which support every [`Trigger`],
+/// and [`FpgaBool`], which has no ordering so only supports [`Trigger::Changed`].
+pub trait WatchValue: Copy + Default + PartialEq + Send + 'static {
+    /// True if the type is ordered, so supports the deadband and level triggers.
+    const ORDERED: bool;
+    /// Orders the value against a trigger level. [`None`] if they can't be ordered.
+    fn compare(self, level: Self) -> Option<Order>;
+    /// True if the value is further than `band` from `reference`.
+    fn outside_deadband(self, reference: Self, band: Self) -> bool;
+}
+
+macro_rules! impl_watch_value {
+    ($rust_type:ty, |$value:ident, $reference:ident, $band:ident| $outside:expr) => {
+        impl WatchValue for $rust_type {
+            const ORDERED: bool = true;
+
+            fn compare(self, level: Self) -> Option<Order> {
+                self.partial_cmp(&level)
+            }
+
+            fn outside_deadband(self, reference: Self, band: Self) -> bool {
+                let ($value, $reference, $band) = (self, reference, band);
+                $outside
+            }
+        }
+    };
+}
+
+macro_rules! impl_watch_value_unsigned {
+    ($($rust_type:ty),*) => {
+        $(impl_watch_value!($rust_type, |value, reference, band| value.abs_diff(reference) > band);)*
+    };
+}
+
+macro_rules! impl_watch_value_signed {
+    ($($rust_type:ty),*) => {
+        $(impl_watch_value!($rust_type, |value, reference, band| {
+            value.abs_diff(reference) > band.unsigned_abs()
+        });)*
+    };
+}
+
+macro_rules! impl_watch_value_float {
+    ($($rust_type:ty),*) => {
+        $(impl_watch_value!($rust_type, |value, reference, band| (value - reference).abs() > band);)*
+    };
+}
+
+impl_watch_value_unsigned!(u8, u16, u32, u64);
+impl_watch_value_signed!(i8, i16, i32, i64);
+impl_watch_value_float!(f32, f64);
+
+impl WatchValue for FpgaBool {
+    const ORDERED: bool = false;
+
+    fn compare(self, _level: Self) -> Option<Order> {
+        None
+    }
+
+    fn outside_deadband(self, reference: Self, _band: Self) -> bool {
+        self != reference
+    }
+}
+
+/// When a watch is sent a change.
+#[derive(Debug, Clone, Copy, PartialEq)]
+pub enum Trigger<T> {
+    /// Whenever the value differs from the last one sent.
+    Changed,
+    /// When the value moves further than the band from the last one sent.
+    ///
+    /// Slow drift is still reported once it adds up to more than the band.
+    Deadband(T),
+    /// When the value goes from at or below the level to above it.
+    Rising(T),
+    /// When the value goes from at or above the level to below it.
+    Falling(T),
+    /// When the value rises or falls through the level.
+    Crossing(T),
+}
+
+/// The state of a trigger for one watch. Kept apart from the driver calls so it can be tested.
+struct Condition<T> {
+    trigger: Trigger<T>,
+    /// The value last sent to the watch.
+    reference: Option<T>,
+}
+
+impl<T: WatchValue> Condition<T> {
+    /// # Panics
+    ///
+    /// If the trigger needs an ordering which the type doesn't have.
+    fn new(trigger: Trigger<T>) -> Self {
+        assert!(
+            T::ORDERED || matches!(trigger, Trigger::Changed),
+            "{} only supports Trigger::Changed",
+            std::any::type_name::<T>()
+        );
+        Self {
+            trigger,
+            reference: None,
+        }
+    }
+
+    /// Checks a new sample against the previous sample of the register, returning true if it fires.
+    ///
+    /// [`Trigger::Changed`] and [`Trigger::Deadband`] fire on the first sample a watch sees
+    /// so it starts with the current value. The level triggers need a previous sample.
+    fn fires(&mut self, previous: Option<T>, value: T) -> bool {
+        let rising = |level: T| {
+            previous.is_some_and(|previous| {
+                matches!(previous.compare(level), Some(Order::Less | Order::Equal))
+                    && value.compare(level) == Some(Order::Greater)
+            })
+        };
+        let falling = |level: T| {
+            previous.is_some_and(|previous| {
+                matches!(previous.compare(level), Some(Order::Greater | Order::Equal))
+                    && value.compare(level) == Some(Order::Less)
+            })
+        };
+        let fires = match self.trigger {
+            Trigger::Changed => self.reference != Some(value),
+            Trigger::Deadband(band) => self
+                .reference
+                .is_none_or(|reference| value.outside_deadband(reference, band)),
+            Trigger::Rising(level) => rising(level),
+            Trigger::Falling(level) => falling(level),
+            Trigger::Crossing(level) => rising(level) || falling(level),
+        };
+        if fires {
+            self.reference = Some(value);
+        }
+        fires
+    }
+}
+
+/// A sample which fired the trigger of a watch.
+#[derive(Debug, Clone, Copy, PartialEq)]
+pub struct Change<T> {
+    /// The sample before this one. [`None`] if this was the first sample of the register.
+    pub previous: Option<T>,
+    /// The value which fired the trigger.
+    pub value: T,
+    /// When the register was sampled.
+    pub sampled: Instant,
+}
+
+/// The counters reported while the watcher runs.
+#[derive(Debug, Default, Clone, Copy, PartialEq, Eq)]
+pub struct WatcherStatistics {
+    /// Samples taken of the whole set of registers.
+    pub samples: u64,
+    /// Register reads made. This is one per watched register per sample.
+    pub reads: u64,
+    /// Changes sent to watches.
+    pub notifications: u64,
+    /// Changes dropped because a watch queue was full.
+    pub dropped: u64,
+    /// Samples triggered by the IRQs rather than the period.
+    pub irq_wakes: u64,
+}
+
+#[derive(Default)]
+struct WatcherCounters {
+    samples: AtomicU64,
+    reads: AtomicU64,
+    notifications: AtomicU64,
+    dropped: AtomicU64,
+    irq_wakes: AtomicU64,
+}
+
+impl WatcherCounters {
+    fn snapshot(&self) -> WatcherStatistics {
+        WatcherStatistics {
+            samples: self.samples.load(Ordering::Relaxed),
+            reads: self.reads.load(Ordering::Relaxed),
+            notifications: self.notifications.load(Ordering::Relaxed),
+            dropped: self.dropped.load(Ordering::Relaxed),
+            irq_wakes: self.irq_wakes.load(Ordering::Relaxed),
+        }
+    }
+}
+
+/// A watched register of any type, generic over the session so it can be tested.
+trait Watched<R>: Send {
+    /// Reads the register and sends the changes, dropping watches which have been dropped.
+    fn sample(
+        &mut self,
+        session: &R,
+        sampled: Instant,
+        counters: &WatcherCounters,
+    ) -> Result<(), FPGAError>;
+    fn is_empty(&self) -> bool;
+    /// Moves the watches of another register of the same address and type into this one.
+    fn merge(&mut self, other: &mut dyn Watched<R>);
+    fn as_any_mut(&mut self) -> &mut dyn Any;
+}
+
+/// Every watch on one register address.
+struct WatchedRegister<T> {
+    address: RegisterAddress,
+    last: Option<T>,
+    watches: Vec<WatchSender<T>>,
+}
+
+/// The watcher end of a [`Watch`].
+struct WatchSender<T> {
+    condition: Condition<T>,
+    sender: SyncSender<Change<T>>,
+    /// Dead once the watch is dropped, even if its trigger never fires to find out.
+    alive: Weak<()>,
+}
+
+impl<R: RegisterInterface<T>, T: WatchValue> Watched<R> for WatchedRegister<T> {
+    fn sample(
+        &mut self,
+        session: &R,
+        sampled: Instant,
+        counters: &WatcherCounters,
+    ) -> Result<(), FPGAError> {
+        let value = session.read(self.address)?;
+        counters.reads.fetch_add(1, Ordering::Relaxed);
+        let previous = self.last.replace(value);
+
+        self.watches.retain_mut(|watch| {
+            if watch.alive.strong_count() == 0 {
+                return false;
+            }
+            if !watch.condition.fires(previous, value) {
+                return true;
+            }
+            let change = Change {
+                previous,
+                value,
+                sampled,
+            };
+            match watch.sender.try_send(change) {
+                Ok(()) => {
+                    counters.notifications.fetch_add(1, Ordering::Relaxed);
+                    true
+                }
+                Err(TrySendError::Full(_)) => {
+                    counters.dropped.fetch_add(1, Ordering::Relaxed);
+                    true
+                }
+                Err(TrySendError::Disconnected(_)) => false,
+            }
+        });
+        Ok(())
+    }
+
+    fn is_empty(&self) -> bool {
+        self.watches.is_empty()
+    }
+
+    fn merge(&mut self, other: &mut dyn Watched<R>) {
+        let other = other
+            .as_any_mut()
+            .downcast_mut::<WatchedRegister<T>>()
+            .expect("Watched types are checked when added");
+        self.watches.append(&mut other.watches);
+    }
+
+    fn as_any_mut(&mut self) -> &mut dyn Any {
+        self
+    }
+}
+
+/// The watched registers of a session.
+type Registers<R> = Vec<(RegisterAddress, Box<dyn Watched<R>>)>;
+
+/// The registers being watched, in the order they were first watched.
+///
+/// The sampling thread takes the registers out to read them so new watches
+/// aren't held up by the driver calls, then commits them back.
+struct WatchList<R> {
+    registers: Registers<R>,
+    /// The type each address is watched as, including registers taken out for a sample.
+    types: HashMap<RegisterAddress, TypeId>,
+    /// Set once the watcher stops so new watches are cancelled straight away.
+    closed: bool,
+}
+
+impl<R> WatchList<R> {
+    fn new() -> Self {
+        Self {
+            registers: Vec::new(),
+            types: HashMap::new(),
+            closed: false,
+        }
+    }
+
+    /// # Panics
+    ///
+    /// If the address is already watched as a different type.
+    fn add<T: WatchValue>(
+        &mut self,
+        address: RegisterAddress,
+        condition: Condition<T>,
+        sender: SyncSender<Change<T>>,
+        alive: Weak<()>,
+    ) where
+        R: RegisterInterface<T>,
+    {
+        if self.closed {
+            return;
+        }
+        let watched_type = *self.types.entry(address).or_insert(TypeId::of::<T>());
+        if watched_type != TypeId::of::<T>() {
+            panic!("Register {address:#x} is already watched as a different type");
+        }
+        let watch = WatchSender {
+            condition,
+            sender,
+            alive,
+        };
+        // While the registers are taken out for a sample this starts a new entry
+        // which is merged back when they are committed.
+        let existing = self
+            .registers
+            .iter_mut()
+            .find(|(watched_address, _)| *watched_address == address);
+        match existing {
+            Some((_, watched)) => watched
+                .as_any_mut()
+                .downcast_mut::<WatchedRegister<T>>()
+                .expect("Watched types are checked above")
+                .watches
+                .push(watch),
+            None => self.registers.push((
+                address,
+                Box::new(WatchedRegister {
+                    address,
+                    last: None,
+                    watches: vec![watch],
+                }),
+            )),
+        }
+    }
+
+    /// Takes the registers out to sample them.
+    fn take(&mut self) -> Registers<R> {
+        std::mem::take(&mut self.registers)
+    }
+
+    /// Puts sampled registers back, merging in the watches added during the sample
+    /// and forgetting the registers which have no watches left.
+    fn commit(&mut self, mut registers: Registers<R>) {
+        if self.closed {
+            return;
+        }
+        for (address, mut added) in self.registers.drain(..) {
+            match registers
+                .iter_mut()
+                .find(|(sampled_address, _)| *sampled_address == address)
+            {
+                Some((_, sampled)) => sampled.merge(added.as_mut()),
+                None => registers.push((address, added)),
+            }
+        }
+        registers.retain(|(_, watched)| !watched.is_empty());
+        self.types
+            .retain(|address, _| registers.iter().any(|(watched, _)| watched == address));
+        self.registers = registers;
+    }
+
+    /// Drops every watch so waiting threads see the watcher has stopped.
+    fn close(&mut self) {
+        self.closed = true;
+        self.registers.clear();
+        self.types.clear();
+    }
+}
+
+/// Samples every register once, reading them without holding the lock on the list.
+fn sample<R>(
+    watches: &Mutex<WatchList<R>>,
+    session: &R,
+    counters: &WatcherCounters,
+) -> Result<(), FPGAError> {
+    let mut registers = watches.lock().unwrap().take();
+    let sampled = Instant::now();
+    let result = registers
+        .iter_mut()
+        .try_for_each(|(_, watched)| watched.sample(session, sampled, counters));
+    watches.lock().unwrap().commit(registers);
+    result?;
+    counters.samples.fetch_add(1, Ordering::Relaxed);
+    Ok(())
+}
+
+struct Shared {
+    watches: Mutex<WatchList<Session>>,
+    counters: WatcherCounters,
+    stop: AtomicBool,
+}
+
+/// Samples the watched registers from a single thread.
+///
+/// The thread is stopped when this is dropped or [`RegisterWatcher::stop`] is called.
+/// See the [module documentation](self) for an example.
+pub struct RegisterWatcher {
+    shared: Arc<Shared>,
+    queue_depth: usize,
+    thread: Option<JoinHandle<Result<(), FPGAError>>>,
+}
+
+impl RegisterWatcher {
+    /// Starts the sampling thread, reserving an IRQ context first if [`WatcherConfig::irq`] is set.
+    pub fn start(session: Arc<Session>, config: WatcherConfig) -> Result<Self, FPGAError> {
+        let context = match config.irq {
+            Some(_) => Some(SendIrqContextHandle(reserve_irq_context(session.handle)?)),
+            None => None,
+        };
+        let shared = Arc::new(Shared {
+            watches: Mutex::new(WatchList::new()),
+            counters: WatcherCounters::default(),
+            stop: AtomicBool::new(false),
+        });
+
+        let thread_shared = shared.clone();
+        let queue_depth = config.queue_depth;
+        let thread = std::thread::Builder::new()
+            .name("register-watcher".to_string())
+            .spawn(move || {
+                let result = watch_loop(&session, &thread_shared, context.as_ref(), &config);
+                if let Some(context) = context {
+                    // Cant do anything useful if this fails so ignore it.
+                    let _ = unsafe { NiFpga_UnreserveIrqContext(session.handle, context.0) };
+                }
+                thread_shared.watches.lock().unwrap().close();
+                result
+            })
+            .expect("Failed to spawn register watcher thread");
+
+        Ok(Self {
+            shared,
+            queue_depth,
+            thread: Some(thread),
+        })
+    }
+
+    /// Watches a register, sending a change each time the trigger fires.
+    ///
+    /// The watch takes part from the next sample.
+    /// Any number of watches can share a register, which is still read once per sample.
+    ///
+    /// # Panics
+    ///
+    /// If the register address is already watched as a different type, or the trigger needs
+    /// an ordering the type doesn't have, such as a level on an [`FpgaBool`].
+    pub fn watch<T: WatchValue>(&self, register: &Register<T>, trigger: Trigger<T>) -> Watch<T>
+    where
+        Session: RegisterInterface<T>,
+    {
+        let condition = Condition::new(trigger);
+        let (sender, receiver) = sync_channel(self.queue_depth);
+        let alive = Arc::new(());
+        self.shared.watches.lock().unwrap().add(
+            register.address(),
+            condition,
+            sender,
+            Arc::downgrade(&alive),
+        );
+        Watch {
+            address: register.address(),
+            receiver,
+            _alive: alive,
+        }
+    }
+
+    /// A snapshot of the watcher counters.
+    pub fn statistics(&self) -> WatcherStatistics {
+        self.shared.counters.snapshot()
+    }
+
+    /// Returns false if the sampling thread has exited, for example due to an error.
+    ///
+    /// Call [`RegisterWatcher::stop`] to retrieve the error.
+    pub fn is_running(&self) -> bool {
+        self.thread
+            .as_ref()
+            .map(|thread| !thread.is_finished())
+            .unwrap_or(false)
+    }
+
+    /// Stops the sampling thread and returns any error it encountered.
+    ///
+    /// Waiting watches return [`FPGAError::Cancelled`].
+    pub fn stop(mut self) -> Result<(), FPGAError> {
+        self.stop_thread()
+    }
+
+    fn stop_thread(&mut self) -> Result<(), FPGAError> {
+        self.shared.stop.store(true, Ordering::Relaxed);
+        match self.thread.take() {
+            Some(thread) => thread.join().expect("Register watcher thread panicked"),
+            None => Ok(()),
+        }
+    }
+}
+
+impl Drop for RegisterWatcher {
+    fn drop(&mut self) {
+        // Cant return result from drop so ignore it.
+        let _ = self.stop_thread();
+    }
+}
+
+fn watch_loop(
+    session: &Session,
+    shared: &Shared,
+    context: Option<&SendIrqContextHandle>,
+    config: &WatcherConfig,
+) -> Result<(), FPGAError> {
+    let mut next_sample = Instant::now();
+    while !shared.stop.load(Ordering::Relaxed) {
+        let asserted = match (config.irq, context) {
+            (Some(irq), Some(context)) => {
+                match wait_on_irqs(session.handle, context.0, irq, config.period)? {
+                    IrqWaitResult::IrqsAsserted(asserted) => Some(asserted),
+                    IrqWaitResult::TimedOut => None,
+                }
+            }
+            _ => {
+                std::thread::sleep(next_sample.saturating_duration_since(Instant::now()));
+                // Don't try to catch up on samples missed while descheduled.
+                next_sample = (next_sample + config.period).max(Instant::now());
+                None
+            }
+        };
+
+        sample(&shared.watches, session, &shared.counters)?;
+
+        if let Some(asserted) = asserted {
+            session.acknowledge_irqs(asserted)?;
+            shared.counters.irq_wakes.fetch_add(1, Ordering::Relaxed);
+        }
+    }
+    Ok(())
+}
+
+/// Receives the changes to one register from a [`RegisterWatcher`].
+///
+/// Watches can be moved to other threads. Dropping it removes it from the
+/// watcher at the next sample, and the register once it has no watches left.
+pub struct Watch<T> {
+    address: RegisterAddress,
+    receiver: Receiver<Change<T>>,
+    _alive: Arc<()>,
+}
+
+impl<T> Watch<T> {
+    /// The address of the watched register.
+    pub fn address(&self) -> RegisterAddress {
+        self.address
+    }
+
+    /// Waits for the next change, returning [`None`] if there was none before the timeout.
+    ///
+    /// Returns [`FPGAError::Cancelled`] once the watcher has stopped and every change is received.
+    pub fn wait(&self, timeout: Duration) -> Result<Option<Change<T>>, FPGAError> {
+        match self.receiver.recv_timeout(timeout) {
+            Ok(change) => Ok(Some(change)),
+            Err(RecvTimeoutError::Timeout) => Ok(None),
+            Err(RecvTimeoutError::Disconnected) => Err(FPGAError::Cancelled),
+        }
+    }
+
+    /// Takes the next change if there is one, without waiting.
+    pub fn try_next(&self) -> Option<Change<T>> {
+        self.receiver.try_recv().ok()
+    }
+
+    /// Discards the queued changes except the most recent, which is returned.
+    pub fn latest(&self) -> Option<Change<T>> {
+        self.receiver.try_iter().last()
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use crate::sim::SimSession;
+
+    const LEVEL: Register<u32> = Register::new(0x18000);
+    const TEMPERATURE: Register<f32> = Register::new(0x18004);
+    const ENABLED: Register<FpgaBool> = Register::new(0x18008);
+
+    fn fired<T: WatchValue>(trigger: Trigger<T>, samples: &[T]) -> Vec<T> {
+        let mut condition = Condition::new(trigger);
+        let mut previous = None;
+        let mut fired = Vec::new();
+        for &value in samples {
+            if condition.fires(previous, value) {
+                fired.push(value);
+            }
+            previous = Some(value);
+        }
+        fired
+    }
+
+    fn watch<T: WatchValue>(
+        list: &Mutex<WatchList<SimSession>>,
+        register: &Register<T>,
+        trigger: Trigger<T>,
+        depth: usize,
+    ) -> Watch<T>
+    where
+        SimSession: RegisterInterface<T>,
+    {
+        let (sender, receiver) = sync_channel(depth);
+        let alive = Arc::new(());
+        list.lock().unwrap().add(
+            register.address(),
+            Condition::new(trigger),
+            sender,
+            Arc::downgrade(&alive),
+        );
+        Watch {
+            address: register.address(),
+            receiver,
+            _alive: alive,
+        }
+    }
+
+    fn values<T>(watch: &Watch<T>) -> Vec<T> {
+        std::iter::from_fn(|| watch.try_next())
+            .map(|change| change.value)
+            .collect()
+    }
+
+    #[test]
+    fn test_changed_fires_on_first_sample_and_each_change() {
+        assert_eq!(
+            fired(Trigger::Changed, &[1, 1, 2, 2, 2, 3, 1]),
+            [1, 2, 3, 1]
+        );
+    }
+
+    #[test]
+    fn test_deadband_measures_from_last_sent_value() {
+        // Each step is inside the band but the drift adds up.
+        assert_eq!(
+            fired(Trigger::Deadband(2), &[10, 11, 12, 13, 14, 9]),
+            [10, 13, 9]
+        );
+        assert_eq!(
+            fired(Trigger::Deadband(0.5f32), &[0.0, 0.4, 0.6, 0.2]),
+            [0.0, 0.6]
+        );
+        assert_eq!(
+            fired(Trigger::Deadband(1i16), &[-5, -3, -4, 0]),
+            [-5, -3, 0]
+        );
+    }
+
+    #[test]
+    fn test_bool_changes() {
+        let (high, low) = (FpgaBool::TRUE, FpgaBool::FALSE);
+        assert_eq!(
+            fired(Trigger::Changed, &[low, low, high, high, low]),
+            [low, high, low]
+        );
+    }
+
+    #[test]
+    #[should_panic(expected = "only supports Trigger::Changed")]
+    fn test_bool_level_trigger_panics() {
+        Condition::new(Trigger::Rising(FpgaBool::FALSE));
+    }
+
+    #[test]
+    fn test_watches_bool_register() {
+        let session = SimSession::new().with_register(&ENABLED, FpgaBool::FALSE);
+        let counters = WatcherCounters::default();
+        let list = Mutex::new(WatchList::new());
+        let enabled = watch(&list, &ENABLED, Trigger::Changed, 8);
+
+        for value in [false, true, true, false] {
+            ENABLED.write(&session, value.into()).unwrap();
+            sample(&list, &session, &counters).unwrap();
+        }
+
+        assert_eq!(
+            values(&enabled),
+            [FpgaBool::FALSE, FpgaBool::TRUE, FpgaBool::FALSE]
+        );
+    }
+
+    #[test]
+    fn test_watches_added_during_a_sample_are_merged() {
+        let session = SimSession::new().with_register(&LEVEL, 1);
+        let counters = WatcherCounters::default();
+        let list = Mutex::new(WatchList::new());
+        let first = watch(&list, &LEVEL, Trigger::Changed, 8);
+
+        // As the sampling thread does, with watches added while the registers are out.
+        let mut registers = list.lock().unwrap().take();
+        let second = watch(&list, &LEVEL, Trigger::Changed, 8);
+        let temperature = watch(&list, &TEMPERATURE, Trigger::Changed, 8);
+        for (_, watched) in registers.iter_mut() {
+            watched.sample(&session, Instant::now(), &counters).unwrap();
+        }
+        list.lock().unwrap().commit(registers);
+        assert_eq!(list.lock().unwrap().registers.len(), 2);
+
+        LEVEL.write(&session, 2).unwrap();
+        sample(&list, &session, &counters).unwrap();
+        assert_eq!(values(&first), [1, 2]);
+        // Joins from the next sample, which reports the previous one.
+        let change = second.try_next().unwrap();
+        assert_eq!((change.previous, change.value), (Some(1), 2));
+        assert_eq!(values(&temperature), [0.0]);
+        assert_eq!(counters.snapshot().reads, 3);
+    }
+
+    #[test]
+    fn test_level_triggers_need_a_crossing() {
+        let samples = [5, 12, 15, 10, 3, 10, 11];
+        assert_eq!(fired(Trigger::Rising(10), &samples), [12, 11]);
+        assert_eq!(fired(Trigger::Falling(10), &samples), [3]);
+        assert_eq!(fired(Trigger::Crossing(10), &samples), [12, 3, 11]);
+        // Starting above the level isn't a crossing.
+        assert_eq!(fired(Trigger::Rising(10), &[12, 13]), Vec::<i32>::new());
+    }
+
+    #[test]
+    fn test_sample_reads_each_register_once() {
+        let session = SimSession::new().with_register(&LEVEL, 1);
+        let counters = WatcherCounters::default();
+        let list = Mutex::new(WatchList::new());
+        let changed = watch(&list, &LEVEL, Trigger::Changed, 8);
+        let rising = watch(&list, &LEVEL, Trigger::Rising(5), 8);
+        let temperature = watch(&list, &TEMPERATURE, Trigger::Deadband(1.0), 8);
+
+        for level in [1, 1, 7, 7, 2] {
+            LEVEL.write(&session, level).unwrap();
+            sample(&list, &session, &counters).unwrap();
+        }
+
+        assert_eq!(values(&changed), [1, 7, 2]);
+        assert_eq!(values(&rising), [7]);
+        assert_eq!(values(&temperature), [0.0]);
+        let statistics = counters.snapshot();
+        assert_eq!(statistics.samples, 5);
+        assert_eq!(statistics.reads, 10);
+        assert_eq!(statistics.notifications, 5);
+    }
+
+    #[test]
+    fn test_change_reports_previous_sample() {
+        let session = SimSession::new().with_register(&LEVEL, 3);
+        let counters = WatcherCounters::default();
+        let list = Mutex::new(WatchList::new());
+        let changed = watch(&list, &LEVEL, Trigger::Changed, 8);
+
+        sample(&list, &session, &counters).unwrap();
+        LEVEL.write(&session, 4).unwrap();
+        sample(&list, &session, &counters).unwrap();
+
+        assert_eq!(changed.try_next().unwrap().previous, None);
+        let change = changed.try_next().unwrap();
+        assert_eq!((change.previous, change.value), (Some(3), 4));
+    }
+
+    #[test]
+    fn test_dropped_watches_stop_the_reads() {
+        let session = SimSession::new();
+        let counters = WatcherCounters::default();
+        let list = Mutex::new(WatchList::new());
+        let level = watch(&list, &LEVEL, Trigger::Changed, 8);
+        // Never fires so the dropped watch can't be found by a failed send.
+        drop(watch(&list, &TEMPERATURE, Trigger::Rising(100.0), 8));
+
+        sample(&list, &session, &counters).unwrap();
+        assert_eq!(list.lock().unwrap().registers.len(), 1);
+        sample(&list, &session, &counters).unwrap();
+        assert_eq!(counters.snapshot().reads, 3);
+        assert_eq!(values(&level), [0]);
+    }
+
+    #[test]
+    fn test_full_queue_drops_changes() {
+        let session = SimSession::new();
+        let counters = WatcherCounters::default();
+        let list = Mutex::new(WatchList::new());
+        let level = watch(&list, &LEVEL, Trigger::Changed, 2);
+
+        for value in 1..=5 {
+            LEVEL.write(&session, value).unwrap();
+            sample(&list, &session, &counters).unwrap();
+        }
+
+        assert_eq!(counters.snapshot().dropped, 3);
+        assert_eq!(level.latest().unwrap().value, 2);
+        assert!(level.try_next().is_none());
+    }
+
+    #[test]
+    fn test_closed_list_cancels_watches() {
+        let list = Mutex::new(WatchList::new());
+        let before = watch(&list, &LEVEL, Trigger::Changed, 8);
+        list.lock().unwrap().close();
+        let after = watch(&list, &LEVEL, Trigger::Changed, 8);
+
+        for watch in [before, after] {
+            assert!(matches!(
+                watch.wait(Duration::from_millis(1)),
+                Err(FPGAError::Cancelled)
+            ));
+        }
+    }
+
+    #[test]
+    #[should_panic(expected = "already watched as a different type")]
+    fn test_watching_address_as_another_type_panics() {
+        let list = Mutex::new(WatchList::<SimSession>::new());
+        let _level = watch(&list, &LEVEL, Trigger::Changed, 8);
+        let _alias = watch(&list, &Register::<i32>::new(0x18000), Trigger::Changed, 8);
+    }
+}
@@ -0,0 +1,316 @@
+//! Batched register access for code which reads and writes the same set
+//! of registers repeatedly, such as a control loop.
+//!
+//! A [`RegisterBatch`] is built once, binding each register to a field of
+//! a struct you own. Each tick you then call [`RegisterBatch::read_into`]
+//! and [`RegisterBatch::write_from`] which perform every access with a single
+//! result to check and no allocation.
+//!
+//! Registers are grouped by type and ordered by address within each group
+//! so each pass runs through tight, monomorphised loops.
+//!
+//! # Example
+//!
+//! ```rust
+//! # mod fpga_defs { pub mod registers {
+//! #     use ni_fpga_interface::registers::{ArrayRegister, Register};
+//! #     pub const Temperature: Register<f32> = Register::new(0x18000);
+//! #     pub const Samples: ArrayRegister<u16, 4> = ArrayRegister::new(0x18004);
+//! #     pub const Setpoint: Register<f32> = Register::new(0x18010);
+//! # } }
+//! # use ni_fpga_interface::session::{NiFpgaContext, Session};
+//! use ni_fpga_interface::registers::RegisterBatch;
+//!
+//! #[derive(Default)]
+//! struct Io {
+//!     temperature: f32,
+//!     samples: [u16; 4],
+//!     setpoint: f32,
+//! }
+//!
+//! # let context = NiFpgaContext::new().unwrap();
+//! # let session = Session::new(&context, "main.lvbitx", "sig", "RIO0", &Default::default()).unwrap();
+//! let batch = RegisterBatch::<Io>::new()
+//!     .read(&fpga_defs::registers::Temperature, |io| &mut io.temperature)
+//!     .read_array(&fpga_defs::registers::Samples, |io| &mut io.samples)
+//!     .write(&fpga_defs::registers::Setpoint, |io| io.setpoint);
+//!
+//! let mut io = Io::default();
+//! loop {
+//!     batch.read_into(&session, &mut io).unwrap();
+//!     io.setpoint = io.temperature * 0.5;
+//!     batch.write_from(&session, &io).unwrap();
+//! #   break;
+//! }
+//! ```
+
+use super::{ArrayRegister, Register};
+use crate::error::Result;
+use crate::session::{RegisterAddress, RegisterInterface, Session};
+use std::any::Any;
+
+type ArrayReadFn<S> = Box<dyn Fn(&Session, &mut S) -> Result<()> + Send + Sync>;
+type ArrayWriteFn<S> = Box<dyn Fn(&Session, &S) -> Result<()> + Send + Sync>;
+
+/// Inserts the entry keeping the list ordered by address.
+fn insert_by_address<E>(
+    entries: &mut Vec<(RegisterAddress, E)>,
+    address: RegisterAddress,
+    entry: E,
+) {
+    let index = entries.partition_point(|(existing, _)| *existing <= address);
+    entries.insert(index, (address, entry));
+}
+
+/// Type erased access to the group for a single register type.
+trait BatchGroup<S>: Send + Sync {
+    fn read_into(&self, session: &Session, target: &mut S) -> Result<()>;
+    fn write_from(&self, session: &Session, source: &S) -> Result<()>;
+    fn as_any_mut(&mut self) -> &mut dyn Any;
+}
+
+/// All of the registers in the batch for one type.
+struct TypedGroup<S, T> {
+    reads: Vec<(RegisterAddress, fn(&mut S) -> &mut T)>,
+    writes: Vec<(RegisterAddress, fn(&S) -> T)>,
+    array_reads: Vec<(RegisterAddress, ArrayReadFn<S>)>,
+    array_writes: Vec<(RegisterAddress, ArrayWriteFn<S>)>,
+}
+
+impl<S, T> TypedGroup<S, T> {
+    fn new() -> Self {
+        Self {
+            reads: Vec::new(),
+            writes: Vec::new(),
+            array_reads: Vec::new(),
+            array_writes: Vec::new(),
+        }
+    }
+}
+
+impl<S, T> BatchGroup<S> for TypedGroup<S, T>
+where
+    S: 'static,
+    T: Default + Copy + 'static,
+    Session: RegisterInterface<T>,
+{
+    fn read_into(&self, session: &Session, target: &mut S) -> Result<()> {
+        for (address, field) in &self.reads {
+            *field(target) = session.read(*address)?;
+        }
+        for (_, read) in &self.array_reads {
+            read(session, target)?;
+        }
+        Ok(())
+    }
+
+    fn write_from(&self, session: &Session, source: &S) -> Result<()> {
+        for (address, field) in &self.writes {
+            session.write(*address, field(source))?;
+        }
+        for (_, write) in &self.array_writes {
+            write(session, source)?;
+        }
+        Ok(())
+    }
+
+    fn as_any_mut(&mut self) -> &mut dyn Any {
+        self
+    }
+}
+
+/// A fixed set of register reads and writes bound to the fields of `S`.
+///
+/// See the [module documentation](self) for an example.
+pub struct RegisterBatch<S> {
+    groups: Vec<Box<dyn BatchGroup<S>>>,
+    read_count: usize,
+    write_count: usize,
+}
+
+impl<S: 'static> Default for RegisterBatch<S> {
+    fn default() -> Self {
+        Self::new()
+    }
+}
+
+impl<S: 'static> RegisterBatch<S> {
+    /// Creates an empty batch.
+    pub fn new() -> Self {
+        Self {
+            groups: Vec::new(),
+            read_count: 0,
+            write_count: 0,
+        }
+    }
+
+    /// Reads the register into the field on each [`RegisterBatch::read_into`].
+    pub fn read<T>(mut self, register: &Register<T>, field: fn(&mut S) -> &mut T) -> Self
+    where
+        T: Default + Copy + 'static,
+        Session: RegisterInterface<T>,
+    {
+        insert_by_address(&mut self.group::<T>().reads, register.address(), field);
+        self.read_count += 1;
+        self
+    }
+
+    /// Writes the value of the field to the register on each [`RegisterBatch::write_from`].
+    pub fn write<T>(mut self, register: &Register<T>, field: fn(&S) -> T) -> Self
+    where
+        T: Default + Copy + 'static,
+        Session: RegisterInterface<T>,
+    {
+        insert_by_address(&mut self.group::<T>().writes, register.address(), field);
+        self.write_count += 1;
+        self
+    }
+
+    /// Reads the array register into the field on each [`RegisterBatch::read_into`].
+    ///
+    /// This uses the array call so the whole array is a single access.
+    pub fn read_array<T, const N: usize>(
+        mut self,
+        register: &ArrayRegister<T, N>,
+        field: fn(&mut S) -> &mut [T; N],
+    ) -> Self
+    where
+        T: Default + Copy + 'static,
+        Session: RegisterInterface<T>,
+    {
+        let address = register.address();
+        let read: ArrayReadFn<S> = Box::new(move |session: &Session, target: &mut S| {
+            session.read_array_mut(address, field(target))
+        });
+        insert_by_address(&mut self.group::<T>().array_reads, address, read);
+        self.read_count += 1;
+        self
+    }
+
+    /// Writes the field to the array register on each [`RegisterBatch::write_from`].
+    ///
+    /// This uses the array call so the whole array is a single access.
+    pub fn write_array<T, const N: usize>(
+        mut self,
+        register: &ArrayRegister<T, N>,
+        field: fn(&S) -> &[T; N],
+    ) -> Self
+    where
+        T: Default + Copy + 'static,
+        Session: RegisterInterface<T>,
+    {
+        let address = register.address();
+        let write: ArrayWriteFn<S> = Box::new(move |session: &Session, source: &S| {
+            session.write_array(address, field(source))
+        });
+        insert_by_address(&mut self.group::<T>().array_writes, address, write);
+        self.write_count += 1;
+        self
+    }
+
+    /// Performs all of the reads in the batch, storing the results in target.
+    ///
+    /// Stops at the first error.
+    pub fn read_into(&self, session: &Session, target: &mut S) -> Result<()> {
+        for group in &self.groups {
+            group.read_into(session, target)?;
+        }
+        Ok(())
+    }
+
+    /// Performs all of the writes in the batch, taking the values from source.
+    ///
+    /// Stops at the first error.
+    pub fn write_from(&self, session: &Session, source: &S) -> Result<()> {
+        for group in &self.groups {
+            group.write_from(session, source)?;
+        }
+        Ok(())
+    }
+
+    /// The number of registers read by [`RegisterBatch::read_into`].
+    pub fn read_count(&self) -> usize {
+        self.read_count
+    }
+
+    /// The number of registers written by [`RegisterBatch::write_from`].
+    pub fn write_count(&self) -> usize {
+        self.write_count
+    }
+
+    /// Finds or creates the group for the register type.
+    fn group<T>(&mut self) -> &mut TypedGroup<S, T>
+    where
+        T: Default + Copy + 'static,
+        Session: RegisterInterface<T>,
+    {
+        let index = match self
+            .groups
+            .iter_mut()
+            .position(|group| group.as_any_mut().is::<TypedGroup<S, T>>())
+        {
+            Some(index) => index,
+            None => {
+                self.groups.push(Box::new(TypedGroup::<S, T>::new()));
+                self.groups.len() - 1
+            }
+        };
+        self.groups[index]
+            .as_any_mut()
+            .downcast_mut()
+            .expect("Group type was just checked")
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[derive(Default)]
+    struct Io {
+        a: u8,
+        b: u8,
+        c: f64,
+        d: [u16; 2],
+    }
+
+    #[test]
+    fn test_groups_registers_by_type() {
+        let mut batch = RegisterBatch::<Io>::new()
+            .read(&Register::new(0x10), |io| &mut io.a)
+            .read(&Register::new(0x20), |io| &mut io.c)
+            .write(&Register::new(0x14), |io| io.b)
+            .read_array(&ArrayRegister::new(0x30), |io| &mut io.d);
+
+        assert_eq!(batch.groups.len(), 3);
+        assert_eq!(batch.read_count(), 3);
+        assert_eq!(batch.write_count(), 1);
+
+        let u8_group = batch.group::<u8>();
+        assert_eq!(u8_group.reads.len(), 1);
+        assert_eq!(u8_group.writes.len(), 1);
+    }
+
+    #[test]
+    fn test_orders_by_address() {
+        let mut batch = RegisterBatch::<Io>::new()
+            .read(&Register::new(0x30), |io| &mut io.a)
+            .read(&Register::new(0x10), |io| &mut io.b)
+            .read(&Register::new(0x20), |io| &mut io.a);
+
+        let addresses: Vec<_> = batch
+            .group::<u8>()
+            .reads
+            .iter()
+            .map(|(address, _)| *address)
+            .collect();
+        assert_eq!(addresses, vec![0x10, 0x20, 0x30]);
+    }
+
+    #[test]
+    fn test_empty_batch_does_nothing() {
+        let batch = RegisterBatch::<Io>::default();
+        assert_eq!(batch.read_count(), 0);
+        assert_eq!(batch.write_count(), 0);
+    }
+}
@@ -1,8 +1,11 @@
 //! Implements the register interfaces to the FPGA.
 //!
 
+mod batch;
+
 use crate::error::Result;
 use crate::session::{RegisterAddress, RegisterInterface};
+pub use batch::RegisterBatch;
 
 /// Provides a binding to a register address including a type.
 ///
@@ -20,6 +23,11 @@ impl<T: Default + Copy> Register<T> {
         }
     }
 
+    /// The address of the register on the FPGA.
+    pub const fn address(&self) -> RegisterAddress {
+        self.address
+    }
+
     pub fn read(&self, session: &impl RegisterInterface<T>) -> Result<T> {
         session.read(self.address)
     }
@@ -42,10 +50,20 @@ impl<T: Default + Copy, const N: usize> ArrayRegister<T, N> {
         }
     }
 
+    /// The address of the register on the FPGA.
+    pub const fn address(&self) -> RegisterAddress {
+        self.address
+    }
+
     pub fn read(&self, session: &impl RegisterInterface<T>) -> Result<[T; N]> {
         session.read_array(self.address)
     }
 
+    /// Reads the array into existing storage rather than returning a copy.
+    pub fn read_into(&self, session: &impl RegisterInterface<T>, value: &mut [T; N]) -> Result<()> {
+        session.read_array_mut(self.address, value)
+    }
+
     pub fn write(&self, session: &impl RegisterInterface<T>, value: &[T; N]) -> Result<()> {
         session.write_array(self.address, value)
     }
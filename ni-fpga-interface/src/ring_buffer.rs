@@ -0,0 +1,234 @@
+//! A single producer, single consumer ring buffer used to hand
+//! data between an acquisition thread and the application.
+//!
+//! The buffer is allocated once on creation and never resized so neither
+//! side allocates or takes a lock once data is flowing.
+
+use std::cell::UnsafeCell;
+use std::sync::atomic::{AtomicUsize, Ordering};
+use std::sync::Arc;
+
+/// Keeps the producer and consumer indexes on separate cache lines
+/// so the two threads don't fight over the same line.
+#[repr(align(64))]
+struct CachePadded<T>(T);
+
+struct Shared<T> {
+    buffer: Box<[UnsafeCell<T>]>,
+    mask: usize,
+    /// Total elements ever written. Only modified by the producer.
+    head: CachePadded<AtomicUsize>,
+    /// Total elements ever read. Only modified by the consumer.
+    tail: CachePadded<AtomicUsize>,
+}
+
+// Safety: the producer only writes to slots between head and tail + capacity
+// and the consumer only reads slots between tail and head, with the atomics
+// publishing the writes across threads.
+unsafe impl<T: Send> Sync for Shared<T> {}
+
+impl<T> Shared<T> {
+    fn capacity(&self) -> usize {
+        self.buffer.len()
+    }
+
+    fn slot_ptr(&self) -> *mut T {
+        UnsafeCell::raw_get(self.buffer.as_ptr())
+    }
+}
+
+/// Creates a new ring buffer returning the two halves.
+///
+/// The capacity is rounded up to the next power of two.
+pub fn ring_buffer<T: Copy + Default>(capacity: usize) -> (RingProducer<T>, RingConsumer<T>) {
+    let capacity = capacity.max(1).next_power_of_two();
+    let buffer = (0..capacity)
+        .map(|_| UnsafeCell::new(T::default()))
+        .collect::<Vec<_>>()
+        .into_boxed_slice();
+
+    let shared = Arc::new(Shared {
+        buffer,
+        mask: capacity - 1,
+        head: CachePadded(AtomicUsize::new(0)),
+        tail: CachePadded(AtomicUsize::new(0)),
+    });
+
+    (
+        RingProducer {
+            shared: shared.clone(),
+            cached_tail: 0,
+        },
+        RingConsumer {
+            shared,
+            cached_head: 0,
+        },
+    )
+}
+
+/// The write half of the ring buffer.
+pub struct RingProducer<T> {
+    shared: Arc<Shared<T>>,
+    /// Last tail we saw so we only touch the shared line when we think we are full.
+    cached_tail: usize,
+}
+
+impl<T: Copy> RingProducer<T> {
+    /// Writes as many elements from data as will fit.
+    ///
+    /// Returns the number of elements written.
+    pub fn push_slice(&mut self, data: &[T]) -> usize {
+        let shared = &*self.shared;
+        let capacity = shared.capacity();
+        let head = shared.head.0.load(Ordering::Relaxed);
+
+        if capacity - head.wrapping_sub(self.cached_tail) < data.len() {
+            self.cached_tail = shared.tail.0.load(Ordering::Acquire);
+        }
+        let free = capacity - head.wrapping_sub(self.cached_tail);
+        let count = free.min(data.len());
+
+        let start = head & shared.mask;
+        let first = count.min(capacity - start);
+        // Safety: the slots from head to head + count are free as established above
+        // and the consumer won't read them until we publish the new head.
+        unsafe {
+            let base = shared.slot_ptr();
+            std::ptr::copy_nonoverlapping(data.as_ptr(), base.add(start), first);
+            std::ptr::copy_nonoverlapping(data.as_ptr().add(first), base, count - first);
+        }
+
+        shared
+            .head
+            .0
+            .store(head.wrapping_add(count), Ordering::Release);
+        count
+    }
+}
+
+/// The read half of the ring buffer.
+pub struct RingConsumer<T> {
+    shared: Arc<Shared<T>>,
+    /// Last head we saw so we only touch the shared line when we think we are empty.
+    cached_head: usize,
+}
+
+impl<T: Copy> RingConsumer<T> {
+    /// Reads up to `data.len()` elements into data.
+    ///
+    /// Returns the number of elements read.
+    pub fn pop_slice(&mut self, data: &mut [T]) -> usize {
+        let shared = &*self.shared;
+        let capacity = shared.capacity();
+        let tail = shared.tail.0.load(Ordering::Relaxed);
+
+        if self.cached_head.wrapping_sub(tail) < data.len() {
+            self.cached_head = shared.head.0.load(Ordering::Acquire);
+        }
+        let available = self.cached_head.wrapping_sub(tail);
+        let count = available.min(data.len());
+
+        let start = tail & shared.mask;
+        let first = count.min(capacity - start);
+        // Safety: the slots from tail to tail + count have been published by the producer
+        // and it won't overwrite them until we publish the new tail.
+        unsafe {
+            let base = shared.slot_ptr();
+            std::ptr::copy_nonoverlapping(base.add(start), data.as_mut_ptr(), first);
+            std::ptr::copy_nonoverlapping(base, data.as_mut_ptr().add(first), count - first);
+        }
+
+        shared
+            .tail
+            .0
+            .store(tail.wrapping_add(count), Ordering::Release);
+        count
+    }
+
+    /// The number of elements available to read.
+    pub fn len(&self) -> usize {
+        let tail = self.shared.tail.0.load(Ordering::Relaxed);
+        let head = self.shared.head.0.load(Ordering::Acquire);
+        head.wrapping_sub(tail)
+    }
+
+    /// The total number of elements the buffer can hold.
+    pub fn capacity(&self) -> usize {
+        self.shared.capacity()
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn test_capacity_rounds_to_power_of_two() {
+        let (_producer, consumer) = ring_buffer::<u32>(1000);
+        assert_eq!(consumer.capacity(), 1024);
+    }
+
+    #[test]
+    fn test_push_then_pop() {
+        let (mut producer, mut consumer) = ring_buffer::<u32>(8);
+        assert_eq!(producer.push_slice(&[1, 2, 3]), 3);
+        assert_eq!(consumer.len(), 3);
+
+        let mut output = [0u32; 4];
+        assert_eq!(consumer.pop_slice(&mut output), 3);
+        assert_eq!(output[0..3], [1, 2, 3]);
+        assert_eq!(consumer.len(), 0);
+    }
+
+    #[test]
+    fn test_push_stops_when_full() {
+        let (mut producer, mut consumer) = ring_buffer::<u16>(4);
+        assert_eq!(producer.push_slice(&[1, 2, 3, 4, 5, 6]), 4);
+        assert_eq!(producer.push_slice(&[7]), 0);
+
+        let mut output = [0u16; 2];
+        consumer.pop_slice(&mut output);
+        assert_eq!(producer.push_slice(&[7, 8, 9]), 2);
+    }
+
+    #[test]
+    fn test_wraps_around_the_end() {
+        let (mut producer, mut consumer) = ring_buffer::<u8>(4);
+        let mut output = [0u8; 4];
+        producer.push_slice(&[1, 2, 3]);
+        consumer.pop_slice(&mut output[0..3]);
+
+        assert_eq!(producer.push_slice(&[4, 5, 6, 7]), 4);
+        assert_eq!(consumer.pop_slice(&mut output), 4);
+        assert_eq!(output, [4, 5, 6, 7]);
+    }
+
+    #[test]
+    fn test_data_is_ordered_across_threads() {
+        let (mut producer, mut consumer) = ring_buffer::<u64>(64);
+        let total = 10_000u64;
+
+        let writer = std::thread::spawn(move || {
+            let mut next = 0u64;
+            while next < total {
+                let block: Vec<u64> = (next..(next + 10).min(total)).collect();
+                let mut written = 0;
+                while written < block.len() {
+                    written += producer.push_slice(&block[written..]);
+                }
+                next += block.len() as u64;
+            }
+        });
+
+        let mut expected = 0u64;
+        let mut buffer = [0u64; 7];
+        while expected < total {
+            let count = consumer.pop_slice(&mut buffer);
+            for value in &buffer[..count] {
+                assert_eq!(*value, expected);
+                expected += 1;
+            }
+        }
+        writer.join().unwrap();
+    }
+}
@@ -5,16 +5,21 @@
 //! * Registers which are the front panel controls and indicators of the FPGA VI.
 //! * FIFOs which are the DMA FIFOs of the FPGA VI.
 
-use crate::error::{to_fpga_result, Result};
+use crate::error::{to_fpga_result, NiFpgaStatus, Result};
+use crate::fifos::FifoLevels;
+use crate::instrumentation::instrument;
 use crate::nifpga_sys::*;
-use crate::session::Session;
+use crate::session::{PinnedSession, Session, SharedSession};
 use crate::types::FpgaBool;
 use libc::size_t;
 use paste::paste;
 use std::time::Duration;
 
 /// Marker trait for the types that are supported directly by the FPGA interface.
-pub trait NativeFpgaType: Copy {}
+pub trait NativeFpgaType: Copy {
+    /// The name used for the type in the FPGA interface, for example `U32` or `Sgl`.
+    const FPGA_TYPE: &'static str;
+}
 
 pub type RegisterAddress = u32;
 
@@ -34,17 +39,44 @@ pub trait RegisterInterface<T: Default + Copy> {
     fn write_array<const N: usize>(&self, address: RegisterAddress, data: &[T; N]) -> Result<()>;
 }
 
+/// Releases elements acquired by a zero copy region back to the FIFO.
+///
+/// This lets the regions be shared by [`Session`] and other implementations of [`FifoInterface`].
+pub(crate) trait ReleaseFifoElements: Sync {
+    fn release_fifo_elements(&self, fifo: FifoAddress, elements: usize) -> Result<()>;
+}
+
+impl ReleaseFifoElements for Session {
+    fn release_fifo_elements(&self, fifo: FifoAddress, elements: usize) -> Result<()> {
+        Session::release_fifo_elements(self, fifo, elements)
+    }
+}
+
 /// The read region is created by calling [`FifoInterface::read_no_copy`] on the FIFO interface.
 ///
 /// This returns this structure where you can use elements to read the data from the FIFO.
 ///
 /// When this structure is dropped the elements are released back to the FIFO automatically.
 pub struct FifoReadRegion<'session, 'data, T: NativeFpgaType> {
-    session: &'session Session,
+    session: &'session dyn ReleaseFifoElements,
     fifo: FifoAddress,
     pub elements: &'data [T],
 }
 
+impl<'s, 'd, T: NativeFpgaType> FifoReadRegion<'s, 'd, T> {
+    pub(crate) fn new(
+        session: &'s dyn ReleaseFifoElements,
+        fifo: FifoAddress,
+        elements: &'d [T],
+    ) -> Self {
+        Self {
+            session,
+            fifo,
+            elements,
+        }
+    }
+}
+
 impl<'s, 'd, T: NativeFpgaType> Drop for FifoReadRegion<'s, 'd, T> {
     fn drop(&mut self) {
         // Cant return result from drop so ignore it.
@@ -60,11 +92,25 @@ impl<'s, 'd, T: NativeFpgaType> Drop for FifoReadRegion<'s, 'd, T> {
 ///
 /// When this structure is dropped the elements are released back to the FIFO automatically.
 pub struct FifoWriteRegion<'session, 'data, T: NativeFpgaType> {
-    session: &'session Session,
+    session: &'session dyn ReleaseFifoElements,
     fifo: FifoAddress,
     pub elements: &'data mut [T],
 }
 
+impl<'s, 'd, T: NativeFpgaType> FifoWriteRegion<'s, 'd, T> {
+    pub(crate) fn new(
+        session: &'s dyn ReleaseFifoElements,
+        fifo: FifoAddress,
+        elements: &'d mut [T],
+    ) -> Self {
+        Self {
+            session,
+            fifo,
+            elements,
+        }
+    }
+}
+
 impl<'s, 'd, T: NativeFpgaType> Drop for FifoWriteRegion<'s, 'd, T> {
     fn drop(&mut self) {
         // Cant return result from drop so ignore it.
@@ -74,6 +120,127 @@ impl<'s, 'd, T: NativeFpgaType> Drop for FifoWriteRegion<'s, 'd, T> {
     }
 }
 
+/// The outcome of a FIFO read or write where running out of time is expected.
+///
+/// A timeout isn't treated as an error here so polling loops can handle it
+/// without building an [`FPGAError`](crate::error::FPGAError).
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub enum FifoTransfer {
+    /// Every element was transferred.
+    Complete {
+        /// For a read the elements left to read. For a write the space left to write.
+        remaining: usize,
+        /// A positive status returned by the driver alongside the data.
+        warning: Option<NiFpgaStatus>,
+    },
+    /// The timeout expired before all the elements could be transferred so none were.
+    ///
+    /// `remaining` is the elements available to read or the space available to write,
+    /// so a smaller transfer of that size would succeed immediately.
+    TimedOut { remaining: usize },
+}
+
+impl FifoTransfer {
+    /// Converts the status from a driver FIFO call.
+    pub(crate) fn from_status(remaining: usize, status: NiFpgaStatus) -> Result<Self> {
+        if status == NiFpgaStatus::FIFO_TIMEOUT {
+            Ok(FifoTransfer::TimedOut { remaining })
+        } else if status.is_error() {
+            Err(status.into())
+        } else {
+            Ok(FifoTransfer::Complete {
+                remaining,
+                warning: status.is_warning().then_some(status),
+            })
+        }
+    }
+
+    pub fn is_timed_out(&self) -> bool {
+        matches!(self, FifoTransfer::TimedOut { .. })
+    }
+
+    /// The elements left to read or the space left to write.
+    pub fn remaining(&self) -> usize {
+        match self {
+            FifoTransfer::Complete { remaining, .. } | FifoTransfer::TimedOut { remaining } => {
+                *remaining
+            }
+        }
+    }
+
+    /// Converts back to the plain form returned by [`FifoInterface::read_fifo`], where a timeout is an error.
+    pub fn into_result(self) -> Result<usize> {
+        match self {
+            FifoTransfer::Complete { remaining, .. } => Ok(remaining),
+            FifoTransfer::TimedOut { .. } => Err(NiFpgaStatus::FIFO_TIMEOUT.into()),
+        }
+    }
+}
+
+/// The outcome of acquiring a zero copy FIFO region where running out of time is expected.
+///
+/// This is the zero copy form of [`FifoTransfer`].
+#[derive(Debug)]
+pub enum FifoAcquire<R> {
+    /// The region was acquired. Its elements are released back to the FIFO when it is dropped.
+    Acquired {
+        region: R,
+        /// For a read the elements left to read. For a write the space left to write.
+        remaining: usize,
+        /// A positive status returned by the driver alongside the region.
+        warning: Option<NiFpgaStatus>,
+    },
+    /// The timeout expired before the elements could be acquired so none were.
+    ///
+    /// `remaining` is the elements available to read or the space available to write,
+    /// so a smaller region of that size could be acquired immediately.
+    TimedOut { remaining: usize },
+}
+
+impl<R> FifoAcquire<R> {
+    /// Converts the status from a driver acquire call, only building the region if it succeeded.
+    pub(crate) fn from_status(
+        remaining: usize,
+        status: NiFpgaStatus,
+        region: impl FnOnce() -> R,
+    ) -> Result<Self> {
+        if status == NiFpgaStatus::FIFO_TIMEOUT {
+            Ok(FifoAcquire::TimedOut { remaining })
+        } else if status.is_error() {
+            Err(status.into())
+        } else {
+            Ok(FifoAcquire::Acquired {
+                region: region(),
+                remaining,
+                warning: status.is_warning().then_some(status),
+            })
+        }
+    }
+
+    pub fn is_timed_out(&self) -> bool {
+        matches!(self, FifoAcquire::TimedOut { .. })
+    }
+
+    /// The elements left to read or the space left to write.
+    pub fn remaining(&self) -> usize {
+        match self {
+            FifoAcquire::Acquired { remaining, .. } | FifoAcquire::TimedOut { remaining } => {
+                *remaining
+            }
+        }
+    }
+
+    /// Converts back to the plain form returned by [`FifoInterface::zero_copy_read`], where a timeout is an error.
+    pub fn into_result(self) -> Result<(R, usize)> {
+        match self {
+            FifoAcquire::Acquired {
+                region, remaining, ..
+            } => Ok((region, remaining)),
+            FifoAcquire::TimedOut { .. } => Err(NiFpgaStatus::FIFO_TIMEOUT.into()),
+        }
+    }
+}
+
 pub trait FifoInterface<T: NativeFpgaType> {
     /// Reads the elements into the provided buffer up to the size of the buffer.
     ///
@@ -91,6 +258,52 @@ pub trait FifoInterface<T: NativeFpgaType> {
     fn write_fifo(&self, fifo: FifoAddress, data: &[T], timeout: Option<Duration>)
         -> Result<usize>;
 
+    /// Reads like [`FifoInterface::read_fifo`] but reports a timeout as [`FifoTransfer::TimedOut`].
+    ///
+    /// [`Session`] converts the driver status directly so it keeps any warning.
+    /// This default is built on `read_fifo`, so the warning is always [`None`] and
+    /// a timeout costs a second, zero element read to find the elements available.
+    fn try_read_fifo(
+        &self,
+        fifo: FifoAddress,
+        buffer: &mut [T],
+        timeout: Option<Duration>,
+    ) -> Result<FifoTransfer> {
+        match self.read_fifo(fifo, buffer, timeout) {
+            Ok(remaining) => Ok(FifoTransfer::Complete {
+                remaining,
+                warning: None,
+            }),
+            Err(error) if error.is_fifo_timeout() => Ok(FifoTransfer::TimedOut {
+                remaining: self.read_fifo(fifo, &mut [], Some(Duration::ZERO))?,
+            }),
+            Err(error) => Err(error),
+        }
+    }
+
+    /// Writes like [`FifoInterface::write_fifo`] but reports a timeout as [`FifoTransfer::TimedOut`].
+    ///
+    /// [`Session`] converts the driver status directly so it keeps any warning.
+    /// This default is built on `write_fifo`, so the warning is always [`None`] and
+    /// a timeout costs a second, zero element write to find the space available.
+    fn try_write_fifo(
+        &self,
+        fifo: FifoAddress,
+        data: &[T],
+        timeout: Option<Duration>,
+    ) -> Result<FifoTransfer> {
+        match self.write_fifo(fifo, data, timeout) {
+            Ok(remaining) => Ok(FifoTransfer::Complete {
+                remaining,
+                warning: None,
+            }),
+            Err(error) if error.is_fifo_timeout() => Ok(FifoTransfer::TimedOut {
+                remaining: self.write_fifo(fifo, &[], Some(Duration::ZERO))?,
+            }),
+            Err(error) => Err(error),
+        }
+    }
+
     /// Provides a region of memory to read from the FIFO.
     fn zero_copy_read(
         &self,
@@ -106,52 +319,137 @@ pub trait FifoInterface<T: NativeFpgaType> {
         elements: usize,
         timeout: Option<Duration>,
     ) -> Result<(FifoWriteRegion<T>, usize)>;
-}
 
-/// First entry is the rust type, second is the text used for that type in the FPGA interface.
-macro_rules! impl_type_session_interface {
-    ($rust_type:ty, $fpga_type:literal) => {
+    /// Acquires like [`FifoInterface::zero_copy_read`] but reports a timeout as [`FifoAcquire::TimedOut`].
+    ///
+    /// As with [`FifoInterface::try_read_fifo`], only [`Session`] keeps the warning and
+    /// the default makes a second, zero element read on a timeout.
+    fn try_zero_copy_read(
+        &self,
+        fifo: FifoAddress,
+        elements: usize,
+        timeout: Option<Duration>,
+    ) -> Result<FifoAcquire<FifoReadRegion<'_, '_, T>>> {
+        match self.zero_copy_read(fifo, elements, timeout) {
+            Ok((region, remaining)) => Ok(FifoAcquire::Acquired {
+                region,
+                remaining,
+                warning: None,
+            }),
+            Err(error) if error.is_fifo_timeout() => Ok(FifoAcquire::TimedOut {
+                remaining: self.read_fifo(fifo, &mut [], Some(Duration::ZERO))?,
+            }),
+            Err(error) => Err(error),
+        }
+    }
 
+    /// Acquires like [`FifoInterface::zero_copy_write`] but reports a timeout as [`FifoAcquire::TimedOut`].
+    ///
+    /// As with [`FifoInterface::try_write_fifo`], only [`Session`] keeps the warning and
+    /// the default makes a second, zero element write on a timeout.
+    fn try_zero_copy_write(
+        &self,
+        fifo: FifoAddress,
+        elements: usize,
+        timeout: Option<Duration>,
+    ) -> Result<FifoAcquire<FifoWriteRegion<'_, '_, T>>> {
+        match self.zero_copy_write(fifo, elements, timeout) {
+            Ok((region, remaining)) => Ok(FifoAcquire::Acquired {
+                region,
+                remaining,
+                warning: None,
+            }),
+            Err(error) if error.is_fifo_timeout() => Ok(FifoAcquire::TimedOut {
+                remaining: self.write_fifo(fifo, &[], Some(Duration::ZERO))?,
+            }),
+            Err(error) => Err(error),
+        }
+    }
 
-        paste! {
-            impl NativeFpgaType for $rust_type {}
+    /// The FIFO levels recorded by [`crate::fifos::ReadFifo`] and [`crate::fifos::WriteFifo`]
+    /// or [`None`] if this session doesn't keep them.
+    fn fifo_levels(&self) -> Option<&FifoLevels> {
+        None
+    }
+}
 
-            impl RegisterInterface<$rust_type> for Session {
+/// Implements the register access for a type holding the session handle in a `handle` field.
+///
+/// The shared session types keep their own copy of the handle so register
+/// accesses don't touch the reference count of the session.
+///
+/// The methods are inline so a call with a constant address, as in the generated
+/// accessors, reduces to the driver call in the calling crate.
+macro_rules! impl_register_interface {
+    ($target:ty, $rust_type:ty, $fpga_type:literal) => {
+        paste! {
+            impl RegisterInterface<$rust_type> for $target {
+                #[inline]
                 fn read(&self, address: RegisterAddress) -> Result<$rust_type> {
                     let mut value: $rust_type = $rust_type::default();
-                    let return_code = unsafe {[< NiFpga_Read $fpga_type >](self.handle, address, &mut value)};
+                    let return_code = instrument!(RegisterRead, address, std::mem::size_of::<$rust_type>(), unsafe {[< NiFpga_Read $fpga_type >](self.handle, address, &mut value)});
                     to_fpga_result(value, return_code)
                 }
+                #[inline]
                 fn write(&self, address: RegisterAddress, value: $rust_type) -> Result<()> {
-                    let return_code = unsafe {[< NiFpga_Write $fpga_type >](self.handle, address, value)};
+                    let return_code = instrument!(RegisterWrite, address, std::mem::size_of::<$rust_type>(), unsafe {[< NiFpga_Write $fpga_type >](self.handle, address, value)});
                     to_fpga_result((), return_code)
                 }
+                #[inline]
                 fn read_array_mut<const N:usize>(&self, address: RegisterAddress, array: &mut [$rust_type; N]) -> Result<()> {
-                    let return_code = unsafe {[< NiFpga_ReadArray $fpga_type >](self.handle, address, array.as_mut_ptr(), N)};
+                    let return_code = instrument!(RegisterRead, address, std::mem::size_of_val(array), unsafe {[< NiFpga_ReadArray $fpga_type >](self.handle, address, array.as_mut_ptr(), N)});
                     to_fpga_result((), return_code)
                 }
+                #[inline]
                 fn write_array<const N:usize>(&self, address: RegisterAddress, value: &[$rust_type;N]) -> Result<()> {
-                    let return_code = unsafe {[< NiFpga_WriteArray $fpga_type >](self.handle, address, value.as_ptr(), N)};
+                    let return_code = instrument!(RegisterWrite, address, std::mem::size_of_val(value), unsafe {[< NiFpga_WriteArray $fpga_type >](self.handle, address, value.as_ptr(), N)});
                     to_fpga_result((), return_code)
                 }
             }
+        }
+    };
+}
+
+/// First entry is the rust type, second is the text used for that type in the FPGA interface.
+macro_rules! impl_type_session_interface {
+    ($rust_type:ty, $fpga_type:literal) => {
+
+
+        paste! {
+            impl NativeFpgaType for $rust_type {
+                const FPGA_TYPE: &'static str = $fpga_type;
+            }
+
+            impl_register_interface!(Session, $rust_type, $fpga_type);
+            impl_register_interface!(SharedSession, $rust_type, $fpga_type);
+            impl_register_interface!(PinnedSession<'_>, $rust_type, $fpga_type);
 
             impl FifoInterface<$rust_type> for Session {
                 fn read_fifo(&self, fifo: u32, data: &mut [$rust_type], timeout: Option<Duration>) -> Result< usize> {
                     let mut elements_remaining: size_t = 0;
-                    let return_code = unsafe {[< NiFpga_ReadFifo $fpga_type >](self.handle, fifo, data.as_mut_ptr(), data.len(), timeout.into(), &mut elements_remaining)};
+                    let return_code = instrument!(FifoRead, fifo, std::mem::size_of_val(data), unsafe {[< NiFpga_ReadFifo $fpga_type >](self.handle, fifo, data.as_mut_ptr(), data.len(), timeout.into(), &mut elements_remaining)});
                     to_fpga_result(elements_remaining, return_code)
                 }
+                fn try_read_fifo(&self, fifo: u32, data: &mut [$rust_type], timeout: Option<Duration>) -> Result<FifoTransfer> {
+                    let mut elements_remaining: size_t = 0;
+                    let return_code = instrument!(FifoRead, fifo, std::mem::size_of_val(data), unsafe {[< NiFpga_ReadFifo $fpga_type >](self.handle, fifo, data.as_mut_ptr(), data.len(), timeout.into(), &mut elements_remaining)});
+                    FifoTransfer::from_status(elements_remaining, return_code)
+                }
                 fn write_fifo(&self, fifo: u32, data: &[$rust_type], timeout: Option<Duration>) -> Result<usize> {
                     let mut elements_remaining: size_t = 0;
-                    let return_code = unsafe {[< NiFpga_WriteFifo $fpga_type >](self.handle, fifo, data.as_ptr(), data.len(), timeout.into(), &mut elements_remaining)};
+                    let return_code = instrument!(FifoWrite, fifo, std::mem::size_of_val(data), unsafe {[< NiFpga_WriteFifo $fpga_type >](self.handle, fifo, data.as_ptr(), data.len(), timeout.into(), &mut elements_remaining)});
                     to_fpga_result(elements_remaining, return_code)
                 }
+                fn try_write_fifo(&self, fifo: u32, data: &[$rust_type], timeout: Option<Duration>) -> Result<FifoTransfer> {
+                    let mut elements_remaining: size_t = 0;
+                    let return_code = instrument!(FifoWrite, fifo, std::mem::size_of_val(data), unsafe {[< NiFpga_WriteFifo $fpga_type >](self.handle, fifo, data.as_ptr(), data.len(), timeout.into(), &mut elements_remaining)});
+                    FifoTransfer::from_status(elements_remaining, return_code)
+                }
                 fn zero_copy_read(&self, fifo: u32, elements: usize, timeout: Option<Duration>) -> Result<(FifoReadRegion<$rust_type>, usize)> {
                     let mut elements_acquired: size_t = 0;
                     let mut elements_remaining: size_t = 0;
                     let mut data: *const $rust_type = std::ptr::null();
-                    let return_code = unsafe {[< NiFpga_AcquireFifoReadElements $fpga_type >](self.handle, fifo, &mut data, elements, timeout.into(), &mut elements_acquired, &mut elements_remaining)};
+                    let return_code = instrument!(FifoAcquireRead, fifo, elements_acquired * std::mem::size_of::<$rust_type>(), unsafe {[< NiFpga_AcquireFifoReadElements $fpga_type >](self.handle, fifo, &mut data, elements, timeout.into(), &mut elements_acquired, &mut elements_remaining)});
                     let read_region = FifoReadRegion{session: self, fifo, elements: unsafe {std::slice::from_raw_parts(data, elements_acquired)}};
                     to_fpga_result((read_region, elements_remaining), return_code)
                 }
@@ -159,10 +457,27 @@ macro_rules! impl_type_session_interface {
                     let mut elements_acquired: size_t = 0;
                     let mut elements_remaining: size_t = 0;
                     let mut data: *mut $rust_type = std::ptr::null_mut();
-                    let return_code = unsafe {[< NiFpga_AcquireFifoWriteElements $fpga_type >](self.handle, fifo, &mut data, elements, timeout.into(), &mut elements_acquired, &mut elements_remaining)};
+                    let return_code = instrument!(FifoAcquireWrite, fifo, elements_acquired * std::mem::size_of::<$rust_type>(), unsafe {[< NiFpga_AcquireFifoWriteElements $fpga_type >](self.handle, fifo, &mut data, elements, timeout.into(), &mut elements_acquired, &mut elements_remaining)});
                     let write_region = FifoWriteRegion{session: self, fifo, elements: unsafe {std::slice::from_raw_parts_mut(data, elements_acquired)}};
                     to_fpga_result((write_region, elements_remaining), return_code)
                 }
+                fn try_zero_copy_read(&self, fifo: u32, elements: usize, timeout: Option<Duration>) -> Result<FifoAcquire<FifoReadRegion<$rust_type>>> {
+                    let mut elements_acquired: size_t = 0;
+                    let mut elements_remaining: size_t = 0;
+                    let mut data: *const $rust_type = std::ptr::null();
+                    let return_code = instrument!(FifoAcquireRead, fifo, elements_acquired * std::mem::size_of::<$rust_type>(), unsafe {[< NiFpga_AcquireFifoReadElements $fpga_type >](self.handle, fifo, &mut data, elements, timeout.into(), &mut elements_acquired, &mut elements_remaining)});
+                    FifoAcquire::from_status(elements_remaining, return_code, || FifoReadRegion{session: self, fifo, elements: unsafe {std::slice::from_raw_parts(data, elements_acquired)}})
+                }
+                fn try_zero_copy_write(&self, fifo: u32, elements: usize, timeout: Option<Duration>) -> Result<FifoAcquire<FifoWriteRegion<$rust_type>>> {
+                    let mut elements_acquired: size_t = 0;
+                    let mut elements_remaining: size_t = 0;
+                    let mut data: *mut $rust_type = std::ptr::null_mut();
+                    let return_code = instrument!(FifoAcquireWrite, fifo, elements_acquired * std::mem::size_of::<$rust_type>(), unsafe {[< NiFpga_AcquireFifoWriteElements $fpga_type >](self.handle, fifo, &mut data, elements, timeout.into(), &mut elements_acquired, &mut elements_remaining)});
+                    FifoAcquire::from_status(elements_remaining, return_code, || FifoWriteRegion{session: self, fifo, elements: unsafe {std::slice::from_raw_parts_mut(data, elements_acquired)}})
+                }
+                fn fifo_levels(&self) -> Option<&FifoLevels> {
+                    Some(&self.fifo_levels)
+                }
             }
         }
     }
@@ -179,3 +494,41 @@ impl_type_session_interface!(i64, "I64");
 impl_type_session_interface!(f32, "Sgl");
 impl_type_session_interface!(f64, "Dbl");
 impl_type_session_interface!(FpgaBool, "Bool");
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use crate::error::FPGAError;
+
+    #[test]
+    fn test_transfer_from_status() {
+        let transfer = FifoTransfer::from_status(5, NiFpgaStatus::FIFO_TIMEOUT).unwrap();
+        assert_eq!(transfer, FifoTransfer::TimedOut { remaining: 5 });
+        assert!(transfer.into_result().unwrap_err().is_fifo_timeout());
+
+        let transfer = FifoTransfer::from_status(3, NiFpgaStatus::SUCCESS).unwrap();
+        assert_eq!(
+            transfer,
+            FifoTransfer::Complete {
+                remaining: 3,
+                warning: None
+            }
+        );
+        assert_eq!(transfer.into_result().unwrap(), 3);
+
+        let warning = NiFpgaStatus(61003);
+        let transfer = FifoTransfer::from_status(3, warning).unwrap();
+        assert_eq!(
+            transfer,
+            FifoTransfer::Complete {
+                remaining: 3,
+                warning: Some(warning)
+            }
+        );
+
+        assert!(matches!(
+            FifoTransfer::from_status(0, NiFpgaStatus::INVALID_PARAMETER),
+            Err(FPGAError::InternalError(NiFpgaStatus::INVALID_PARAMETER))
+        ));
+    }
+}
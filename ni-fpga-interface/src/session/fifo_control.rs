@@ -3,37 +3,195 @@
 //! In general we recommend using the [`crate::fifos`] module for a higher level interface.
 
 use crate::error::{to_fpga_result, Result};
+use crate::host_buffer::HostBufferAllocation;
+use crate::instrumentation::instrument;
 use crate::nifpga_sys::*;
-use libc::size_t;
+pub use crate::types::FifoProperty;
+use libc::{c_void, size_t};
+use paste::paste;
+use std::sync::Arc;
+use std::time::Duration;
 
 use super::Session;
 
+/// First entry is the rust type, second is the text used for that type in the FIFO property API.
+macro_rules! impl_fifo_property_accessors {
+    ($rust_type:ty, $fpga_type:literal) => {
+        paste! {
+            impl Session {
+                /// Sets a FIFO property of this type. The value may be coerced by the driver.
+                ///
+                /// The FIFO must be stopped and the change is applied by [`Session::commit_fifo_configuration`]
+                /// or the next start, read or write.
+                pub fn [<set_fifo_property_ $rust_type>](&self, fifo: FifoAddress, property: FifoProperty, value: $rust_type) -> Result<()> {
+                    let result = unsafe { [<NiFpga_SetFifoProperty $fpga_type>](self.handle, fifo, property, value) };
+                    to_fpga_result((), result)
+                }
+
+                /// Gets a FIFO property of this type as it will be used by the FIFO.
+                pub fn [<get_fifo_property_ $rust_type>](&self, fifo: FifoAddress, property: FifoProperty) -> Result<$rust_type> {
+                    let mut value: $rust_type = 0;
+                    let result = unsafe { [<NiFpga_GetFifoProperty $fpga_type>](self.handle, fifo, property, &mut value) };
+                    to_fpga_result(value, result)
+                }
+            }
+        }
+    };
+}
+
+impl_fifo_property_accessors!(u32, "U32");
+impl_fifo_property_accessors!(i32, "I32");
+impl_fifo_property_accessors!(u64, "U64");
+impl_fifo_property_accessors!(i64, "I64");
+
 impl Session {
     /// Specify the depth of the host memory part of the FIFO.
     ///
     /// Returns the actual size configured which may be larger than the request.
     pub fn configure_fifo(&self, fifo: FifoAddress, requested_depth: usize) -> Result<usize> {
         let mut actual_depth: size_t = 0;
-        let result = unsafe {
+        let result = instrument!(FifoConfigure, fifo, 0, unsafe {
             NiFpga_ConfigureFifo2(
                 self.handle,
                 fifo,
                 requested_depth,
                 &mut actual_depth as *mut size_t,
             )
-        };
+        });
         to_fpga_result(actual_depth, result)
     }
 
+    /// Sets a pointer FIFO property such as [`FifoProperty::HostBuffer`].
+    ///
+    /// # Safety
+    ///
+    /// When setting the host buffer the driver will DMA into this memory.
+    /// It must remain valid until the session is closed or the FIFO is
+    /// reconfigured to use a different buffer.
+    pub unsafe fn set_fifo_property_ptr(
+        &self,
+        fifo: FifoAddress,
+        property: FifoProperty,
+        value: *mut c_void,
+    ) -> Result<()> {
+        let result = NiFpga_SetFifoPropertyPtr(self.handle, fifo, property, value);
+        to_fpga_result((), result)
+    }
+
+    /// Gets a pointer FIFO property such as [`FifoProperty::HostBuffer`].
+    pub fn get_fifo_property_ptr(
+        &self,
+        fifo: FifoAddress,
+        property: FifoProperty,
+    ) -> Result<*mut c_void> {
+        let mut value: *mut c_void = std::ptr::null_mut();
+        let result = unsafe { NiFpga_GetFifoPropertyPtr(self.handle, fifo, property, &mut value) };
+        to_fpga_result(value, result)
+    }
+
+    /// Commits the FIFO properties to the driver and resolves the host memory part of the FIFO.
+    ///
+    /// The FIFO must be stopped to call this.
+    pub fn commit_fifo_configuration(&self, fifo: FifoAddress) -> Result<()> {
+        let result = instrument!(FifoConfigure, fifo, 0, unsafe {
+            NiFpga_CommitFifoConfiguration(self.handle, fifo)
+        });
+        to_fpga_result((), result)
+    }
+
+    /// Holds the allocation until the session is closed or the FIFO is committed with another buffer.
+    ///
+    /// Fails with [`FPGAError::InvalidFifoConfig`] while the allocation is held for another FIFO.
+    pub(crate) fn retain_host_buffer(
+        &self,
+        fifo: FifoAddress,
+        buffer: &Arc<HostBufferAllocation>,
+    ) -> Result<()> {
+        self.host_buffers.bind(fifo, buffer)
+    }
+
+    /// Drops the allocations held for the FIFO other than `keep` once a commit means the driver no longer uses them.
+    pub(crate) fn release_host_buffers(
+        &self,
+        fifo: FifoAddress,
+        keep: Option<&Arc<HostBufferAllocation>>,
+    ) {
+        self.host_buffers.release(fifo, keep);
+    }
+
+    /// Reads packed elements from a FIFO of clusters or other composite types.
+    ///
+    /// Returns the number of elements remaining in the FIFO.
+    ///
+    /// # Safety
+    ///
+    /// data must be valid for writes of `bytes_per_element * number_of_elements` bytes.
+    pub unsafe fn read_fifo_composite(
+        &self,
+        fifo: FifoAddress,
+        data: *mut c_void,
+        bytes_per_element: u32,
+        number_of_elements: usize,
+        timeout: Option<Duration>,
+    ) -> Result<usize> {
+        let mut elements_remaining: size_t = 0;
+        let result = instrument!(
+            FifoRead,
+            fifo,
+            bytes_per_element as usize * number_of_elements,
+            NiFpga_ReadFifoComposite(
+                self.handle,
+                fifo,
+                data,
+                bytes_per_element,
+                number_of_elements,
+                timeout.into(),
+                &mut elements_remaining,
+            )
+        );
+        to_fpga_result(elements_remaining, result)
+    }
+
+    /// Writes packed elements to a FIFO of clusters or other composite types.
+    ///
+    /// The number of elements is the length of the data divided by `bytes_per_element`.
+    ///
+    /// Returns the number of empty elements remaining in the FIFO.
+    pub fn write_fifo_composite(
+        &self,
+        fifo: FifoAddress,
+        data: &[u8],
+        bytes_per_element: u32,
+        timeout: Option<Duration>,
+    ) -> Result<usize> {
+        let mut empty_elements_remaining: size_t = 0;
+        let result = instrument!(FifoWrite, fifo, data.len(), unsafe {
+            NiFpga_WriteFifoComposite(
+                self.handle,
+                fifo,
+                data.as_ptr() as *const c_void,
+                bytes_per_element,
+                data.len() / bytes_per_element as usize,
+                timeout.into(),
+                &mut empty_elements_remaining,
+            )
+        });
+        to_fpga_result(empty_elements_remaining, result)
+    }
+
     /// Start the FIFO.
     pub fn start_fifo(&self, fifo: FifoAddress) -> Result<()> {
-        let result = unsafe { NiFpga_StartFifo(self.handle, fifo) };
+        let result = instrument!(FifoStart, fifo, 0, unsafe {
+            NiFpga_StartFifo(self.handle, fifo)
+        });
         to_fpga_result((), result)
     }
 
     /// Stop the FIFO.
     pub fn stop_fifo(&self, fifo: FifoAddress) -> Result<()> {
-        let result = unsafe { NiFpga_StopFifo(self.handle, fifo) };
+        let result = instrument!(FifoStop, fifo, 0, unsafe {
+            NiFpga_StopFifo(self.handle, fifo)
+        });
         to_fpga_result((), result)
     }
 
@@ -48,7 +206,9 @@ impl Session {
         fifo: FifoAddress,
         number_of_elements: usize,
     ) -> Result<()> {
-        let result = unsafe { NiFpga_ReleaseFifoElements(self.handle, fifo, number_of_elements) };
+        let result = instrument!(FifoRelease, fifo, 0, unsafe {
+            NiFpga_ReleaseFifoElements(self.handle, fifo, number_of_elements)
+        });
         to_fpga_result((), result)
     }
 
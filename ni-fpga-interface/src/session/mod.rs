@@ -2,13 +2,18 @@
 //!
 mod data_interfaces;
 pub mod fifo_control;
+mod shared;
 use std::sync::atomic::AtomicBool;
 use std::sync::atomic::Ordering;
 use std::sync::Arc;
 
 use crate::error::{to_fpga_result, FPGAError};
+use crate::fifos::FifoLevels;
+use crate::host_buffer::HostBufferBindings;
+use crate::instrumentation::instrument;
 use crate::nifpga_sys::*;
 pub use data_interfaces::*;
+pub use shared::*;
 
 static CONTEXT_ACTIVE: AtomicBool = AtomicBool::new(false);
 
@@ -49,6 +54,7 @@ impl Drop for NiFpgaContext {
 }
 
 /// Options for the session.
+#[derive(Debug, Clone, Copy)]
 pub struct SessionOptions {
     /// Reset the FPGA on close (default: True)
     pub reset_on_close: bool,
@@ -87,6 +93,10 @@ pub struct Session {
     pub handle: SessionHandle,
     close_attribute: u32,
     _context: Arc<NiFpgaContext>,
+    /// Host buffers given to FIFOs. Dropped after the session is closed in [`Drop`].
+    host_buffers: HostBufferBindings,
+    /// The last levels observed on the FIFOs.
+    fifo_levels: FifoLevels,
 }
 
 impl Session {
@@ -123,7 +133,7 @@ impl Session {
         let bitfile = std::ffi::CString::new(bitfile).unwrap();
         let signature = std::ffi::CString::new(signature).unwrap();
         let resource = std::ffi::CString::new(resource).unwrap();
-        let result = unsafe {
+        let result = instrument!(Open, 0, 0, unsafe {
             NiFpga_Open(
                 bitfile.as_ptr(),
                 signature.as_ptr(),
@@ -131,12 +141,14 @@ impl Session {
                 options.open_attribute(),
                 &mut handle,
             )
-        };
+        });
         to_fpga_result(
             Self {
                 handle,
                 _context: context.clone(),
                 close_attribute: options.close_attribute(),
+                host_buffers: HostBufferBindings::default(),
+                fifo_levels: FifoLevels::new(),
             },
             result,
         )
@@ -165,7 +177,7 @@ impl Session {
 
     /// Reset the FPGA back to it's initial state.
     pub fn reset(&mut self) -> Result<(), crate::error::FPGAError> {
-        let result = unsafe { NiFpga_Reset(self.handle) };
+        let result = instrument!(Reset, 0, 0, unsafe { NiFpga_Reset(self.handle) });
 
         to_fpga_result((), result)
     }
@@ -175,28 +187,43 @@ impl Session {
     pub fn run(&mut self, wait_until_done: bool) -> Result<(), crate::error::FPGAError> {
         let attributes = if wait_until_done { 1 } else { 0 };
 
-        let result = unsafe { NiFpga_Run(self.handle, attributes) };
+        let result = instrument!(Run, 0, 0, unsafe { NiFpga_Run(self.handle, attributes) });
 
         to_fpga_result((), result)
     }
 
     /// Abort the FPGA VI.
     pub fn abort(&mut self) -> Result<(), crate::error::FPGAError> {
-        let result = unsafe { NiFpga_Abort(self.handle) };
+        let result = instrument!(Abort, 0, 0, unsafe { NiFpga_Abort(self.handle) });
 
         to_fpga_result((), result)
     }
 
     /// Re-download the bitfile to the FPGA.
     pub fn download(&mut self) -> Result<(), crate::error::FPGAError> {
-        let result = unsafe { NiFpga_Download(self.handle) };
+        let result = instrument!(Download, 0, 0, unsafe { NiFpga_Download(self.handle) });
 
         to_fpga_result((), result)
     }
 
+    /// Reads the XML contents of the bitfile the session was opened with.
+    pub fn bitfile_contents(&self) -> Result<String, crate::error::FPGAError> {
+        let mut contents: *const std::ffi::c_char = std::ptr::null();
+        let result = unsafe { NiFpga_GetBitfileContents(self.handle, &mut contents) };
+        to_fpga_result((), result)?;
+        if contents.is_null() {
+            return Ok(String::new());
+        }
+        // The driver owns the string for the life of the session so copy it out.
+        let contents = unsafe { std::ffi::CStr::from_ptr(contents) };
+        Ok(contents.to_string_lossy().into_owned())
+    }
+
     /// Close the session to the FPGA and resets it if set for the session.
     pub fn close(self) -> Result<(), crate::error::FPGAError> {
-        let result = unsafe { NiFpga_Close(self.handle, self.close_attribute) };
+        let result = instrument!(Close, 0, 0, unsafe {
+            NiFpga_Close(self.handle, self.close_attribute)
+        });
 
         to_fpga_result((), result)
     }
@@ -0,0 +1,208 @@
+//! A session which can be cloned and shared between threads.
+
+use super::{
+    FifoAcquire, FifoInterface, FifoReadRegion, FifoTransfer, FifoWriteRegion, NativeFpgaType,
+    Session,
+};
+use crate::error::Result;
+use crate::fifos::FifoLevels;
+use crate::nifpga_sys::{FifoAddress, SessionHandle};
+use std::ops::Deref;
+use std::sync::Arc;
+use std::time::Duration;
+
+/// A reference counted [`Session`] which closes the FPGA session when the last clone is dropped.
+///
+/// This implements the register and FIFO interfaces directly and dereferences to
+/// [`Session`] for everything else. It keeps its own copy of the session handle so
+/// register accesses don't read the cache line holding the reference count.
+///
+/// Cloning still updates the shared reference count. For many short lived tasks
+/// on a thread, clone once per thread and use [`SharedSession::pin`] for the tasks.
+///
+/// ```rust
+/// # use ni_fpga_interface::session::{NiFpgaContext, Session, SharedSession};
+/// # mod fpga_defs { pub mod registers {
+/// #     use ni_fpga_interface::registers::Register;
+/// #     pub const U8Result: Register<u8> = Register::new(0x1800A);
+/// # } }
+/// # let context = NiFpgaContext::new().unwrap();
+/// let session = SharedSession::new(
+///     Session::new(&context, "main.lvbitx", "sig", "RIO0", &Default::default()).unwrap(),
+/// );
+///
+/// let thread_session = session.clone();
+/// std::thread::spawn(move || {
+///     let value = fpga_defs::registers::U8Result.read(&thread_session).unwrap();
+///     println!("{value}");
+/// })
+/// .join()
+/// .unwrap();
+/// ```
+#[derive(Clone)]
+pub struct SharedSession {
+    pub(crate) handle: SessionHandle,
+    session: Arc<Session>,
+}
+
+impl SharedSession {
+    /// Takes ownership of the session so it can be shared.
+    pub fn new(session: Session) -> Self {
+        Self::from(Arc::new(session))
+    }
+
+    /// Returns a handle for the current scope which can be copied without touching the reference count.
+    pub fn pin(&self) -> PinnedSession<'_> {
+        PinnedSession {
+            handle: self.handle,
+            session: &self.session,
+        }
+    }
+
+    /// The underlying [`Arc`] for APIs which take an `Arc<Session>`, such as streaming.
+    pub fn as_arc(&self) -> &Arc<Session> {
+        &self.session
+    }
+}
+
+impl From<Session> for SharedSession {
+    fn from(session: Session) -> Self {
+        Self::new(session)
+    }
+}
+
+impl From<Arc<Session>> for SharedSession {
+    fn from(session: Arc<Session>) -> Self {
+        Self {
+            handle: session.handle,
+            session,
+        }
+    }
+}
+
+impl Deref for SharedSession {
+    type Target = Session;
+
+    fn deref(&self) -> &Session {
+        &self.session
+    }
+}
+
+/// A borrowed session handle from [`SharedSession::pin`].
+///
+/// This is [`Copy`] so it can be handed to any number of tasks in scope for free.
+#[derive(Clone, Copy)]
+pub struct PinnedSession<'session> {
+    pub(crate) handle: SessionHandle,
+    session: &'session Session,
+}
+
+impl Deref for PinnedSession<'_> {
+    type Target = Session;
+
+    fn deref(&self) -> &Session {
+        self.session
+    }
+}
+
+/// FIFO access goes through the session as the regions must borrow it to release their elements.
+macro_rules! delegate_fifo_interface {
+    ($target:ty) => {
+        impl<T: NativeFpgaType> FifoInterface<T> for $target
+        where
+            Session: FifoInterface<T>,
+        {
+            fn read_fifo(
+                &self,
+                fifo: FifoAddress,
+                buffer: &mut [T],
+                timeout: Option<Duration>,
+            ) -> Result<usize> {
+                (**self).read_fifo(fifo, buffer, timeout)
+            }
+
+            fn write_fifo(
+                &self,
+                fifo: FifoAddress,
+                data: &[T],
+                timeout: Option<Duration>,
+            ) -> Result<usize> {
+                (**self).write_fifo(fifo, data, timeout)
+            }
+
+            fn try_read_fifo(
+                &self,
+                fifo: FifoAddress,
+                buffer: &mut [T],
+                timeout: Option<Duration>,
+            ) -> Result<FifoTransfer> {
+                (**self).try_read_fifo(fifo, buffer, timeout)
+            }
+
+            fn try_write_fifo(
+                &self,
+                fifo: FifoAddress,
+                data: &[T],
+                timeout: Option<Duration>,
+            ) -> Result<FifoTransfer> {
+                (**self).try_write_fifo(fifo, data, timeout)
+            }
+
+            fn zero_copy_read(
+                &self,
+                fifo: FifoAddress,
+                elements: usize,
+                timeout: Option<Duration>,
+            ) -> Result<(FifoReadRegion<'_, '_, T>, usize)> {
+                (**self).zero_copy_read(fifo, elements, timeout)
+            }
+
+            fn zero_copy_write(
+                &self,
+                fifo: FifoAddress,
+                elements: usize,
+                timeout: Option<Duration>,
+            ) -> Result<(FifoWriteRegion<'_, '_, T>, usize)> {
+                (**self).zero_copy_write(fifo, elements, timeout)
+            }
+
+            fn try_zero_copy_read(
+                &self,
+                fifo: FifoAddress,
+                elements: usize,
+                timeout: Option<Duration>,
+            ) -> Result<FifoAcquire<FifoReadRegion<'_, '_, T>>> {
+                (**self).try_zero_copy_read(fifo, elements, timeout)
+            }
+
+            fn try_zero_copy_write(
+                &self,
+                fifo: FifoAddress,
+                elements: usize,
+                timeout: Option<Duration>,
+            ) -> Result<FifoAcquire<FifoWriteRegion<'_, '_, T>>> {
+                (**self).try_zero_copy_write(fifo, elements, timeout)
+            }
+
+            fn fifo_levels(&self) -> Option<&FifoLevels> {
+                <Session as FifoInterface<T>>::fifo_levels(self)
+            }
+        }
+    };
+}
+
+delegate_fifo_interface!(SharedSession);
+delegate_fifo_interface!(PinnedSession<'_>);
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    fn assert_send_sync<T: Send + Sync>() {}
+
+    #[test]
+    fn test_shared_session_is_send_and_sync() {
+        assert_send_sync::<SharedSession>();
+        assert_send_sync::<PinnedSession<'static>>();
+    }
+}
@@ -0,0 +1,354 @@
+//! Opens sessions to several FPGA targets in parallel.
+//!
+//! Opening a session programs the FPGA if it isn't already running the bitfile,
+//! which can take seconds per target. [`SessionManager::open`] opens every
+//! target from a small pool of threads sharing the one [`NiFpgaContext`] so the
+//! start up time is closer to the slowest target than the sum of them all.
+//!
+//! Each target records how long its open took in an [`OpenTiming`]. A target
+//! which fails to open doesn't stop the others. Its error is kept so it can be
+//! reported and the target reopened with [`SessionManager::reopen_failed`].
+//!
+//! # Example
+//!
+//! ```rust
+//! use ni_fpga_interface::session::NiFpgaContext;
+//! use ni_fpga_interface::session_manager::{SessionManager, SessionManagerConfig, SessionTarget};
+//!
+//! let context = NiFpgaContext::new().unwrap();
+//! let targets = (0..8)
+//!     .map(|chassis| SessionTarget::new("main.lvbitx", "sig", format!("RIO{chassis}")))
+//!     .collect();
+//! let mut manager = SessionManager::open(&context, targets, SessionManagerConfig::default());
+//!
+//! for entry in manager.entries() {
+//!     println!("{}: {:?}", entry.target.resource, entry.timing.total());
+//! }
+//! if !manager.all_open() {
+//!     manager.reopen_failed();
+//! }
+//! let session = manager.session("RIO0").unwrap();
+//! ```
+
+use crate::error::FPGAError;
+use crate::session::{NiFpgaContext, Session, SessionOptions, SharedSession};
+use std::sync::atomic::{AtomicUsize, Ordering};
+use std::sync::{Arc, Mutex};
+use std::time::{Duration, Instant};
+
+/// The bitfile to open on one resource.
+#[derive(Debug, Clone, PartialEq, Eq)]
+pub struct SessionTarget {
+    pub bitfile: String,
+    pub signature: String,
+    pub resource: String,
+}
+
+impl SessionTarget {
+    /// Takes the arguments in the same order as [`Session::new`].
+    pub fn new(
+        bitfile: impl Into<String>,
+        signature: impl Into<String>,
+        resource: impl Into<String>,
+    ) -> Self {
+        Self {
+            bitfile: bitfile.into(),
+            signature: signature.into(),
+            resource: resource.into(),
+        }
+    }
+}
+
+/// When the bitfile is programmed onto the FPGA.
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub enum DownloadPolicy {
+    /// Let the open decide. The driver only programs the FPGA when it isn't
+    /// already running a bitfile with the same signature, so a warm restart
+    /// skips the download.
+    IfNeeded,
+    /// Always program the FPGA after opening, for example to clear the state of a running VI.
+    Always,
+}
+
+/// Controls how [`SessionManager`] opens the targets.
+#[derive(Debug, Clone, Copy)]
+pub struct SessionManagerConfig {
+    /// The most sessions opened at once (default: 4).
+    pub max_parallel: usize,
+    /// When to program the FPGA (default: [`DownloadPolicy::IfNeeded`]).
+    pub download: DownloadPolicy,
+    /// The options every session is opened with (default: run on open and reset on close).
+    pub options: SessionOptions,
+}
+
+impl Default for SessionManagerConfig {
+    fn default() -> Self {
+        Self {
+            max_parallel: 4,
+            download: DownloadPolicy::IfNeeded,
+            options: SessionOptions::default(),
+        }
+    }
+}
+
+/// How long each step of opening a target took.
+#[derive(Debug, Clone, Copy, Default, PartialEq, Eq)]
+pub struct OpenTiming {
+    /// Time spent in the open call, including any download the driver decided was needed.
+    pub open: Duration,
+    /// Time spent in the explicit download with [`DownloadPolicy::Always`], otherwise zero.
+    pub download: Duration,
+    /// Time spent starting the VI after an explicit download, otherwise zero.
+    pub run: Duration,
+}
+
+impl OpenTiming {
+    pub fn total(&self) -> Duration {
+        self.open + self.download + self.run
+    }
+}
+
+/// The outcome of opening one target.
+pub struct ManagedSession {
+    pub target: SessionTarget,
+    pub timing: OpenTiming,
+    pub session: Result<SharedSession, FPGAError>,
+}
+
+impl ManagedSession {
+    pub fn is_open(&self) -> bool {
+        self.session.is_ok()
+    }
+}
+
+/// A set of sessions to different FPGA targets opened together.
+///
+/// See the [module documentation](self) for an example.
+pub struct SessionManager {
+    context: Arc<NiFpgaContext>,
+    config: SessionManagerConfig,
+    entries: Vec<ManagedSession>,
+}
+
+impl SessionManager {
+    /// Opens every target, at most [`SessionManagerConfig::max_parallel`] at a time.
+    ///
+    /// This returns once every target has opened or failed. The entries are in the same order as the targets.
+    pub fn open(
+        context: &Arc<NiFpgaContext>,
+        targets: Vec<SessionTarget>,
+        config: SessionManagerConfig,
+    ) -> Self {
+        let entries = run_bounded(&targets, config.max_parallel, |target| {
+            open_target(context, target, &config)
+        });
+        let entries = targets
+            .into_iter()
+            .zip(entries)
+            .map(|(target, (timing, session))| ManagedSession {
+                target,
+                timing,
+                session,
+            })
+            .collect();
+        Self {
+            context: context.clone(),
+            config,
+            entries,
+        }
+    }
+
+    /// The outcome for every target in the order they were given.
+    pub fn entries(&self) -> &[ManagedSession] {
+        &self.entries
+    }
+
+    /// Returns true if every target opened.
+    pub fn all_open(&self) -> bool {
+        self.entries.iter().all(ManagedSession::is_open)
+    }
+
+    /// The session for the resource if it opened.
+    pub fn session(&self, resource: &str) -> Option<&SharedSession> {
+        self.entries
+            .iter()
+            .find(|entry| entry.target.resource == resource)
+            .and_then(|entry| entry.session.as_ref().ok())
+    }
+
+    /// The targets which failed to open with their errors.
+    pub fn failures(&self) -> impl Iterator<Item = (&SessionTarget, &FPGAError)> {
+        self.entries.iter().filter_map(|entry| {
+            entry
+                .session
+                .as_ref()
+                .err()
+                .map(|error| (&entry.target, error))
+        })
+    }
+
+    /// Opens the resource again, for example after the target has rebooted.
+    ///
+    /// The previous session is dropped first. It only closes once any clones of it are dropped too.
+    pub fn reopen(&mut self, resource: &str) -> Option<&Result<SharedSession, FPGAError>> {
+        let entry = self
+            .entries
+            .iter_mut()
+            .find(|entry| entry.target.resource == resource)?;
+        // Release our reference before opening so the old session isn't held alongside the new one.
+        entry.session = Err(FPGAError::Cancelled);
+        let (timing, session) = open_target(&self.context, &entry.target, &self.config);
+        entry.timing = timing;
+        entry.session = session;
+        Some(&entry.session)
+    }
+
+    /// Opens every target which failed before, in parallel as with [`SessionManager::open`].
+    ///
+    /// Returns true if every target is now open.
+    pub fn reopen_failed(&mut self) -> bool {
+        let failed: Vec<&mut ManagedSession> = self
+            .entries
+            .iter_mut()
+            .filter(|entry| !entry.is_open())
+            .collect();
+        let targets: Vec<SessionTarget> = failed.iter().map(|entry| entry.target.clone()).collect();
+        let context = &self.context;
+        let config = &self.config;
+        let results = run_bounded(&targets, config.max_parallel, |target| {
+            open_target(context, target, config)
+        });
+        for (entry, (timing, session)) in failed.into_iter().zip(results) {
+            entry.timing = timing;
+            entry.session = session;
+        }
+        self.all_open()
+    }
+
+    /// Takes the sessions out of the manager.
+    pub fn into_entries(self) -> Vec<ManagedSession> {
+        self.entries
+    }
+}
+
+fn open_target(
+    context: &Arc<NiFpgaContext>,
+    target: &SessionTarget,
+    config: &SessionManagerConfig,
+) -> (OpenTiming, Result<SharedSession, FPGAError>) {
+    let mut timing = OpenTiming::default();
+    let result = open_timed(context, target, config, &mut timing);
+    (timing, result.map(SharedSession::new))
+}
+
+fn open_timed(
+    context: &Arc<NiFpgaContext>,
+    target: &SessionTarget,
+    config: &SessionManagerConfig,
+    timing: &mut OpenTiming,
+) -> Result<Session, FPGAError> {
+    let always_download = config.download == DownloadPolicy::Always;
+    // Don't start a VI which is about to be replaced by the download.
+    let open_options = SessionOptions {
+        run_on_open: config.options.run_on_open && !always_download,
+        ..config.options
+    };
+
+    let start = Instant::now();
+    let mut session = Session::new(
+        context,
+        &target.bitfile,
+        &target.signature,
+        &target.resource,
+        &open_options,
+    )?;
+    timing.open = start.elapsed();
+
+    if always_download {
+        let start = Instant::now();
+        session.download()?;
+        timing.download = start.elapsed();
+
+        if config.options.run_on_open {
+            let start = Instant::now();
+            session.run(false)?;
+            timing.run = start.elapsed();
+        }
+    }
+    Ok(session)
+}
+
+/// Runs the task for every item on at most `max_parallel` threads, returning the results in item order.
+fn run_bounded<I: Sync, R: Send>(
+    items: &[I],
+    max_parallel: usize,
+    task: impl Fn(&I) -> R + Sync,
+) -> Vec<R> {
+    let next = AtomicUsize::new(0);
+    let results: Mutex<Vec<Option<R>>> = Mutex::new(items.iter().map(|_| None).collect());
+    let workers = max_parallel.clamp(1, items.len().max(1));
+
+    std::thread::scope(|scope| {
+        for _ in 0..workers {
+            scope.spawn(|| loop {
+                let index = next.fetch_add(1, Ordering::Relaxed);
+                let Some(item) = items.get(index) else {
+                    break;
+                };
+                let result = task(item);
+                results.lock().expect("Results poisoned")[index] = Some(result);
+            });
+        }
+    });
+
+    results
+        .into_inner()
+        .expect("Results poisoned")
+        .into_iter()
+        .map(|result| result.expect("Every item is run"))
+        .collect()
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn test_run_bounded_keeps_order() {
+        let items: Vec<u32> = (0..20).collect();
+        let results = run_bounded(&items, 3, |item| item * 2);
+        assert_eq!(results, (0..20).map(|item| item * 2).collect::<Vec<_>>());
+    }
+
+    #[test]
+    fn test_run_bounded_limits_concurrency() {
+        let running = AtomicUsize::new(0);
+        let peak = AtomicUsize::new(0);
+        let items = [(); 12];
+        run_bounded(&items, 4, |_| {
+            let now = running.fetch_add(1, Ordering::SeqCst) + 1;
+            peak.fetch_max(now, Ordering::SeqCst);
+            std::thread::sleep(Duration::from_millis(5));
+            running.fetch_sub(1, Ordering::SeqCst);
+        });
+        let peak = peak.load(Ordering::SeqCst);
+        assert!(peak <= 4);
+        assert!(peak > 1);
+    }
+
+    #[test]
+    fn test_run_bounded_empty() {
+        let items: [u32; 0] = [];
+        assert!(run_bounded(&items, 0, |item| *item).is_empty());
+    }
+
+    #[test]
+    fn test_timing_total() {
+        let timing = OpenTiming {
+            open: Duration::from_millis(3),
+            download: Duration::from_millis(2),
+            run: Duration::from_millis(1),
+        };
+        assert_eq!(timing.total(), Duration::from_millis(6));
+    }
+}
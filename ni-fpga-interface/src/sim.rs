@@ -0,0 +1,739 @@
+//! An in-memory session for running host code without an FPGA.
+//!
+//! [`SimSession`] implements [`RegisterInterface`] and [`FifoInterface`] so
+//! code written against those traits, including the generated registers and
+//! FIFOs, can run on a workstation or in CI.
+//!
+//! * Registers hold the last value written, or the default for the type.
+//! * Target to host FIFOs replay a block of data, such as a capture from
+//!   [`read_recording`](crate::recording::read_recording), into a simulated host buffer.
+//! * Host to target FIFOs are drained from the host buffer and the data discarded.
+//!
+//! Each FIFO moves data at the configured rate. Reads and writes wait for data
+//! or space up to their timeout and then fail with the same FIFO timeout as the
+//! driver. If the host falls behind a rate limited target to host FIFO the new
+//! elements are lost, as they would be on the FPGA, and counted in the
+//! [`SimFifoStatistics`].
+//!
+//! # Example
+//!
+//! ```rust
+//! # mod fpga_defs {
+//! #     pub mod registers {
+//! #         use ni_fpga_interface::registers::Register;
+//! #         pub const U8Control: Register<u8> = Register::new(0x18006);
+//! #     }
+//! #     pub mod fifos {
+//! #         use ni_fpga_interface::fifos::ReadFifo;
+//! #         pub const NumbersFromFPGA: ReadFifo<u32> = ReadFifo::new(1);
+//! #     }
+//! # }
+//! use ni_fpga_interface::sim::{SimFifoConfig, SimSession};
+//!
+//! let session = SimSession::new()
+//!     .with_register(&fpga_defs::registers::U8Control, 5)
+//!     .with_read_fifo(
+//!         &fpga_defs::fifos::NumbersFromFPGA,
+//!         (0..1_000_000).collect(),
+//!         SimFifoConfig {
+//!             elements_per_second: 10e6,
+//!             ..Default::default()
+//!         },
+//!     );
+//!
+//! assert_eq!(fpga_defs::registers::U8Control.read(&session).unwrap(), 5);
+//!
+//! let mut fifo = fpga_defs::fifos::NumbersFromFPGA;
+//! let mut buffer = [0u32; 1000];
+//! fifo.read(&session, None, &mut buffer).unwrap();
+//! ```
+
+use crate::error::{FPGAError, NiFpgaStatus, Result};
+use crate::fifos::{Fifo, FifoLevels, ReadFifo, WriteFifo};
+use crate::nifpga_sys::FifoAddress;
+use crate::registers::{ArrayRegister, Register};
+use crate::session::{
+    FifoInterface, FifoReadRegion, FifoWriteRegion, NativeFpgaType, RegisterAddress,
+    RegisterInterface, ReleaseFifoElements,
+};
+use std::any::Any;
+use std::cell::UnsafeCell;
+use std::collections::HashMap;
+use std::sync::{Mutex, MutexGuard};
+use std::time::{Duration, Instant};
+
+/// The longest a blocked read or write sleeps before checking the FIFO again.
+const MAX_POLL_INTERVAL: Duration = Duration::from_millis(10);
+
+/// Configuration for a simulated FIFO.
+#[derive(Debug, Clone, Copy, PartialEq)]
+pub struct SimFifoConfig {
+    /// The size of the host buffer in elements (default: 16384).
+    pub depth: usize,
+    /// The rate the FPGA side moves elements in or out of the host buffer (default: unlimited).
+    ///
+    /// When unlimited the FPGA side waits for space instead of losing data.
+    pub elements_per_second: f64,
+    /// Replay the data from the start once it has all been sent (default: false).
+    pub repeat: bool,
+}
+
+impl Default for SimFifoConfig {
+    fn default() -> Self {
+        Self {
+            depth: 16384,
+            elements_per_second: f64::INFINITY,
+            repeat: false,
+        }
+    }
+}
+
+/// Counters for a simulated FIFO.
+#[derive(Debug, Clone, Copy, Default, PartialEq, Eq)]
+pub struct SimFifoStatistics {
+    /// Elements moved through the host buffer by the FPGA side.
+    pub transferred: u64,
+    /// Elements which arrived while the host buffer was full and were discarded.
+    pub lost: u64,
+}
+
+enum Direction<T> {
+    /// The FPGA writes the source into the host buffer.
+    TargetToHost { source: Vec<T>, position: usize },
+    /// The FPGA drains the host buffer.
+    HostToTarget,
+}
+
+/// The state of one FIFO, held under a lock by the session.
+///
+/// The counters are totals since the FIFO started. For a target to host FIFO
+/// `fpga` is the elements written by the FPGA and for host to target it is the
+/// elements drained. The host acquires elements and later releases them.
+struct SimFifo<T> {
+    direction: Direction<T>,
+    config: SimFifoConfig,
+    buffer: Box<[UnsafeCell<T>]>,
+    fpga: u64,
+    acquired: u64,
+    released: u64,
+    lost: u64,
+    last_update: Option<Instant>,
+    /// Fractional elements owed to the FPGA side at the configured rate.
+    credit: f64,
+}
+
+impl<T: NativeFpgaType + Default> SimFifo<T> {
+    fn new(direction: Direction<T>, config: SimFifoConfig) -> Self {
+        let depth = config.depth.max(1);
+        Self {
+            direction,
+            config: SimFifoConfig { depth, ..config },
+            buffer: (0..depth).map(|_| UnsafeCell::new(T::default())).collect(),
+            fpga: 0,
+            acquired: 0,
+            released: 0,
+            lost: 0,
+            last_update: None,
+            credit: 0.0,
+        }
+    }
+
+    fn depth(&self) -> usize {
+        self.buffer.len()
+    }
+
+    fn slot_ptr(&self) -> *mut T {
+        UnsafeCell::raw_get(self.buffer.as_ptr())
+    }
+
+    /// The elements the host can acquire now.
+    fn host_available(&self) -> usize {
+        match self.direction {
+            Direction::TargetToHost { .. } => (self.fpga - self.acquired) as usize,
+            Direction::HostToTarget => self.depth() - (self.acquired - self.fpga) as usize,
+        }
+    }
+
+    /// Moves the FPGA side forward to `now`.
+    ///
+    /// The FIFO starts on the first call, as the driver starts a FIFO on first access.
+    fn advance(&mut self, now: Instant) {
+        let last = *self.last_update.get_or_insert(now);
+        self.last_update = Some(now);
+        let unlimited = self.config.elements_per_second.is_infinite();
+        let budget = if unlimited {
+            u64::MAX
+        } else {
+            self.credit += self.config.elements_per_second * now.duration_since(last).as_secs_f64();
+            let whole = self.credit.floor();
+            self.credit -= whole;
+            whole as u64
+        };
+
+        let depth = self.depth();
+        let ring = self.slot_ptr();
+        let start = self.fpga;
+        match &mut self.direction {
+            Direction::TargetToHost { source, position } => {
+                let space = depth as u64 - (self.fpga - self.released);
+                let remaining = if self.config.repeat && !source.is_empty() {
+                    u64::MAX
+                } else {
+                    (source.len() - *position) as u64
+                };
+                let arriving = budget.min(remaining);
+                let stored = arriving.min(space) as usize;
+                // Without a rate limit the FPGA waits for space instead of dropping data.
+                let skipped = if unlimited {
+                    0
+                } else {
+                    arriving - stored as u64
+                };
+
+                let mut copied = 0;
+                while copied < stored {
+                    let slot = ((start + copied as u64) % depth as u64) as usize;
+                    let index = (*position + copied) % source.len();
+                    let run = (stored - copied)
+                        .min(depth - slot)
+                        .min(source.len() - index);
+                    // Safety: slots between fpga and released + depth are not held by the host.
+                    unsafe {
+                        std::ptr::copy_nonoverlapping(
+                            source.as_ptr().add(index),
+                            ring.add(slot),
+                            run,
+                        );
+                    }
+                    copied += run;
+                }
+
+                let consumed = stored as u64 + skipped;
+                if !self.config.repeat {
+                    *position += consumed as usize;
+                } else if !source.is_empty() {
+                    *position = ((*position as u64 + consumed) % source.len() as u64) as usize;
+                }
+                self.fpga += stored as u64;
+                self.lost += skipped;
+            }
+            Direction::HostToTarget => {
+                let pending = self.released - self.fpga;
+                self.fpga += budget.min(pending);
+            }
+        }
+    }
+
+    /// An estimate of how long until `elements` can be acquired.
+    fn time_until(&self, elements: usize) -> Duration {
+        let missing = elements.saturating_sub(self.host_available()) as f64;
+        let rate = self.config.elements_per_second;
+        if rate.is_finite() && rate > 0.0 {
+            Duration::from_secs_f64(missing / rate).min(MAX_POLL_INTERVAL)
+        } else {
+            MAX_POLL_INTERVAL
+        }
+    }
+
+    /// Acquires up to `elements` contiguous slots from the host buffer.
+    ///
+    /// Fewer are returned if the end of the buffer is reached, as with the driver.
+    fn acquire(&mut self, elements: usize) -> (*mut T, usize) {
+        let slot = (self.acquired % self.depth() as u64) as usize;
+        let count = elements.min(self.depth() - slot);
+        self.acquired += count as u64;
+        // Safety: the slot is within the buffer.
+        (unsafe { self.slot_ptr().add(slot) }, count)
+    }
+
+    fn release(&mut self, elements: usize) -> Result<()> {
+        if self.released + elements as u64 > self.acquired {
+            return Err(NiFpgaStatus::INVALID_FIFO_ELEMENTS.into());
+        }
+        self.released += elements as u64;
+        Ok(())
+    }
+}
+
+/// Type erased access to a simulated FIFO for the operations which don't depend on the element type.
+trait SimChannel: Send + Sync {
+    fn release(&self, elements: usize) -> Result<()>;
+    fn statistics(&self) -> SimFifoStatistics;
+    fn as_any(&self) -> &dyn Any;
+}
+
+impl<T: NativeFpgaType + Default + Send + 'static> SimChannel for Mutex<SimFifo<T>> {
+    fn release(&self, elements: usize) -> Result<()> {
+        self.lock().expect("Sim FIFO poisoned").release(elements)
+    }
+
+    fn statistics(&self) -> SimFifoStatistics {
+        let mut fifo = self.lock().expect("Sim FIFO poisoned");
+        fifo.advance(Instant::now());
+        SimFifoStatistics {
+            transferred: fifo.fpga,
+            lost: fifo.lost,
+        }
+    }
+
+    fn as_any(&self) -> &dyn Any {
+        self
+    }
+}
+
+/// A session backed by memory instead of an FPGA.
+///
+/// See the [module documentation](self) for an example.
+#[derive(Default)]
+pub struct SimSession {
+    registers: Mutex<HashMap<RegisterAddress, Box<dyn Any + Send>>>,
+    fifos: HashMap<FifoAddress, Box<dyn SimChannel>>,
+    fifo_levels: FifoLevels,
+}
+
+impl SimSession {
+    /// Creates a session with no FIFOs where every register reads as the default value.
+    pub fn new() -> Self {
+        Self::default()
+    }
+
+    /// Sets the initial value of a register.
+    pub fn with_register<T: NativeFpgaType + Default + Send + 'static>(
+        self,
+        register: &Register<T>,
+        value: T,
+    ) -> Self {
+        self.store_register(register.address(), vec![value]);
+        self
+    }
+
+    /// Sets the initial value of an array register.
+    pub fn with_array_register<T: NativeFpgaType + Default + Send + 'static, const N: usize>(
+        self,
+        register: &ArrayRegister<T, N>,
+        value: [T; N],
+    ) -> Self {
+        self.store_register(register.address(), value.to_vec());
+        self
+    }
+
+    /// Adds a target to host FIFO which sends `data` to the host.
+    pub fn with_read_fifo<T: NativeFpgaType + Default + Send + 'static>(
+        mut self,
+        fifo: &ReadFifo<T>,
+        data: Vec<T>,
+        config: SimFifoConfig,
+    ) -> Self {
+        let direction = Direction::TargetToHost {
+            source: data,
+            position: 0,
+        };
+        self.fifos.insert(
+            fifo.address(),
+            Box::new(Mutex::new(SimFifo::new(direction, config))),
+        );
+        self
+    }
+
+    /// Adds a host to target FIFO.
+    pub fn with_write_fifo<T: NativeFpgaType + Default + Send + 'static>(
+        mut self,
+        fifo: &WriteFifo<T>,
+        config: SimFifoConfig,
+    ) -> Self {
+        self.fifos.insert(
+            fifo.address(),
+            Box::new(Mutex::new(SimFifo::<T>::new(
+                Direction::HostToTarget,
+                config,
+            ))),
+        );
+        self
+    }
+
+    /// Returns the counters for a FIFO or [`None`] if it hasn't been added.
+    pub fn fifo_statistics(&self, fifo: &impl Fifo) -> Option<SimFifoStatistics> {
+        self.fifos
+            .get(&fifo.address())
+            .map(|channel| channel.statistics())
+    }
+
+    fn store_register<T: Send + 'static>(&self, address: RegisterAddress, value: Vec<T>) {
+        self.registers
+            .lock()
+            .expect("Sim registers poisoned")
+            .insert(address, Box::new(value));
+    }
+
+    fn load_register<T: Copy + Default + 'static>(
+        &self,
+        address: RegisterAddress,
+        data: &mut [T],
+    ) -> Result<()> {
+        let registers = self.registers.lock().expect("Sim registers poisoned");
+        match registers.get(&address) {
+            None => data.fill(T::default()),
+            Some(stored) => match stored.downcast_ref::<Vec<T>>() {
+                Some(stored) if stored.len() == data.len() => data.copy_from_slice(stored),
+                _ => return Err(NiFpgaStatus::INVALID_PARAMETER.into()),
+            },
+        }
+        Ok(())
+    }
+
+    fn fifo<T: NativeFpgaType + Default + Send + 'static>(
+        &self,
+        address: FifoAddress,
+    ) -> Result<&Mutex<SimFifo<T>>> {
+        let channel = self
+            .fifos
+            .get(&address)
+            .ok_or(FPGAError::from(NiFpgaStatus::RESOURCE_NOT_FOUND))?;
+        channel
+            .as_any()
+            .downcast_ref()
+            .ok_or(NiFpgaStatus::INVALID_PARAMETER.into())
+    }
+
+    /// Waits until the host can acquire `elements` or the timeout expires.
+    fn wait_for<'a, T: NativeFpgaType + Default + Send + 'static>(
+        &'a self,
+        address: FifoAddress,
+        elements: usize,
+        timeout: Option<Duration>,
+    ) -> Result<MutexGuard<'a, SimFifo<T>>> {
+        let fifo = self.fifo::<T>(address)?;
+        let deadline = timeout.map(|timeout| Instant::now() + timeout);
+        loop {
+            let mut guard = fifo.lock().expect("Sim FIFO poisoned");
+            if elements > guard.depth() {
+                return Err(NiFpgaStatus::INVALID_FIFO_ELEMENTS.into());
+            }
+            let now = Instant::now();
+            guard.advance(now);
+            if guard.host_available() >= elements {
+                return Ok(guard);
+            }
+
+            let mut wait = guard.time_until(elements);
+            drop(guard);
+            if let Some(deadline) = deadline {
+                if now >= deadline {
+                    return Err(NiFpgaStatus::FIFO_TIMEOUT.into());
+                }
+                wait = wait.min(deadline - now);
+            }
+            std::thread::sleep(wait);
+        }
+    }
+}
+
+impl<T: NativeFpgaType + Default + Send + 'static> RegisterInterface<T> for SimSession {
+    fn read(&self, address: RegisterAddress) -> Result<T> {
+        let mut value = [T::default()];
+        self.load_register(address, &mut value)?;
+        Ok(value[0])
+    }
+
+    fn write(&self, address: RegisterAddress, data: T) -> Result<()> {
+        self.store_register(address, vec![data]);
+        Ok(())
+    }
+
+    fn read_array_mut<const N: usize>(
+        &self,
+        address: RegisterAddress,
+        array: &mut [T; N],
+    ) -> Result<()> {
+        self.load_register(address, array)
+    }
+
+    fn write_array<const N: usize>(&self, address: RegisterAddress, data: &[T; N]) -> Result<()> {
+        self.store_register(address, data.to_vec());
+        Ok(())
+    }
+}
+
+impl ReleaseFifoElements for SimSession {
+    fn release_fifo_elements(&self, fifo: FifoAddress, elements: usize) -> Result<()> {
+        self.fifos
+            .get(&fifo)
+            .ok_or(FPGAError::from(NiFpgaStatus::RESOURCE_NOT_FOUND))?
+            .release(elements)
+    }
+}
+
+/// Copies through the host buffer in up to two parts where it wraps.
+///
+/// Don't mix these with outstanding zero copy regions on the same FIFO, as with the driver.
+impl<T: NativeFpgaType + Default + Send + 'static> FifoInterface<T> for SimSession {
+    fn read_fifo(
+        &self,
+        fifo: FifoAddress,
+        buffer: &mut [T],
+        timeout: Option<Duration>,
+    ) -> Result<usize> {
+        let mut guard = self.wait_for::<T>(fifo, buffer.len(), timeout)?;
+        let mut copied = 0;
+        while copied < buffer.len() {
+            let (slots, count) = guard.acquire(buffer.len() - copied);
+            // Safety: the acquired slots are only touched by the host until released.
+            unsafe { std::ptr::copy_nonoverlapping(slots, buffer[copied..].as_mut_ptr(), count) };
+            copied += count;
+        }
+        guard.release(copied)?;
+        Ok(guard.host_available())
+    }
+
+    fn write_fifo(
+        &self,
+        fifo: FifoAddress,
+        data: &[T],
+        timeout: Option<Duration>,
+    ) -> Result<usize> {
+        let mut guard = self.wait_for::<T>(fifo, data.len(), timeout)?;
+        let mut copied = 0;
+        while copied < data.len() {
+            let (slots, count) = guard.acquire(data.len() - copied);
+            // Safety: the acquired slots are only touched by the host until released.
+            unsafe { std::ptr::copy_nonoverlapping(data[copied..].as_ptr(), slots, count) };
+            copied += count;
+        }
+        guard.release(copied)?;
+        Ok(guard.host_available())
+    }
+
+    fn zero_copy_read(
+        &self,
+        fifo: FifoAddress,
+        elements: usize,
+        timeout: Option<Duration>,
+    ) -> Result<(FifoReadRegion<'_, '_, T>, usize)> {
+        let mut guard = self.wait_for::<T>(fifo, elements, timeout)?;
+        let (slots, count) = guard.acquire(elements);
+        // Safety: the slots stay acquired, so the FPGA side won't write them, until the region releases them.
+        let data = unsafe { std::slice::from_raw_parts(slots as *const T, count) };
+        Ok((
+            FifoReadRegion::new(self, fifo, data),
+            guard.host_available(),
+        ))
+    }
+
+    fn zero_copy_write(
+        &self,
+        fifo: FifoAddress,
+        elements: usize,
+        timeout: Option<Duration>,
+    ) -> Result<(FifoWriteRegion<'_, '_, T>, usize)> {
+        let mut guard = self.wait_for::<T>(fifo, elements, timeout)?;
+        let (slots, count) = guard.acquire(elements);
+        // Safety: the slots stay acquired, so the FPGA side won't drain them, until the region releases them.
+        let data = unsafe { std::slice::from_raw_parts_mut(slots, count) };
+        Ok((
+            FifoWriteRegion::new(self, fifo, data),
+            guard.host_available(),
+        ))
+    }
+
+    fn fifo_levels(&self) -> Option<&FifoLevels> {
+        Some(&self.fifo_levels)
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use crate::session::{FifoAcquire, FifoTransfer};
+
+    const U16_REGISTER: Register<u16> = Register::new(0x10);
+    const ARRAY_REGISTER: ArrayRegister<i32, 3> = ArrayRegister::new(0x20);
+    const READ_FIFO: ReadFifo<u32> = ReadFifo::new(1);
+    const WRITE_FIFO: WriteFifo<i16> = WriteFifo::new(2);
+
+    fn assert_send_sync<T: Send + Sync>() {}
+
+    #[test]
+    fn test_sim_session_is_send_and_sync() {
+        assert_send_sync::<SimSession>();
+    }
+
+    #[test]
+    fn test_registers_default_then_hold_writes() {
+        let session = SimSession::new().with_array_register(&ARRAY_REGISTER, [1, 2, 3]);
+        assert_eq!(U16_REGISTER.read(&session).unwrap(), 0);
+        U16_REGISTER.write(&session, 1234).unwrap();
+        assert_eq!(U16_REGISTER.read(&session).unwrap(), 1234);
+        assert_eq!(ARRAY_REGISTER.read(&session).unwrap(), [1, 2, 3]);
+    }
+
+    #[test]
+    fn test_register_type_mismatch_is_an_error() {
+        let session = SimSession::new().with_register(&U16_REGISTER, 1);
+        let wrong_type: Register<u8> = Register::new(U16_REGISTER.address());
+        assert!(wrong_type.read(&session).is_err());
+    }
+
+    #[test]
+    fn test_read_fifo_replays_data() {
+        let session = SimSession::new().with_read_fifo(
+            &READ_FIFO,
+            (0..100).collect(),
+            SimFifoConfig::default(),
+        );
+        let mut fifo = READ_FIFO;
+        let mut buffer = [0u32; 40];
+        let remaining = fifo
+            .read(&session, Some(Duration::ZERO), &mut buffer)
+            .unwrap();
+        assert_eq!(remaining, 60);
+        assert_eq!(buffer[39], 39);
+        assert_eq!(session.fifo_statistics(&fifo).unwrap().transferred, 100);
+    }
+
+    #[test]
+    fn test_read_fifo_times_out_when_data_runs_out() {
+        let session =
+            SimSession::new().with_read_fifo(&READ_FIFO, vec![1, 2], SimFifoConfig::default());
+        let mut fifo = READ_FIFO;
+        let mut buffer = [0u32; 3];
+        let error = fifo
+            .read(&session, Some(Duration::from_millis(1)), &mut buffer)
+            .unwrap_err();
+        assert!(error.is_fifo_timeout());
+    }
+
+    #[test]
+    fn test_try_read_reports_timeout_with_available() {
+        let session =
+            SimSession::new().with_read_fifo(&READ_FIFO, vec![1, 2], SimFifoConfig::default());
+        let mut fifo = READ_FIFO;
+        let mut buffer = [0u32; 3];
+        let transfer = fifo
+            .try_read(&session, Some(Duration::ZERO), &mut buffer)
+            .unwrap();
+        assert_eq!(transfer, FifoTransfer::TimedOut { remaining: 2 });
+        let transfer = fifo
+            .try_read(&session, Some(Duration::ZERO), &mut buffer[..2])
+            .unwrap();
+        assert!(!transfer.is_timed_out());
+        assert_eq!(buffer[..2], [1, 2]);
+    }
+
+    #[test]
+    fn test_try_get_read_region_reports_timeout_with_available() {
+        let session =
+            SimSession::new().with_read_fifo(&READ_FIFO, vec![1, 2], SimFifoConfig::default());
+        let mut fifo = READ_FIFO;
+        let acquire = fifo
+            .try_get_read_region(&session, 3, Some(Duration::ZERO))
+            .unwrap();
+        assert!(matches!(acquire, FifoAcquire::TimedOut { remaining: 2 }));
+        drop(acquire);
+        match fifo
+            .try_get_read_region(&session, 2, Some(Duration::ZERO))
+            .unwrap()
+        {
+            FifoAcquire::Acquired {
+                region, remaining, ..
+            } => {
+                assert_eq!(region.elements, &[1, 2]);
+                assert_eq!(remaining, 0);
+            }
+            FifoAcquire::TimedOut { .. } => panic!("The elements were available"),
+        };
+    }
+
+    #[test]
+    fn test_try_get_write_region_reports_timeout_with_space() {
+        let config = SimFifoConfig {
+            depth: 4,
+            elements_per_second: 0.0,
+            ..Default::default()
+        };
+        let session = SimSession::new().with_write_fifo(&WRITE_FIFO, config);
+        let mut fifo = WRITE_FIFO;
+        fifo.write(&session, None, &[1, 2, 3]).unwrap();
+        let acquire = fifo
+            .try_get_write_region(&session, 2, Some(Duration::ZERO))
+            .unwrap();
+        assert!(matches!(acquire, FifoAcquire::TimedOut { remaining: 1 }));
+        drop(acquire);
+        let (region, remaining) = fifo
+            .try_get_write_region(&session, 1, Some(Duration::ZERO))
+            .unwrap()
+            .into_result()
+            .unwrap();
+        region.elements[0] = 4;
+        assert_eq!(remaining, 0);
+    }
+
+    #[test]
+    fn test_unlimited_rate_waits_for_space_and_wraps() {
+        let config = SimFifoConfig {
+            depth: 8,
+            repeat: true,
+            ..Default::default()
+        };
+        let session = SimSession::new().with_read_fifo(&READ_FIFO, (0..5).collect(), config);
+        let mut fifo = READ_FIFO;
+        let mut buffer = [0u32; 6];
+        fifo.read(&session, None, &mut buffer).unwrap();
+        assert_eq!(buffer, [0, 1, 2, 3, 4, 0]);
+
+        // Only two slots are left before the end of the buffer.
+        let (region, _remaining) = fifo.get_read_region(&session, 4, None).unwrap();
+        assert_eq!(region.elements, &[1, 2]);
+        drop(region);
+        let mut buffer = [0u32; 3];
+        fifo.read(&session, None, &mut buffer).unwrap();
+        assert_eq!(buffer, [3, 4, 0]);
+        assert_eq!(session.fifo_statistics(&fifo).unwrap().lost, 0);
+    }
+
+    #[test]
+    fn test_rate_limited_fifo_loses_data_when_full() {
+        let config = SimFifoConfig {
+            depth: 4,
+            elements_per_second: 1e6,
+            ..Default::default()
+        };
+        let session = SimSession::new().with_read_fifo(&READ_FIFO, (0..1000).collect(), config);
+        let mut fifo = READ_FIFO;
+        // The first access starts the FIFO.
+        fifo.elements_available(&session).unwrap();
+        std::thread::sleep(Duration::from_millis(5));
+
+        let mut buffer = [0u32; 4];
+        fifo.read(&session, Some(Duration::ZERO), &mut buffer)
+            .unwrap();
+        assert_eq!(buffer, [0, 1, 2, 3]);
+        let statistics = session.fifo_statistics(&fifo).unwrap();
+        assert_eq!(statistics.transferred, 4);
+        assert_eq!(statistics.lost, 996);
+    }
+
+    #[test]
+    fn test_write_fifo_applies_backpressure() {
+        let config = SimFifoConfig {
+            depth: 4,
+            elements_per_second: 0.0,
+            ..Default::default()
+        };
+        let session = SimSession::new().with_write_fifo(&WRITE_FIFO, config);
+        let mut fifo = WRITE_FIFO;
+        assert_eq!(fifo.write(&session, None, &[1, 2, 3]).unwrap(), 1);
+        let error = fifo
+            .write(&session, Some(Duration::ZERO), &[4, 5])
+            .unwrap_err();
+        assert!(error.is_fifo_timeout());
+        // More than the host buffer can ever hold.
+        assert!(fifo.write(&session, None, &[0; 5]).is_err());
+    }
+
+    #[test]
+    fn test_unknown_fifo_is_an_error() {
+        let session = SimSession::new();
+        let mut fifo = READ_FIFO;
+        assert!(fifo.read(&session, None, &mut [0u32; 1]).is_err());
+    }
+}
@@ -0,0 +1,258 @@
+//! Provides a background acquisition thread for target to host DMA FIFOs.
+//!
+//! For continuous acquisition the application thread can't always service
+//! the FIFO in time and samples are lost when the DMA host buffer fills.
+//!
+//! [`FifoStream`] moves the FIFO reads to a dedicated thread which acquires
+//! large blocks using the zero copy interface and copies them into a
+//! preallocated lock-free ring buffer. The application then reads from
+//! the ring buffer without any driver calls or locks.
+//!
+//! # Example
+//!
+//! ```rust
+//! # use ni_fpga_interface::fifos::ReadFifo;
+//! # use ni_fpga_interface::session::{NiFpgaContext, Session};
+//! use ni_fpga_interface::streaming::{FifoStream, StreamConfig};
+//! use std::sync::Arc;
+//!
+//! # let context = NiFpgaContext::new().unwrap();
+//! let session = Arc::new(
+//!     Session::new(&context, "main.lvbitx", "sig", "RIO0", &Default::default()).unwrap(),
+//! );
+//! let fifo = ReadFifo::<u64>::new(1);
+//! let mut stream = FifoStream::start(session.clone(), fifo, StreamConfig::default());
+//!
+//! let mut buffer = [0u64; 1000];
+//! let read = stream.read(&mut buffer);
+//! println!("Read {read} elements. {:?}", stream.statistics());
+//!
+//! stream.stop().unwrap();
+//! ```
+
+use crate::error::FPGAError;
+use crate::fifos::{Fifo, ReadFifo};
+use crate::ring_buffer::{ring_buffer, RingConsumer, RingProducer};
+use crate::session::{FifoInterface, NativeFpgaType, Session};
+use std::sync::atomic::{AtomicBool, AtomicU64, AtomicUsize, Ordering};
+use std::sync::Arc;
+use std::thread::JoinHandle;
+use std::time::Duration;
+
+/// Configuration for the acquisition thread.
+#[derive(Debug, Clone)]
+pub struct StreamConfig {
+    /// The number of elements to acquire from the DMA FIFO in a single call (default: 16384).
+    pub block_size: usize,
+    /// The number of elements held in the ring buffer. This is rounded up to a power of two (default: 1048576).
+    pub ring_capacity: usize,
+    /// How long to wait for a full block before taking whatever is available (default: 10ms).
+    pub poll_timeout: Duration,
+}
+
+impl Default for StreamConfig {
+    fn default() -> Self {
+        Self {
+            block_size: 16_384,
+            ring_capacity: 1 << 20,
+            poll_timeout: Duration::from_millis(10),
+        }
+    }
+}
+
+/// The counters reported by the stream.
+#[derive(Debug, Default, Clone, Copy, PartialEq, Eq)]
+pub struct StreamStatistics {
+    /// Total elements acquired from the DMA FIFO.
+    pub elements_acquired: u64,
+    /// Elements dropped because the ring buffer was full.
+    pub overflow_elements: u64,
+    /// Number of blocks where some elements were dropped.
+    pub overflow_events: u64,
+    /// Number of reads which asked for more elements than were available.
+    pub underruns: u64,
+    /// The most elements seen waiting in the DMA host buffer.
+    /// If this approaches the FIFO depth then the thread is not keeping up.
+    pub peak_fifo_backlog: usize,
+}
+
+#[derive(Default)]
+struct StreamCounters {
+    elements_acquired: AtomicU64,
+    overflow_elements: AtomicU64,
+    overflow_events: AtomicU64,
+    underruns: AtomicU64,
+    peak_fifo_backlog: AtomicUsize,
+}
+
+impl StreamCounters {
+    fn record_block(&self, acquired: usize, written: usize, backlog: usize) {
+        self.elements_acquired
+            .fetch_add(acquired as u64, Ordering::Relaxed);
+        if written < acquired {
+            self.overflow_elements
+                .fetch_add((acquired - written) as u64, Ordering::Relaxed);
+            self.overflow_events.fetch_add(1, Ordering::Relaxed);
+        }
+        // Only the acquisition thread writes this so no need for a compare loop.
+        if backlog > self.peak_fifo_backlog.load(Ordering::Relaxed) {
+            self.peak_fifo_backlog.store(backlog, Ordering::Relaxed);
+        }
+    }
+
+    fn snapshot(&self) -> StreamStatistics {
+        StreamStatistics {
+            elements_acquired: self.elements_acquired.load(Ordering::Relaxed),
+            overflow_elements: self.overflow_elements.load(Ordering::Relaxed),
+            overflow_events: self.overflow_events.load(Ordering::Relaxed),
+            underruns: self.underruns.load(Ordering::Relaxed),
+            peak_fifo_backlog: self.peak_fifo_backlog.load(Ordering::Relaxed),
+        }
+    }
+}
+
+/// A target to host FIFO which is drained by a dedicated thread.
+///
+/// The thread is stopped when this is dropped or [`FifoStream::stop`] is called.
+pub struct FifoStream<T: NativeFpgaType> {
+    consumer: RingConsumer<T>,
+    counters: Arc<StreamCounters>,
+    stop: Arc<AtomicBool>,
+    thread: Option<JoinHandle<Result<(), FPGAError>>>,
+}
+
+impl<T> FifoStream<T>
+where
+    T: NativeFpgaType + Default + Send + 'static,
+    Session: FifoInterface<T>,
+{
+    /// Starts the acquisition thread for the FIFO.
+    ///
+    /// The ring buffer is allocated here so no allocation happens once data is flowing.
+    pub fn start(session: Arc<Session>, fifo: ReadFifo<T>, config: StreamConfig) -> Self {
+        let (producer, consumer) = ring_buffer(config.ring_capacity);
+        let counters = Arc::new(StreamCounters::default());
+        let stop = Arc::new(AtomicBool::new(false));
+
+        let thread_counters = counters.clone();
+        let thread_stop = stop.clone();
+        let thread = std::thread::Builder::new()
+            .name(format!("fifo-stream-{}", fifo.address()))
+            .spawn(move || {
+                acquisition_loop(
+                    session,
+                    fifo,
+                    producer,
+                    thread_counters,
+                    thread_stop,
+                    config,
+                )
+            })
+            .expect("Failed to spawn FIFO acquisition thread");
+
+        Self {
+            consumer,
+            counters,
+            stop,
+            thread: Some(thread),
+        }
+    }
+}
+
+impl<T: NativeFpgaType> FifoStream<T> {
+    /// Reads up to the length of data from the ring buffer without blocking.
+    ///
+    /// Returns the number of elements read. If fewer elements were available
+    /// than requested this is counted as an underrun.
+    pub fn read(&mut self, data: &mut [T]) -> usize {
+        let read = self.consumer.pop_slice(data);
+        if read < data.len() {
+            self.counters.underruns.fetch_add(1, Ordering::Relaxed);
+        }
+        read
+    }
+
+    /// The number of elements waiting in the ring buffer.
+    pub fn available(&self) -> usize {
+        self.consumer.len()
+    }
+
+    /// The number of elements the ring buffer can hold.
+    pub fn capacity(&self) -> usize {
+        self.consumer.capacity()
+    }
+
+    /// A snapshot of the stream counters.
+    pub fn statistics(&self) -> StreamStatistics {
+        self.counters.snapshot()
+    }
+
+    /// Returns false if the acquisition thread has exited, for example due to an error.
+    ///
+    /// Call [`FifoStream::stop`] to retrieve the error.
+    pub fn is_running(&self) -> bool {
+        self.thread
+            .as_ref()
+            .map(|thread| !thread.is_finished())
+            .unwrap_or(false)
+    }
+
+    /// Stops the acquisition thread and returns any error it encountered.
+    pub fn stop(mut self) -> Result<(), FPGAError> {
+        self.stop_thread()
+    }
+
+    fn stop_thread(&mut self) -> Result<(), FPGAError> {
+        self.stop.store(true, Ordering::Relaxed);
+        match self.thread.take() {
+            Some(thread) => thread.join().expect("FIFO acquisition thread panicked"),
+            None => Ok(()),
+        }
+    }
+}
+
+impl<T: NativeFpgaType> Drop for FifoStream<T> {
+    fn drop(&mut self) {
+        // Cant return result from drop so ignore it.
+        let _ = self.stop_thread();
+    }
+}
+
+fn acquisition_loop<T>(
+    session: Arc<Session>,
+    fifo: ReadFifo<T>,
+    mut producer: RingProducer<T>,
+    counters: Arc<StreamCounters>,
+    stop: Arc<AtomicBool>,
+    config: StreamConfig,
+) -> Result<(), FPGAError>
+where
+    T: NativeFpgaType + 'static,
+    Session: FifoInterface<T>,
+{
+    let session = session.as_ref();
+    let address = fifo.address();
+
+    while !stop.load(Ordering::Relaxed) {
+        match session.zero_copy_read(address, config.block_size, Some(config.poll_timeout)) {
+            Ok((region, remaining)) => {
+                let written = producer.push_slice(region.elements);
+                counters.record_block(region.elements.len(), written, remaining);
+            }
+            Err(error) if error.is_fifo_timeout() => {
+                // A full block didn't arrive in time. Take what is there so
+                // the latency to the consumer stays bounded by the poll timeout.
+                let available = fifo.elements_available(session)?;
+                if available > 0 {
+                    let (region, remaining) =
+                        session.zero_copy_read(address, available, Some(Duration::ZERO))?;
+                    let written = producer.push_slice(region.elements);
+                    counters.record_block(region.elements.len(), written, remaining);
+                }
+            }
+            Err(error) => return Err(error),
+        }
+    }
+
+    Ok(())
+}
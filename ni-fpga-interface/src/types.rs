@@ -54,6 +54,76 @@ impl From<Option<Duration>> for FpgaTimeoutMs {
     }
 }
 
+/// The FIFO properties which can be read or written through the FIFO property API.
+///
+/// Not all properties can be set. See the individual properties for details.
+#[repr(C)]
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub enum FifoProperty {
+    /// (U32, read only) The number of bytes in a single element of the FIFO.
+    BytesPerElement = 1,
+    /// (U32) The smallest allocation unit the host buffer size is coerced to. Must be a power of 2.
+    HostBufferAllocationGranularity = 2,
+    /// (U64) The number of elements in the host memory part of the DMA FIFO.
+    HostBufferSize = 3,
+    /// (U64) The number of elements mirrored at the end of the host buffer so acquired regions don't wrap.
+    HostBufferMirrorSize = 4,
+    /// (I32) Who allocates the host buffer. See [`HostBufferType`].
+    HostBufferType = 5,
+    /// (Ptr) The start of the host buffer when it is allocated by the user.
+    HostBuffer = 6,
+    /// (I32) The flow control behaviour of the FIFO. See [`FifoFlowControl`].
+    FlowControl = 7,
+    /// (U64, read only) The number of elements currently acquired and not released.
+    ElementsCurrentlyAcquired = 8,
+}
+
+/// Specifies who allocates the host memory part of the DMA FIFO.
+#[repr(i32)]
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub enum HostBufferType {
+    /// The buffer is allocated by the NI-RIO driver (default).
+    AllocatedByRio = 1,
+    /// The buffer is provided by the user through the host buffer property.
+    AllocatedByUser = 2,
+}
+
+impl TryFrom<i32> for HostBufferType {
+    type Error = i32;
+
+    fn try_from(value: i32) -> Result<Self, Self::Error> {
+        match value {
+            1 => Ok(HostBufferType::AllocatedByRio),
+            2 => Ok(HostBufferType::AllocatedByUser),
+            _ => Err(value),
+        }
+    }
+}
+
+/// The flow control behaviour of a DMA FIFO.
+#[repr(i32)]
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub enum FifoFlowControl {
+    /// The FPGA transfers data without waiting on the host.
+    /// The FIFO no longer behaves first in first out and data can be overwritten,
+    /// which suits "latest value" streams.
+    Disabled = 1,
+    /// Standard first in first out behaviour where no data is lost (default).
+    Enabled = 2,
+}
+
+impl TryFrom<i32> for FifoFlowControl {
+    type Error = i32;
+
+    fn try_from(value: i32) -> Result<Self, Self::Error> {
+        match value {
+            1 => Ok(FifoFlowControl::Disabled),
+            2 => Ok(FifoFlowControl::Enabled),
+            _ => Err(value),
+        }
+    }
+}
+
 /// Represents a selection of 0 or more IRQs.
 ///
 /// Internally the FPGA API expects a bitwise field to select IRQs.
@@ -144,6 +214,13 @@ impl From<u32> for IrqSelection {
     }
 }
 
+impl From<IrqSelection> for u32 {
+    /// The raw value of the selection with a bit set for each IRQ.
+    fn from(value: IrqSelection) -> Self {
+        value.0
+    }
+}
+
 #[cfg(test)]
 mod tests {
     use super::*;
@@ -178,6 +255,26 @@ mod tests {
         assert_eq!(fpga_bool_false, FpgaBool::FALSE);
     }
 
+    #[test]
+    fn test_flow_control_from_raw() {
+        assert_eq!(FifoFlowControl::try_from(1), Ok(FifoFlowControl::Disabled));
+        assert_eq!(FifoFlowControl::try_from(2), Ok(FifoFlowControl::Enabled));
+        assert_eq!(FifoFlowControl::try_from(3), Err(3));
+    }
+
+    #[test]
+    fn test_host_buffer_type_from_raw() {
+        assert_eq!(
+            HostBufferType::try_from(1),
+            Ok(HostBufferType::AllocatedByRio)
+        );
+        assert_eq!(
+            HostBufferType::try_from(2),
+            Ok(HostBufferType::AllocatedByUser)
+        );
+        assert_eq!(HostBufferType::try_from(0), Err(0));
+    }
+
     #[test]
     fn test_irq_selection_new() {
         let irq = IrqSelection::new(20);